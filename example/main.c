@@ -2,6 +2,7 @@
 #include "../src/api/core/global.h"
 #include "../src/api/core/vm.h"
 #include "../src/api/core/code.h"
+#include "../src/api/core/text.h"
 #include "filereader.h"
 #include "parser.h"
 
@@ -9,11 +10,9 @@
 void print_function(size_t _arg_count) {
     for (size_t i = 0; i < _arg_count; i++) {
         object_t* top = vm_pop();
-        char* str = object_to_string(top);
-        printf("%s", str);
-        free(str);
+        object_print(top, stdout);
         if (i < _arg_count - 1) {
-            printf(" ");
+            putchar(' ');
         }
     }
     vm_load_null();
@@ -23,14 +22,12 @@ void print_function(size_t _arg_count) {
 void println_function(size_t _arg_count) {
     for (size_t i = 0; i < _arg_count; i++) {
         object_t* top = vm_pop();
-        char* str = object_to_string(top);
-        printf("%s", str);
-        free(str);
+        object_print(top, stdout);
         if (i < _arg_count - 1) {
-            printf(" ");
+            putchar(' ');
         }
     }
-    printf("\n");
+    putchar('\n');
     vm_load_null();
 }
 
@@ -61,6 +58,81 @@ void scan_function(size_t _arg_count) {
     free(input);
 }
 
+// Number of external strings released by the vm.
+static size_t released_count = 0;
+
+// Checks the type of an argument.
+static bool is_type(object_t* _obj, const char* _type) {
+    char* type = object_type_to_string(_obj);
+    bool result = strcmp(type, _type) == 0;
+    free(type);
+    return result;
+}
+
+// Reads an int argument.
+static long to_long(object_t* _obj) {
+    char* str = object_to_string(_obj);
+    long value = atol(str);
+    free(str);
+    return value;
+}
+
+// The built-in slice function, a view into a string without a copy.
+void slice_function(size_t _arg_count) {
+    if (_arg_count != 3) {
+        for (size_t i = 0; i < _arg_count; i++) vm_pop();
+        vm_push(object_new_error("slice expects a string, an offset and a length", true));
+        return;
+    }
+    object_t* str = vm_pop();
+    object_t* offset = vm_pop();
+    object_t* length = vm_pop();
+    if (!is_type(str, "String") || !is_type(offset, "Int") || !is_type(length, "Int")) {
+        vm_push(object_new_error("slice expects a string, an offset and a length", true));
+        return;
+    }
+    long start = to_long(offset);
+    long count = to_long(length);
+    object_t* slice = (start < 0 || count < 0) ? NULL : object_new_string_slice(str, start, count);
+    if (slice == NULL) {
+        vm_push(object_new_error("slice out of range", true));
+        return;
+    }
+    vm_push(slice);
+}
+
+// Frees the buffer of an external string.
+void release_external(const char* _chars, size_t _length, void* _context) {
+    free((char*) _chars);
+    released_count++;
+}
+
+// The built-in external function, a string over a buffer the host owns.
+void external_function(size_t _arg_count) {
+    if (_arg_count != 1) {
+        for (size_t i = 0; i < _arg_count; i++) vm_pop();
+        vm_push(object_new_error("external expects a string", true));
+        return;
+    }
+    object_t* str = vm_pop();
+    if (!is_type(str, "String")) {
+        vm_push(object_new_error("external expects a string", true));
+        return;
+    }
+    size_t length;
+    const char* bytes = object_string_bytes(str, &length);
+    // No null terminator, the vm must not rely on one
+    char* buffer = malloc(length > 0 ? length : 1);
+    memcpy(buffer, bytes, length);
+    vm_push(object_new_string_external(buffer, length, release_external, NULL));
+}
+
+// The built-in released function, the number of external strings freed so far.
+void released_function(size_t _arg_count) {
+    for (size_t i = 0; i < _arg_count; i++) vm_pop();
+    vm_push(object_new_int((int) released_count));
+}
+
 void custom_name_resolver(env_t* _env, char* _name) {
     // if (strcmp(_name, "print") == 0) {
     //    vm_push(object_new_native_function(1, (vm_native_function) print_function));
@@ -89,6 +161,9 @@ int main(int argc, char** argv) {
     vm_define_global("print", object_new_native_function(1, (vm_native_function) print_function));
     vm_define_global("println", object_new_native_function(1, (vm_native_function) println_function));
     vm_define_global("scan", object_new_native_function(0, (vm_native_function) scan_function));
+    vm_define_global("slice", object_new_native_function(3, (vm_native_function) slice_function));
+    vm_define_global("external", object_new_native_function(1, (vm_native_function) external_function));
+    vm_define_global("released", object_new_native_function(0, (vm_native_function) released_function));
     vm_run_main(bytecode);
     parser_free(parser);
     return 0;
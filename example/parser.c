@@ -1,5 +1,8 @@
 #include "parser.h"
 
+// Exported by the VM, the public AST header only declares the int node
+DLLEXPORT ast_node_t* ast_long_node(position_t* _position, long _value);
+
 parser_t* parser_new(char* _path, char* _data) {
     parser_t* parser = (parser_t*) malloc(sizeof(parser_t));
     if (parser == NULL) {
@@ -54,10 +57,26 @@ ast_node_t* parser_terminal(parser_t* _parser) {
         ACCEPTT(TTIDN);
         return node;
     } else if (CHECKT(TTINT)) {
-        ast_node_t* node = ast_int_node(
-            _parser->current->position,
-            atoi(_parser->current->value)
-        );
+        errno = 0;
+        long long value = strtoll(_parser->current->value, NULL, 10);
+        ast_node_t* node;
+        if (errno == ERANGE) {
+            // Wider than 64 bits
+            node = ast_double_node(
+                _parser->current->position,
+                strtod(_parser->current->value, NULL)
+            );
+        } else if (value > INT32_MAX) {
+            node = ast_long_node(
+                _parser->current->position,
+                (long) value
+            );
+        } else {
+            node = ast_int_node(
+                _parser->current->position,
+                (int) value
+            );
+        }
         ACCEPTT(TTINT);
         return node;
     } else if (CHECKT(TTNUM)) {
@@ -14,6 +14,13 @@ if "%1"=="--tests" (
         echo Running test: %%f
         example.exe "%%f"
     )
+    REM The register tier is off by default, run the tests again on a build with it
+    echo Running tests on the register tier...
+    gcc -o example_register.exe *.c ../src/*.c -lm -ldl -g -DVM_USE_REGISTER_TIER=1
+    for %%f in (../tests/*.lang) do (
+        echo Running test: %%f
+        example_register.exe "%%f"
+    )
 ) else (
     REM Compile the C files
     gcc -o example.exe *.c ../src/*.c -lm -ldl -g
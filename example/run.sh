@@ -19,6 +19,15 @@ if [ "$1" = "--tests" ]; then
             ./example.exe "$f"
         fi
     done
+    # The register tier is off by default, run the tests again on a build with it
+    echo "Running tests on the register tier..."
+    gcc -o example_register.exe *.c ../src/*.c -lm -ldl -g -DVM_USE_REGISTER_TIER=1
+    for f in ./tests/*.lang; do
+        if [ -f "$f" ]; then
+            echo "Running test: $f"
+            ./example_register.exe "$f"
+        fi
+    done
 else
     # Compile the C files
     gcc -o example.exe *.c ../src/*.c -lm -ldl -g
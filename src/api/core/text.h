@@ -0,0 +1,65 @@
+/**
+ * @file text.h
+ * @brief The text API (strings without copies, printing).
+ * @author Philipp Andrew Redondo
+ * @date 2026-10-17
+ * @version 0.1.0
+ * @copyright MIT License
+ * @note This file is part of the aorusvm project.
+ */
+
+#include "global.h"
+#include "object.h"
+
+#ifndef API_CORE_TEXT_H
+#define API_CORE_TEXT_H
+
+/*
+ * Release function of an external string.
+ * @param _chars The bytes given to object_new_string_external.
+ * @param _length The number of bytes.
+ * @param _context The context given to object_new_string_external.
+ */
+typedef void (*string_release_function)(const char* _chars, size_t _length, void* _context);
+
+/*
+ * Create a string object over bytes the embedder owns (a buffer or an
+ * mmap'd region), without copying them. The bytes must stay valid and
+ * unchanged until the release function is called, they need no null
+ * terminator.
+ * @param _chars The bytes.
+ * @param _length The number of bytes.
+ * @param _release Called when the string is freed, may be NULL.
+ * @param _context Passed to the release function.
+ * @return A new string object
+ */
+DLLEXPORT object_t* object_new_string_external(const char* _chars, size_t _length, string_release_function _release, void* _context);
+
+/*
+ * Create a string object over part of another string, without copying.
+ * The slice keeps the string it points into alive.
+ * @param _str The string object.
+ * @param _offset The offset of the first byte.
+ * @param _length The number of bytes.
+ * @return A new string object, or NULL if the range is out of bounds
+ */
+DLLEXPORT object_t* object_new_string_slice(object_t* _str, size_t _offset, size_t _length);
+
+/*
+ * Get the bytes of a string object without copying them. The bytes are
+ * not always null terminated, use object_to_string for a C string.
+ * @param _str The string object.
+ * @param _length Set to the number of bytes.
+ * @return The bytes, owned by the object
+ */
+DLLEXPORT const char* object_string_bytes(object_t* _str, size_t* _length);
+
+/*
+ * Write an object as object_to_string shows it, numbers and strings are
+ * written without building a C string first.
+ * @param _obj The object.
+ * @param _stream The stream.
+ */
+DLLEXPORT void object_print(object_t* _obj, FILE* _stream);
+
+#endif
\ No newline at end of file
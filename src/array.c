@@ -97,6 +97,29 @@ object_t* array_pop(array_t* _array) {
     return _array->elements[--_array->length];
 }
 
+void array_reserve(array_t* _array, size_t _capacity) {
+    if (!_array) return;
+
+    // One slot past the last element stays free (see array_push)
+    size_t required = _capacity + 1;
+    if (required <= _array->capacity) return;
+
+    size_t new_capacity = (_array->capacity == 0) ? required : _array->capacity;
+    while (new_capacity < required) new_capacity *= 2;
+
+    object_t** new_elements = (object_t**) realloc(_array->elements, sizeof(object_t*) * new_capacity);
+    if (!new_elements) {
+        PD("failed to allocate memory for array reserve");
+        return;
+    }
+    for (size_t i = _array->capacity; i < new_capacity; ++i) {
+        new_elements[i] = NULL;
+    }
+
+    _array->elements = new_elements;
+    _array->capacity = new_capacity;
+}
+
 void array_extend(array_t* _array, array_t* _other_array) {
     if (!_array || !_other_array) return;
 
@@ -107,23 +130,12 @@ void array_extend(array_t* _array, array_t* _other_array) {
     size_t current_len = _array->length;
     size_t required = current_len + other_len;
 
-    // Resize if needed
-    if (required > _array->capacity) {
-        // Calculate optimal capacity in one step
-        size_t new_capacity = (_array->capacity == 0) ? required : _array->capacity;
-        while (new_capacity < required) new_capacity *= 2;
-
-        object_t** new_elements = realloc(_array->elements, new_capacity * sizeof(object_t*));
-        if (!new_elements) {
-            PD("failed to allocate memory for array extend");
-            return;
-        }
-        _array->elements = new_elements;
-        _array->capacity = new_capacity;
-    }
+    // Grow once for the whole source
+    array_reserve(_array, required);
+    if (required >= _array->capacity) return;
 
     // Use memcpy for faster copying of pointers
     memcpy(_array->elements + current_len, _other_array->elements, other_len * sizeof(object_t*));
 
     _array->length = required;
-}
+}
\ No newline at end of file
@@ -77,6 +77,15 @@ void array_push(array_t* _array, object_t* _element);
 object_t* array_pop(array_t* _array);
 
 
+/*
+ * Make room for a number of elements, so the array holds that many
+ * without growing.
+ *
+ * @param _array The array.
+ * @param _capacity The number of elements.
+ */
+void array_reserve(array_t* _array, size_t _capacity);
+
 /*
  * Extend an array with another array.
  *
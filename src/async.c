@@ -1,13 +1,22 @@
 #include "async.h"
+#include "vm.h"
 
-async_t* async_new(size_t ip, size_t top, env_t* env, code_t* code, object_t* promise) {
+async_t* async_new(object_t* _awaited, object_t* _promise, struct vm_frame_struct* _frames, size_t _frame_count, object_t** _stack, size_t _stack_count) {
     async_t* async = malloc(sizeof(async_t));
     if (!async) PD("failed to allocate memory for async_t");
-    async->ip = ip;
-    async->top = top;
-    async->env = env;
-    async->code = code;
-    async->promise = promise;
+    async->awaited = _awaited;
+    async->promise = _promise;
+    async->frames = malloc(sizeof(vm_frame_t) * _frame_count);
+    if (!async->frames) PD("failed to allocate memory for async frames");
+    memcpy(async->frames, _frames, sizeof(vm_frame_t) * _frame_count);
+    async->frame_count = _frame_count;
+    async->stack = NULL;
+    if (_stack_count > 0) {
+        async->stack = malloc(sizeof(object_t*) * _stack_count);
+        if (!async->stack) PD("failed to allocate memory for async stack");
+        memcpy(async->stack, _stack, sizeof(object_t*) * _stack_count);
+    }
+    async->stack_count = _stack_count;
     return async;
 }
 
@@ -33,6 +42,7 @@ void async_reject(object_t* _promise, object_t* _value) {
 }
 
 void async_free(async_t* _async) {
-    env_free(_async->env);
+    free(_async->frames);
+    free(_async->stack);
     free(_async);
 }
\ No newline at end of file
@@ -7,12 +7,19 @@
 #ifndef ASYNC_H
 #define ASYNC_H
 
+struct vm_frame_struct;
+
 typedef struct async_struct {
-    size_t    ip;
-    size_t    top;
-    env_t*    env;
-    code_t*   code;
+    // The promise the function waits for
+    object_t* awaited;
+    // The promise of the function, resolved with its return value
     object_t* promise;
+    // The function frame and the blocks up to the await
+    struct vm_frame_struct* frames;
+    size_t    frame_count;
+    // The stack of the function (operands, loop iterators)
+    object_t** stack;
+    size_t    stack_count;
 } async_t;
 
 typedef struct async_promise_struct {
@@ -20,8 +27,8 @@ typedef struct async_promise_struct {
     object_t*     value;
 } async_promise_t;
 
-// Create a new async
-async_t* async_new(size_t ip, size_t top, env_t* env, code_t* code, object_t* promise);
+// Create a new async, the frames and the stack are copied
+async_t* async_new(object_t* _awaited, object_t* _promise, struct vm_frame_struct* _frames, size_t _frame_count, object_t** _stack, size_t _stack_count);
 
 // Create a new async promise
 async_promise_t* async_promise_new(async_state_t _state, object_t* _value);
@@ -1,4 +1,9 @@
 #include "code.h"
+#include "intern.h"
+#include "internal.h"
+#include "object.h"
+#include "register.h"
+#include "type.h"
 
 code_t* code_new_module(char* _file_name, char* _block_name) {
     code_t* code = malloc(sizeof(code_t));
@@ -9,8 +14,26 @@ code_t* code_new_module(char* _file_name, char* _block_name) {
     code->block_name  = _block_name;
     code->is_async    = false;
     code->param_count = 0;
+    code->local_count = 0;
     code->size        = 0;
     code->bytecode    = (uint8_t*) malloc(sizeof(uint8_t));
+    code->constants   = NULL;
+    code->constant_count = 0;
+    code->constant_capacity = 0;
+    code->constant_slots = NULL;
+    code->instructions = NULL;
+    code->instruction_count = 0;
+    code->caches = NULL;
+    code->cache_count = 0;
+    code->literals = NULL;
+    code->literal_count = 0;
+    code->literal_capacity = 0;
+    code->captures = NULL;
+    code->capture_count = 0;
+    code->atoms = NULL;
+    code->register_code = NULL;
+    code->max_stack = 0;
+    code->verified = false;
     code->environment = env_new(NULL);
     return code;
 }
@@ -25,8 +48,26 @@ code_t* code_new_function(char* _file_name, char* _block_name, bool _is_scoped,
     code->block_name  = _block_name;
     code->is_async    = _is_async;
     code->param_count = _param_count;
+    code->local_count = 0;
     code->size        = _size;
     code->bytecode    = _bytecode;
+    code->constants   = NULL;
+    code->constant_count = 0;
+    code->constant_capacity = 0;
+    code->constant_slots = NULL;
+    code->instructions = NULL;
+    code->instruction_count = 0;
+    code->caches = NULL;
+    code->cache_count = 0;
+    code->literals = NULL;
+    code->literal_count = 0;
+    code->literal_capacity = 0;
+    code->captures = NULL;
+    code->capture_count = 0;
+    code->atoms = NULL;
+    code->register_code = NULL;
+    code->max_stack = 0;
+    code->verified = false;
     code->environment = env_new(NULL);
     return code;
 }
@@ -40,13 +81,119 @@ code_t* code_new_block(char* _file_name, char* _block_name, uint8_t* _bytecode,
     code->block_name  = _block_name;
     code->is_async    = false;
     code->param_count = 0;
+    code->local_count = 0;
     code->size        = _size;
     code->bytecode    = _bytecode;
+    code->constants   = NULL;
+    code->constant_count = 0;
+    code->constant_capacity = 0;
+    code->constant_slots = NULL;
+    code->instructions = NULL;
+    code->instruction_count = 0;
+    code->caches = NULL;
+    code->cache_count = 0;
+    code->literals = NULL;
+    code->literal_count = 0;
+    code->literal_capacity = 0;
+    code->captures = NULL;
+    code->capture_count = 0;
+    code->atoms = NULL;
+    code->register_code = NULL;
+    code->max_stack = 0;
+    code->verified = false;
     code->environment = env_new(NULL);
     return code;
 }
 
+/**
+ * Find the index slot of a constant, or the empty slot it would take.
+ *
+ * @param _code The code.
+ * @param _value The constant value.
+ * @return The slot in the constant index.
+ */
+INTERNAL size_t code_constant_slot(code_t* _code, char* _value) {
+    size_t mask = (_code->constant_capacity * 2) - 1;
+    size_t slot = hash64(_value) & mask;
+    while (_code->constant_slots[slot] != 0) {
+        if (strcmp(_code->constants[_code->constant_slots[slot] - 1], _value) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * Double the constant table and rebuild its index.
+ *
+ * @param _code The code.
+ */
+INTERNAL void code_grow_constants(code_t* _code) {
+    _code->constant_capacity = (_code->constant_capacity == 0) ? 8 : _code->constant_capacity * 2;
+    _code->constants = (char**) realloc(_code->constants, sizeof(char*) * _code->constant_capacity);
+    ASSERTNULL(_code->constants, "Failed to allocate memory for constants");
+    free(_code->constant_slots);
+    _code->constant_slots = (size_t*) calloc(_code->constant_capacity * 2, sizeof(size_t));
+    ASSERTNULL(_code->constant_slots, "Failed to allocate memory for constant index");
+    for (size_t i = 0; i < _code->constant_count; i++) {
+        _code->constant_slots[code_constant_slot(_code, _code->constants[i])] = i + 1;
+    }
+}
+
+int code_add_constant(code_t* _code, char* _value) {
+    if (_code->constant_count == _code->constant_capacity) {
+        code_grow_constants(_code);
+    }
+    size_t slot = code_constant_slot(_code, _value);
+    if (_code->constant_slots[slot] != 0) {
+        return (int) (_code->constant_slots[slot] - 1);
+    }
+    _code->constants[_code->constant_count] = string_allocate(_value);
+    _code->constant_slots[slot] = ++_code->constant_count;
+    return (int) (_code->constant_count - 1);
+}
+
+object_t* code_atom(code_t* _code, int _index) {
+    if (_code->atoms == NULL) {
+        _code->atoms = (object_t**) calloc(_code->constant_count + 1, sizeof(object_t*));
+        ASSERTNULL(_code->atoms, "Failed to allocate memory for atoms");
+    }
+    if (_code->atoms[_index] == NULL) {
+        _code->atoms[_index] = intern_string(_code->constants[_index]);
+    }
+    return _code->atoms[_index];
+}
+
+object_t* code_add_literal(code_t* _code, object_t* _literal) {
+    if (OBJECT_IS_TAGGED(_literal)) {
+        return _literal;
+    }
+    if (_code->literal_count == _code->literal_capacity) {
+        _code->literal_capacity = (_code->literal_capacity == 0) ? 8 : _code->literal_capacity * 2;
+        object_t** literals = (object_t**) realloc(_code->literals, sizeof(object_t*) * _code->literal_capacity);
+        ASSERTNULL(literals, "failed to allocate memory for literals");
+        _code->literals = literals;
+    }
+    _code->literals[_code->literal_count++] = object_make_immortal(_literal);
+    return _literal;
+}
+
 void code_free(code_t* _code) {
+    for (size_t i = 0; i < _code->constant_count; i++) {
+        free(_code->constants[i]);
+    }
+    free(_code->constants);
+    free(_code->constant_slots);
+    for (size_t i = 0; i < _code->literal_count; i++) {
+        free(_code->literals[i]);
+    }
+    free(_code->literals);
+    free(_code->atoms);
+    free(_code->instructions);
+    free(_code->caches);
+    free(_code->captures);
+    register_code_free(_code->register_code);
     free(_code->file_name);
     free(_code->block_name);
     free(_code->bytecode);
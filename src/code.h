@@ -1,9 +1,60 @@
 #include "api/core/env.h"
 #include "api/core/global.h"
+#include "api/core/internal.h"
+#include "shape.h"
 
 #ifndef CODE_H
 #define CODE_H
 
+// Frame slot that holds the receiver of a method call
+#define CODE_THIS_SLOT 0
+
+// Decoded form of a single instruction, built from the raw bytecode
+typedef struct instruction_struct {
+    void*    handler; // Dispatch label (threaded dispatch only)
+    union {
+        int    i32;
+        int64_t i64;
+        double f64;
+        void*  ptr;
+    } operand;
+    int      arg;     // Second operand (aka the argument count of a method call)
+    uint8_t  opcode;
+    uint8_t  op;      // Opcode folded into a superinstruction
+    uint16_t cache;   // Inline cache of a property or method site (CODE_NO_CACHE if none)
+} instruction_t;
+
+// Sites past the last cache index run uncached
+#define CODE_NO_CACHE UINT16_MAX
+
+// Receivers a property or method site remembers before it starts evicting
+#define INLINE_CACHE_WAYS 4
+
+// A receiver layout seen at a site and where the property was found for it
+typedef struct inline_cache_entry_struct {
+    shape_t*   shape;   // Shape of the receiver's own properties (NULL for classes)
+    object_t*  owner;   // Class of the receiver (NULL for plain objects)
+    size_t     version; // Class version the prototype lookup was done under
+    long       slot;    // Own slot of the property, -1 if it came from a prototype
+    object_t** cell;    // Cell of the property in the prototype that defines it
+    shape_t*   next;    // Shape after a store that adds the property
+} inline_cache_entry_t;
+
+typedef struct inline_cache_struct {
+    inline_cache_entry_t entries[INLINE_CACHE_WAYS];
+    size_t victim; // Next entry to replace on a miss
+} inline_cache_t;
+
+// A name a closure captures and the local slot it is read from (-1 if it
+// is looked up by name)
+typedef struct code_capture_struct {
+    object_t* name;
+    int       slot;
+} code_capture_t;
+
+// Register tier form of a function (see register.h)
+typedef struct register_code_struct register_code_t;
+
 typedef struct code_struct {
     size_t   top;
     size_t   bot;
@@ -11,9 +62,34 @@ typedef struct code_struct {
     char*    file_name;
     char*    block_name;
     size_t   param_count;
+    size_t   local_count;
+    size_t   max_stack;   // Deepest operand stack use of one run (computed by the verifier)
+    bool     verified;    // Passed the verifier (see verifier.h)
     bool     is_async;
     size_t   size;
     uint8_t* bytecode;
+    char**   constants;
+    size_t   constant_count;
+    size_t   constant_capacity;
+    // Open addressing index of the constants (2 x capacity slots, index + 1, 0 is empty)
+    size_t*  constant_slots;
+    // Decoded instructions (built on first execution)
+    instruction_t* instructions;
+    size_t   instruction_count;
+    // Inline caches of the property and method sites (built with the instructions)
+    inline_cache_t* caches;
+    size_t   cache_count;
+    // Immortal objects of the literal instructions (built with the instructions)
+    object_t** literals;
+    size_t   literal_count;
+    size_t   literal_capacity;
+    // Capture lists of the closures made by the code (built with the instructions)
+    code_capture_t* captures;
+    size_t   capture_count;
+    // Atoms of the constants by index, names and string literals (see code_atom)
+    object_t** atoms;
+    // Register tier code (NULL if the function only runs on the stack tier)
+    register_code_t* register_code;
     env_t*   environment;
 } code_t;
 
@@ -66,6 +142,36 @@ code_t* code_new_block(
         uint8_t* _bytecode, 
         size_t   _size);
 
+/*
+ * Add a string constant to the code's constant table.
+ * Duplicate values share a single entry.
+ *
+ * @param _code The code.
+ * @param _value The constant value (copied).
+ * @return The index of the constant.
+ */
+int code_add_constant(code_t* _code, char* _value);
+
+/*
+ * Get the atom of a constant (see intern.h), interned on first use. The
+ * atom is pinned, the code only caches it.
+ *
+ * @param _code The code.
+ * @param _index The index of the constant.
+ * @return The atom.
+ */
+object_t* code_atom(code_t* _code, int _index);
+
+/*
+ * Hand an object over to the code's literal table, it is made immortal
+ * and freed with the code.
+ *
+ * @param _code The code.
+ * @param _literal The literal object.
+ * @return The literal object.
+ */
+object_t* code_add_literal(code_t* _code, object_t* _literal);
+
 /*
  * Free the code.
  *
@@ -1,28 +1,27 @@
 #include "decompiler.h"
 
-INTERNAL char* decompiler_get_string(uint8_t* bytecode, size_t _ip) {
-    char* str = string_allocate("");
-    while (bytecode[_ip] != 0) {
-        str = string_append_char(str, bytecode[_ip]);
-        _ip++;
+INTERNAL int decompiler_get_int(uint8_t* bytecode, size_t _ip) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        value = value | ((uint32_t)bytecode[_ip + i] << (i * 8));
     }
-    return str;
+    return (int)value;
 }
 
-INTERNAL int decompiler_get_int(uint8_t* bytecode, size_t _ip) {
-    int value = 0;
-    for (size_t i = 0; i < 4; i++) {
-        value = value | (bytecode[_ip + i] << (i * 8));
+INTERNAL char* decompiler_get_constant(code_t* _code, size_t _ip) {
+    int index = decompiler_get_int(_code->bytecode, _ip);
+    if (index < 0 || (size_t) index >= _code->constant_count) {
+        PD("constant index out of range (%d)", index);
     }
-    return value;
+    return _code->constants[index];
 }
 
-INTERNAL long decompiler_get_long(uint8_t* bytecode, size_t _ip) {
-    long value = 0;
+INTERNAL int64_t decompiler_get_long(uint8_t* bytecode, size_t _ip) {
+    uint64_t value = 0;
     for (size_t i = 0; i < 8; i++) {
-        value = value | ((long)bytecode[_ip + i] << (i * 8));
+        value = value | ((uint64_t)bytecode[_ip + i] << (i * 8));
     }
-    return value;
+    return (int64_t) value;
 }
 
 INTERNAL
@@ -47,6 +46,28 @@ void* decompile_get_memory(uint8_t* bytecode, size_t _ip) {
     return (void*)value;
 }
 
+INTERNAL const char* decompiler_binary_name(uint8_t _opcode) {
+    switch (_opcode) {
+        case OPCODE_MUL:     return "mul (*)";
+        case OPCODE_DIV:     return "div (/)";
+        case OPCODE_MOD:     return "mod (%)";
+        case OPCODE_ADD:     return "add (+)";
+        case OPCODE_SUB:     return "sub (-)";
+        case OPCODE_SHL:     return "shl (<<)";
+        case OPCODE_SHR:     return "shr (>>)";
+        case OPCODE_CMP_LT:  return "cmp_lt (<)";
+        case OPCODE_CMP_LTE: return "cmp_lte (<=)";
+        case OPCODE_CMP_GT:  return "cmp_gt (>)";
+        case OPCODE_CMP_GTE: return "cmp_gte (>=)";
+        case OPCODE_CMP_EQ:  return "cmp_eq (==)";
+        case OPCODE_CMP_NE:  return "cmp_ne (!=)";
+        case OPCODE_AND:     return "and (&)";
+        case OPCODE_OR:      return "or (|)";
+        case OPCODE_XOR:     return "xor (^)";
+        default:             return "unknown";
+    }
+}
+
 #define FORWARD(n) ip += n
 #define OPCODE (bytecode[ip])
 #define PRINT_OPCODE(format, ...) printf("[%.*zu] " format, (int)log10(bytecode_size) + 1, ip-1, ##__VA_ARGS__)
@@ -70,11 +91,75 @@ void _decompile(code_t* _code, size_t _ip) {
         index = ip;
         uint8_t opcode = bytecode[ip++];
         switch (opcode) {
+            case OPCODE_LOAD_LOCAL: {
+                int slot = decompiler_get_int(bytecode, ip);
+                PRINT_OPCODE("load_local: (slot = %d)\n", slot);
+                FORWARD(4);
+                break;
+            }
+            case OPCODE_STORE_LOCAL: {
+                int slot = decompiler_get_int(bytecode, ip);
+                PRINT_OPCODE("store_local: (slot = %d)\n", slot);
+                FORWARD(4);
+                break;
+            }
+            case OPCODE_SET_LOCAL: {
+                int slot = decompiler_get_int(bytecode, ip);
+                PRINT_OPCODE("set_local: (slot = %d)\n", slot);
+                FORWARD(4);
+                break;
+            }
+            case OPCODE_CMP_LT_JUMP_IF_FALSE:
+            case OPCODE_CMP_LTE_JUMP_IF_FALSE:
+            case OPCODE_CMP_GT_JUMP_IF_FALSE:
+            case OPCODE_CMP_GTE_JUMP_IF_FALSE:
+            case OPCODE_CMP_EQ_JUMP_IF_FALSE:
+            case OPCODE_CMP_NE_JUMP_IF_FALSE: {
+                int jump_offset = decompiler_get_int(bytecode, ip);
+                PRINT_OPCODE(
+                    "%s + pop_jump_if_false: (jump_to_offset = %d)\n",
+                    decompiler_binary_name(OPCODE_CMP_LT + (opcode - OPCODE_CMP_LT_JUMP_IF_FALSE)),
+                    jump_offset
+                );
+                FORWARD(4);
+                break;
+            }
+            case OPCODE_LOAD_LOCAL_INT_BINARY: {
+                int slot = decompiler_get_int(bytecode, ip);
+                int value = decompiler_get_int(bytecode, ip + 4);
+                PRINT_OPCODE("load_local + load_int + %s: (slot = %d, value = %d)\n", decompiler_binary_name(bytecode[ip + 8]), slot, value);
+                FORWARD(9);
+                break;
+            }
+            case OPCODE_LOAD_NAME_INT_BINARY: {
+                char* name = decompiler_get_constant(_code, ip);
+                int value = decompiler_get_int(bytecode, ip + 4);
+                PRINT_OPCODE("load_name + load_int + %s: (name = %s, value = %d)\n", decompiler_binary_name(bytecode[ip + 8]), name, value);
+                FORWARD(9);
+                break;
+            }
+            case OPCODE_INCREMENT_LOCAL: {
+                int slot = decompiler_get_int(bytecode, ip);
+                PRINT_OPCODE("%s_local: (slot = %d)\n", (bytecode[ip + 4] == OPCODE_INCREMENT) ? "increment" : "decrement", slot);
+                FORWARD(5);
+                break;
+            }
+            case OPCODE_INCREMENT_NAME: {
+                char* name = decompiler_get_constant(_code, ip);
+                PRINT_OPCODE("%s_name: %s\n", (bytecode[ip + 4] == OPCODE_INCREMENT) ? "increment" : "decrement", name);
+                FORWARD(5);
+                break;
+            }
+            case OPCODE_SET_NAME_POP: {
+                char* name = decompiler_get_constant(_code, ip);
+                PRINT_OPCODE("set_name + poptop: %s\n", name);
+                FORWARD(4);
+                break;
+            }
             case OPCODE_LOAD_NAME: {
-                char* name = decompiler_get_string(bytecode, ip);
+                char* name = decompiler_get_constant(_code, ip);
                 PRINT_OPCODE("load_name: %s\n", name);
-                FORWARD(strlen(name) + 1);
-                free(name);
+                FORWARD(4);
                 break;
             }
             case OPCODE_LOAD_INT: {
@@ -89,11 +174,16 @@ void _decompile(code_t* _code, size_t _ip) {
                 FORWARD(8);
                 break;
             }
+            case OPCODE_LOAD_LONG: {
+                int64_t value = decompiler_get_long(bytecode, ip);
+                PRINT_OPCODE("load_long: %lld\n", (long long) value);
+                FORWARD(8);
+                break;
+            }
             case OPCODE_LOAD_STRING: {
-                char* value = decompiler_get_string(bytecode, ip);
+                char* value = decompiler_get_constant(_code, ip);
                 PRINT_OPCODE("load_string: %s\n", value);
-                FORWARD(strlen(value) + 1);
-                free(value);
+                FORWARD(4);
                 break;
             }
             case OPCODE_LOAD_NULL: {
@@ -120,6 +210,12 @@ void _decompile(code_t* _code, size_t _ip) {
                 FORWARD(4);
                 break;
             }
+            case OPCODE_NEW_ARRAY: {
+                int length = decompiler_get_int(bytecode, ip);
+                PRINT_OPCODE("new_array: (capacity = %d)\n", length);
+                FORWARD(4);
+                break;
+            }
             case OPCODE_EXTEND_ARRAY: {
                 PRINT_OPCODE("extend_array\n");
                 break;
@@ -134,6 +230,12 @@ void _decompile(code_t* _code, size_t _ip) {
                 FORWARD(4);
                 break;
             }
+            case OPCODE_NEW_OBJECT: {
+                int length = decompiler_get_int(bytecode, ip);
+                PRINT_OPCODE("new_object: (capacity = %d)\n", length);
+                FORWARD(4);
+                break;
+            }
             case OPCODE_EXTEND_OBJECT: {
                 PRINT_OPCODE("extend_object\n");
                 break;
@@ -143,31 +245,27 @@ void _decompile(code_t* _code, size_t _ip) {
                 break;
             }
             case OPCODE_STORE_NAME: {
-                char* name = decompiler_get_string(bytecode, ip);
+                char* name = decompiler_get_constant(_code, ip);
                 PRINT_OPCODE("store_name: %s\n", name);
-                FORWARD(strlen(name) + 1);
-                free(name);
+                FORWARD(4);
                 break;
             }
             case OPCODE_STORE_CLASS: {
-                char* name = decompiler_get_string(bytecode, ip);
+                char* name = decompiler_get_constant(_code, ip);
                 PRINT_OPCODE("store_class: %s\n", name);
-                FORWARD(strlen(name) + 1);
-                free(name);
+                FORWARD(4);
                 break;
             }
             case OPCODE_SET_NAME: {
-                char* name = decompiler_get_string(bytecode, ip);
+                char* name = decompiler_get_constant(_code, ip);
                 PRINT_OPCODE("set_name: %s\n", name);
-                FORWARD(strlen(name) + 1);
-                free(name);
+                FORWARD(4);
                 break;
             }
             case OPCODE_SET_PROPERTY: {
-                char* name = decompiler_get_string(bytecode, ip);
+                char* name = decompiler_get_constant(_code, ip);
                 PRINT_OPCODE("set_property: %s\n", name);
-                FORWARD(strlen(name) + 1);
-                free(name);
+                FORWARD(4);
                 break;
             }
             case OPCODE_RANGE: {
@@ -175,10 +273,23 @@ void _decompile(code_t* _code, size_t _ip) {
                 break;
             }
             case OPCODE_GET_PROPERTY: {
-                char* name = decompiler_get_string(bytecode, ip);
+                char* name = decompiler_get_constant(_code, ip);
                 PRINT_OPCODE("get_property: %s\n", name);
-                FORWARD(strlen(name) + 1);
-                free(name);
+                FORWARD(4);
+                break;
+            }
+            case OPCODE_GET_FIELD: {
+                char* name = decompiler_get_constant(_code, ip);
+                int slot = decompiler_get_int(bytecode, ip + 4);
+                PRINT_OPCODE("get_field: (name = %s, slot = %d)\n", name, slot);
+                FORWARD(8);
+                break;
+            }
+            case OPCODE_SET_FIELD: {
+                char* name = decompiler_get_constant(_code, ip);
+                int slot = decompiler_get_int(bytecode, ip + 4);
+                PRINT_OPCODE("set_field: (name = %s, slot = %d)\n", name, slot);
+                FORWARD(8);
                 break;
             }
             case OPCODE_INDEX: {
@@ -196,12 +307,11 @@ void _decompile(code_t* _code, size_t _ip) {
                 break;
             }
             case OPCODE_CALL_METHOD: {
-                char* method_name = decompiler_get_string(bytecode, ip);
-                FORWARD(strlen(method_name) + 1);
+                char* method_name = decompiler_get_constant(_code, ip);
+                FORWARD(4);
                 int argc = decompiler_get_int(bytecode, ip);
                 PRINT_OPCODE("call_method: (method_name = %s, argc = %d)\n", method_name, argc);
                 FORWARD(4);
-                free(method_name);
                 break;
             }
             case OPCODE_CALL: {
@@ -264,6 +374,12 @@ void _decompile(code_t* _code, size_t _ip) {
                 PRINT_OPCODE("add (+)\n");
                 break;
             }
+            case OPCODE_CONCAT_N: {
+                int count = decompiler_get_int(bytecode, ip);
+                PRINT_OPCODE("concat_n: (count = %d)\n", count);
+                FORWARD(4);
+                break;
+            }
             case OPCODE_SUB: {
                 PRINT_OPCODE("sub (-)\n");
                 break;
@@ -479,18 +595,35 @@ void _decompile(code_t* _code, size_t _ip) {
                 int length = 4;
                 printf("[");
                 for (int i = 0; i < capture_count; i++) {
-                    char* name = decompiler_get_string(bytecode, ip+length);
+                    char* name = decompiler_get_constant(_code, ip+length);
+                    int slot = decompiler_get_int(bytecode, ip+length+4);
                     printf("%s", name);
-                    length += strlen(name) + 1;
+                    if (slot >= 0) {
+                        printf(" (slot = %d)", slot);
+                    }
+                    length += 8;
                     if (i < capture_count - 1) {
                         printf(", ");
                     }
-                    free(name);
                 }
                 printf("]\n");
                 FORWARD(length);
                 break;
             }
+            case OPCODE_LAYOUT_CLASS: {
+                int field_count = decompiler_get_int(bytecode, ip);
+                PRINT_OPCODE("layout_class: (field_count = %d) ", field_count);
+                printf("[");
+                for (int i = 0; i < field_count; i++) {
+                    printf("%s", decompiler_get_constant(_code, ip + 4 + (4 * i)));
+                    if (i < field_count - 1) {
+                        printf(", ");
+                    }
+                }
+                printf("]\n");
+                FORWARD(4 + (4 * field_count));
+                break;
+            }
             case OPCODE_GET_ITERATOR_OR_JUMP: {
                 int jump_offset = decompiler_get_int(bytecode, ip);
                 PRINT_OPCODE("get_iterator_or_jump: (jump_to_offset = %d)\n", jump_offset);
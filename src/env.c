@@ -3,6 +3,7 @@
 #include "api/core/object.h"
 #include "env.h"
 #include "error.h"
+#include "intern.h"
 #include "internal.h"
 
 #define ENV_BUCKET_COUNT 16
@@ -18,9 +19,28 @@ DLLEXPORT env_t* env_new(env_t* _parent) {
     env->bucket_count = ENV_BUCKET_COUNT;
     env->size = 0;
     env->closure = NULL;
+    env->locals = NULL;
+    env->local_count = 0;
+    env->owns_locals = false;
+    env->mark = 0;
     return env;
 }
 
+void env_reserve_locals(env_t* _env, size_t _count) {
+    // Always keep room for the "this" slot
+    if (_count == 0) _count = 1;
+    _env->locals = calloc(_count, sizeof(object_t*));
+    ASSERTNULL(_env->locals, "failed to allocate memory for locals");
+    _env->local_count = _count;
+    _env->owns_locals = true;
+}
+
+void env_share_locals(env_t* _env, env_t* _frame) {
+    _env->locals = _frame->locals;
+    _env->local_count = _frame->local_count;
+    _env->owns_locals = false;
+}
+
 INTERNAL void env_rehash(env_t* _env) {
     size_t new_bucket_count = _env->bucket_count * 2;
     env_node_t** new_buckets = calloc(new_bucket_count, sizeof(env_node_t*));
@@ -31,7 +51,7 @@ INTERNAL void env_rehash(env_t* _env) {
         env_node_t* node = _env->buckets[i];
         while (node) {
             env_node_t* next = node->next;
-            size_t index = hash64(node->name) % new_bucket_count;
+            size_t index = OBJECT_STRING(node->key)->hash % new_bucket_count;
             node->next = new_buckets[index];
             new_buckets[index] = node;
             node = next;
@@ -43,23 +63,38 @@ INTERNAL void env_rehash(env_t* _env) {
     _env->bucket_count = new_bucket_count;
 }
 
+/**
+ * Finds the atom of a name, every name in an environment has one.
+ *
+ * @param _name The name.
+ * @return object_t* The atom, or NULL if no environment has the name.
+ */
+INTERNAL object_t* env_atom(char* _name) {
+    return intern_find(_name, strlen(_name), hash64(_name));
+}
+
 DLLEXPORT bool env_has(env_t* _env, char* _name, bool _recurse) {
+    object_t* key = env_atom(_name);
+    return key != NULL && env_has_atom(_env, key, _recurse);
+}
+
+bool env_has_atom(env_t* _env, object_t* _key, bool _recurse) {
     if (_env == NULL) return false;
     
     env_t* current_env = _env;
-    size_t hash = hash64(_name);
+    size_t hash = OBJECT_STRING(_key)->hash;
     
     do {
         size_t index = hash % current_env->bucket_count;
         env_node_t* node = current_env->buckets[index];
         
         while (node) {
-            if (strcmp(node->name, _name) == 0) return true;
+            if (node->key == _key) return true;
             node = node->next;
         }
         
         // Check closure environment if it exists
-        if (current_env->closure != NULL && env_has(current_env->closure, _name, _recurse)) {
+        if (current_env->closure != NULL && env_has_atom(current_env->closure, _key, _recurse)) {
             return true;
         }
         
@@ -71,14 +106,19 @@ DLLEXPORT bool env_has(env_t* _env, char* _name, bool _recurse) {
 
 DLLEXPORT void env_put(env_t* _env, char* _name, object_t* _value) {
     if (_env == NULL) return;
-    size_t hash = hash64(_name);
+    env_put_atom(_env, intern_string(_name), _value);
+}
+
+void env_put_atom(env_t* _env, object_t* _key, object_t* _value) {
+    if (_env == NULL) return;
+    size_t hash = OBJECT_STRING(_key)->hash;
     size_t index = hash % _env->bucket_count;
     env_node_t* node = _env->buckets[index];
 
     if (node != NULL) {
         env_node_t* current = node;
         while (current) {
-            if (strcmp(current->name, _name) == 0) {
+            if (current->key == _key) {
                 current->value = _value;
                 return;
             }
@@ -87,7 +127,7 @@ DLLEXPORT void env_put(env_t* _env, char* _name, object_t* _value) {
         }
         node = malloc(sizeof(env_node_t));
         ASSERTNULL(node, "failed to allocate memory for env node");
-        node->name = string_allocate(_name);
+        node->key = intern_pin(_key);
         node->value = _value;
         node->next = NULL;
         current->next = node;
@@ -96,7 +136,7 @@ DLLEXPORT void env_put(env_t* _env, char* _name, object_t* _value) {
     } else {
         node = malloc(sizeof(env_node_t));
         ASSERTNULL(node, "failed to allocate memory for env node");
-        node->name = string_allocate(_name);
+        node->key = intern_pin(_key);
         node->value = _value;
         node->next = NULL;
         _env->buckets[index] = node;
@@ -112,7 +152,13 @@ DLLEXPORT void env_put(env_t* _env, char* _name, object_t* _value) {
 
 DLLEXPORT object_t* env_get(env_t* _env, char* _name) {
     if (_env == NULL) return NULL;
-    size_t hash = hash64(_name);
+    object_t* key = env_atom(_name);
+    return (key != NULL) ? env_get_atom(_env, key) : NULL;
+}
+
+object_t* env_get_atom(env_t* _env, object_t* _key) {
+    if (_env == NULL) return NULL;
+    size_t hash = OBJECT_STRING(_key)->hash;
     env_t* current_env = _env;
     
     while (current_env) {
@@ -120,7 +166,7 @@ DLLEXPORT object_t* env_get(env_t* _env, char* _name) {
         size_t index = hash % current_env->bucket_count;
         env_node_t* node = current_env->buckets[index];
         while (node) {
-            if (strcmp(node->name, _name) == 0) {
+            if (node->key == _key) {
                 return node->value;
             }
             node = node->next;
@@ -128,7 +174,7 @@ DLLEXPORT object_t* env_get(env_t* _env, char* _name) {
         
         // Check in closure environment if it exists
         if (current_env->closure != NULL) {
-            object_t* closure_value = env_get(current_env->closure, _name);
+            object_t* closure_value = env_get_atom(current_env->closure, _key);
             if (closure_value != NULL) {
                 return closure_value;
             }
@@ -150,11 +196,11 @@ DLLEXPORT void env_free(env_t* _env) {
         env_node_t* node = _env->buckets[i];
         while (node) {
             env_node_t* next = node->next;
-            free(node->name);
             free(node);
             node = next;
         }
     }
+    if (_env->owns_locals) free(_env->locals);
     free(_env->buckets);
     free(_env);
 }
@@ -198,11 +244,12 @@ void env_dump_symbols(env_t* _env) {
         for (size_t i = 0; i < _env->parent->bucket_count; i++) {
             env_node_t* node = _env->parent->buckets[i];
             while (node) {
-                if (strlen(node->name) > 24) {
-                    printf("| %.20s... |\n", node->name);
+                char* name = OBJECT_STRING(node->key)->data;
+                if (strlen(name) > 24) {
+                    printf("| %.20s... |\n", name);
                 } else {
-                    printf("| %s", node->name);
-                    for (size_t j = 0; j < 24 - strlen(node->name); j++) {
+                    printf("| %s", name);
+                    for (size_t j = 0; j < 24 - strlen(name); j++) {
                         printf(" ");
                     }
                     printf("|\n");
@@ -217,11 +264,12 @@ void env_dump_symbols(env_t* _env) {
         for (size_t i = 0; i < _env->closure->bucket_count; i++) {
             env_node_t* node = _env->closure->buckets[i];
             while (node) {
-                if (strlen(node->name) > 24) {
-                    printf("| %.20s... |\n", node->name);
+                char* name = OBJECT_STRING(node->key)->data;
+                if (strlen(name) > 24) {
+                    printf("| %.20s... |\n", name);
                 } else {
-                    printf("| %s", node->name);
-                    for (size_t j = 0; j < 24 - strlen(node->name); j++) {
+                    printf("| %s", name);
+                    for (size_t j = 0; j < 24 - strlen(name); j++) {
                         printf(" ");
                     }
                     printf("|\n");
@@ -235,11 +283,12 @@ void env_dump_symbols(env_t* _env) {
     for (size_t i = 0; i < _env->bucket_count; i++) {
         env_node_t* node = _env->buckets[i];
         while (node) {
-            if (strlen(node->name) > 24) {
-                printf("| %.20s... |\n", node->name);
+            char* name = OBJECT_STRING(node->key)->data;
+            if (strlen(name) > 24) {
+                printf("| %.20s... |\n", name);
             } else {
-                printf("| %s", node->name);
-                for (size_t j = 0; j < 24 - strlen(node->name); j++) {
+                printf("| %s", name);
+                for (size_t j = 0; j < 24 - strlen(name); j++) {
                     printf(" ");
                 }
                 printf("|\n");
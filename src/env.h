@@ -5,7 +5,7 @@
 
 typedef struct env_node_struct env_node_t;
 typedef struct env_node_struct {
-    char* name;
+    object_t* key; // The name (a pinned atom, see intern.h)
     object_t* value;
     env_node_t* next;
 } env_node_t;
@@ -16,8 +16,56 @@ typedef struct env_struct {
     size_t bucket_count;
     size_t size;
     env_t* closure;
+    object_t** locals;
+    size_t local_count;
+    bool owns_locals;
+    size_t mark; // The collection that last marked it (see gc.c)
 } env_t;
 
+/*
+ * Check if a variable exists in the environment, by atom.
+ *
+ * @param _env The environment.
+ * @param _key The name (an atom, see intern.h).
+ * @param _recurse True to look in the parent environments as well.
+ * @return True if the variable exists, false otherwise.
+ */
+bool env_has_atom(env_t* _env, object_t* _key, bool _recurse);
+
+/*
+ * Put a variable into the environment, by atom.
+ *
+ * @param _env The environment.
+ * @param _key The name (an atom), pinned here.
+ * @param _value The value of the variable.
+ */
+void env_put_atom(env_t* _env, object_t* _key, object_t* _value);
+
+/*
+ * Get the value of a variable, by atom.
+ *
+ * @param _env The environment.
+ * @param _key The name (an atom).
+ * @return The value of the variable, or NULL if not found.
+ */
+object_t* env_get_atom(env_t* _env, object_t* _key);
+
+/*
+ * Reserve the local slots of a frame environment.
+ *
+ * @param _env The environment.
+ * @param _count The number of slots.
+ */
+void env_reserve_locals(env_t* _env, size_t _count);
+
+/*
+ * Share the local slots of the enclosing frame (used by blocks).
+ *
+ * @param _env The environment.
+ * @param _frame The environment that owns the slots.
+ */
+void env_share_locals(env_t* _env, env_t* _frame);
+
 /*
  * Get the object list of the environment.
  *
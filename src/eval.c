@@ -4,11 +4,17 @@ INTERNAL double eval_coerce_to_double(eval_result_t _result) {
     switch (_result.type) {
         case EvalInt:
             return (double) _result.value.i32;
+        case EvalLong:
+            return (double) _result.value.i64;
         case EvalDouble:
             return _result.value.f64;
-        case EvalString:
-            if (!string_is_number((char*) _result.value.ptr)) break;
-            return strtod((char*) _result.value.ptr, NULL);
+        case EvalString: {
+            double value;
+            int64_t integer;
+            char* str = (char*) _result.value.ptr;
+            if (!number_parse(str, strlen(str), &value, &integer)) break;
+            return value;
+        }
         default:
             PD("cannot coerce %d to double", _result.type);
     }
@@ -19,11 +25,17 @@ INTERNAL long eval_coerce_to_long(eval_result_t _result) {
     switch (_result.type) {
         case EvalInt:
             return (long) _result.value.i32;
+        case EvalLong:
+            return (long) _result.value.i64;
         case EvalDouble:
             return (long) _result.value.f64;
-        case EvalString:
-            if (!string_is_number((char*) _result.value.ptr)) break;
-            return strtol((char*) _result.value.ptr, NULL, 10);
+        case EvalString: {
+            double value;
+            int64_t integer;
+            char* str = (char*) _result.value.ptr;
+            if (!number_parse(str, strlen(str), &value, &integer)) break;
+            return (long) integer;
+        }
         default:
             PD("cannot coerce %d to long", _result.type);
     }
@@ -34,11 +46,13 @@ INTERNAL bool eval_coerce_to_boolean(eval_result_t _result) {
     switch (_result.type) {
         case EvalInt:
             return _result.value.i32 != 0;
+        case EvalLong:
+            return _result.value.i64 != 0;
         case EvalDouble:
             return _result.value.f64 != 0.0;
         case EvalBoolean:
             return _result.value.i32 != 0;
-        case EvalString:
+        case EvalString: {
             if (strcmp((char*) _result.value.ptr, "true") == 0 || 
                 strcmp((char*) _result.value.ptr, "1") == 0) {
                 return true;
@@ -47,8 +61,12 @@ INTERNAL bool eval_coerce_to_boolean(eval_result_t _result) {
                 strcmp((char*) _result.value.ptr, "0") == 0) {
                 return false;
             }
-            if (!string_is_number((char*) _result.value.ptr)) break;
-            return strtol((char*) _result.value.ptr, NULL, 10) != 0;
+            double value;
+            int64_t integer;
+            char* str = (char*) _result.value.ptr;
+            if (!number_parse(str, strlen(str), &value, &integer)) break;
+            return integer != 0;
+        }
         default:
             PD("cannot coerce %d to boolean", _result.type);
     }
@@ -58,6 +76,7 @@ INTERNAL bool eval_coerce_to_boolean(eval_result_t _result) {
 INTERNAL bool eval_is_number(eval_result_t _result) {
     switch (_result.type) {
         case EvalInt:
+        case EvalLong:
             return true;
         case EvalDouble:
             return true;
@@ -72,11 +91,13 @@ INTERNAL bool eval_is_truthy(eval_result_t _result) {
     switch (_result.type) {
         case EvalInt:
             return _result.value.i32 != 0;
+        case EvalLong:
+            return _result.value.i64 != 0;
         case EvalDouble:
             return _result.value.f64 != 0.0;
         case EvalBoolean:
             return _result.value.i32 != 0;
-        case EvalString:
+        case EvalString: {
             if (strcmp((char*) _result.value.ptr, "true") == 0 || 
                 strcmp((char*) _result.value.ptr, "1") == 0) {
                 return true;
@@ -85,14 +106,62 @@ INTERNAL bool eval_is_truthy(eval_result_t _result) {
                 strcmp((char*) _result.value.ptr, "0") == 0) {
                 return false;
             }
-            if (!string_is_number((char*) _result.value.ptr)) break;
-            return strtol((char*) _result.value.ptr, NULL, 10) != 0;
+            double value;
+            int64_t integer;
+            char* str = (char*) _result.value.ptr;
+            if (!number_parse(str, strlen(str), &value, &integer)) break;
+            return integer != 0;
+        }
         case EvalNull:
         default:
             return false;
     }
 }
 
+INTERNAL bool eval_is_integer(eval_result_t _result) {
+    return _result.type == EvalInt || _result.type == EvalLong;
+}
+
+INTERNAL int64_t eval_integer_value(eval_result_t _result) {
+    return (_result.type == EvalInt) ? (int64_t) _result.value.i32 : _result.value.i64;
+}
+
+/**
+ * Makes an integer result, as an int when it fits in 32 bits.
+ *
+ * @param _value The value.
+ * @return eval_result_t
+ */
+INTERNAL eval_result_t eval_integer(int64_t _value) {
+    eval_result_t result;
+    if (_value >= INT32_MIN && _value <= INT32_MAX) {
+        result.type = EvalInt;
+        result.value.i32 = (int) _value;
+    } else {
+        result.type = EvalLong;
+        result.value.i64 = _value;
+    }
+    return result;
+}
+
+/**
+ * Makes the result of a double operation, as an integer when it is
+ * integral and in the int64 range (same rule as the vm).
+ *
+ * @param _value The value.
+ * @return eval_result_t
+ */
+INTERNAL eval_result_t eval_number(double _value) {
+    // The range is checked first, casting a double outside it is undefined
+    if (_value >= -9223372036854775808.0 && _value < 9223372036854775808.0 && _value == (double)(int64_t)_value) {
+        return eval_integer((int64_t) _value);
+    }
+    eval_result_t result;
+    result.type = EvalDouble;
+    result.value.f64 = _value;
+    return result;
+}
+
 INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
     eval_result_t result;
     switch (_expression->type) {
@@ -100,6 +169,8 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
             result.type = EvalInt;
             result.value.i32 = _expression->value.i32;
             break;
+        case AstLong:
+            return eval_integer((int64_t) _expression->value.i64);
         case AstDouble:
             result.type = EvalDouble;
             result.value.f64 = _expression->value.f64;
@@ -129,31 +200,23 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
                 return result;
             }
 
-            if (l.type == EvalInt && r.type == EvalInt) {
-                long product = (long)l.value.i32 * r.value.i32;
-                if (product <= INT32_MAX && product >= INT32_MIN) {
-                    result.type = EvalInt;
-                    result.value.i32 = (int)product;
-                } else {
+            if (eval_is_integer(l) && eval_is_integer(r)) {
+                int64_t a = eval_integer_value(l);
+                int64_t b = eval_integer_value(r);
+                int64_t product;
+                if (NUMBER_MUL_OVERFLOW(a, b, &product)) {
                     result.type = EvalDouble;
-                    result.value.f64 = (double)product;
+                    result.value.f64 = (double)a * (double)b;
+                    return result;
                 }
-                return result;
+                return eval_integer(product);
             }
 
             double lvalue = eval_coerce_to_double(l);
             double rvalue = eval_coerce_to_double(r);
             double product = lvalue * rvalue;
 
-            double intpart;
-            if (modf(product, &intpart) == 0.0 && product <= INT32_MAX && product >= INT32_MIN) {
-                result.type = EvalInt;
-                result.value.i32 = (int)product;
-            } else {
-                result.type = EvalDouble;
-                result.value.f64 = product;
-            }
-            return result;
+            return eval_number(product);
         }
         case AstBinaryDiv: {
             eval_result_t l = eval_eval_expression(_expression->ast0);
@@ -169,11 +232,20 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
             }
 
             // Catch zero division for integer types
-            if ((r.type == EvalInt && r.value.i32 == 0)) {
+            if (eval_is_integer(r) && eval_integer_value(r) == 0) {
                 result.type = EvalZeroDivision;
                 return result;
             }
 
+            // Exact integer quotients stay exact past 2^53
+            if (eval_is_integer(l) && eval_is_integer(r)) {
+                int64_t a = eval_integer_value(l);
+                int64_t b = eval_integer_value(r);
+                if (!(a == INT64_MIN && b == -1) && a % b == 0) {
+                    return eval_integer(a / b);
+                }
+            }
+
             double rvalue = eval_coerce_to_double(r);
             if (rvalue == 0.0) {
                 result.type = EvalZeroDivision;
@@ -183,15 +255,7 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
             double lvalue = eval_coerce_to_double(l);
             double quotient = lvalue / rvalue;
 
-            double intpart;
-            if (modf(quotient, &intpart) == 0.0 && quotient <= INT32_MAX && quotient >= INT32_MIN) {
-                result.type = EvalInt;
-                result.value.i32 = (int)quotient;
-            } else {
-                result.type = EvalDouble;
-                result.value.f64 = quotient;
-            }
-            return result;
+            return eval_number(quotient);
         }
         case AstBinaryMod: {
             eval_result_t l = eval_eval_expression(_expression->ast0);
@@ -207,16 +271,15 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
             }
 
             // Catch zero division for integer types
-            if ((r.type == EvalInt && r.value.i32 == 0) ||
+            if ((eval_is_integer(r) && eval_integer_value(r) == 0) ||
                 (r.type == EvalDouble && r.value.f64 == 0.0)) {
                 result.type = EvalZeroDivision;
                 return result;
             }
 
-            if (l.type == EvalInt && r.type == EvalInt) {
-                result.type = EvalInt;
-                result.value.i32 = l.value.i32 % r.value.i32;
-                return result;
+            if (eval_is_integer(l) && eval_is_integer(r)) {
+                int64_t b = eval_integer_value(r);
+                return eval_integer((b == -1) ? 0 : eval_integer_value(l) % b);
             }
 
             double rvalue = eval_coerce_to_double(r);
@@ -228,15 +291,7 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
             double lvalue = eval_coerce_to_double(l);
             double remainder = fmod(lvalue, rvalue);
 
-            double intpart;
-            if (modf(remainder, &intpart) == 0.0 && remainder <= INT32_MAX && remainder >= INT32_MIN) {
-                result.type = EvalInt;
-                result.value.i32 = (int)remainder;
-            } else {
-                result.type = EvalDouble;
-                result.value.f64 = remainder;
-            }
-            return result;
+            return eval_number(remainder);
         }
         case AstBinaryAdd: {
             eval_result_t l = eval_eval_expression(_expression->ast0);
@@ -247,25 +302,21 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
             }
 
             // Fast path for most common cases
-            if (l.type == EvalInt) {
-                if (r.type == EvalInt) {
-                    // Check for overflow using unsigned arithmetic
-                    int a = l.value.i32;
-                    int b = r.value.i32;
-                    int sum = a + b;
-                    
-                    if (((a ^ sum) & (b ^ sum)) < 0) {
+            if (eval_is_integer(l)) {
+                if (eval_is_integer(r)) {
+                    int64_t a = eval_integer_value(l);
+                    int64_t b = eval_integer_value(r);
+                    int64_t sum;
+                    if (NUMBER_ADD_OVERFLOW(a, b, &sum)) {
                         // Overflow occurred, promote to double
                         result.type = EvalDouble;
                         result.value.f64 = (double)a + (double)b;
-                    } else {
-                        result.type = EvalInt;
-                        result.value.i32 = sum;
+                        return result;
                     }
-                    return result;
+                    return eval_integer(sum);
                 }
                 // Promote int to double for other numeric types
-                l.value.f64 = (double)l.value.i32;
+                l.value.f64 = (double)eval_integer_value(l);
                 l.type = EvalDouble;
             }
 
@@ -289,15 +340,7 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
             double sum = lvalue + rvalue;
 
             // Try to preserve integer type if possible
-            double intpart;
-            if (modf(sum, &intpart) == 0.0 && sum <= INT32_MAX && sum >= INT32_MIN) {
-                result.type = EvalInt;
-                result.value.i32 = (int)sum;
-            } else {
-                result.type = EvalDouble;
-                result.value.f64 = sum;
-            }
-            return result;
+            return eval_number(sum);
         }
         case AstBinarySub: {
             eval_result_t l = eval_eval_expression(_expression->ast0);
@@ -312,34 +355,23 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
                 return result;
             }
 
-            if (l.type == EvalInt && r.type == EvalInt) {
-                int a = l.value.i32;
-                int b = r.value.i32;
-                int diff = a - b;
-                
-                if (((a ^ b) & (a ^ diff)) < 0) {
+            if (eval_is_integer(l) && eval_is_integer(r)) {
+                int64_t a = eval_integer_value(l);
+                int64_t b = eval_integer_value(r);
+                int64_t diff;
+                if (NUMBER_SUB_OVERFLOW(a, b, &diff)) {
                     result.type = EvalDouble;
                     result.value.f64 = (double)a - (double)b;
-                } else {
-                    result.type = EvalInt;
-                    result.value.i32 = diff;
+                    return result;
                 }
-                return result;
+                return eval_integer(diff);
             }
 
             double lvalue = eval_coerce_to_double(l);
             double rvalue = eval_coerce_to_double(r);
             double diff = lvalue - rvalue;
 
-            double intpart;
-            if (modf(diff, &intpart) == 0.0 && diff <= INT32_MAX && diff >= INT32_MIN) {
-                result.type = EvalInt;
-                result.value.i32 = (int)diff;
-            } else {
-                result.type = EvalDouble;
-                result.value.f64 = diff;
-            }
-            return result;
+            return eval_number(diff);
         }
         case AstBinaryShl: {
             eval_result_t l = eval_eval_expression(_expression->ast0);
@@ -351,28 +383,14 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
             if (!eval_is_number(l) || !eval_is_number(r)) {
                 result.type = EvalError;
             }
-            if (l.type == EvalInt && r.type == EvalInt) {
-                int value = l.value.i32 << r.value.i32;
-                if (value <= INT32_MAX && value >= INT32_MIN) {
-                    result.type = EvalInt;
-                    result.value.i32 = value;
-                } else {
-                    result.type = EvalDouble;
-                    result.value.f64 = (double)value;
-                }
-                return result;
+            if (eval_is_integer(l) && eval_is_integer(r)) {
+                int64_t a = eval_integer_value(l);
+                int64_t b = eval_integer_value(r);
+                return eval_integer((int64_t)((uint64_t)a << (b & 63)));
             }
             long lhs_value = eval_coerce_to_long(l);
             long rhs_value = eval_coerce_to_long(r);
-            long value = lhs_value << rhs_value;
-            if (value <= INT32_MAX && value >= INT32_MIN) {
-                result.type = EvalInt;
-                result.value.i32 = (int)value;
-            } else {
-                result.type = EvalDouble;
-                result.value.f64 = (double)value;
-            }
-            return result;
+            return eval_integer((int64_t)(lhs_value << rhs_value));
         }
         case AstBinaryShr: {
             eval_result_t l = eval_eval_expression(_expression->ast0);
@@ -385,27 +403,14 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
                 result.type = EvalError;
                 return result;
             }
-            if (l.type == EvalInt && r.type == EvalInt) {
-                int value = l.value.i32 >> r.value.i32;
-                if (value <= INT32_MAX && value >= INT32_MIN) {
-                    result.type = EvalInt;
-                    result.value.i32 = value;
-                } else {
-                    result.type = EvalDouble;
-                    result.value.f64 = (double)value;
-                }
+            if (eval_is_integer(l) && eval_is_integer(r)) {
+                int64_t a = eval_integer_value(l);
+                int64_t b = eval_integer_value(r);
+                return eval_integer(a >> (b & 63));
             }
             long lhs_value = eval_coerce_to_long(l);
             long rhs_value = eval_coerce_to_long(r);
-            long value = lhs_value >> rhs_value;
-            if (value <= INT32_MAX && value >= INT32_MIN) {
-                result.type = EvalInt;
-                result.value.i32 = (int)value;
-            } else {
-                result.type = EvalDouble;
-                result.value.f64 = (double)value;
-            }
-            return result;
+            return eval_integer((int64_t)(lhs_value >> rhs_value));
         }
         case AstCmpLt: {
             eval_result_t l = eval_eval_expression(_expression->ast0);
@@ -418,9 +423,9 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
                 result.type = EvalError;
                 return result;
             }
-            if (l.type == EvalInt && r.type == EvalInt) {
+            if (eval_is_integer(l) && eval_is_integer(r)) {
                 result.type = EvalBoolean;
-                result.value.i32 = l.value.i32 < r.value.i32;
+                result.value.i32 = eval_integer_value(l) < eval_integer_value(r);
                 return result;
             }
             long lhs_value = eval_coerce_to_long(l);
@@ -440,9 +445,9 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
                 result.type = EvalError;
                 return result;
             }
-            if (l.type == EvalInt && r.type == EvalInt) {
+            if (eval_is_integer(l) && eval_is_integer(r)) {
                 result.type = EvalBoolean;
-                result.value.i32 = l.value.i32 <= r.value.i32;
+                result.value.i32 = eval_integer_value(l) <= eval_integer_value(r);
                 return result;
             }
             long lhs_value = eval_coerce_to_long(l);
@@ -462,9 +467,9 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
                 result.type = EvalError;
                 return result;
             }
-            if (l.type == EvalInt && r.type == EvalInt) {
+            if (eval_is_integer(l) && eval_is_integer(r)) {
                 result.type = EvalBoolean;
-                result.value.i32 = l.value.i32 > r.value.i32;
+                result.value.i32 = eval_integer_value(l) > eval_integer_value(r);
                 return result;
             }
             long lhs_value = eval_coerce_to_long(l);
@@ -484,9 +489,9 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
                 result.type = EvalError;
                 return result;
             }
-            if (l.type == EvalInt && r.type == EvalInt) {
+            if (eval_is_integer(l) && eval_is_integer(r)) {
                 result.type = EvalBoolean;
-                result.value.i32 = l.value.i32 >= r.value.i32;
+                result.value.i32 = eval_integer_value(l) >= eval_integer_value(r);
                 return result;
             }
             long lhs_value = eval_coerce_to_long(l);
@@ -556,22 +561,12 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
                 result.type = EvalError;
                 return result;
             }
-            if (l.type == EvalInt && r.type == EvalInt) {
-                result.type = EvalInt;
-                result.value.i32 = l.value.i32 & r.value.i32;
-                return result;
+            if (eval_is_integer(l) && eval_is_integer(r)) {
+                return eval_integer(eval_integer_value(l) & eval_integer_value(r));
             }
             long lhs_value = eval_coerce_to_long(l);
             long rhs_value = eval_coerce_to_long(r);
-            long value = lhs_value & rhs_value;
-            if (value <= INT32_MAX && value >= INT32_MIN) {
-                result.type = EvalInt;
-                result.value.i32 = (int)value;
-            } else {
-                result.type = EvalDouble;
-                result.value.f64 = (double)value;
-            }
-            return result;
+            return eval_integer((int64_t)(lhs_value & rhs_value));
         }
         case AstBinaryOr: {
             eval_result_t l = eval_eval_expression(_expression->ast0);
@@ -580,22 +575,12 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
                 result.type = EvalError;
                 return result;
             }
-            if (l.type == EvalInt && r.type == EvalInt) {
-                result.type = EvalInt;
-                result.value.i32 = l.value.i32 | r.value.i32;
-                return result;
+            if (eval_is_integer(l) && eval_is_integer(r)) {
+                return eval_integer(eval_integer_value(l) | eval_integer_value(r));
             }
             long lhs_value = eval_coerce_to_long(l);
             long rhs_value = eval_coerce_to_long(r);
-            long value = lhs_value | rhs_value;
-            if (value <= INT32_MAX && value >= INT32_MIN) {
-                result.type = EvalInt;
-                result.value.i32 = (int)value;
-            } else {
-                result.type = EvalDouble;
-                result.value.f64 = (double)value;
-            }
-            return result;
+            return eval_integer((int64_t)(lhs_value | rhs_value));
         }
         case AstBinaryXor: {
             eval_result_t l = eval_eval_expression(_expression->ast0);
@@ -604,22 +589,12 @@ INTERNAL eval_result_t eval_eval_expression(ast_node_t* _expression) {
                 result.type = EvalError;
                 return result;
             }
-            if (l.type == EvalInt && r.type == EvalInt) {
-                result.type = EvalInt;
-                result.value.i32 = l.value.i32 ^ r.value.i32;
-                return result;
+            if (eval_is_integer(l) && eval_is_integer(r)) {
+                return eval_integer(eval_integer_value(l) ^ eval_integer_value(r));
             }
             long lhs_value = eval_coerce_to_long(l);
             long rhs_value = eval_coerce_to_long(r);
-            long value = lhs_value ^ rhs_value;
-            if (value <= INT32_MAX && value >= INT32_MIN) {
-                result.type = EvalInt;
-                result.value.i32 = (int)value;
-            } else {
-                result.type = EvalDouble;
-                result.value.f64 = (double)value;
-            }
-            return result;
+            return eval_integer((int64_t)(lhs_value ^ rhs_value));
         }
         case AstLogicalAnd:
         case AstLogicalOr: {
@@ -8,6 +8,7 @@
 
 typedef enum eval_result_type_enum {
     EvalInt,
+    EvalLong,
     EvalDouble,
     EvalString,
     EvalBoolean,
@@ -19,9 +20,10 @@ typedef enum eval_result_type_enum {
 typedef struct eval_result_struct {
     eval_result_type_t type;
     union eval_result_union {
-        int    i32;
-        double f64;
-        void*  ptr;
+        int     i32;
+        int64_t i64;
+        double  f64;
+        void*   ptr;
     } value;
 } eval_result_t;
 
@@ -1,7 +1,12 @@
 #include "gc.h"
+#include "intern.h"
 
 size_t gc_collected_count = 0;
 
+// Numbers the collections, an environment marked in the current one is
+// not visited again
+INTERNAL size_t gc_epoch = 0;
+
 #define OPCODE (_code->bytecode[ip+1])
 
 INTERNAL void gc_mark_env_content(env_t* _env);
@@ -21,14 +26,16 @@ INTERNAL size_t gc_total_objects(object_t* root) {
 }
 
 INTERNAL void gc_free_object(object_t* _obj) {
-    if (_obj == NULL) {
+    if (_obj == NULL || OBJECT_IS_TAGGED(_obj)) {
         return;
     }
     
     // Free type-specific resources
     switch (_obj->type) {
         case OBJECT_TYPE_STRING:
-            free(_obj->value.opaque);
+            // A weakly held atom leaves the intern table with its string
+            if (INTERN_IS_ATOM(_obj)) intern_forget(_obj);
+            str_free((str_t*)_obj->value.opaque);
             break;
         case OBJECT_TYPE_ARRAY:
             array_free((array_t*)_obj->value.opaque);
@@ -42,6 +49,10 @@ INTERNAL void gc_free_object(object_t* _obj) {
         case OBJECT_TYPE_OBJECT:
             hashmap_free((hashmap_t*)_obj->value.opaque);
             break;
+        case OBJECT_TYPE_USER_TYPE:
+            hashmap_free(((user_type_t*)_obj->value.opaque)->methods);
+            free(_obj->value.opaque);
+            break;
         case OBJECT_TYPE_PROMISE:
             free(_obj->value.opaque);
             break;
@@ -53,7 +64,8 @@ INTERNAL void gc_free_object(object_t* _obj) {
 }
 
 INTERNAL void gc_mark_object(object_t* _obj) {
-    if (_obj == NULL) {
+    // Immediate values and immortal objects are never on the heap
+    if (_obj == NULL || OBJECT_IS_TAGGED(_obj) || _obj->immortal || _obj->marked) {
         return;
     }
 
@@ -62,6 +74,14 @@ INTERNAL void gc_mark_object(object_t* _obj) {
 
     // Handle different object types
     switch (_obj->type) {
+        case OBJECT_TYPE_STRING: {
+            // A rope keeps its halves until it is flattened, a slice its
+            // parent (both NULL otherwise)
+            str_t* str = OBJECT_STRING(_obj);
+            gc_mark_object(str->left);
+            gc_mark_object(str->right);
+            break;
+        }
         case OBJECT_TYPE_ARRAY: {
             array_t* array = (array_t*)_obj->value.opaque;
             size_t length = array_length(array);
@@ -77,13 +97,13 @@ INTERNAL void gc_mark_object(object_t* _obj) {
         }
         case OBJECT_TYPE_OBJECT: {
             hashmap_t* hashmap = (hashmap_t*)_obj->value.opaque;
-            for (size_t i = 0; i < hashmap->bucket_count; i++) {
-                hashmap_node_t* node = hashmap->buckets[i];
-                while (node) {
-                    gc_mark_object(node->key);
-                    gc_mark_object(node->value);
-                    node = node->next;
-                }
+            hashmap_cursor_t cursor;
+            object_t* key;
+            object_t* value;
+            hashmap_cursor_begin(hashmap, &cursor);
+            while (hashmap_cursor_next(hashmap, &cursor, &key, &value)) {
+                gc_mark_object(key);
+                gc_mark_object(value);
             }
             break;
         }
@@ -127,35 +147,47 @@ INTERNAL void gc_mark_vm_content(vm_t* _vm) {
         gc_mark_object(_vm->evaluation_stack[i]);
     }
 
+    // Calls are parented to the program, not to their caller, so every
+    // running frame is a root of its own
+    for (size_t i = 0; i < _vm->frame_count; i++) {
+        gc_mark_env_content(_vm->frames[i].env);
+        gc_mark_object(_vm->frames[i].promise);
+    }
+    if (_vm->program_env != NULL) {
+        gc_mark_env_content(_vm->program_env);
+    }
+
     for (size_t i = 0; i < _vm->aq; i++) {
         async_t* async = _vm->queque[i];
+        gc_mark_object(async->awaited);
         gc_mark_object(async->promise);
-        gc_mark_env_content(async->env);
+        for (size_t j = 0; j < async->frame_count; j++) {
+            gc_mark_env_content(async->frames[j].env);
+        }
+        for (size_t j = 0; j < async->stack_count; j++) {
+            gc_mark_object(async->stack[j]);
+        }
     }
 }
 
 INTERNAL void gc_mark_env_content(env_t* _env) {
-    env_t* current = _env;
-    // First mark all objects in the current environment chain
-    while (current != NULL) {
-        // Get and mark all objects in the current environment
-        object_t** objects = env_get_object_list(current);
-        for (size_t i = 0; objects[i] != NULL; i++) {
-            gc_mark_object(objects[i]);
+    // Walk the parent chain iteratively and stop at the first environment
+    // this collection already marked, its parents are marked as well. Only
+    // closure environments recurse, they have no parent
+    for (env_t* current = _env; current != NULL && current->mark != gc_epoch; current = current->parent) {
+        current->mark = gc_epoch;
+        for (size_t i = 0; i < current->bucket_count; i++) {
+            for (env_node_t* node = current->buckets[i]; node != NULL; node = node->next) {
+                gc_mark_object(node->value);
+            }
+        }
+        // Mark the frame slots
+        for (size_t i = 0; i < current->local_count; i++) {
+            gc_mark_object(current->locals[i]);
+        }
+        if (current->closure != NULL) {
+            gc_mark_env_content(current->closure);
         }
-        free(objects);
-        current = current->parent;
-    }
-    
-    // Then handle parent and closure environments if they exist
-    // Note: This is recursive and could be optimized with a non-recursive approach
-    // but keeping the recursive structure as instructed
-    if (_env->parent != NULL) {
-        gc_mark_env_content(_env->parent);
-    }
-    
-    if (_env->closure != NULL) {
-        gc_mark_env_content(_env->closure);
     }
 }
 
@@ -166,7 +198,12 @@ INTERNAL void gc_sweep(vm_t* _vm, bool _free_all) {
     while (*current != NULL) {
         object_t* obj = *current;
         
-        if (!obj->marked) {
+        if (obj->immortal) {
+            // Pinned after it reached the heap (see intern_pin), it is
+            // kept but no longer swept
+            *current = obj->next;
+            obj->next = NULL;
+        } else if (!obj->marked) {
             // Object not marked, collect it
             ++gc_collected_count;
             *current = obj->next;  // Remove from linked list
@@ -188,15 +225,19 @@ INTERNAL void gc_sweep(vm_t* _vm, bool _free_all) {
         code_free(_vm->function_table_item[i]);
     }
     free(_vm->function_table_item);
+    // The pinned atoms live as long as the vm
+    intern_table_free(&_vm->intern);
 }
 
 void gc_collect_all(vm_t* _vm) {
+    ++gc_epoch;
     gc_mark_vm_content(_vm);
     gc_sweep(_vm, true);
 }
 
 void gc_collect(vm_t* _vm, env_t* _env) {
     size_t total_allocated = gc_total_objects(_vm->root);
+    ++gc_epoch;
     // mark the evaluation stack
     gc_mark_vm_content(_vm);
 
@@ -7,7 +7,10 @@
 #include "internal.h"
 #include "node.h"
 #include "opcode.h"
+#include "peephole.h"
+#include "register.h"
 #include "scope.h"
+#include "verifier.h"
 
 #ifndef GENERATOR_C
 #define GENERATOR_C
@@ -19,6 +22,9 @@ typedef struct generator_struct {
     uint8_t* bytecode;
     size_t   bsize;
     size_t   codelen;
+    // Field layout of the class being generated (NULL outside of a class)
+    char**   fields;
+    size_t   field_count;
 } generator_t;
 
 
@@ -140,6 +146,13 @@ INTERNAL void emit_int(code_t* _code, int _value) {
     }
 }
 
+INTERNAL void emit_long(code_t* _code, int64_t _value) {
+    resize(_code, 8);
+    for (size_t i = 0; i < 8; i++) {
+        _code->bytecode[_code->size++] = (uint8_t)(((uint64_t) _value >> (i * 8)) & 0xFF);
+    }
+}
+
 INTERNAL void emit_double(code_t* _code, double _value) {
     union double_bytes_t {
         double f64;
@@ -166,13 +179,8 @@ INTERNAL void emit_memory(code_t* _code, void* _value) {
 }
 
 INTERNAL void emit_string(code_t* _code, char* _value) {
-    size_t len0 = strlen(_value);
-    size_t len1 = len0 + 1;
-    resize(_code, len1);
-    for (size_t i = 0; i < len0; i++) {
-        _code->bytecode[_code->size++] = _value[i];
-    }
-    _code->bytecode[_code->size++] = 0;
+    // Strings live in the code's constant table, the bytecode only holds the index
+    emit_int(_code, code_add_constant(_code, _value));
 }
 
 INTERNAL int emit_jump(code_t* _code, opcode_t _opcode) {
@@ -213,6 +221,10 @@ INTERNAL void label(code_t* _code, int _start) {
             emit(_code, OPCODE_LOAD_INT); \
             emit_int(_code, result.value.i32); \
             break; \
+        case EvalLong: \
+            emit(_code, OPCODE_LOAD_LONG); \
+            emit_long(_code, result.value.i64); \
+            break; \
         case EvalDouble: \
             emit(_code, OPCODE_LOAD_DOUBLE); \
             emit_double(_code, result.value.f64); \
@@ -250,6 +262,171 @@ INTERNAL void label(code_t* _code, int _start) {
 INTERNAL void generator_expression(generator_t* _generator, code_t* _code, scope_t* _scope, ast_node_t* _expression);
 INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_t* _scope, ast_node_t* _statement);
 
+INTERNAL void generator_load_name(code_t* _code, scope_t* _scope, char* _name) {
+    int slot = scope_get_slot(_scope, _name);
+    if (slot >= 0) {
+        emit(_code, OPCODE_LOAD_LOCAL);
+        emit_int(_code, slot);
+        return;
+    }
+    emit(_code, OPCODE_LOAD_NAME);
+    emit_string(_code, _name);
+    if ((scope_is_function(_scope) || scope_is_async_function(_scope)) && !scope_function_has(_scope, _name)) {
+        scope_save_capture(_scope, _name);
+    }
+}
+
+INTERNAL void generator_set_name(code_t* _code, scope_t* _scope, char* _name) {
+    int slot = scope_get_slot(_scope, _name);
+    if (slot >= 0) {
+        emit(_code, OPCODE_SET_LOCAL);
+        emit_int(_code, slot);
+        return;
+    }
+    emit(_code, OPCODE_SET_NAME);
+    emit_string(_code, _name);
+}
+
+/**
+ * Collects the fields a class assigns through "this.<name> = ..." in its
+ * body, in the order they first appear.
+ *
+ * @param _generator The generator.
+ * @param _node The node to search.
+ */
+INTERNAL void generator_collect_fields(generator_t* _generator, ast_node_t* _node) {
+    if (_node == NULL) return;
+    if (_node->type == AstAssign &&
+        _node->ast0 != NULL && _node->ast0->type == AstMemberAccess &&
+        _node->ast0->ast0 != NULL && _node->ast0->ast0->type == AstThis &&
+        _node->ast0->ast1 != NULL && _node->ast0->ast1->type == AstName) {
+        char* name = _node->ast0->ast1->str0;
+        bool found = false;
+        for (size_t i = 0; i < _generator->field_count && !found; i++) {
+            found = strcmp(_generator->fields[i], name) == 0;
+        }
+        if (!found) {
+            _generator->fields = (char**) realloc(_generator->fields, sizeof(char*) * (_generator->field_count + 1));
+            ASSERTNULL(_generator->fields, "failed to allocate memory for class fields");
+            _generator->fields[_generator->field_count++] = name;
+        }
+    }
+    generator_collect_fields(_generator, _node->ast0);
+    generator_collect_fields(_generator, _node->ast1);
+    generator_collect_fields(_generator, _node->ast2);
+    generator_collect_fields(_generator, _node->ast3);
+    ast_node_list_t arrays[3] = { _node->array0, _node->array1, _node->array2 };
+    for (size_t i = 0; i < 3; i++) {
+        if (arrays[i] == NULL) continue;
+        for (size_t j = 0; arrays[i][j] != NULL; j++) {
+            generator_collect_fields(_generator, arrays[i][j]);
+        }
+    }
+}
+
+/**
+ * Gets the layout slot of a member access, only "this.<field>" inside
+ * the class that declares the field has one.
+ *
+ * @param _generator The generator.
+ * @param _object The object of the member access.
+ * @param _name The member name.
+ * @return int The slot, or -1 if the member is not in the layout.
+ */
+INTERNAL int generator_field_slot(generator_t* _generator, ast_node_t* _object, char* _name) {
+    if (_object->type != AstThis) return -1;
+    for (size_t i = 0; i < _generator->field_count; i++) {
+        if (strcmp(_generator->fields[i], _name) == 0) return (int) i;
+    }
+    return -1;
+}
+
+INTERNAL void generator_get_property(generator_t* _generator, code_t* _code, ast_node_t* _object, char* _name) {
+    int slot = generator_field_slot(_generator, _object, _name);
+    if (slot >= 0) {
+        emit(_code, OPCODE_GET_FIELD);
+        emit_string(_code, _name);
+        emit_int(_code, slot);
+        return;
+    }
+    emit(_code, OPCODE_GET_PROPERTY);
+    emit_string(_code, _name);
+}
+
+INTERNAL void generator_set_property(generator_t* _generator, code_t* _code, ast_node_t* _object, char* _name) {
+    int slot = generator_field_slot(_generator, _object, _name);
+    if (slot >= 0) {
+        emit(_code, OPCODE_SET_FIELD);
+        emit_string(_code, _name);
+        emit_int(_code, slot);
+        return;
+    }
+    emit(_code, OPCODE_SET_PROPERTY);
+    emit_string(_code, _name);
+}
+
+/**
+ * Counts the elements of an array or object literal that are not spread,
+ * the spread sources are only sized at runtime.
+ *
+ * @param _elements The elements.
+ * @return int The count.
+ */
+INTERNAL int generator_count_plain(ast_node_list_t _elements) {
+    int count = 0;
+    for (size_t i = 0; _elements[i] != NULL; i++) {
+        if (_elements[i]->type != AstUnarySpread) count++;
+    }
+    return count;
+}
+
+/**
+ * Generates the operands of a left-deep chain of additions, leftmost
+ * first. A constant part of the chain is folded into one operand.
+ *
+ * @param _generator The generator.
+ * @param _code The code.
+ * @param _scope The scope.
+ * @param _expression The expression.
+ * @return int The number of operands.
+ */
+INTERNAL int generator_add_chain(generator_t* _generator, code_t* _code, scope_t* _scope, ast_node_t* _expression) {
+    if (_expression->type != AstBinaryAdd || _expression->ast0 == NULL || _expression->ast1 == NULL ||
+        generator_is_constant_node(_expression)) {
+        generator_expression(_generator, _code, _scope, _expression);
+        return 1;
+    }
+    int count = generator_add_chain(_generator, _code, _scope, _expression->ast0);
+    generator_expression(_generator, _code, _scope, _expression->ast1);
+    return count + 1;
+}
+
+INTERNAL int generator_store_declaration(code_t* _code, scope_t* _scope, char* _name) {
+    // Globals stay in the environment so they can be resolved dynamically
+    if (scope_is_global(_scope)) {
+        emit(_code, OPCODE_STORE_NAME);
+        emit_string(_code, _name);
+        return -1;
+    }
+    int slot = scope_allocate_slot(_scope);
+    emit(_code, OPCODE_STORE_LOCAL);
+    emit_int(_code, slot);
+    return slot;
+}
+
+INTERNAL void generator_save_captures(code_t* _code, scope_t* _scope, scope_t* _function_scope) {
+    if (_function_scope->capture_count == 0) {
+        return;
+    }
+    // Emit opcode save captures
+    emit(_code, OPCODE_SAVE_CAPTURES);
+    emit_int(_code, _function_scope->capture_count);
+    for (size_t i = 0; i < _function_scope->capture_count; i++) {
+        emit_string(_code, _function_scope->captures[i]);
+        emit_int(_code, scope_get_slot(_scope, _function_scope->captures[i]));
+    }
+}
+
 INTERNAL void generator_assignment(generator_t* _generator, code_t* _code, scope_t* _scope, ast_node_t* _expression) {
     if (_expression == NULL) {
         __THROW_ERROR(
@@ -272,14 +449,12 @@ INTERNAL void generator_assignment(generator_t* _generator, code_t* _code, scope
     switch (lhs->type) {
         case AstName:
             generator_expression(_generator, _code, _scope, rhs);
-            emit(_code, OPCODE_SET_NAME);
-            emit_string(_code, lhs->str0);
+            generator_set_name(_code, _scope, lhs->str0);
             break;
         case AstMemberAccess:
             generator_expression(_generator, _code, _scope, rhs); // value
             generator_expression(_generator, _code, _scope, lhs->ast0); //object
-            emit(_code, OPCODE_SET_PROPERTY);
-            emit_string(_code, lhs->ast1->str0);
+            generator_set_property(_generator, _code, lhs->ast0, lhs->ast1->str0);
             break;
         default:
             __THROW_ERROR(
@@ -291,6 +466,21 @@ INTERNAL void generator_assignment(generator_t* _generator, code_t* _code, scope
     }
 }
 
+/**
+ * Emits the instructions that duplicate the two values on top of the
+ * stack (a b -> a b a b).
+ *
+ * @param _code The code.
+ */
+INTERNAL void generator_dup2(code_t* _code) {
+    emit(_code, OPCODE_ROT2);   // b a
+    emit(_code, OPCODE_DUPTOP); // b a a
+    emit(_code, OPCODE_ROT3);   // a a b
+    emit(_code, OPCODE_DUPTOP); // a a b b
+    emit(_code, OPCODE_ROT3);   // a b b a
+    emit(_code, OPCODE_ROT2);   // a b a b
+}
+
 INTERNAL void generator_assignment0(generator_t* _generator, code_t* _code, scope_t* _scope, ast_node_t* _expression, bool _is_postfix) {
     if (_expression == NULL) {
         __THROW_ERROR(
@@ -310,11 +500,7 @@ INTERNAL void generator_assignment0(generator_t* _generator, code_t* _code, scop
     }
     switch (_expression->type) {
         case AstName:
-            emit(_code, OPCODE_LOAD_NAME);
-            emit_string(_code, _expression->str0);
-            if ((scope_is_function(_scope) || scope_is_async_function(_scope)) && !scope_function_has(_scope, _expression->str0)) {
-                scope_save_capture(_scope, _expression->str0);
-            }
+            generator_load_name(_code, _scope, _expression->str0);
             if (_is_postfix) emit(_code, OPCODE_DUPTOP);
             break;
         case AstMemberAccess: {
@@ -352,9 +538,11 @@ INTERNAL void generator_assignment0(generator_t* _generator, code_t* _code, scop
                     "member access must be a name"
                 );
             }
+            // The object is evaluated once, a copy stays below the value for
+            // the store in generator_assignment1
             generator_expression(_generator, _code, _scope, obj);
-            emit(_code, OPCODE_GET_PROPERTY);
-            emit_string(_code, mem->str0);
+            emit(_code, OPCODE_DUPTOP);
+            generator_get_property(_generator, _code, obj, mem->str0);
             if (_is_postfix) emit(_code, OPCODE_DUPTOP);
             break;
         }
@@ -393,8 +581,11 @@ INTERNAL void generator_assignment0(generator_t* _generator, code_t* _code, scop
                     "index must have an index"
                 );
             }
+            // The object and the index are evaluated once, a copy of both
+            // stays below the value for the store in generator_assignment1
             generator_expression(_generator, _code, _scope, obj);
             generator_expression(_generator, _code, _scope, idx);
+            generator_dup2(_code);
             emit(_code, OPCODE_INDEX);
             if (_is_postfix) emit(_code, OPCODE_DUPTOP);
             break;
@@ -461,11 +652,7 @@ INTERNAL void generator_assignment1(generator_t* _generator, code_t* _code, scop
                     "constant variable %s cannot be re-assigned", _expression->str0
                 );
             }
-            emit(_code, OPCODE_SET_NAME);
-            emit_string(
-                _code,
-                _expression->str0
-            );
+            generator_set_name(_code, _scope, _expression->str0);
             if (_is_postfix) emit(_code, OPCODE_POPTOP);
             break;
         case AstMemberAccess: {
@@ -503,10 +690,9 @@ INTERNAL void generator_assignment1(generator_t* _generator, code_t* _code, scop
                     "member access must be a name"
                 );
             }
-            if (_is_postfix) emit(_code, OPCODE_ROT3);
-            generator_expression(_generator, _code, _scope, obj);
-            emit(_code, OPCODE_SET_PROPERTY);
-            emit_string(_code, mem->str0);
+            // object value -> value object (postfix: object old new -> old new object)
+            emit(_code, _is_postfix ? OPCODE_ROT3 : OPCODE_ROT2);
+            generator_set_property(_generator, _code, obj, mem->str0);
             if (_is_postfix) emit(_code, OPCODE_POPTOP);
             break;
         }
@@ -545,9 +731,11 @@ INTERNAL void generator_assignment1(generator_t* _generator, code_t* _code, scop
                     "index must have an index"
                 );
             }
-            if (_is_postfix) emit(_code, OPCODE_ROT3);
-            generator_expression(_generator, _code, _scope, obj); // object
-            generator_expression(_generator, _code, _scope, idx); // index
+            // object index value -> value object index (postfix: object index
+            // old new -> old new object index)
+            opcode_t rotate = _is_postfix ? OPCODE_ROT4 : OPCODE_ROT3;
+            emit(_code, rotate);
+            emit(_code, rotate);
             emit(_code, OPCODE_SET_INDEX);
             if (_is_postfix) emit(_code, OPCODE_POPTOP);
             break;
@@ -624,12 +812,13 @@ INTERNAL void generator_function(generator_t* _generator, code_t* _code, scope_t
             .name      = param->str0,
             .is_const  = false,
             .is_global = true,
+            .slot      = scope_allocate_slot(local_scope),
             .position  = param->position
         };
         scope_put(local_scope, param->str0, symbol);
-        // Emit the store name opcode
-        emit(_func, OPCODE_STORE_NAME);
-        emit_string(_func, param->str0);
+        // Emit the store local opcode
+        emit(_func, OPCODE_STORE_LOCAL);
+        emit_int(_func, symbol.slot);
     }
     // Compile body
     bool has_visible_return = false;
@@ -646,15 +835,12 @@ INTERNAL void generator_function(generator_t* _generator, code_t* _code, scope_t
         emit(_func, OPCODE_LOAD_NULL);
         emit(_func, OPCODE_RETURN);
     }
+    _func->local_count = function_scope->local_count;
+#if VM_USE_REGISTER_TIER
+    _func->register_code = register_compile(_func, params, body);
+#endif
     // Save captures
-    if (function_scope->capture_count > 0) {
-        // Emit opcode save captures
-        emit(_code, OPCODE_SAVE_CAPTURES);
-        emit_int(_code, function_scope->capture_count);
-        for (size_t i = 0; i < function_scope->capture_count; i++) {
-            emit_string(_code, function_scope->captures[i]);
-        }
-    }
+    generator_save_captures(_code, _scope, function_scope);
     // Free the function scope
     scope_free(local_scope);
     scope_free(function_scope);
@@ -679,11 +865,7 @@ INTERNAL void generator_expression(generator_t* _generator, code_t* _code, scope
     }
     switch (_expression->type) {
         case AstName:
-            emit(_code, OPCODE_LOAD_NAME);
-            emit_string(_code, _expression->str0);
-            if ((scope_is_function(_scope) || scope_is_async_function(_scope)) && !scope_function_has(_scope, _expression->str0)) {
-                scope_save_capture(_scope, _expression->str0);
-            }
+            generator_load_name(_code, _scope, _expression->str0);
             break;
         case AstInt:
         case AstFloat:
@@ -691,9 +873,12 @@ INTERNAL void generator_expression(generator_t* _generator, code_t* _code, scope
             emit_int(_code, (int) _expression->value.i32);
             break;
         case AstLong:
+            emit(_code, OPCODE_LOAD_LONG);
+            emit_long(_code, (int64_t) _expression->value.i64);
+            break;
         case AstDouble:
             emit(_code, OPCODE_LOAD_DOUBLE);
-            emit_double(_code, (double) _expression->value.i64);
+            emit_double(_code, _expression->value.f64);
             break;
         case AstString:
             if (_expression->str0 == NULL) {
@@ -758,9 +943,9 @@ INTERNAL void generator_expression(generator_t* _generator, code_t* _code, scope
                 emit(_code, OPCODE_LOAD_ARRAY);
                 emit_int(_code, count);
             } else {
-                // Dynamic array with possible spread
-                emit(_code, OPCODE_LOAD_ARRAY);
-                emit_int(_code, 0); // Start from empty array
+                // Dynamic array with possible spread, sized for the plain elements
+                emit(_code, OPCODE_NEW_ARRAY);
+                emit_int(_code, generator_count_plain(elements));
 
                 for (i = 0; i < count; i++) {
                     ast_node_t* element = elements[i];
@@ -841,9 +1026,9 @@ INTERNAL void generator_expression(generator_t* _generator, code_t* _code, scope
                 emit(_code, OPCODE_LOAD_OBJECT);
                 emit_int(_code, count);
             } else {
-                // Dynamic object with possible spread
-                emit(_code, OPCODE_LOAD_OBJECT);
-                emit_int(_code, 0); // Start from empty object
+                // Dynamic object with possible spread, sized for the plain properties
+                emit(_code, OPCODE_NEW_OBJECT);
+                emit_int(_code, generator_count_plain(properties));
 
                 for (i = 0; i < count; i++) {
                     ast_node_t* property = properties[i];
@@ -930,8 +1115,7 @@ INTERNAL void generator_expression(generator_t* _generator, code_t* _code, scope
                 );
             }
             generator_expression(_generator, _code, _scope, obj);
-            emit(_code, OPCODE_GET_PROPERTY);
-            emit_string(_code, member->str0);
+            generator_get_property(_generator, _code, obj, member->str0);
             break;
         }
         case AstIndex: {
@@ -1285,19 +1469,25 @@ INTERNAL void generator_expression(generator_t* _generator, code_t* _code, scope
                 FOLD_CONSTANT_EXPRESSION(_expression);
                 return;
             }
-            generator_expression(
+            // a + b + c + ... is built in one step instead of one add each
+            int count = generator_add_chain(
                 _generator,
                 _code,
                 _scope,
                 _expression->ast0
-            );
+            ) + 1;
             generator_expression(
                 _generator,
                 _code,
                 _scope,
                 _expression->ast1
             );
-            emit(_code, OPCODE_ADD);
+            if (count == 2) {
+                emit(_code, OPCODE_ADD);
+            } else {
+                emit(_code, OPCODE_CONCAT_N);
+                emit_int(_code, count);
+            }
             break;
         }
         case AstBinarySub: {
@@ -2029,14 +2219,25 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
                 }
 
                 // Store value
-                emit(_code, OPCODE_STORE_NAME);
-                emit_string(_code, name->str0);
+                int slot = generator_store_declaration(_code, _scope, name->str0);
+
+                // A function stored in a slot can only see itself through its captures
+                if (slot >= 0 && value && value->type == AstFunctionExpression) {
+                    emit(_code, OPCODE_LOAD_LOCAL);
+                    emit_int(_code, slot);
+                    emit(_code, OPCODE_SAVE_CAPTURES);
+                    emit_int(_code, 1);
+                    emit_string(_code, name->str0);
+                    emit_int(_code, slot);
+                    emit(_code, OPCODE_POPTOP);
+                }
 
                 // Add to scope
                 scope_value_t symbol = {
                     .name      = name->str0,
                     .is_const  = (_statement->type == AstConstStatement),
                     .is_global = scope_is_global(_scope),
+                    .slot      = slot,
                     .position  = name->position
                 };
                 scope_put(_scope, name->str0, symbol);
@@ -2350,8 +2551,9 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
             if (initializer->type == AstName) {
                 emit(_code, OPCODE_GET_NEXT_VALUE);
 
-                emit(_code, OPCODE_STORE_NAME);
-                emit_string(_code, initializer->str0);
+                int slot = scope_allocate_slot(for_scope);
+                emit(_code, OPCODE_STORE_LOCAL);
+                emit_int(_code, slot);
 
                 if (scope_has(for_scope, initializer->str0, false)) {
                     __THROW_ERROR(
@@ -2366,6 +2568,7 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
                     .name      = initializer->str0,
                     .is_const  = true,
                     .is_global = true,
+                    .slot      = slot,
                     .position  = initializer->position
                 };
                 scope_put(for_scope, initializer->str0, symbol);
@@ -2398,12 +2601,14 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
                     );
                 }
                 // For Key
-                emit(_code, OPCODE_STORE_NAME);
-                emit_string(_code, init_l->str0);
+                int slot0 = scope_allocate_slot(for_scope);
+                emit(_code, OPCODE_STORE_LOCAL);
+                emit_int(_code, slot0);
 
                 // For Value
-                emit(_code, OPCODE_STORE_NAME);
-                emit_string(_code, init_r->str0); // init_r->str0
+                int slot1 = scope_allocate_slot(for_scope);
+                emit(_code, OPCODE_STORE_LOCAL);
+                emit_int(_code, slot1);
 
                 // Check if the symbol is already defined
                 if (scope_has(for_scope, init_l->str0, false)) {
@@ -2419,6 +2624,7 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
                     .name      = init_l->str0,
                     .is_const  = true,
                     .is_global = true,
+                    .slot      = slot0,
                     .position  = init_l->position
                 };
                 scope_put(for_scope, init_l->str0, symbol0);
@@ -2436,6 +2642,7 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
                     .name      = init_r->str0,
                     .is_const  = true,
                     .is_global = true,
+                    .slot      = slot1,
                     .position  = init_r->position
                 };
                 scope_put(for_scope, init_r->str0, symbol1);
@@ -2506,7 +2713,7 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
             break;
         }
         case AstReturnStatement: {
-            bool is_func = false, is_async, is_catch = false;
+            bool is_func = false, is_async = false, is_catch = false;
             if (!(is_func = scope_is_function(_scope)) && !(is_func = is_async = scope_is_async_function(_scope)) && !(is_catch = scope_is_catch(_scope))) {
                 __THROW_ERROR(
                     _generator->fpath,
@@ -2597,6 +2804,16 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
                 0
             );
 
+            // Fields assigned through "this" in the body make up the layout,
+            // an enclosing class keeps its own (restored below)
+            char** outer_fields = _generator->fields;
+            size_t outer_field_count = _generator->field_count;
+            _generator->fields = NULL;
+            _generator->field_count = 0;
+            for (size_t i = 0; body[i] != NULL; i++) {
+                generator_collect_fields(_generator, body[i]);
+            }
+
             // Emit the setup class opcode
             emit(_code, OPCODE_SETUP_CLASS);
             // Emit the begin class opcode
@@ -2650,6 +2867,7 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
                         .name      = name->str0,
                         .is_const  = false,
                         .is_global = true,
+                        .slot      = -1,
                         .position  = name->position
                     };
                     scope_put(local_scope, name->str0, symbol);
@@ -2719,6 +2937,7 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
                             .name      = name->str0,
                             .is_const  = statement->type == AstConstStatement,
                             .is_global = true,
+                            .slot      = -1,
                             .position  = name->position
                         };
                         scope_put(local_scope, name->str0, symbol);
@@ -2744,6 +2963,16 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
                 generator_expression(_generator, _code, _scope, super);
                 emit(_code, OPCODE_EXTEND_CLASS);
             }
+            if (_generator->field_count > 0) {
+                emit(_code, OPCODE_LAYOUT_CLASS);
+                emit_int(_code, (int) _generator->field_count);
+                for (size_t i = 0; i < _generator->field_count; i++) {
+                    emit_string(_code, _generator->fields[i]);
+                }
+            }
+            free(_generator->fields);
+            _generator->fields = outer_fields;
+            _generator->field_count = outer_field_count;
             // Emit the pop top opcode
             emit(_code, OPCODE_POPTOP);
             // Free the class scope
@@ -2842,12 +3071,13 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
                     .name      = param->str0,
                     .is_const  = false,
                     .is_global = true,
+                    .slot      = scope_allocate_slot(local_scope),
                     .position  = param->position
                 };
                 scope_put(local_scope, param->str0, symbol);
-                // Emit the store name opcode
-                emit(_func, OPCODE_STORE_NAME);
-                emit_string(_func, param->str0);
+                // Emit the store local opcode
+                emit(_func, OPCODE_STORE_LOCAL);
+                emit_int(_func, symbol.slot);
             }
             // Compile body
             bool has_visible_return = false;
@@ -2864,23 +3094,21 @@ INTERNAL void generator_statement(generator_t* _generator, code_t* _code, scope_
                 emit(_func, OPCODE_LOAD_NULL);
                 emit(_func, OPCODE_RETURN);
             }
+            _func->local_count = function_scope->local_count;
+#if VM_USE_REGISTER_TIER
+            _func->register_code = register_compile(_func, params, body);
+#endif
             // Save into symbol table
             scope_value_t symbol = {
                 .name      = name->str0,
                 .is_const  = false,
                 .is_global = true,
+                .slot      = -1,
                 .position  = name->position
             };
             scope_put(_scope, name->str0, symbol);
             // Save captures
-            if (function_scope->capture_count > 0) {
-                // Emit opcode save captures
-                emit(_code, OPCODE_SAVE_CAPTURES);
-                emit_int(_code, function_scope->capture_count);
-                for (size_t i = 0; i < function_scope->capture_count; i++) {
-                    emit_string(_code, function_scope->captures[i]);
-                }
-            }
+            generator_save_captures(_code, _scope, function_scope);
             // Emit the store name opcode
             emit(_code, OPCODE_STORE_NAME);
             emit_string(_code, name->str0);
@@ -2932,6 +3160,13 @@ INTERNAL code_t* generator_program(generator_t* _generator, ast_node_t* _program
     // write the bytecode to the file
     emit(_block, OPCODE_LOAD_NULL);
     emit(_block, OPCODE_RETURN);
+    _block->local_count = scope->local_count;
+    peephole_optimize(_block);
+    // Verified once here, this also records the stack depth of every code
+    char* message = NULL;
+    if (!verifier_verify(_block, &message)) {
+        PD("invalid bytecode: %s", message);
+    }
     // Free the scope
     scope_free(scope);
     ast_node_free_all(_program);
@@ -2947,6 +3182,8 @@ DLLEXPORT generator_t* generator_new(char* _fpath, char* _fdata) {
     generator->fdata = string_allocate(_fdata);
     generator->fsize = strlen(_fdata);
     generator->bsize = 0;
+    generator->fields = NULL;
+    generator->field_count = 0;
     generator->bytecode = (uint8_t*) malloc(sizeof(uint8_t) * 1);
     ASSERTNULL(generator->bytecode, "failed to allocate memory for bytecode");
     // Return instance
@@ -2958,6 +3195,7 @@ DLLEXPORT code_t* generator_generate(generator_t* _generator, ast_node_t* _progr
 }
 
 DLLEXPORT void generator_free(generator_t* _generator) {
+    free(_generator->fields);
     free(_generator->fpath);
     free(_generator->fdata);
     free(_generator);
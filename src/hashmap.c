@@ -1,176 +1,469 @@
 #include "hashmap.h"
+#include "intern.h"
+#include "object.h"
+#include "type.h"
 
-#define ENV_BUCKET_COUNT 16
-#define LOAD_FACTOR_THRESHOLD 0.75
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define HASHMAP_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+    #define HASHMAP_NEON 1
+#endif
+
+// Smallest entry array of a dictionary mode map
+#define MIN_ENTRY_CAPACITY 8
+
+// Tables stay at most 7/8 full, so every probe ends at an empty slot
+#define MAX_LOAD(capacity) (((capacity) / 8) * 7)
 
 hashmap_t* hashmap_new() {
     hashmap_t* hashmap = malloc(sizeof(hashmap_t));
     ASSERTNULL(hashmap, "error allocating hashmap");
-    hashmap->buckets = calloc(ENV_BUCKET_COUNT, sizeof(hashmap_node_t*));
-    ASSERTNULL(hashmap->buckets, "error allocating buckets");
-    hashmap->bucket_count = ENV_BUCKET_COUNT;
+    hashmap->shape = shape_root();
+    hashmap->slots = NULL;
+    hashmap->slot_capacity = 0;
+    hashmap->controls = NULL;
+    hashmap->indices = NULL;
+    hashmap->table_capacity = 0;
+    hashmap->entries = NULL;
+    hashmap->entry_capacity = 0;
     hashmap->size = 0;
     return hashmap;
 }
 
 void hashmap_free(hashmap_t* _hashmap) {
     if (!_hashmap) return;
+    free(_hashmap->slots);
+    free(_hashmap->controls);
+    free(_hashmap->indices);
+    free(_hashmap->entries);
+    free(_hashmap);
+}
+
+/**
+ * Spreads the bits of a hash, object_hash of small ints and hash64 of
+ * short strings only differ in their low bits.
+ *
+ * @param _hash The hash.
+ * @return size_t The mixed hash.
+ */
+INTERNAL size_t hashmap_mix(size_t _hash) {
+    uint64_t hash = (uint64_t)_hash;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return (size_t)hash;
+}
+
+/**
+ * Matches a byte against a group of control bytes.
+ *
+ * @param _group The first control byte of the group.
+ * @param _byte The byte.
+ * @return uint32_t Bit i is set if control byte i is equal to the byte.
+ */
+INTERNAL uint32_t hashmap_group_match(uint8_t* _group, uint8_t _byte) {
+#if HASHMAP_SSE2
+    __m128i group = _mm_loadu_si128((const __m128i*)_group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)_byte)));
+#elif HASHMAP_NEON
+    static const uint8_t bits[HASHMAP_GROUP_WIDTH] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+    };
+    uint8x16_t match = vandq_u8(vceqq_u8(vld1q_u8(_group), vdupq_n_u8(_byte)), vld1q_u8(bits));
+    return (uint32_t)vaddv_u8(vget_low_u8(match)) | ((uint32_t)vaddv_u8(vget_high_u8(match)) << 8);
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < HASHMAP_GROUP_WIDTH; i++) {
+        mask |= (uint32_t)(_group[i] == _byte) << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * Gets the index of the lowest set bit of a non-zero match.
+ *
+ * @param _match The match.
+ * @return size_t The index.
+ */
+INTERNAL size_t hashmap_match_first(uint32_t _match) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_ctz(_match);
+#else
+    size_t index = 0;
+    while (!(_match & 1)) {
+        _match >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
 
-    // Free all nodes in each bucket
-    for (size_t i = 0; i < _hashmap->bucket_count; i++) {
-        hashmap_node_t* node = _hashmap->buckets[i];
-        while (node) {
-            hashmap_node_t* next = node->next;
-            free(node);
-            node = next;
+/**
+ * Gets the table capacity that holds a number of entries under the
+ * maximum load.
+ *
+ * @param _count The number of entries.
+ * @return size_t The capacity.
+ */
+INTERNAL size_t hashmap_table_capacity(size_t _count) {
+    size_t capacity = HASHMAP_GROUP_WIDTH;
+    while (MAX_LOAD(capacity) < _count) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/**
+ * Puts an entry index in the first empty table slot of a hash's probe
+ * sequence. Groups are probed in triangular steps, which visits every
+ * group of a power of two table.
+ *
+ * @param _hashmap The hashmap (dictionary mode).
+ * @param _hash The hash of the entry's key.
+ * @param _index The entry index.
+ */
+INTERNAL void hashmap_table_place(hashmap_t* _hashmap, size_t _hash, size_t _index) {
+    size_t mixed = hashmap_mix(_hash);
+    size_t group_mask = (_hashmap->table_capacity / HASHMAP_GROUP_WIDTH) - 1;
+    size_t group = (mixed >> 7) & group_mask;
+    for (size_t step = 1;; step++) {
+        uint8_t* controls = &_hashmap->controls[group * HASHMAP_GROUP_WIDTH];
+        uint32_t empty = hashmap_group_match(controls, HASHMAP_EMPTY);
+        if (empty != 0) {
+            size_t slot = hashmap_match_first(empty);
+            controls[slot] = (uint8_t)(mixed & 0x7F);
+            _hashmap->indices[group * HASHMAP_GROUP_WIDTH + slot] = (uint32_t)_index;
+            return;
         }
+        group = (group + step) & group_mask;
     }
+}
 
-    free(_hashmap->buckets);
-    free(_hashmap);
+/**
+ * Rebuilds the table of a dictionary mode hashmap at a new capacity.
+ *
+ * @param _hashmap The hashmap (dictionary mode).
+ * @param _capacity The table capacity, a power of two.
+ */
+INTERNAL void hashmap_table_resize(hashmap_t* _hashmap, size_t _capacity) {
+    free(_hashmap->controls);
+    free(_hashmap->indices);
+    _hashmap->controls = malloc(sizeof(uint8_t) * _capacity);
+    _hashmap->indices = malloc(sizeof(uint32_t) * _capacity);
+    ASSERTNULL(_hashmap->controls, "error allocating hashmap table");
+    ASSERTNULL(_hashmap->indices, "error allocating hashmap table");
+    memset(_hashmap->controls, HASHMAP_EMPTY, _capacity);
+    _hashmap->table_capacity = _capacity;
+
+    for (size_t i = 0; i < _hashmap->size; i++) {
+        hashmap_table_place(_hashmap, _hashmap->entries[i].hash, i);
+    }
 }
 
-INTERNAL void hashmap_rehash(hashmap_t* _hashmap) {
-    size_t new_bucket_count = _hashmap->bucket_count * 2;
-    hashmap_node_t** new_buckets = calloc(new_bucket_count, sizeof(hashmap_node_t*));
-    ASSERTNULL(new_buckets, "error allocating buckets");
+/**
+ * Grows the entries and the table of a dictionary mode hashmap to hold a
+ * number of entries.
+ *
+ * @param _hashmap The hashmap (dictionary mode).
+ * @param _count The number of entries.
+ */
+INTERNAL void hashmap_table_reserve(hashmap_t* _hashmap, size_t _count) {
+    if (_count > _hashmap->entry_capacity) {
+        size_t capacity = (_hashmap->entry_capacity == 0) ? MIN_ENTRY_CAPACITY : _hashmap->entry_capacity;
+        while (capacity < _count) {
+            capacity *= 2;
+        }
+        hashmap_entry_t* entries = realloc(_hashmap->entries, sizeof(hashmap_entry_t) * capacity);
+        ASSERTNULL(entries, "error allocating hashmap entries");
+        _hashmap->entries = entries;
+        _hashmap->entry_capacity = capacity;
+    }
+    if (_hashmap->table_capacity == 0 || _count > MAX_LOAD(_hashmap->table_capacity)) {
+        hashmap_table_resize(_hashmap, hashmap_table_capacity(_count));
+    }
+}
 
-    for (size_t i = 0; i < _hashmap->bucket_count; i++) {
-        hashmap_node_t* node = _hashmap->buckets[i];
-        while (node) {
-            hashmap_node_t* next = node->next;
-            size_t index = object_hash(node->key) % new_bucket_count;
-            node->next = new_buckets[index];
-            new_buckets[index] = node;
-            node = next;
+/**
+ * Finds the entry of a key in a dictionary mode hashmap. String keys are
+ * always atoms, so they are matched by pointer.
+ *
+ * @param _hashmap The hashmap (dictionary mode).
+ * @param _key The key, an atom if it is a string.
+ * @param _hash The hash of the key.
+ * @return hashmap_entry_t* The entry, or NULL if the hashmap has no such key.
+ */
+INTERNAL hashmap_entry_t* hashmap_find(hashmap_t* _hashmap, object_t* _key, size_t _hash) {
+    size_t mixed = hashmap_mix(_hash);
+    size_t group_mask = (_hashmap->table_capacity / HASHMAP_GROUP_WIDTH) - 1;
+    size_t group = (mixed >> 7) & group_mask;
+    for (size_t step = 1;; step++) {
+        uint8_t* controls = &_hashmap->controls[group * HASHMAP_GROUP_WIDTH];
+        uint32_t match = hashmap_group_match(controls, (uint8_t)(mixed & 0x7F));
+        while (match != 0) {
+            size_t slot = hashmap_match_first(match);
+            hashmap_entry_t* entry = &_hashmap->entries[_hashmap->indices[group * HASHMAP_GROUP_WIDTH + slot]];
+            if (entry->key == _key || (entry->hash == _hash && !OBJECT_TYPE_STRING(_key) && object_equals(entry->key, _key))) {
+                return entry;
+            }
+            match &= match - 1;
         }
+        // An empty slot ends the probe sequence, nothing is ever removed
+        if (hashmap_group_match(controls, HASHMAP_EMPTY) != 0) {
+            return NULL;
+        }
+        group = (group + step) & group_mask;
     }
+}
 
-    free(_hashmap->buckets);
-    _hashmap->buckets = new_buckets;
-    _hashmap->bucket_count = new_bucket_count;
+/**
+ * Adds a key that is known to be absent to the entries.
+ *
+ * @param _hashmap The hashmap (dictionary mode).
+ * @param _key The key.
+ * @param _hash The hash of the key.
+ * @param _value The value.
+ */
+INTERNAL void hashmap_insert_entry(hashmap_t* _hashmap, object_t* _key, size_t _hash, object_t* _value) {
+    if (_hashmap->size >= _hashmap->entry_capacity || _hashmap->size + 1 > MAX_LOAD(_hashmap->table_capacity)) {
+        hashmap_table_reserve(_hashmap, (_hashmap->size + 1) * 2);
+    }
+    hashmap_entry_t* entry = &_hashmap->entries[_hashmap->size];
+    entry->key = _key;
+    entry->value = _value;
+    entry->hash = _hash;
+    hashmap_table_place(_hashmap, _hash, _hashmap->size);
+    _hashmap->size++;
 }
 
-bool hashmap_has(hashmap_t* _hashmap, object_t* _key) {
+/**
+ * Moves a shape mode hashmap to dictionary mode, keeping its entries.
+ *
+ * @param _hashmap The hashmap.
+ * @param _capacity The number of entries to make room for.
+ */
+INTERNAL void hashmap_to_dictionary(hashmap_t* _hashmap, size_t _capacity) {
+    shape_t* shape = _hashmap->shape;
+    object_t** slots = _hashmap->slots;
+
+    _hashmap->shape = NULL;
+    _hashmap->slots = NULL;
+    _hashmap->slot_capacity = 0;
+    _hashmap->size = 0;
+    hashmap_table_reserve(_hashmap, (_capacity > shape->count) ? _capacity : shape->count);
+
+    for (size_t i = 0; i < shape->count; i++) {
+        hashmap_insert_entry(_hashmap, shape->keys[i], shape->hashes[i], slots[i]);
+    }
+    free(slots);
+}
+
+hashmap_t* hashmap_new_sized(size_t _capacity) {
+    hashmap_t* hashmap = hashmap_new();
+    if (_capacity > SHAPE_MAX_PROPERTIES) {
+        hashmap_to_dictionary(hashmap, _capacity);
+    } else {
+        hashmap_reserve(hashmap, _capacity);
+    }
+    return hashmap;
+}
+
+/**
+ * Puts a value under a string key while in shape mode, moving to the
+ * next shape when the key is new.
+ *
+ * @param _hashmap The hashmap (shape mode).
+ * @param _key The key (an atom).
+ * @param _value The value.
+ * @return bool False if the map has to move to dictionary mode first.
+ */
+INTERNAL bool hashmap_put_slot(hashmap_t* _hashmap, object_t* _key, object_t* _value) {
+    long slot = shape_lookup(_hashmap->shape, _key);
+    if (slot >= 0) {
+        _hashmap->slots[slot] = _value;
+        return true;
+    }
+    if (_hashmap->shape->count >= SHAPE_MAX_PROPERTIES) {
+        return false;
+    }
+    hashmap_append(_hashmap, shape_transition(_hashmap->shape, _key), _value);
+    return true;
+}
+
+void hashmap_append(hashmap_t* _hashmap, shape_t* _shape, object_t* _value) {
+    if (_hashmap->size >= _hashmap->slot_capacity) {
+        size_t capacity = _hashmap->slot_capacity == 0 ? 4 : _hashmap->slot_capacity * 2;
+        object_t** slots = realloc(_hashmap->slots, sizeof(object_t*) * capacity);
+        ASSERTNULL(slots, "error allocating slots");
+        _hashmap->slots = slots;
+        _hashmap->slot_capacity = capacity;
+    }
+    _hashmap->shape = _shape;
+    _hashmap->slots[_hashmap->size++] = _value;
+}
+
+void hashmap_reserve(hashmap_t* _hashmap, size_t _capacity) {
     ASSERTNULL(_hashmap, "hashmap is null");
-    ASSERTNULL(_key, "key is null");
-    
-    size_t hash = object_hash(_key);
-    hashmap_node_t* node = _hashmap->buckets[hash % _hashmap->bucket_count];
-    while (node) {
-        if (object_equals(node->key, _key)) return true;
-        node = node->next;
+    if (_hashmap->shape == NULL) {
+        hashmap_table_reserve(_hashmap, _capacity);
+        return;
     }
-    return false;
+    if (_capacity > SHAPE_MAX_PROPERTIES) _capacity = SHAPE_MAX_PROPERTIES;
+    if (_capacity <= _hashmap->slot_capacity) return;
+    object_t** slots = realloc(_hashmap->slots, sizeof(object_t*) * _capacity);
+    ASSERTNULL(slots, "error allocating slots");
+    _hashmap->slots = slots;
+    _hashmap->slot_capacity = _capacity;
+}
+
+bool hashmap_has(hashmap_t* _hashmap, object_t* _key) {
+    return hashmap_get(_hashmap, _key) != NULL;
 }
 
 bool hashmap_has_string(hashmap_t* _hashmap, char* _key) {
+    return hashmap_get_string(_hashmap, _key) != NULL;
+}
+
+void hashmap_put(hashmap_t* _hashmap, object_t* _key, object_t* _value) {
     ASSERTNULL(_hashmap, "hashmap is null");
     ASSERTNULL(_key, "key is null");
+    ASSERTNULL(_value, "value is null");
 
-    size_t hash = hash64(_key);
-    hashmap_node_t* node = _hashmap->buckets[hash % _hashmap->bucket_count];
-    while (node) {
-        if (strcmp(object_to_string(node->key), _key) == 0) return true;
-        node = node->next;
+    if (OBJECT_TYPE_STRING(_key)) {
+        hashmap_put_atom(_hashmap, intern_object(_key), _value);
+        return;
     }
-    return false;
+
+    if (_hashmap->shape != NULL) {
+        hashmap_to_dictionary(_hashmap, _hashmap->size + 1);
+    }
+
+    size_t hash = object_hash(_key);
+    hashmap_entry_t* entry = hashmap_find(_hashmap, _key, hash);
+    if (entry != NULL) {
+        entry->value = _value;
+        return;
+    }
+    hashmap_insert_entry(_hashmap, _key, hash, _value);
 }
 
-void hashmap_put(hashmap_t* _hashmap, object_t* _key, object_t* _value) {
+void hashmap_put_string(hashmap_t* _hashmap, char* _key, object_t* _value) {
+    ASSERTNULL(_key, "key is null");
+    hashmap_put_atom(_hashmap, intern_string(_key), _value);
+}
+
+void hashmap_put_atom(hashmap_t* _hashmap, object_t* _key, object_t* _value) {
     ASSERTNULL(_hashmap, "hashmap is null");
     ASSERTNULL(_key, "key is null");
     ASSERTNULL(_value, "value is null");
 
-    size_t hash = object_hash(_key);
-    size_t index = hash % _hashmap->bucket_count;
-    hashmap_node_t* node = _hashmap->buckets[index];
-
-    // Check for existing entry
-    while (node) {
-        if (object_equals(node->key, _key)) {
-            node->value = _value;
-            return;
-        }
-        node = node->next;
+    if (_hashmap->shape != NULL) {
+        if (hashmap_put_slot(_hashmap, _key, _value)) return;
+        hashmap_to_dictionary(_hashmap, _hashmap->size + 1);
     }
 
-    // Create new node and insert at head of chain
-    node = malloc(sizeof(hashmap_node_t));
-    ASSERTNULL(node, "error allocating hashmap node");
-    node->key = _key;
-    node->value = _value;
-    node->next = _hashmap->buckets[index];
-    _hashmap->buckets[index] = node;
-    _hashmap->size++;
-
-    // Check load factor and rehash if needed
-    if (_hashmap->size > _hashmap->bucket_count * LOAD_FACTOR_THRESHOLD) {
-        hashmap_rehash(_hashmap);
+    size_t hash = OBJECT_STRING(_key)->hash;
+    hashmap_entry_t* entry = hashmap_find(_hashmap, _key, hash);
+    if (entry != NULL) {
+        entry->value = _value;
+        return;
     }
+    hashmap_insert_entry(_hashmap, _key, hash, _value);
 }
 
 object_t* hashmap_get(hashmap_t* _hashmap, object_t* _key) {
     ASSERTNULL(_hashmap, "hashmap is null");
     ASSERTNULL(_key, "key is null");
 
-    size_t hash = object_hash(_key);
-    hashmap_node_t* node = _hashmap->buckets[hash % _hashmap->bucket_count];
-    while (node) {
-        if (object_equals(node->key, _key)) {
-            return node->value;
+    if (OBJECT_TYPE_STRING(_key)) {
+        // No atom means no map has the key
+        if (!INTERN_IS_ATOM(_key)) {
+            str_t* key = OBJECT_STRING(_key);
+            _key = intern_find(STR_BYTES(key), key->length, str_hash(key));
+            if (_key == NULL) return NULL;
         }
-        node = node->next;
+        return hashmap_get_atom(_hashmap, _key);
+    }
+
+    if (_hashmap->shape != NULL) {
+        // Shape mode only holds string keys
+        return NULL;
     }
-    return NULL;
+
+    hashmap_entry_t* entry = hashmap_find(_hashmap, _key, object_hash(_key));
+    return (entry != NULL) ? entry->value : NULL;
 }
 
 object_t* hashmap_get_string(hashmap_t* _hashmap, char* _key) {
-    ASSERTNULL(_hashmap, "hashmap is null");
+    object_t** cell = hashmap_cell_string(_hashmap, _key);
+    return (cell != NULL) ? *cell : NULL;
+}
+
+object_t** hashmap_cell_string(hashmap_t* _hashmap, char* _key) {
     ASSERTNULL(_key, "key is null");
+    object_t* atom = intern_find(_key, strlen(_key), hash64(_key));
+    return (atom != NULL) ? hashmap_cell_atom(_hashmap, atom) : NULL;
+}
 
-    size_t hash = hash64(_key);
-    hashmap_node_t* node = _hashmap->buckets[hash % _hashmap->bucket_count];
-    while (node) {
-        if (strcmp(object_to_string(node->key), _key) == 0) {
-            return node->value;
-        }
-        node = node->next;
+object_t* hashmap_get_atom(hashmap_t* _hashmap, object_t* _key) {
+    object_t** cell = hashmap_cell_atom(_hashmap, _key);
+    return (cell != NULL) ? *cell : NULL;
+}
+
+object_t** hashmap_cell_atom(hashmap_t* _hashmap, object_t* _key) {
+    ASSERTNULL(_hashmap, "hashmap is null");
+
+    if (_hashmap->shape != NULL) {
+        long slot = shape_lookup(_hashmap->shape, _key);
+        return slot >= 0 ? &_hashmap->slots[slot] : NULL;
     }
-    return NULL;
+
+    hashmap_entry_t* entry = hashmap_find(_hashmap, _key, OBJECT_STRING(_key)->hash);
+    return (entry != NULL) ? &entry->value : NULL;
 }
 
 void hashmap_extend(hashmap_t* _hashmap, hashmap_t* _other) {
     ASSERTNULL(_hashmap, "hashmap is null");
     ASSERTNULL(_other, "other is null");
-    
+
     // Early return if other hashmap is empty
     if (_other->size == 0) return;
-    
-    // Pre-allocate space for the combined size
-    size_t combined_size = _hashmap->size + _other->size;
-    if (combined_size > _hashmap->bucket_count * LOAD_FACTOR_THRESHOLD) {
-        // Calculate new bucket count to avoid multiple rehashes
-        size_t new_bucket_count = _hashmap->bucket_count;
-        while (combined_size > new_bucket_count * LOAD_FACTOR_THRESHOLD) {
-            new_bucket_count *= 2;
-        }
-        
-        // Resize once before adding elements
-        hashmap_rehash(_hashmap);
-    }
-    
-    // Now add all elements without triggering additional rehashes
-    for (size_t i = 0; i < _other->bucket_count; i++) {
-        hashmap_node_t* node = _other->buckets[i];
-        while (node) {
-            hashmap_put(_hashmap, node->key, node->value);
-            node = node->next;
-        }
+
+    // Grow once for the worst case (no shared keys) instead of per put
+    hashmap_reserve(_hashmap, _hashmap->size + _other->size);
+
+    hashmap_cursor_t cursor;
+    object_t* key;
+    object_t* value;
+    hashmap_cursor_begin(_other, &cursor);
+    while (hashmap_cursor_next(_other, &cursor, &key, &value)) {
+        hashmap_put(_hashmap, key, value);
     }
 }
 
 size_t hashmap_size(hashmap_t* _hashmap) {
     ASSERTNULL(_hashmap, "hashmap is null");
     return _hashmap->size;
+}
+
+void hashmap_cursor_begin(hashmap_t* _hashmap, hashmap_cursor_t* _cursor) {
+    ASSERTNULL(_hashmap, "hashmap is null");
+    _cursor->index = 0;
+}
+
+bool hashmap_cursor_next(hashmap_t* _hashmap, hashmap_cursor_t* _cursor, object_t** _key, object_t** _value) {
+    ASSERTNULL(_hashmap, "hashmap is null");
+
+    if (_cursor->index >= _hashmap->size) return false;
+    if (_hashmap->shape != NULL) {
+        *_key = _hashmap->shape->keys[_cursor->index];
+        *_value = _hashmap->slots[_cursor->index];
+    } else {
+        *_key = _hashmap->entries[_cursor->index].key;
+        *_value = _hashmap->entries[_cursor->index].value;
+    }
+    _cursor->index++;
+    return true;
 }
\ No newline at end of file
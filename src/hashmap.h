@@ -1,23 +1,54 @@
 #include "api/core/global.h"
 #include "api/core/object.h"
 #include "internal.h"
+#include "shape.h"
 
 #ifndef HASHMAP_H
 #define HASHMAP_H
 
-typedef struct hashmap_node_struct hashmap_node_t;
-typedef struct hashmap_node_struct {
+/*
+ * Control byte of an unused table slot. Used slots hold the low 7 bits of
+ * the mixed hash of their key instead, so the high bit tells them apart.
+ */
+#define HASHMAP_EMPTY 0x80
+
+// Table slots matched at once (one SSE2/NEON register of control bytes)
+#define HASHMAP_GROUP_WIDTH 16
+
+typedef struct hashmap_entry_struct {
     object_t* key;
     object_t* value;
-    hashmap_node_t* next;
-} hashmap_node_t;
+    size_t    hash; // Full hash of the key (object_hash)
+} hashmap_entry_t;
 
+/*
+ * Property storage of an object. String keys are always atoms (see
+ * intern.h) and match by pointer. While every key is a string the map is
+ * in shape mode: the values sit in a slot vector laid out by a shared
+ * shape. Non-string keys or more than SHAPE_MAX_PROPERTIES keys move it to
+ * dictionary mode, an open addressing table (Swiss table) over an array of
+ * entries kept in insertion order.
+ */
 typedef struct hashmap_struct {
-    hashmap_node_t** buckets;
-    size_t bucket_count;
+    shape_t* shape;            // Layout of the slots, NULL in dictionary mode
+    object_t** slots;
+    size_t slot_capacity;
+    uint8_t* controls;         // Dictionary mode only, one per table slot
+    uint32_t* indices;         // Dictionary mode only, entry of each used table slot
+    size_t table_capacity;     // Power of two, at least HASHMAP_GROUP_WIDTH
+    hashmap_entry_t* entries;  // Dictionary mode only
+    size_t entry_capacity;
     size_t size;
 } hashmap_t;
 
+/*
+ * Position of an iteration over a hashmap, both modes iterate in
+ * insertion order.
+ */
+typedef struct hashmap_cursor_struct {
+    size_t index;
+} hashmap_cursor_t;
+
 /*
  * Create a new hashmap.
  *
@@ -25,6 +56,15 @@ typedef struct hashmap_struct {
  */
 hashmap_t* hashmap_new();
 
+/*
+ * Create a new hashmap with room for a number of keys. Maps that can not
+ * fit in shape mode start in dictionary mode.
+ *
+ * @param _capacity The expected number of keys.
+ * @return The new hashmap.
+ */
+hashmap_t* hashmap_new_sized(size_t _capacity);
+
 /*
  * Free the hashmap.
  *
@@ -59,6 +99,43 @@ bool hashmap_has_string(hashmap_t* _hashmap, char* _key);
  */
 void hashmap_put(hashmap_t* _hashmap, object_t* _key, object_t* _value);
 
+/*
+ * Put a value under a string key into the hashmap.
+ *
+ * @param _hashmap The hashmap.
+ * @param _key The key.
+ * @param _value The value.
+ */
+void hashmap_put_string(hashmap_t* _hashmap, char* _key, object_t* _value);
+
+/*
+ * Put a value under an atom into the hashmap.
+ *
+ * @param _hashmap The hashmap.
+ * @param _key The key (an atom, see intern.h).
+ * @param _value The value.
+ */
+void hashmap_put_atom(hashmap_t* _hashmap, object_t* _key, object_t* _value);
+
+/*
+ * Add a value to a shape mode hashmap in the slot after the last one.
+ *
+ * @param _hashmap The hashmap (shape mode).
+ * @param _shape The transition out of the current shape that adds the key.
+ * @param _value The value.
+ */
+void hashmap_append(hashmap_t* _hashmap, shape_t* _shape, object_t* _value);
+
+/*
+ * Make room for a number of keys up front, so adding that many keys does
+ * not grow the slots (shape mode) or the entries and table (dictionary
+ * mode).
+ *
+ * @param _hashmap The hashmap.
+ * @param _capacity The number of keys.
+ */
+void hashmap_reserve(hashmap_t* _hashmap, size_t _capacity);
+
 /*
  * Get a value from the hashmap.
  *
@@ -77,6 +154,35 @@ object_t* hashmap_get(hashmap_t* _hashmap, object_t* _key);
  */
 object_t* hashmap_get_string(hashmap_t* _hashmap, char* _key);
 
+/*
+ * Get the cell that holds the value of a string key. The cell stays put
+ * until a key is added to the hashmap.
+ *
+ * @param _hashmap The hashmap.
+ * @param _key The key.
+ * @return The cell, or NULL if the hashmap has no such key.
+ */
+object_t** hashmap_cell_string(hashmap_t* _hashmap, char* _key);
+
+/*
+ * Get a value from the hashmap by atom, matched by pointer.
+ *
+ * @param _hashmap The hashmap.
+ * @param _key The key (an atom).
+ * @return The value, or NULL if the hashmap has no such key.
+ */
+object_t* hashmap_get_atom(hashmap_t* _hashmap, object_t* _key);
+
+/*
+ * Get the cell that holds the value of an atom key, see
+ * hashmap_cell_string.
+ *
+ * @param _hashmap The hashmap.
+ * @param _key The key (an atom).
+ * @return The cell, or NULL if the hashmap has no such key.
+ */
+object_t** hashmap_cell_atom(hashmap_t* _hashmap, object_t* _key);
+
 /*
  * Extend the hashmap with another hashmap.
  *
@@ -93,4 +199,23 @@ void hashmap_extend(hashmap_t* _hashmap, hashmap_t* _other);
  */
 size_t hashmap_size(hashmap_t* _hashmap);
 
+/*
+ * Start an iteration over the hashmap.
+ *
+ * @param _hashmap The hashmap.
+ * @param _cursor The cursor to reset.
+ */
+void hashmap_cursor_begin(hashmap_t* _hashmap, hashmap_cursor_t* _cursor);
+
+/*
+ * Get the next entry of an iteration and advance the cursor.
+ *
+ * @param _hashmap The hashmap.
+ * @param _cursor The cursor.
+ * @param _key Set to the key of the entry.
+ * @param _value Set to the value of the entry.
+ * @return True if there was an entry, false at the end.
+ */
+bool hashmap_cursor_next(hashmap_t* _hashmap, hashmap_cursor_t* _cursor, object_t** _key, object_t** _value);
+
 #endif
\ No newline at end of file
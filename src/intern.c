@@ -0,0 +1,162 @@
+#include "intern.h"
+#include "object.h"
+#include "type.h"
+#include "vm.h"
+
+#define INTERN_BUCKET_COUNT 256
+
+typedef struct intern_entry_struct {
+    object_t*       atom;
+    intern_entry_t* next;
+} intern_entry_t;
+
+extern vm_t* instance;
+
+void intern_table_init(intern_table_t* _table) {
+    _table->buckets = (intern_entry_t**) calloc(INTERN_BUCKET_COUNT, sizeof(intern_entry_t*));
+    ASSERTNULL(_table->buckets, "failed to allocate memory for intern table");
+    _table->bucket_count = INTERN_BUCKET_COUNT;
+    _table->count = 0;
+}
+
+void intern_table_free(intern_table_t* _table) {
+    for (size_t i = 0; i < _table->bucket_count; i++) {
+        intern_entry_t* entry = _table->buckets[i];
+        while (entry) {
+            intern_entry_t* next = entry->next;
+            object_t* atom = entry->atom;
+            if (atom->immortal) {
+                str_free(OBJECT_STRING(atom));
+                free(atom);
+            } else {
+                // The gc frees it, there is no table to forget it from
+                OBJECT_STRING(atom)->flags &= ~STR_FLAG_ATOM;
+            }
+            free(entry);
+            entry = next;
+        }
+    }
+    free(_table->buckets);
+    _table->buckets = NULL;
+    _table->bucket_count = 0;
+    _table->count = 0;
+}
+
+/**
+ * Doubles the bucket array.
+ *
+ * @param _table The table.
+ */
+INTERNAL void intern_rehash(intern_table_t* _table) {
+    size_t new_bucket_count = _table->bucket_count * 2;
+    intern_entry_t** new_buckets = (intern_entry_t**) calloc(new_bucket_count, sizeof(intern_entry_t*));
+    ASSERTNULL(new_buckets, "failed to allocate memory for intern table");
+    for (size_t i = 0; i < _table->bucket_count; i++) {
+        intern_entry_t* entry = _table->buckets[i];
+        while (entry) {
+            intern_entry_t* next = entry->next;
+            size_t index = OBJECT_STRING(entry->atom)->hash & (new_bucket_count - 1);
+            entry->next = new_buckets[index];
+            new_buckets[index] = entry;
+            entry = next;
+        }
+    }
+    free(_table->buckets);
+    _table->buckets = new_buckets;
+    _table->bucket_count = new_bucket_count;
+}
+
+/**
+ * Adds an atom known to be absent to the table.
+ *
+ * @param _atom The string object, its hash is cached.
+ * @return object_t* The atom.
+ */
+INTERNAL object_t* intern_insert(object_t* _atom) {
+    ASSERTNULL(instance, "VM is not initialized");
+    intern_table_t* table = &instance->intern;
+    str_t* str = OBJECT_STRING(_atom);
+    str->flags |= STR_FLAG_ATOM;
+
+    intern_entry_t* entry = (intern_entry_t*) malloc(sizeof(intern_entry_t));
+    ASSERTNULL(entry, "failed to allocate memory for intern entry");
+    size_t index = str->hash & (table->bucket_count - 1);
+    entry->atom = _atom;
+    entry->next = table->buckets[index];
+    table->buckets[index] = entry;
+
+    if (++table->count > table->bucket_count) {
+        intern_rehash(table);
+    }
+    return _atom;
+}
+
+object_t* intern_find(const char* _chars, size_t _length, size_t _hash) {
+    if (instance == NULL || instance->intern.buckets == NULL) return NULL;
+    intern_table_t* table = &instance->intern;
+    intern_entry_t* entry = table->buckets[_hash & (table->bucket_count - 1)];
+    while (entry) {
+        str_t* str = OBJECT_STRING(entry->atom);
+        if (str->hash == _hash && str->length == _length && memcmp(str->data, _chars, _length) == 0) {
+            return entry->atom;
+        }
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+object_t* intern_string(const char* _chars) {
+    return intern_string_sized(_chars, strlen(_chars), hash64((char*) _chars));
+}
+
+object_t* intern_string_sized(const char* _chars, size_t _length, size_t _hash) {
+    object_t* atom = intern_find(_chars, _length, _hash);
+    if (atom != NULL) {
+        return intern_pin(atom);
+    }
+    // Never linked into the vm heap, so the gc never frees it
+    atom = object_make_immortal(object_new_string_sized(_chars, _length));
+    OBJECT_STRING(atom)->hash   = _hash;
+    OBJECT_STRING(atom)->flags |= STR_FLAG_HASHED;
+    return intern_insert(atom);
+}
+
+object_t* intern_object(object_t* _str) {
+    if (INTERN_IS_ATOM(_str)) return _str;
+    str_t* str = OBJECT_STRING(_str);
+    // Hash first, it flattens a rope
+    size_t hash = str_hash(str);
+    object_t* atom = intern_find(str->data, str->length, hash);
+    if (atom != NULL) return atom;
+    // A pinned atom is never marked, so it can't keep the parent of a slice
+    if ((str->flags & STR_FLAG_SLICE) != 0) str_flatten(str);
+    // and it would keep the embedder's bytes forever, an external string
+    // gets an atom with a copy of them
+    if ((str->flags & STR_FLAG_EXTERNAL) != 0) {
+        object_t* copy = vm_to_heap(object_new_string_sized(str->data, str->length));
+        OBJECT_STRING(copy)->hash   = hash;
+        OBJECT_STRING(copy)->flags |= STR_FLAG_HASHED;
+        return intern_insert(copy);
+    }
+    return intern_insert(_str);
+}
+
+object_t* intern_pin(object_t* _atom) {
+    // A heap atom is unlinked from the heap by the next sweep (see gc.c)
+    return object_make_immortal(_atom);
+}
+
+void intern_forget(object_t* _atom) {
+    intern_table_t* table = &instance->intern;
+    intern_entry_t** link = &table->buckets[OBJECT_STRING(_atom)->hash & (table->bucket_count - 1)];
+    while (*link) {
+        intern_entry_t* entry = *link;
+        if (entry->atom == _atom) {
+            *link = entry->next;
+            free(entry);
+            table->count--;
+            return;
+        }
+        link = &entry->next;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "api/core/global.h"
+#include "api/core/object.h"
+#include "internal.h"
+#include "str.h"
+
+#ifndef INTERN_H
+#define INTERN_H
+
+/*
+ * The intern table keeps one string object per distinct byte sequence,
+ * an atom, so atoms compare by pointer and carry their hash. The table
+ * belongs to the vm (vm_t.intern), the functions below use the running
+ * vm's table.
+ *
+ * Atoms made from C strings (names in the bytecode, shape keys, string
+ * literals) are pinned: immortal, they live as long as the vm and are
+ * freed with its table. A heap string can become an atom as well
+ * (dictionary keys), the table holds it weakly and the gc sweeps it like
+ * any other string, dropping it from the table when it frees it. Pinning
+ * a heap atom makes it immortal in place, so an atom is never replaced.
+ */
+
+#define INTERN_IS_ATOM(object) ((((str_t*) (object)->value.opaque)->flags & STR_FLAG_ATOM) != 0)
+
+typedef struct intern_entry_struct intern_entry_t;
+
+typedef struct intern_table_struct {
+    intern_entry_t** buckets;
+    size_t           bucket_count;
+    size_t           count;
+} intern_table_t;
+
+/*
+ * Initialize an empty intern table.
+ *
+ * @param _table The table.
+ */
+void intern_table_init(intern_table_t* _table);
+
+/*
+ * Free an intern table with its pinned atoms. Atoms still in the heap are
+ * left to the gc and stop being atoms.
+ *
+ * @param _table The table.
+ */
+void intern_table_free(intern_table_t* _table);
+
+/*
+ * Get the pinned atom of a C string, creating it on first use.
+ *
+ * @param _chars The bytes (null terminated).
+ * @return The atom.
+ */
+object_t* intern_string(const char* _chars);
+
+/*
+ * Get the pinned atom of a number of bytes, creating it on first use.
+ *
+ * @param _chars The bytes.
+ * @param _length The number of bytes.
+ * @param _hash The hash of the bytes (hash64).
+ * @return The atom.
+ */
+object_t* intern_string_sized(const char* _chars, size_t _length, size_t _hash);
+
+/*
+ * Find the atom of a number of bytes without creating one.
+ *
+ * @param _chars The bytes.
+ * @param _length The number of bytes.
+ * @param _hash The hash of the bytes (hash64).
+ * @return The atom, or NULL if no string with these bytes was interned.
+ */
+object_t* intern_find(const char* _chars, size_t _length, size_t _hash);
+
+/*
+ * Get the atom of a string object. A heap string without one becomes the
+ * atom itself (held weakly), an external string gets a copy as its atom.
+ *
+ * @param _str The string object.
+ * @return The atom.
+ */
+object_t* intern_object(object_t* _str);
+
+/*
+ * Pin an atom so it outlives every collection.
+ *
+ * @param _atom The atom.
+ * @return The atom.
+ */
+object_t* intern_pin(object_t* _atom);
+
+/*
+ * Drop a weakly held atom from the table, called by the gc before it frees
+ * the string.
+ *
+ * @param _atom The atom.
+ */
+void intern_forget(object_t* _atom);
+
+#endif
\ No newline at end of file
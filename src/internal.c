@@ -51,35 +51,315 @@ char* string_format(char* _format, ...) {
 
 bool string_is_number(char* _str) {
     if (_str == NULL) return false;
+    double value;
+    int64_t integer;
+    return number_parse(_str, strlen(_str), &value, &integer);
+}
+#pragma endregion
+
+#pragma region NumberC
+// "00" to "99", two digits are written at a time
+INTERNAL const char number_digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Powers of ten a double holds exactly
+INTERNAL const double number_exact_powers[23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Formats an unsigned 64-bit int in decimal.
+ *
+ * @param _buffer The buffer, at least 21 bytes.
+ * @param _value The value.
+ * @return size_t The number of bytes written, terminator excluded.
+ */
+INTERNAL size_t number_format_unsigned(char* _buffer, uint64_t _value) {
+    char digits[20];
+    size_t at = sizeof(digits);
+    while (_value >= 100) {
+        size_t pair = (size_t) (_value % 100) * 2;
+        _value /= 100;
+        digits[--at] = number_digit_pairs[pair + 1];
+        digits[--at] = number_digit_pairs[pair];
+    }
+    if (_value >= 10) {
+        digits[--at] = number_digit_pairs[_value * 2 + 1];
+        digits[--at] = number_digit_pairs[_value * 2];
+    } else {
+        digits[--at] = (char) ('0' + _value);
+    }
+    size_t length = sizeof(digits) - at;
+    memcpy(_buffer, digits + at, length);
+    _buffer[length] = '\0';
+    return length;
+}
+
+size_t number_format_long(char* _buffer, int64_t _value) {
+    if (_value < 0) {
+        _buffer[0] = '-';
+        // Negated unsigned, INT64_MIN has no positive counterpart
+        return 1 + number_format_unsigned(_buffer + 1, 0 - (uint64_t) _value);
+    }
+    return number_format_unsigned(_buffer, (uint64_t) _value);
+}
+
+size_t number_format_double(char* _buffer, double _value) {
+    if (!isfinite(_value)) {
+        return (size_t) snprintf(_buffer, NUMBER_FORMAT_MAX, "%.2lf", _value);
+    }
+    double intpart;
+    if (modf(_value, &intpart) == 0.0) {
+        // Integral doubles past the 64-bit range cannot go through a cast
+        if (fabs(_value) < 9223372036854775808.0) {
+            return number_format_long(_buffer, (int64_t) _value);
+        }
+        return (size_t) snprintf(_buffer, NUMBER_FORMAT_MAX, "%.0lf", _value);
+    }
 
-    // Optional: skip leading whitespace
-    while (isspace((unsigned char)*_str)) _str++;
-    if (*_str == '\0') return false;
+    // The value is m * 2^e with e < 0 (it has a fraction), so the value
+    // times 100 is (m * 100) >> -e, rounded half to even on the exact
+    // remainder like printf does
+    uint64_t bits;
+    memcpy(&bits, &_value, sizeof(bits));
+    int exponent = (int) ((bits >> 52) & 0x7FF);
+    uint64_t mantissa = bits & 0xFFFFFFFFFFFFFULL;
+    if (exponent == 0) {
+        exponent = 1;
+    } else {
+        mantissa |= 1ULL << 52;
+    }
+    int shift = 1075 - exponent;
+    uint64_t hundredths = 0;
+    // Past 60 bits the scaled value is below one half
+    if (shift <= 60) {
+        uint64_t scaled = mantissa * 100;
+        uint64_t remainder = scaled & ((1ULL << shift) - 1);
+        uint64_t half = 1ULL << (shift - 1);
+        hundredths = scaled >> shift;
+        if (remainder > half || (remainder == half && (hundredths & 1) != 0)) {
+            hundredths++;
+        }
+    }
+
+    size_t length = 0;
+    if (signbit(_value)) {
+        _buffer[length++] = '-';
+    }
+    length += number_format_unsigned(_buffer + length, hundredths / 100);
+    size_t pair = (size_t) (hundredths % 100) * 2;
+    _buffer[length++] = '.';
+    _buffer[length++] = number_digit_pairs[pair];
+    _buffer[length++] = number_digit_pairs[pair + 1];
+    _buffer[length] = '\0';
+    return length;
+}
 
-    char* endptr = NULL;
+/**
+ * Rounds the bytes of a number with strtod, once the grammar is checked.
+ *
+ * @param _start The first byte (sign included).
+ * @param _end Past the last byte.
+ * @param _value Set to the value.
+ * @return bool False if the value is out of the double range.
+ */
+INTERNAL bool number_strtod(const char* _start, const char* _end, double* _value) {
+    char small[64];
+    size_t length = (size_t) (_end - _start);
+    char* copy = (length < sizeof(small)) ? small : (char*) malloc(length + 1);
+    ASSERTNULL(copy, "failed to allocate memory for number");
+    memcpy(copy, _start, length);
+    copy[length] = '\0';
     errno = 0;
-    double val = strtod(_str, &endptr);
+    double value = strtod(copy, NULL);
+    bool range_error = (errno == ERANGE);
+    if (copy != small) free(copy);
+    if (range_error || isinf(value)) return false;
+    *_value = value;
+    return true;
+}
+
+/**
+ * Truncates a double to a 64-bit int, saturating past the int64 range.
+ *
+ * @param _value The value.
+ * @return int64_t
+ */
+INTERNAL int64_t number_truncate(double _value) {
+    if (_value >= 9223372036854775807.0) return INT64_MAX;
+    if (_value <= -9223372036854775808.0) return INT64_MIN;
+    return (int64_t) _value;
+}
 
-    // Optional: skip trailing whitespace
-    while (isspace((unsigned char)*endptr)) endptr++;
+/**
+ * Parses the part of a hex number after the 0x, with an optional fraction
+ * and binary exponent (the forms strtod reads).
+ *
+ * @param _at The first byte after the 0x.
+ * @param _end Past the last byte.
+ * @param _start The first byte of the number (sign included).
+ * @param _negative Whether the number has a minus sign.
+ * @param _value Set to the value.
+ * @param _integer Set to the value as a 64-bit int.
+ * @return bool True if the string is a number.
+ */
+INTERNAL bool number_parse_hex(const char* _at, const char* _end, const char* _start, bool _negative, double* _value, int64_t* _integer) {
+    uint64_t mantissa = 0;
+    bool digits = false;
+    bool truncated = false;
+    bool integral = true;
+    while (_at < _end && isxdigit((unsigned char) *_at)) {
+        if ((mantissa >> 60) == 0) {
+            int digit = isdigit((unsigned char) *_at) ? (*_at - '0') : (tolower((unsigned char) *_at) - 'a' + 10);
+            mantissa = (mantissa << 4) | (uint64_t) digit;
+        } else {
+            truncated = true;
+        }
+        digits = true;
+        _at++;
+    }
+    if (_at < _end && *_at == '.') {
+        integral = false;
+        _at++;
+        while (_at < _end && isxdigit((unsigned char) *_at)) {
+            digits = true;
+            _at++;
+        }
+    }
+    if (!digits) return false;
+    if (_at < _end && (*_at == 'p' || *_at == 'P')) {
+        integral = false;
+        _at++;
+        if (_at < _end && (*_at == '+' || *_at == '-')) _at++;
+        if (_at >= _end || !isdigit((unsigned char) *_at)) return false;
+        while (_at < _end && isdigit((unsigned char) *_at)) _at++;
+    }
+    if (_at != _end) return false;
 
-    if (endptr != _str && *endptr == '\0' && errno == 0 && !isinf(val) && !isnan(val)) {
+    if (integral && !truncated && mantissa <= (uint64_t) INT64_MAX) {
+        *_integer = _negative ? -(int64_t) mantissa : (int64_t) mantissa;
+        *_value = _negative ? -(double) mantissa : (double) mantissa;
         return true;
     }
+    if (!number_strtod(_start, _end, _value)) return false;
+    *_integer = number_truncate(*_value);
+    return true;
+}
+
+bool number_parse(const char* _chars, size_t _length, double* _value, int64_t* _integer) {
+    const char* at = _chars;
+    const char* end = _chars + _length;
+    while (at < end && isspace((unsigned char) *at)) at++;
+    while (end > at && isspace((unsigned char) end[-1])) end--;
+    const char* start = at;
+
+    bool negative = false;
+    if (at < end && (*at == '+' || *at == '-')) {
+        negative = (*at == '-');
+        at++;
+    }
+
+    // Hex is read as strtod reads it
+    if (end - at > 2 && at[0] == '0' && (at[1] == 'x' || at[1] == 'X')) {
+        return number_parse_hex(at + 2, end, start, negative, _value, _integer);
+    }
+
+    // Up to 19 significant digits are kept, the rest only move the exponent
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+    bool truncated = false;
+    bool integral = true;
+    while (at < end && isdigit((unsigned char) *at)) {
+        if (mantissa < 1000000000000000000ULL) {
+            mantissa = mantissa * 10 + (uint64_t) (*at - '0');
+        } else {
+            exponent++;
+            truncated = true;
+        }
+        digits = true;
+        at++;
+    }
+    if (at < end && *at == '.') {
+        integral = false;
+        at++;
+        while (at < end && isdigit((unsigned char) *at)) {
+            if (mantissa < 1000000000000000000ULL) {
+                mantissa = mantissa * 10 + (uint64_t) (*at - '0');
+                exponent--;
+            } else if (*at != '0') {
+                truncated = true;
+            }
+            digits = true;
+            at++;
+        }
+    }
+    if (!digits) return false;
+    if (at < end && (*at == 'e' || *at == 'E')) {
+        integral = false;
+        at++;
+        bool exponent_negative = false;
+        if (at < end && (*at == '+' || *at == '-')) {
+            exponent_negative = (*at == '-');
+            at++;
+        }
+        if (at >= end || !isdigit((unsigned char) *at)) return false;
+        int value = 0;
+        while (at < end && isdigit((unsigned char) *at)) {
+            if (value < 100000) value = value * 10 + (*at - '0');
+            at++;
+        }
+        exponent += exponent_negative ? -value : value;
+    }
+    if (at != end) return false;
+
+    // Plain integers are exact
+    if (integral && !truncated && mantissa <= (uint64_t) INT64_MAX) {
+        *_integer = negative ? -(int64_t) mantissa : (int64_t) mantissa;
+        *_value = negative ? -(double) mantissa : (double) mantissa;
+        return true;
+    }
+
+    double value;
+    if (!truncated && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        // Both the mantissa and the power of ten are exact, so one
+        // rounded operation gives the correctly rounded result
+        value = (exponent < 0) ? (double) mantissa / number_exact_powers[-exponent]
+                               : (double) mantissa * number_exact_powers[exponent];
+        if (negative) value = -value;
+    } else if (!number_strtod(start, end, &value)) {
+        // The grammar is checked, strtod only rounds the hard cases
+        return false;
+    }
+    *_value = value;
+    *_integer = number_truncate(value);
+    return true;
+}
+
+bool number_parse_string(object_t* _str, double* _value, int64_t* _integer) {
+    str_t* str = OBJECT_STRING(_str);
+    if ((str->flags & STR_FLAG_NOT_NUMBER) != 0) return false;
+    if (number_parse(STR_BYTES(str), str->length, _value, _integer)) return true;
+    str->flags |= STR_FLAG_NOT_NUMBER;
     return false;
 }
-#pragma endregion
 
-#pragma region NumberC
 int number_coerce_to_int(object_t* _obj) {
-    switch (_obj->type) {
+    double value;
+    int64_t integer;
+    switch (OBJECT_TYPE_OF(_obj)) {
         case OBJECT_TYPE_INT:
-            return _obj->value.i32;
+            return OBJECT_INT_VALUE(_obj);
         case OBJECT_TYPE_DOUBLE:
             return (int) _obj->value.f64;
         case OBJECT_TYPE_STRING:
-            if (!string_is_number((char*) _obj->value.opaque)) break;
-            return (int) strtol((char*) _obj->value.opaque, NULL, 10);
+            if (!number_parse_string(_obj, &value, &integer)) break;
+            return (int) integer;
         default:
             break;
     }
@@ -87,14 +367,16 @@ int number_coerce_to_int(object_t* _obj) {
 }
 
 long number_coerce_to_long(object_t* _obj) {
-    switch (_obj->type) {
+    double value;
+    int64_t integer;
+    switch (OBJECT_TYPE_OF(_obj)) {
         case OBJECT_TYPE_INT:
-            return (long) _obj->value.i32;
+            return (long) OBJECT_INT_VALUE(_obj);
         case OBJECT_TYPE_DOUBLE:
             return (long) _obj->value.f64;
         case OBJECT_TYPE_STRING:
-            if (!string_is_number((char*) _obj->value.opaque)) break;
-            return (long) strtol((char*) _obj->value.opaque, NULL, 10);
+            if (!number_parse_string(_obj, &value, &integer)) break;
+            return (long) integer;
         default:
             break;
     }
@@ -102,19 +384,50 @@ long number_coerce_to_long(object_t* _obj) {
 }
 
 double number_coerce_to_double(object_t* _obj) {
-    switch (_obj->type) {
+    double value;
+    int64_t integer;
+    switch (OBJECT_TYPE_OF(_obj)) {
         case OBJECT_TYPE_INT:
-            return (double) _obj->value.i32;
+            return (double) OBJECT_INT_VALUE(_obj);
         case OBJECT_TYPE_DOUBLE:
             return (double) _obj->value.f64;
         case OBJECT_TYPE_STRING:
-            if (!string_is_number((char*) _obj->value.opaque)) break;
-            return strtod((char*) _obj->value.opaque, NULL);
+            if (!number_parse_string(_obj, &value, &integer)) break;
+            return value;
         default:
             break;
     }
     return 0.0;
 }
+
+bool number_add_overflow(int64_t _a, int64_t _b, int64_t* _result) {
+    #if defined(__GNUC__) || defined(__clang__)
+        return __builtin_add_overflow(_a, _b, _result);
+    #else
+        *_result = (int64_t) ((uint64_t) _a + (uint64_t) _b);
+        return (_b > 0 && _a > INT64_MAX - _b) || (_b < 0 && _a < INT64_MIN - _b);
+    #endif
+}
+
+bool number_sub_overflow(int64_t _a, int64_t _b, int64_t* _result) {
+    #if defined(__GNUC__) || defined(__clang__)
+        return __builtin_sub_overflow(_a, _b, _result);
+    #else
+        *_result = (int64_t) ((uint64_t) _a - (uint64_t) _b);
+        return (_b < 0 && _a > INT64_MAX + _b) || (_b > 0 && _a < INT64_MIN + _b);
+    #endif
+}
+
+bool number_mul_overflow(int64_t _a, int64_t _b, int64_t* _result) {
+    #if defined(__GNUC__) || defined(__clang__)
+        return __builtin_mul_overflow(_a, _b, _result);
+    #else
+        *_result = (int64_t) ((uint64_t) _a * (uint64_t) _b);
+        if (_a == 0 || _b == 0) return false;
+        if ((_a == -1 && _b == INT64_MIN) || (_b == -1 && _a == INT64_MIN)) return true;
+        return (*_result / _b) != _a;
+    #endif
+}
 #pragma endregion
 
 #pragma region PathC
@@ -10,6 +10,56 @@
 #pragma endregion
 
 #pragma region NumberH
+/*
+ * The most bytes number_format_long and number_format_double write,
+ * terminator included (an integral double may have 309 digits).
+ */
+#define NUMBER_FORMAT_MAX 320
+
+/*
+ * Format a 64-bit int in decimal.
+ *
+ * @param _buffer The buffer, NUMBER_FORMAT_MAX bytes.
+ * @param _value The value.
+ * @return The number of bytes written, terminator excluded.
+ */
+size_t number_format_long(char* _buffer, int64_t _value);
+
+/*
+ * Format a double the way it is displayed: integral values without a
+ * fraction, the rest rounded to two decimals (same output as "%.2lf").
+ *
+ * @param _buffer The buffer, NUMBER_FORMAT_MAX bytes.
+ * @param _value The value.
+ * @return The number of bytes written, terminator excluded.
+ */
+size_t number_format_double(char* _buffer, double _value);
+
+/*
+ * Parse a whole string as a decimal number: optional surrounding
+ * whitespace, an optional sign, digits with an optional fraction and an
+ * optional exponent, or hex as strtod reads it. Inf, nan and values out
+ * of the double range are not numbers.
+ *
+ * @param _chars The bytes (need not be null terminated).
+ * @param _length The number of bytes.
+ * @param _value Set to the value.
+ * @param _integer Set to the value as a 64-bit int (exact for integers, truncated otherwise).
+ * @return True if the string is a number.
+ */
+bool number_parse(const char* _chars, size_t _length, double* _value, int64_t* _integer);
+
+/*
+ * Parse a string object as a number (see number_parse), a string found
+ * not to be one is remembered.
+ *
+ * @param _str The string object.
+ * @param _value Set to the value.
+ * @param _integer Set to the value as a 64-bit int.
+ * @return True if the string is a number.
+ */
+bool number_parse_string(object_t* _str, double* _value, int64_t* _integer);
+
 /*
  * Coerce an object to an int.
  *
@@ -33,6 +83,30 @@ long number_coerce_to_long(object_t* _obj);
  * @return The double value.
  */
 double number_coerce_to_double(object_t* _obj);
+
+/*
+ * Overflow checked 64-bit int arithmetic.
+ * Each sets *_result and returns true if the result overflowed.
+ *
+ * @param _a The left operand.
+ * @param _b The right operand.
+ * @param _result The result.
+ * @return True on overflow.
+ */
+bool number_add_overflow(int64_t _a, int64_t _b, int64_t* _result);
+bool number_sub_overflow(int64_t _a, int64_t _b, int64_t* _result);
+bool number_mul_overflow(int64_t _a, int64_t _b, int64_t* _result);
+
+// Compilers with overflow builtins check inline
+#if defined(__GNUC__) || defined(__clang__)
+    #define NUMBER_ADD_OVERFLOW(a, b, result) __builtin_add_overflow(a, b, result)
+    #define NUMBER_SUB_OVERFLOW(a, b, result) __builtin_sub_overflow(a, b, result)
+    #define NUMBER_MUL_OVERFLOW(a, b, result) __builtin_mul_overflow(a, b, result)
+#else
+    #define NUMBER_ADD_OVERFLOW(a, b, result) number_add_overflow(a, b, result)
+    #define NUMBER_SUB_OVERFLOW(a, b, result) number_sub_overflow(a, b, result)
+    #define NUMBER_MUL_OVERFLOW(a, b, result) number_mul_overflow(a, b, result)
+#endif
 #pragma endregion
 
 #pragma region PathH
@@ -5,7 +5,8 @@ iterator_t* iterator_new(object_t* _obj) {
     iterator_t* iterator = malloc(sizeof(iterator_t));
     ASSERTNULL(iterator, "failed to allocate memory for iterator");
     iterator->obj = _obj;
-    iterator->next = NULL;
+    iterator->key = NULL;
+    iterator->value = NULL;
 
     if (OBJECT_TYPE_ARRAY(_obj)) {
         array_t* array = (array_t*) _obj->value.opaque;
@@ -20,13 +21,13 @@ iterator_t* iterator_new(object_t* _obj) {
     } else if (OBJECT_TYPE_OBJECT(_obj)) {
         hashmap_t* hashmap = (hashmap_t*) _obj->value.opaque;
         iterator->start = 0;
-        iterator->end = hashmap->bucket_count;
+        iterator->end = 0;
         iterator->step = 1;
-        // Find first non-empty bucket
-        while (iterator->start < iterator->end && hashmap->buckets[iterator->start] == NULL) {
-            iterator->start++;
+        // Fetch the first entry ahead so has_next is a plain check
+        hashmap_cursor_begin(hashmap, &iterator->cursor);
+        if (!hashmap_cursor_next(hashmap, &iterator->cursor, &iterator->key, &iterator->value)) {
+            iterator->key = NULL;
         }
-        iterator->next = iterator->start < iterator->end ? hashmap->buckets[iterator->start] : NULL;
     } else {
         PD("not supported");
     }
@@ -40,7 +41,7 @@ bool iterator_has_next(object_t* _obj) {
     if (OBJECT_TYPE_ARRAY(iterator->obj) || OBJECT_TYPE_RANGE(iterator->obj)) {
         return iterator->start < iterator->end;
     } else if (OBJECT_TYPE_OBJECT(iterator->obj)) {
-        return iterator->next != NULL;
+        return iterator->key != NULL;
     }
     PD("not supported type: %s", object_type_to_string(iterator->obj));
     return false;
@@ -61,24 +62,15 @@ object_t** iterator_next(object_t* _obj) {
         return values;
     } else if (OBJECT_TYPE_OBJECT(iterator->obj)) {
         hashmap_t* hashmap = (hashmap_t*) iterator->obj->value.opaque;
-        hashmap_node_t* node = (hashmap_node_t*)iterator->next;
-        
-        values[0] = node->key;
-        values[1] = node->value;
-        
-        // Update next pointer
-        iterator->next = node->next;
-        if (iterator->next == NULL) {
-            iterator->start++;
-            // Find next non-empty bucket
-            while (iterator->start < iterator->end && hashmap->buckets[iterator->start] == NULL) {
-                iterator->start++;
-            }
-            if (iterator->start < iterator->end) {
-                iterator->next = hashmap->buckets[iterator->start];
-            }
+
+        values[0] = iterator->key;
+        values[1] = iterator->value;
+
+        // Fetch the following entry
+        if (!hashmap_cursor_next(hashmap, &iterator->cursor, &iterator->key, &iterator->value)) {
+            iterator->key = NULL;
         }
-        
+
         return values;
     }
     
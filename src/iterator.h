@@ -11,7 +11,10 @@ typedef struct iterator_struct {
     size_t    start;
     size_t    end;
     size_t    step;
-    void*     next;
+    // Objects only: the cursor and the entry it yields next (key is NULL at the end)
+    hashmap_cursor_t cursor;
+    object_t* key;
+    object_t* value;
 } iterator_t;
 
 /*
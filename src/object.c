@@ -6,11 +6,23 @@
 #include "type.h"
 
 DLLEXPORT object_t* object_new(object_type_t _type) {
+    // Immediate types carry their value in the handle
+    switch (_type) {
+        case OBJECT_TYPE_INT:
+            return OBJECT_INT(0);
+        case OBJECT_TYPE_BOOL:
+            return OBJECT_BOOL(false);
+        case OBJECT_TYPE_NULL:
+            return OBJECT_NULL;
+        default:
+            break;
+    }
     object_t* obj = (object_t* ) malloc(sizeof(object_t));
     ASSERTNULL(obj, "failed to allocate memory for object");
     obj->type = _type;
     obj->next = NULL;
     obj->marked = false;
+    obj->immortal = false;
     return obj;
 }
 
@@ -20,9 +32,34 @@ DLLEXPORT object_t* object_new_object() {
     return obj;
 }
 
+object_t* object_make_immortal(object_t* _obj) {
+    if (!OBJECT_IS_TAGGED(_obj)) {
+        _obj->immortal = true;
+    }
+    return _obj;
+}
+
+object_t* object_new_object_sized(size_t _capacity) {
+    object_t* obj = object_new(OBJECT_TYPE_OBJECT);
+    obj->value.opaque = hashmap_new_sized(_capacity);
+    return obj;
+}
+
 DLLEXPORT object_t* object_new_int(int _value) {
-    object_t* obj = object_new(OBJECT_TYPE_INT);
-    obj->value.i32 = _value;
+    return object_new_long((int64_t) _value);
+}
+
+object_t* object_new_long(int64_t _value) {
+    if (OBJECT_INT_FITS(_value)) {
+        return OBJECT_INT(_value);
+    }
+    object_t* obj = (object_t*) malloc(sizeof(object_t));
+    ASSERTNULL(obj, "failed to allocate memory for object");
+    obj->type = OBJECT_TYPE_INT;
+    obj->next = NULL;
+    obj->marked = false;
+    obj->immortal = false;
+    obj->value.i64 = _value;
     return obj;
 }
 
@@ -33,28 +70,198 @@ DLLEXPORT object_t* object_new_double(double _value) {
 }
 
 DLLEXPORT object_t* object_new_string(char *_value) {
-    object_t* obj = object_new(OBJECT_TYPE_STRING);
-    obj->value.opaque = string_allocate((const char*) _value);
+    return object_new_string_sized(_value, strlen(_value));
+}
+
+object_t* object_new_string_sized(const char* _chars, size_t _length) {
+    object_t* obj;
+    if (_length <= STR_INLINE_MAX) {
+        // Header and bytes follow the object in one block
+        obj = (object_t*) malloc(sizeof(object_t) + STR_SIZE(_length));
+        ASSERTNULL(obj, "failed to allocate memory for object");
+        obj->value.opaque = str_init(obj + 1, _chars, _length, STR_FLAG_INLINE);
+    } else {
+        obj = (object_t*) malloc(sizeof(object_t));
+        ASSERTNULL(obj, "failed to allocate memory for object");
+        obj->value.opaque = str_new(_chars, _length);
+    }
+    obj->type = OBJECT_TYPE_STRING;
+    obj->next = NULL;
+    obj->marked = false;
+    obj->immortal = false;
     return obj;
 }
 
-DLLEXPORT object_t* object_new_null() {
-    object_t* obj = object_new(OBJECT_TYPE_NULL);
+/**
+ * Creates a rope over two strings, the header follows the object.
+ * 
+ * @param _left The first string object
+ * @param _right The second string object
+ * @return object_t* The rope
+ */
+INTERNAL object_t* object_new_rope(object_t* _left, object_t* _right) {
+    object_t* obj = (object_t*) malloc(sizeof(object_t) + sizeof(str_t));
+    ASSERTNULL(obj, "failed to allocate memory for object");
+    obj->value.opaque = str_init_rope(obj + 1, _left, _right, STR_FLAG_INLINE);
+    obj->type = OBJECT_TYPE_STRING;
+    obj->next = NULL;
+    obj->marked = false;
+    obj->immortal = false;
     return obj;
 }
 
-DLLEXPORT object_t* object_new_bool(bool _value) {
-    object_t* obj = object_new(OBJECT_TYPE_BOOL);
-    obj->value.i32 = _value;
+/**
+ * Builds a balanced rope over a run of leaves. Inner nodes join the heap,
+ * the root is left to the caller.
+ * 
+ * @param _leaves The flat strings, in order
+ * @param _count The number of leaves
+ * @return object_t* The rope, or the leaf if there is only one
+ */
+INTERNAL object_t* object_new_rope_balanced(object_t** _leaves, size_t _count) {
+    if (_count == 1) return _leaves[0];
+    size_t half = _count / 2;
+    object_t* left  = object_new_rope_balanced(_leaves, half);
+    object_t* right = object_new_rope_balanced(_leaves + half, _count - half);
+    if (half > 1) vm_to_heap(left);
+    if (_count - half > 1) vm_to_heap(right);
+    return object_new_rope(left, right);
+}
+
+object_t* object_new_string_concat(object_t* _lhs, object_t* _rhs) {
+    str_t* lhs = OBJECT_STRING(_lhs);
+    str_t* rhs = OBJECT_STRING(_rhs);
+    size_t length = lhs->length + rhs->length;
+    if (length < STR_ROPE_MIN) {
+        // Short results are cheaper to copy than to link
+        object_t* obj = object_new_string_sized(NULL, length);
+        str_t* str = OBJECT_STRING(obj);
+        memcpy(str->data, STR_BYTES(lhs), lhs->length);
+        memcpy(str->data + lhs->length, STR_BYTES(rhs), rhs->length);
+        // Ascii only if both halves are
+        str->flags |= lhs->flags & rhs->flags & STR_FLAG_ASCII;
+        return obj;
+    }
+    if (lhs->data == NULL && rhs->length < STR_ROPE_MIN) {
+        // Appending in a loop grows the short last leaf instead of adding
+        // a leaf per piece
+        str_t* last = OBJECT_STRING(lhs->right);
+        if (last->data != NULL && last->length + rhs->length < STR_ROPE_MIN) {
+            object_t* leaf = vm_to_heap(object_new_string_concat(lhs->right, _rhs));
+            return object_new_rope(lhs->left, leaf);
+        }
+    }
+    object_t* obj = object_new_rope(_lhs, _rhs);
+    if (OBJECT_STRING(obj)->depth > STR_ROPE_MAX_DEPTH) {
+        size_t count;
+        object_t** leaves = str_leaves(OBJECT_STRING(obj), &count);
+        free(obj);
+        obj = object_new_rope_balanced(leaves, count);
+        free(leaves);
+    }
+    return obj;
+}
+
+object_t* object_new_string_join(object_t** _parts, size_t _count) {
+    size_t length = 0;
+    for (size_t i = 0; i < _count; i++) {
+        length += OBJECT_STRING(_parts[i])->length;
+    }
+    size_t head = OBJECT_STRING(_parts[0])->length;
+    if (length - head >= STR_ROPE_MIN) {
+        // Long pieces are linked one after the other as ropes
+        object_t* obj = _parts[0];
+        for (size_t i = 1; i < _count; i++) {
+            if (i > 1) vm_to_heap(obj);
+            obj = object_new_string_concat(obj, _parts[i]);
+        }
+        return obj;
+    }
+    // A long first piece (a string appended to) keeps growing as a rope,
+    // the rest is copied once
+    size_t first = (head >= STR_ROPE_MIN) ? 1 : 0;
+    object_t* obj = object_new_string_sized(NULL, length - ((first == 1) ? head : 0));
+    str_t* str = OBJECT_STRING(obj);
+    uint32_t ascii = STR_FLAG_ASCII;
+    size_t used = 0;
+    for (size_t i = first; i < _count; i++) {
+        str_t* part = OBJECT_STRING(_parts[i]);
+        memcpy(str->data + used, STR_BYTES(part), part->length);
+        used += part->length;
+        ascii &= part->flags;
+    }
+    str->flags |= ascii;
+    if (first == 1) {
+        return object_new_string_concat(_parts[0], vm_to_heap(obj));
+    }
+    return obj;
+}
+
+DLLEXPORT object_t* object_new_string_external(const char* _chars, size_t _length, string_release_function _release, void* _context) {
+    object_t* obj = (object_t*) malloc(sizeof(object_t) + sizeof(str_external_t));
+    ASSERTNULL(obj, "failed to allocate memory for object");
+    obj->value.opaque = str_init_external(obj + 1, _chars, _length, _release, _context, STR_FLAG_INLINE);
+    obj->type = OBJECT_TYPE_STRING;
+    obj->next = NULL;
+    obj->marked = false;
+    obj->immortal = false;
+    return obj;
+}
+
+DLLEXPORT object_t* object_new_string_slice(object_t* _str, size_t _offset, size_t _length) {
+    str_t* str = OBJECT_STRING(_str);
+    if (_offset > str->length || _length > str->length - _offset) {
+        return NULL;
+    }
+    char* bytes = STR_BYTES(str);
+    if (_length <= STR_INLINE_MAX) {
+        // Short slices are cheaper to copy than to keep the parent for
+        return object_new_string_sized(bytes + _offset, _length);
+    }
+    object_t* obj = (object_t*) malloc(sizeof(object_t) + sizeof(str_t));
+    ASSERTNULL(obj, "failed to allocate memory for object");
+    obj->value.opaque = str_init_slice(obj + 1, _str, _offset, _length, STR_FLAG_INLINE);
+    obj->type = OBJECT_TYPE_STRING;
+    obj->next = NULL;
+    obj->marked = false;
+    obj->immortal = false;
     return obj;
 }
 
+DLLEXPORT const char* object_string_bytes(object_t* _str, size_t* _length) {
+    str_t* str = OBJECT_STRING(_str);
+    *_length = str->length;
+    return STR_BYTES(str);
+}
+
+char* object_string_chars(object_t* _obj) {
+    return STR_CHARS(OBJECT_STRING(_obj));
+}
+
+size_t object_string_length(object_t* _obj) {
+    return OBJECT_STRING(_obj)->length;
+}
+
+DLLEXPORT object_t* object_new_null() {
+    return OBJECT_NULL;
+}
+
+DLLEXPORT object_t* object_new_bool(bool _value) {
+    return OBJECT_BOOL(_value);
+}
+
 DLLEXPORT object_t* object_new_array(size_t _length) {
     object_t* obj = object_new(OBJECT_TYPE_ARRAY);
     obj->value.opaque = array_new_initialized(_length);
     return obj;
 }
 
+object_t* object_new_array_sized(size_t _capacity) {
+    object_t* obj = object_new(OBJECT_TYPE_ARRAY);
+    obj->value.opaque = array_new(_capacity);
+    return obj;
+}
+
 DLLEXPORT object_t* object_new_range(long _start, long _end, long _step) {
     object_t* obj = object_new(OBJECT_TYPE_RANGE);
     obj->value.opaque = range_new(_start, _end, _step);
@@ -75,6 +282,9 @@ DLLEXPORT object_t* object_new_user_type(char* _name, object_t* _super, object_t
     user_type->name = _name;
     user_type->super = _super;
     user_type->prototype = _prototype;
+    user_type->methods = NULL;
+    user_type->version = 0;
+    user_type->layout = NULL;
     return obj;
 }
 
@@ -122,22 +332,24 @@ DLLEXPORT object_t* object_new_promise(async_state_t _state, object_t* _value) {
 
 DLLEXPORT char* object_to_string(object_t* _obj) {
     if (_obj == NULL) return string_allocate("<cnull>");
-    switch (_obj->type) {
-        case OBJECT_TYPE_INT:
-            return string_format("%d", _obj->value.i32);
+    switch (OBJECT_TYPE_OF(_obj)) {
+        case OBJECT_TYPE_INT: {
+            char buffer[NUMBER_FORMAT_MAX];
+            number_format_long(buffer, OBJECT_INT_VALUE(_obj));
+            return string_allocate(buffer);
+        }
         case OBJECT_TYPE_DOUBLE: {
-            double intpart;
-            if (modf(_obj->value.f64, &intpart) == 0.0) {
-                return string_format("%ld", (long) _obj->value.f64);
-            } else {
-                return string_format("%.2lf", (double) _obj->value.f64);
-            }
+            char buffer[NUMBER_FORMAT_MAX];
+            number_format_double(buffer, _obj->value.f64);
+            return string_allocate(buffer);
         }
         case OBJECT_TYPE_STRING: {
-            return string_allocate((char*) _obj->value.opaque);
+            // Copied straight from the bytes, a slice keeps borrowing them
+            str_t* str = OBJECT_STRING(_obj);
+            return string_format("%.*s", (int) str->length, STR_BYTES(str));
         }
         case OBJECT_TYPE_BOOL: {
-            return string_allocate(_obj->value.i32 ? "true" : "false");
+            return string_allocate(OBJECT_BOOL_VALUE(_obj) ? "true" : "false");
         }
         case OBJECT_TYPE_NULL: {
             return string_allocate("null");
@@ -288,15 +500,39 @@ DLLEXPORT char* object_to_string(object_t* _obj) {
     }
 }
 
+DLLEXPORT void object_print(object_t* _obj, FILE* _stream) {
+    char buffer[NUMBER_FORMAT_MAX];
+    if (_obj != NULL) {
+        switch (OBJECT_TYPE_OF(_obj)) {
+            case OBJECT_TYPE_INT:
+                fwrite(buffer, 1, number_format_long(buffer, OBJECT_INT_VALUE(_obj)), _stream);
+                return;
+            case OBJECT_TYPE_DOUBLE:
+                fwrite(buffer, 1, number_format_double(buffer, _obj->value.f64), _stream);
+                return;
+            case OBJECT_TYPE_STRING: {
+                str_t* str = OBJECT_STRING(_obj);
+                fwrite(STR_BYTES(str), 1, str->length, _stream);
+                return;
+            }
+            default:
+                break;
+        }
+    }
+    char* str = object_to_string(_obj);
+    fputs(str, _stream);
+    free(str);
+}
+
 DLLEXPORT bool object_is_truthy(object_t* _obj) {
-    switch (_obj->type) {
+    switch (OBJECT_TYPE_OF(_obj)) {
         case OBJECT_TYPE_INT:
         case OBJECT_TYPE_DOUBLE:
             return number_coerce_to_double(_obj) != 0;
         case OBJECT_TYPE_STRING:
-            return strlen((char*) _obj->value.opaque) > 0;
+            return OBJECT_STRING(_obj)->length > 0;
         case OBJECT_TYPE_BOOL:
-            return _obj->value.i32 != 0;
+            return OBJECT_BOOL_VALUE(_obj);
         case OBJECT_TYPE_NULL:
             return false;
         case OBJECT_TYPE_ARRAY:
@@ -317,34 +553,38 @@ DLLEXPORT bool object_is_truthy(object_t* _obj) {
 }
 
 DLLEXPORT bool object_is_error(object_t* _obj) {
-    return _obj->type == OBJECT_TYPE_ERROR;
+    return OBJECT_TYPE_ERROR(_obj);
 }
 
 DLLEXPORT bool object_is_number(object_t* _obj) {
-    switch (_obj->type) {
+    switch (OBJECT_TYPE_OF(_obj)) {
         case OBJECT_TYPE_INT:
         case OBJECT_TYPE_DOUBLE:
             return true;
-        case OBJECT_TYPE_STRING:
-            return string_is_number((char*) _obj->value.opaque);
+        case OBJECT_TYPE_STRING: {
+            double value;
+            int64_t integer;
+            return number_parse_string(_obj, &value, &integer);
+        }
         default:
             return false;
     }
 }
 
 DLLEXPORT bool object_equals(object_t* _obj1, object_t* _obj2) {
-    if (_obj1->type != _obj2->type) return false;
-    switch (_obj1->type) {
+    object_type_t type = OBJECT_TYPE_OF(_obj1);
+    if (type != OBJECT_TYPE_OF(_obj2)) return false;
+    switch (type) {
         case OBJECT_TYPE_INT:
-            return _obj1->value.i32 == _obj2->value.i32;
+            return OBJECT_INT_VALUE(_obj1) == OBJECT_INT_VALUE(_obj2);
         case OBJECT_TYPE_DOUBLE:
             return _obj1->value.f64 == _obj2->value.f64;
         case OBJECT_TYPE_STRING:
-            return strcmp((char*) _obj1->value.opaque, (char*) _obj2->value.opaque) == 0;
+            return str_equals(OBJECT_STRING(_obj1), OBJECT_STRING(_obj2));
         case OBJECT_TYPE_BOOL:
-            return _obj1->value.i32 == _obj2->value.i32;
+            return OBJECT_BOOL_VALUE(_obj1) == OBJECT_BOOL_VALUE(_obj2);
         case OBJECT_TYPE_NULL:
-            return _obj2->type == OBJECT_TYPE_NULL;
+            return true;
         case OBJECT_TYPE_PROMISE:
             return _obj1 == _obj2;
         case OBJECT_TYPE_ARRAY: {
@@ -369,11 +609,13 @@ DLLEXPORT bool object_equals(object_t* _obj1, object_t* _obj2) {
             hashmap_t* map1 = (hashmap_t*) _obj1->value.opaque;
             hashmap_t* map2 = (hashmap_t*) _obj2->value.opaque;
             if (map1->size != map2->size) return false;
-            for (size_t i = 0; i < map1->size; i++) {
-                object_t* key = map1->buckets[i]->key;
-                object_t* val1 = hashmap_get(map1, key);
+            hashmap_cursor_t cursor;
+            object_t* key;
+            object_t* val1;
+            hashmap_cursor_begin(map1, &cursor);
+            while (hashmap_cursor_next(map1, &cursor, &key, &val1)) {
                 object_t* val2 = hashmap_get(map2, key);
-                if (!object_equals(val1, val2)) return false;
+                if (val2 == NULL || !object_equals(val1, val2)) return false;
             }
             return true;
         }
@@ -391,7 +633,7 @@ DLLEXPORT bool object_equals(object_t* _obj1, object_t* _obj2) {
 
 DLLEXPORT char* object_type_to_string(object_t* _obj) {
     if (_obj == NULL) return string_allocate("<cnull>");
-    switch (_obj->type) {
+    switch (OBJECT_TYPE_OF(_obj)) {
         case OBJECT_TYPE_INT:
             return string_allocate("Int");
         case OBJECT_TYPE_DOUBLE:
@@ -430,9 +672,9 @@ DLLEXPORT char* object_type_to_string(object_t* _obj) {
 }
 
 DLLEXPORT size_t object_hash(object_t* _obj) {
-    switch (_obj->type) {
+    switch (OBJECT_TYPE_OF(_obj)) {
         case OBJECT_TYPE_INT:
-            return (size_t) _obj->value.i32;
+            return (size_t) OBJECT_INT_VALUE(_obj);
         case OBJECT_TYPE_DOUBLE: {
             double intpart;
             if (modf(_obj->value.f64, &intpart) == 0.0) {
@@ -459,9 +701,9 @@ DLLEXPORT size_t object_hash(object_t* _obj) {
             }
         }
         case OBJECT_TYPE_STRING:
-            return (size_t) hash64((char*) _obj->value.opaque);
+            return str_hash(OBJECT_STRING(_obj));
         case OBJECT_TYPE_BOOL:
-            return (size_t) _obj->value.i32;
+            return (size_t) OBJECT_BOOL_VALUE(_obj);
         case OBJECT_TYPE_NULL:
             return 0;
         case OBJECT_TYPE_PROMISE: {
@@ -505,11 +747,17 @@ DLLEXPORT size_t object_hash(object_t* _obj) {
                 size_t prime = 16777619u;   // FNV prime
             #endif
             hashmap_t* map = (hashmap_t*) _obj->value.opaque;
-            for (size_t i = 0; i < map->size; i++) {
-                object_t* key = map->buckets[i]->key;
-                hash ^= object_hash(key);
-                hash *= prime; // FNV prime
+            hashmap_cursor_t cursor;
+            object_t* key;
+            object_t* value;
+            size_t keys = 0;
+            // Summed so that equal objects hash alike whatever their key order
+            hashmap_cursor_begin(map, &cursor);
+            while (hashmap_cursor_next(map, &cursor, &key, &value)) {
+                keys += object_hash(key);
             }
+            hash ^= keys;
+            hash *= prime; // FNV prime
             return (size_t) hash;
         }
         case OBJECT_TYPE_FUNCTION:
@@ -545,106 +793,106 @@ char* object_object_to_string_with_indent(object_t* _obj, int _indent) {
     int next_indent = _indent + 1;
     
     size_t entries_added = 0;
-    for (size_t i = 0; i < map->bucket_count; i++) {
-        hashmap_node_t* node = map->buckets[i];
-        while (node) {
-            // Add indentation
-            if (used + next_indent + 1 >= capacity) {
-                capacity *= 2;
-                char* new_buf = realloc(result, capacity);
-                if (!new_buf) {
-                    free(result);
-                    return NULL;
-                }
-                result = new_buf;
-            }
-            
-            // Add proper indentation based on level
-            for (int j = 0; j < next_indent; j++) {
-                result[used++] = '\t';
-            }
-            
-            // Get string representation of key
-            char* key_str = object_to_string(node->key);
-            if (!key_str) {
+    hashmap_cursor_t cursor;
+    object_t* key;
+    object_t* value;
+    hashmap_cursor_begin(map, &cursor);
+    while (hashmap_cursor_next(map, &cursor, &key, &value)) {
+        // Add indentation
+        if (used + next_indent + 1 >= capacity) {
+            capacity *= 2;
+            char* new_buf = realloc(result, capacity);
+            if (!new_buf) {
                 free(result);
                 return NULL;
             }
-            
-            size_t key_len = strlen(key_str);
-            
-            // Ensure buffer has enough space for key
-            if (used + key_len + 2 >= capacity) {
-                capacity = capacity * 2 + key_len;
-                char* new_buf = realloc(result, capacity);
-                if (!new_buf) {
-                    free(key_str);
-                    free(result);
-                    return NULL;
-                }
-                result = new_buf;
-            }
-            
-            // Copy key string
-            memcpy(result + used, key_str, key_len);
-            used += key_len;
-            free(key_str);
-            
-            // Add ": " separator
-            if (used + 2 >= capacity) {
-                capacity *= 2;
-                char* new_buf = realloc(result, capacity);
-                if (!new_buf) {
-                    free(result);
-                    return NULL;
-                }
-                result = new_buf;
-            }
-            result[used++] = ':';
-            result[used++] = ' ';
-            
-            // Get string representation of value
-            char* val_str;
-            if (node->value->type == OBJECT_TYPE_OBJECT) {
-                // Recursively format nested objects with increased indentation
-                val_str = object_object_to_string_with_indent(node->value, next_indent);
-            } else {
-                val_str = object_to_string(node->value);
-            }
-            
-            if (!val_str) {
+            result = new_buf;
+        }
+        
+        // Add proper indentation based on level
+        for (int j = 0; j < next_indent; j++) {
+            result[used++] = '\t';
+        }
+        
+        // Get string representation of key
+        char* key_str = object_to_string(key);
+        if (!key_str) {
+            free(result);
+            return NULL;
+        }
+        
+        size_t key_len = strlen(key_str);
+        
+        // Ensure buffer has enough space for key
+        if (used + key_len + 2 >= capacity) {
+            capacity = capacity * 2 + key_len;
+            char* new_buf = realloc(result, capacity);
+            if (!new_buf) {
+                free(key_str);
                 free(result);
                 return NULL;
             }
-            
-            size_t val_len = strlen(val_str);
-            
-            // Ensure buffer has enough space for value
-            if (used + val_len + 2 >= capacity) {
-                capacity = capacity * 2 + val_len + 2;
-                char* new_buf = realloc(result, capacity);
-                if (!new_buf) {
-                    free(val_str);
-                    free(result);
-                    return NULL;
-                }
-                result = new_buf;
+            result = new_buf;
+        }
+        
+        // Copy key string
+        memcpy(result + used, key_str, key_len);
+        used += key_len;
+        free(key_str);
+        
+        // Add ": " separator
+        if (used + 2 >= capacity) {
+            capacity *= 2;
+            char* new_buf = realloc(result, capacity);
+            if (!new_buf) {
+                free(result);
+                return NULL;
             }
-            
-            // Copy value string
-            memcpy(result + used, val_str, val_len);
-            used += val_len;
-            free(val_str);
-            
-            // Add comma and newline if not the last element
-            if (entries_added < entries_count - 1) {
-                result[used++] = ',';
+            result = new_buf;
+        }
+        result[used++] = ':';
+        result[used++] = ' ';
+        
+        // Get string representation of value
+        char* val_str;
+        if (OBJECT_TYPE_OBJECT(value)) {
+            // Recursively format nested objects with increased indentation
+            val_str = object_object_to_string_with_indent(value, next_indent);
+        } else {
+            val_str = object_to_string(value);
+        }
+        
+        if (!val_str) {
+            free(result);
+            return NULL;
+        }
+        
+        size_t val_len = strlen(val_str);
+        
+        // Ensure buffer has enough space for value
+        if (used + val_len + 2 >= capacity) {
+            capacity = capacity * 2 + val_len + 2;
+            char* new_buf = realloc(result, capacity);
+            if (!new_buf) {
+                free(val_str);
+                free(result);
+                return NULL;
             }
-            result[used++] = '\n';
-            
-            entries_added++;
-            node = node->next;
+            result = new_buf;
+        }
+        
+        // Copy value string
+        memcpy(result + used, val_str, val_len);
+        used += val_len;
+        free(val_str);
+        
+        // Add comma and newline if not the last element
+        if (entries_added < entries_count - 1) {
+            result[used++] = ',';
         }
+        result[used++] = '\n';
+        
+        entries_added++;
     }
     
     // Add closing brace with proper indentation
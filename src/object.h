@@ -6,6 +6,7 @@
 #include "hashmap.h"
 #include "iterator.h"
 #include "range.h"
+#include "str.h"
 #include "type.h"
 
 #ifndef OBJECT_H
@@ -14,19 +15,30 @@
 typedef struct object_struct {
     object_type_t type;
     union object_union {
-        int    i32;
-        double f64;
+        int64_t i64;
+        double  f64;
         void*  opaque;
     } value;
     // for garbage collection
     bool      marked;
+    bool      immortal; // Never on the vm heap (literals and pinned atoms), see object_make_immortal
     object_t* next;
 } object_t;
 
+// The string header of a string object
+#define OBJECT_STRING(object) ((str_t*) (object)->value.opaque)
+
 typedef struct user_type_struct {
-    char*     name;
-    object_t* super;
-    object_t* prototype;
+    char*      name;
+    object_t*  super;
+    object_t*  prototype;
+    // Flattened prototype chain, maps each property to the prototype that
+    // defines it (built on demand, see vm.c)
+    hashmap_t* methods;
+    size_t     version; // Class version the table was built under
+    // Fields assigned through "this" in the class body and the classes it
+    // extends, instances reserve a slot for each (see OPCODE_LAYOUT_CLASS)
+    shape_t*   layout;
 } user_type_t;
 
 typedef struct user_type_instance_struct {
@@ -46,6 +58,89 @@ typedef struct user_type_instance_struct {
  */
 object_t* object_new_promise(async_state_t _state, object_t* _value);
 
+/*
+ * Creates a new 64-bit int object.
+ * 
+ * Values that fit in a handle are returned as an immediate int, the rest
+ * are boxed.
+ * 
+ * @param _value The value
+ * @return A new int object
+ */
+object_t* object_new_long(int64_t _value);
+
+/*
+ * Creates a new string object from a number of bytes. Short strings are
+ * allocated together with their object (see STR_INLINE_MAX).
+ * 
+ * @param _chars The bytes, NULL to write them through object_string_chars
+ * @param _length The number of bytes
+ * @return A new string object
+ */
+object_t* object_new_string_sized(const char* _chars, size_t _length);
+
+/*
+ * Creates a new string object holding two strings one after the other.
+ * 
+ * @param _lhs The first string object
+ * @param _rhs The second string object
+ * @return A new string object
+ */
+object_t* object_new_string_concat(object_t* _lhs, object_t* _rhs);
+
+/*
+ * Creates a new string object holding a number of strings one after the
+ * other, sized once.
+ * 
+ * @param _parts The string objects (at least one)
+ * @param _count The number of strings
+ * @return A new string object
+ */
+object_t* object_new_string_join(object_t** _parts, size_t _count);
+
+/*
+ * Gets the null terminated bytes of a string object.
+ * 
+ * @param _obj The string object
+ * @return The bytes, owned by the object
+ */
+char* object_string_chars(object_t* _obj);
+
+/*
+ * Gets the length in bytes of a string object.
+ * 
+ * @param _obj The string object
+ * @return The length
+ */
+size_t object_string_length(object_t* _obj);
+
+/*
+ * Creates a new empty object with room for a number of properties.
+ * 
+ * @param _capacity The expected number of properties
+ * @return A new object
+ */
+object_t* object_new_object_sized(size_t _capacity);
+
+/*
+ * Creates a new empty array with room for a number of elements.
+ * 
+ * @param _capacity The expected number of elements
+ * @return A new array object
+ */
+object_t* object_new_array_sized(size_t _capacity);
+
+/*
+ * Makes an object immortal: it is never linked into the vm heap, so the
+ * gc neither marks nor frees it. The owner (a code's literal table) frees
+ * it instead, pinned atoms live for the whole process. An object that is
+ * already on the heap is unlinked by the next sweep.
+ * 
+ * @param _obj The object (a string, double or boxed int)
+ * @return The object
+ */
+object_t* object_make_immortal(object_t* _obj);
+
 /*
  * Creates a new user-defined type object.
  * 
@@ -2,11 +2,11 @@
 #define OPCODE_H
 
 typedef enum opcode_enum {
-    OPCODE_LOAD_NAME                         = 75,   // Followed by the length of the name in bytes + 1 (for the null terminator)
+    OPCODE_LOAD_NAME                         = 75,   // Followed by 4 bytes (aka the constant index of the name)
     OPCODE_LOAD_INT                          = 76,   // Followed by 4 bytes
     OPCODE_LOAD_DOUBLE                       = 77,   // Followed by 8 bytes
     OPCODE_LOAD_BOOL                         = 78,   // Followed by 1 byte
-    OPCODE_LOAD_STRING                       = 79,   // Followed by the length of the string in bytes + 1 (for the null terminator)
+    OPCODE_LOAD_STRING                       = 79,   // Followed by 4 bytes (aka the constant index of the string)
     OPCODE_LOAD_NULL                         = 80,   // No following bytes
     OPCODE_LOAD_THIS                         = 81,   // No following bytes
     OPCODE_LOAD_SUPER                        = 82,   // No following bytes
@@ -16,18 +16,18 @@ typedef enum opcode_enum {
     OPCODE_LOAD_OBJECT                       = 86,   // Followed by 4 bytes (aka the number of properties)
     OPCODE_EXTEND_OBJECT                     = 87,   // No following bytes
     OPCODE_PUT_OBJECT                        = 88,   // No following bytes
-    OPCODE_STORE_NAME                        = 89,   // Followed by the length of the name in bytes + 1 (for the null terminator)
-    OPCODE_STORE_CLASS                       = 90,   // Followed by the length of the class name in bytes + 1 (for the null terminator)
-    OPCODE_SET_NAME                          = 91,   // Followed by the length of the name in bytes + 1 (for the null terminator)
+    OPCODE_STORE_NAME                        = 89,   // Followed by 4 bytes (aka the constant index of the name)
+    OPCODE_STORE_CLASS                       = 90,   // Followed by 4 bytes (aka the constant index of the class name)
+    OPCODE_SET_NAME                          = 91,   // Followed by 4 bytes (aka the constant index of the name)
     OPCODE_RANGE                             = 92,   // No following bytes
-    OPCODE_GET_PROPERTY                      = 93,   // Followed by the length of the property in bytes + 1 (for the null terminator)
+    OPCODE_GET_PROPERTY                      = 93,   // Followed by 4 bytes (aka the constant index of the property)
     OPCODE_INDEX                             = 94,   // No following bytes
     OPCODE_SET_INDEX                         = 95,   // No following bytes
     OPCODE_CALL_CONSTRUCTOR                  = 96,   // Followed by 4 bytes (aka the number of arguments)
     OPCODE_CALL                              = 97,   // Followed by 4 bytes (aka the number of arguments)
-    OPCODE_CALL_METHOD                       = 98,   // Followed by N bytes (aka the method name) + 1 byte (for the null terminator) + 4 bytes (aka the number of arguments)
-    OPCODE_INCREMENT                         = 99,   // No following bytes
-    OPCODE_DECREMENT                         = 100,  // No following bytes
+    OPCODE_CALL_METHOD                       = 98,   // Followed by 4 bytes (aka the constant index of the method name) + 4 bytes (aka the number of arguments)
+    OPCODE_INCREMENT                         = 99,   // Followed by 1 byte (aka the postfix flag)
+    OPCODE_DECREMENT                         = 100,  // Followed by 1 byte (aka the postfix flag)
     OPCODE_UNARY_PLUS                        = 101,  // No following bytes
     OPCODE_UNARY_MINUS                       = 102,  // No following bytes
     OPCODE_NOT                               = 103,  // No following bytes
@@ -74,17 +74,59 @@ typedef enum opcode_enum {
     OPCODE_ROT2                              = 144,  // No following bytes
     OPCODE_ROT3                              = 145,  // No following bytes
     OPCODE_ROT4                              = 146,  // No following bytes
-    OPCODE_SAVE_CAPTURES                     = 147,  // Followed by 4 bytes (aka the number of captures) + N bytes separated by null terminators
+    OPCODE_SAVE_CAPTURES                     = 147,  // Followed by 4 bytes (aka the number of captures) + 8 bytes per capture (aka the constant index of the name + the frame slot or -1)
     OPCODE_GET_ITERATOR_OR_JUMP              = 148,  // Followed by 4 bytes (aka jump offset)
     OPCODE_HAS_NEXT                          = 149,  // Followed by 4 bytes (aka jump offset)
     OPCODE_GET_NEXT_VALUE                    = 150,  // No following bytes
     OPCODE_GET_NEXT_KEY_VALUE                = 151,  // No following bytes
-    OPCODE_SET_PROPERTY                      = 152,  // Followed by the length of the property in bytes + 1 (for the null terminator)
+    OPCODE_SET_PROPERTY                      = 152,  // Followed by 4 bytes (aka the constant index of the property)
     OPCODE_AWAIT                             = 153,  // No following bytes
     OPCODE_CONTINUE                          = 154,  // No following bytes
     OPCODE_BREAK                             = 155,  // No following bytes
     OPCODE_BEGIN_LOOP_THREAD                 = 156,  // No following bytes
     OPCODE_END_LOOP_THREAD                   = 157,  // No following bytes
+    OPCODE_LOAD_LOCAL                        = 158,  // Followed by 4 bytes (aka the frame slot)
+    OPCODE_STORE_LOCAL                       = 159,  // Followed by 4 bytes (aka the frame slot)
+    OPCODE_SET_LOCAL                         = 160,  // Followed by 4 bytes (aka the frame slot)
+    // Superinstructions (selected by the peephole pass)
+    OPCODE_CMP_LT_JUMP_IF_FALSE              = 161,  // Followed by 4 bytes (aka jump offset)
+    OPCODE_CMP_LTE_JUMP_IF_FALSE             = 162,  // Followed by 4 bytes (aka jump offset)
+    OPCODE_CMP_GT_JUMP_IF_FALSE              = 163,  // Followed by 4 bytes (aka jump offset)
+    OPCODE_CMP_GTE_JUMP_IF_FALSE             = 164,  // Followed by 4 bytes (aka jump offset)
+    OPCODE_CMP_EQ_JUMP_IF_FALSE              = 165,  // Followed by 4 bytes (aka jump offset)
+    OPCODE_CMP_NE_JUMP_IF_FALSE              = 166,  // Followed by 4 bytes (aka jump offset)
+    OPCODE_LOAD_LOCAL_INT_BINARY             = 167,  // Followed by 4 bytes (aka the frame slot) + 4 bytes (aka the int) + 1 byte (aka the binary opcode)
+    OPCODE_LOAD_NAME_INT_BINARY              = 168,  // Followed by 4 bytes (aka the constant index of the name) + 4 bytes (aka the int) + 1 byte (aka the binary opcode)
+    OPCODE_INCREMENT_LOCAL                   = 169,  // Followed by 4 bytes (aka the frame slot) + 1 byte (aka OPCODE_INCREMENT or OPCODE_DECREMENT)
+    OPCODE_INCREMENT_NAME                    = 170,  // Followed by 4 bytes (aka the constant index of the name) + 1 byte (aka OPCODE_INCREMENT or OPCODE_DECREMENT)
+    OPCODE_SET_NAME_POP                      = 171,  // Followed by 4 bytes (aka the constant index of the name)
+    OPCODE_LOAD_LONG                         = 172,  // Followed by 8 bytes (aka a 64-bit int)
+    OPCODE_GET_FIELD                         = 173,  // Followed by 4 bytes (aka the constant index of the name) + 4 bytes (aka the layout slot)
+    OPCODE_SET_FIELD                         = 174,  // Followed by 4 bytes (aka the constant index of the name) + 4 bytes (aka the layout slot)
+    OPCODE_LAYOUT_CLASS                      = 175,  // Followed by 4 bytes (aka the field count) + 4 bytes per field (aka the constant index of the name)
+    OPCODE_NEW_ARRAY                         = 176,  // Followed by 4 bytes (aka the expected length)
+    OPCODE_NEW_OBJECT                        = 177,  // Followed by 4 bytes (aka the expected property count)
+    OPCODE_CONCAT_N                          = 178,  // Followed by 4 bytes (aka the number of operands)
+    // Quickened forms (rewritten in place by the VM, never emitted)
+    OPCODE_ADD_INT_INT                       = 179,  // No following bytes
+    OPCODE_ADD_DBL_DBL                       = 180,  // No following bytes
+    OPCODE_SUB_INT_INT                       = 181,  // No following bytes
+    OPCODE_SUB_DBL_DBL                       = 182,  // No following bytes
+    OPCODE_MUL_INT_INT                       = 183,  // No following bytes
+    OPCODE_MUL_DBL_DBL                       = 184,  // No following bytes
+    OPCODE_CONCAT_STR_STR                    = 185,  // No following bytes
+    OPCODE_CMP_LT_INT                        = 186,  // No following bytes
+    OPCODE_CMP_LTE_INT                       = 187,  // No following bytes
+    OPCODE_CMP_GT_INT                        = 188,  // No following bytes
+    OPCODE_CMP_GTE_INT                       = 189,  // No following bytes
+    OPCODE_CMP_EQ_INT                        = 190,  // No following bytes
+    OPCODE_CMP_NE_INT                        = 191,  // No following bytes
+    OPCODE_CMP_LT_INT_JUMP_IF_FALSE          = 192,  // Followed by 4 bytes (aka jump offset)
+    OPCODE_CMP_LTE_INT_JUMP_IF_FALSE         = 193,  // Followed by 4 bytes (aka jump offset)
+    OPCODE_CMP_GT_INT_JUMP_IF_FALSE          = 194,  // Followed by 4 bytes (aka jump offset)
+    OPCODE_CMP_GTE_INT_JUMP_IF_FALSE         = 195,  // Followed by 4 bytes (aka jump offset)
+    OPCODE_CMP_EQ_INT_JUMP_IF_FALSE          = 196,  // Followed by 4 bytes (aka jump offset)
+    OPCODE_CMP_NE_INT_JUMP_IF_FALSE          = 197,  // Followed by 4 bytes (aka jump offset)
     // NOTE: 255 is the last opcode
 } opcode_t;
 
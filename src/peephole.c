@@ -0,0 +1,328 @@
+#include "peephole.h"
+
+/*
+ * Fused sequences were picked from an opcode pair count over the example
+ * and test programs. The hottest pairs were:
+ *   SET_NAME  -> POPTOP            (assignment statements)
+ *   LOAD_NAME -> LOAD_INT -> ADD   (x + 1, i * 2, ...)
+ *   CMP_LT    -> POP_JUMP_IF_FALSE (loop and if conditions)
+ *   DUPTOP    -> INCREMENT -> SET_NAME -> POPTOP -> POPTOP (i++;)
+ */
+
+typedef struct peephole_instruction_struct {
+    size_t  offset;
+    size_t  size;
+    uint8_t opcode;
+} peephole_instruction_t;
+
+INTERNAL int peephole_get_int(uint8_t* _bytecode, size_t _ip) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        value = value | ((uint32_t)_bytecode[_ip + i] << (i * 8));
+    }
+    return (int)value;
+}
+
+INTERNAL void peephole_put_int(uint8_t* _bytecode, size_t _ip, int _value) {
+    for (size_t i = 0; i < 4; i++) {
+        _bytecode[_ip + i] = (uint8_t)((_value >> (i * 8)) & 0xFF);
+    }
+}
+
+INTERNAL void* peephole_get_memory(uint8_t* _bytecode, size_t _ip) {
+    uintptr_t value = 0;
+    for (size_t i = 0; i < 8; i++) {
+        value |= ((uintptr_t)_bytecode[_ip + i] << (i * 8));
+    }
+    return (void*)value;
+}
+
+size_t peephole_instruction_size(uint8_t* _bytecode, size_t _ip) {
+    switch (_bytecode[_ip]) {
+        case OPCODE_LOAD_BOOL:
+        case OPCODE_INCREMENT:
+        case OPCODE_DECREMENT:
+            return 1 + 1;
+        case OPCODE_LOAD_NAME:
+        case OPCODE_LOAD_INT:
+        case OPCODE_LOAD_STRING:
+        case OPCODE_LOAD_ARRAY:
+        case OPCODE_LOAD_OBJECT:
+        case OPCODE_NEW_ARRAY:
+        case OPCODE_NEW_OBJECT:
+        case OPCODE_CONCAT_N:
+        case OPCODE_STORE_NAME:
+        case OPCODE_STORE_CLASS:
+        case OPCODE_SET_NAME:
+        case OPCODE_GET_PROPERTY:
+        case OPCODE_CALL_CONSTRUCTOR:
+        case OPCODE_CALL:
+        case OPCODE_POP_JUMP_IF_FALSE:
+        case OPCODE_POP_JUMP_IF_TRUE:
+        case OPCODE_JUMP_IF_FALSE_OR_POP:
+        case OPCODE_JUMP_IF_TRUE_OR_POP:
+        case OPCODE_JUMP_IF_NOT_ERROR:
+        case OPCODE_JUMP_FORWARD:
+        case OPCODE_JUMP_IF_CONTINUE:
+        case OPCODE_JUMP_IF_BREAK:
+        case OPCODE_ABSOLUTE_JUMP:
+        case OPCODE_GET_ITERATOR_OR_JUMP:
+        case OPCODE_HAS_NEXT:
+        case OPCODE_SET_PROPERTY:
+        case OPCODE_LOAD_LOCAL:
+        case OPCODE_STORE_LOCAL:
+        case OPCODE_SET_LOCAL:
+        case OPCODE_CMP_LT_JUMP_IF_FALSE:
+        case OPCODE_CMP_LTE_JUMP_IF_FALSE:
+        case OPCODE_CMP_GT_JUMP_IF_FALSE:
+        case OPCODE_CMP_GTE_JUMP_IF_FALSE:
+        case OPCODE_CMP_EQ_JUMP_IF_FALSE:
+        case OPCODE_CMP_NE_JUMP_IF_FALSE:
+        case OPCODE_SET_NAME_POP:
+            return 1 + 4;
+        case OPCODE_INCREMENT_LOCAL:
+        case OPCODE_INCREMENT_NAME:
+            return 1 + 4 + 1;
+        case OPCODE_LOAD_DOUBLE:
+        case OPCODE_LOAD_LONG:
+        case OPCODE_CALL_METHOD:
+        case OPCODE_BEGIN_CLASS:
+        case OPCODE_BEGIN_FUNCTION:
+        case OPCODE_BEGIN_BLOCK:
+        case OPCODE_SETUP_CATCH_BLOCK:
+            return 1 + 8;
+        case OPCODE_GET_FIELD:
+        case OPCODE_SET_FIELD:
+            return 1 + 4 + 4;
+        case OPCODE_LOAD_LOCAL_INT_BINARY:
+        case OPCODE_LOAD_NAME_INT_BINARY:
+            return 1 + 4 + 4 + 1;
+        case OPCODE_SAVE_CAPTURES:
+            return 1 + 4 + (8 * (size_t)peephole_get_int(_bytecode, _ip + 1));
+        case OPCODE_LAYOUT_CLASS:
+            return 1 + 4 + (4 * (size_t)peephole_get_int(_bytecode, _ip + 1));
+        default:
+            return 1;
+    }
+}
+
+INTERNAL bool peephole_is_jump(uint8_t _opcode) {
+    switch (_opcode) {
+        case OPCODE_POP_JUMP_IF_FALSE:
+        case OPCODE_POP_JUMP_IF_TRUE:
+        case OPCODE_JUMP_IF_FALSE_OR_POP:
+        case OPCODE_JUMP_IF_TRUE_OR_POP:
+        case OPCODE_JUMP_IF_NOT_ERROR:
+        case OPCODE_JUMP_FORWARD:
+        case OPCODE_JUMP_IF_CONTINUE:
+        case OPCODE_JUMP_IF_BREAK:
+        case OPCODE_ABSOLUTE_JUMP:
+        case OPCODE_GET_ITERATOR_OR_JUMP:
+        case OPCODE_HAS_NEXT:
+        case OPCODE_CMP_LT_JUMP_IF_FALSE:
+        case OPCODE_CMP_LTE_JUMP_IF_FALSE:
+        case OPCODE_CMP_GT_JUMP_IF_FALSE:
+        case OPCODE_CMP_GTE_JUMP_IF_FALSE:
+        case OPCODE_CMP_EQ_JUMP_IF_FALSE:
+        case OPCODE_CMP_NE_JUMP_IF_FALSE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+INTERNAL bool peephole_is_binary(uint8_t _opcode) {
+    switch (_opcode) {
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_MOD:
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_SHL:
+        case OPCODE_SHR:
+        case OPCODE_CMP_LT:
+        case OPCODE_CMP_LTE:
+        case OPCODE_CMP_GT:
+        case OPCODE_CMP_GTE:
+        case OPCODE_CMP_EQ:
+        case OPCODE_CMP_NE:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Check that the next _length instructions exist and that none but the
+ * first is a jump target, so the sequence can be fused safely.
+ */
+INTERNAL bool peephole_can_fuse(peephole_instruction_t* _instructions, size_t _count, size_t _index, size_t _length, bool* _is_target) {
+    if (_index + _length > _count) {
+        return false;
+    }
+    for (size_t i = 1; i < _length; i++) {
+        if (_is_target[_instructions[_index + i].offset]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Try to fuse the sequence starting at _index.
+ *
+ * @return The number of instructions consumed (0 if nothing was fused).
+ */
+INTERNAL size_t peephole_fuse(uint8_t* _bytecode, peephole_instruction_t* _instructions, size_t _count, size_t _index, bool* _is_target, uint8_t* _out, size_t* _size) {
+    #define OP(k) (_instructions[_index + (k)].opcode)
+    #define ARG(k) (peephole_get_int(_bytecode, _instructions[_index + (k)].offset + 1))
+    #define OUT(byte) (_out[(*_size)++] = (uint8_t)(byte))
+    #define OUT_INT(value) { peephole_put_int(_out, *_size, value); *_size += 4; }
+
+    bool is_local = (OP(0) == OPCODE_LOAD_LOCAL);
+    bool is_name  = (OP(0) == OPCODE_LOAD_NAME);
+    uint8_t set_opcode = is_local ? OPCODE_SET_LOCAL : OPCODE_SET_NAME;
+    uint8_t inc_opcode = is_local ? OPCODE_INCREMENT_LOCAL : OPCODE_INCREMENT_NAME;
+
+    // x++; x--; (LOAD x, DUPTOP, INCREMENT, SET x, POPTOP, POPTOP)
+    if ((is_local || is_name) && peephole_can_fuse(_instructions, _count, _index, 6, _is_target) &&
+        OP(1) == OPCODE_DUPTOP &&
+        (OP(2) == OPCODE_INCREMENT || OP(2) == OPCODE_DECREMENT) &&
+        OP(3) == set_opcode && ARG(3) == ARG(0) &&
+        OP(4) == OPCODE_POPTOP &&
+        OP(5) == OPCODE_POPTOP) {
+        OUT(inc_opcode);
+        OUT_INT(ARG(0));
+        OUT(OP(2));
+        return 6;
+    }
+
+    // ++x; --x; (LOAD x, INCREMENT, SET x, POPTOP)
+    if ((is_local || is_name) && peephole_can_fuse(_instructions, _count, _index, 4, _is_target) &&
+        (OP(1) == OPCODE_INCREMENT || OP(1) == OPCODE_DECREMENT) &&
+        OP(2) == set_opcode && ARG(2) == ARG(0) &&
+        OP(3) == OPCODE_POPTOP) {
+        OUT(inc_opcode);
+        OUT_INT(ARG(0));
+        OUT(OP(1));
+        return 4;
+    }
+
+    // x + 1, i < 10, ... (LOAD x, LOAD_INT, binary)
+    if ((is_local || is_name) && peephole_can_fuse(_instructions, _count, _index, 3, _is_target) &&
+        OP(1) == OPCODE_LOAD_INT &&
+        peephole_is_binary(OP(2))) {
+        OUT(is_local ? OPCODE_LOAD_LOCAL_INT_BINARY : OPCODE_LOAD_NAME_INT_BINARY);
+        OUT_INT(ARG(0));
+        OUT_INT(ARG(1));
+        OUT(OP(2));
+        return 3;
+    }
+
+    if (!peephole_can_fuse(_instructions, _count, _index, 2, _is_target)) {
+        return 0;
+    }
+
+    // Compare and branch
+    if (OP(0) >= OPCODE_CMP_LT && OP(0) <= OPCODE_CMP_NE && OP(1) == OPCODE_POP_JUMP_IF_FALSE) {
+        OUT(OPCODE_CMP_LT_JUMP_IF_FALSE + (OP(0) - OPCODE_CMP_LT));
+        OUT_INT(ARG(1));
+        return 2;
+    }
+
+    // Assignment statements
+    if (OP(0) == OPCODE_SET_LOCAL && OP(1) == OPCODE_POPTOP) {
+        OUT(OPCODE_STORE_LOCAL);
+        OUT_INT(ARG(0));
+        return 2;
+    }
+    if (OP(0) == OPCODE_SET_NAME && OP(1) == OPCODE_POPTOP) {
+        OUT(OPCODE_SET_NAME_POP);
+        OUT_INT(ARG(0));
+        return 2;
+    }
+    if (OP(0) == OPCODE_DUPTOP && OP(1) == OPCODE_STORE_LOCAL) {
+        OUT(OPCODE_SET_LOCAL);
+        OUT_INT(ARG(1));
+        return 2;
+    }
+
+    return 0;
+
+    #undef OP
+    #undef ARG
+    #undef OUT
+    #undef OUT_INT
+}
+
+void peephole_optimize(code_t* _code) {
+    uint8_t* bytecode = _code->bytecode;
+    size_t size = _code->size;
+
+    // Split the bytecode into instructions
+    peephole_instruction_t* instructions = (peephole_instruction_t*)malloc(sizeof(peephole_instruction_t) * (size + 1));
+    ASSERTNULL(instructions, "failed to allocate memory for peephole instructions");
+    size_t count = 0;
+    for (size_t ip = 0; ip < size; ip += instructions[count - 1].size) {
+        instructions[count].offset = ip;
+        instructions[count].opcode = bytecode[ip];
+        instructions[count].size   = peephole_instruction_size(bytecode, ip);
+        count++;
+    }
+
+    // Mark every jump target, sequences may not be fused across them
+    bool* is_target = (bool*)calloc(size + 1, sizeof(bool));
+    ASSERTNULL(is_target, "failed to allocate memory for jump targets");
+    for (size_t i = 0; i < count; i++) {
+        if (!peephole_is_jump(instructions[i].opcode)) continue;
+        int target = peephole_get_int(bytecode, instructions[i].offset + 1);
+        if (target < 0 || (size_t)target > size) {
+            PD("invalid jump target %d in %s", target, _code->block_name);
+        }
+        is_target[target] = true;
+    }
+
+    // Fused sequences are never longer than the original ones
+    uint8_t* out = (uint8_t*)malloc(sizeof(uint8_t) * (size + 1));
+    ASSERTNULL(out, "failed to allocate memory for bytecode");
+    size_t* new_offset = (size_t*)malloc(sizeof(size_t) * (size + 1));
+    ASSERTNULL(new_offset, "failed to allocate memory for offsets");
+
+    size_t new_size = 0;
+    size_t index = 0;
+    while (index < count) {
+        new_offset[instructions[index].offset] = new_size;
+        size_t consumed = peephole_fuse(bytecode, instructions, count, index, is_target, out, &new_size);
+        if (consumed == 0) {
+            memcpy(out + new_size, bytecode + instructions[index].offset, instructions[index].size);
+            new_size += instructions[index].size;
+            consumed = 1;
+        }
+        index += consumed;
+    }
+    new_offset[size] = new_size;
+
+    // Relocate jumps and optimize nested codes
+    for (size_t ip = 0; ip < new_size; ip += peephole_instruction_size(out, ip)) {
+        uint8_t opcode = out[ip];
+        if (peephole_is_jump(opcode)) {
+            peephole_put_int(out, ip + 1, (int)new_offset[peephole_get_int(out, ip + 1)]);
+        } else if (
+            opcode == OPCODE_BEGIN_CLASS ||
+            opcode == OPCODE_BEGIN_FUNCTION ||
+            opcode == OPCODE_BEGIN_BLOCK ||
+            opcode == OPCODE_SETUP_CATCH_BLOCK) {
+            peephole_optimize((code_t*)peephole_get_memory(out, ip + 1));
+        }
+    }
+
+    free(instructions);
+    free(is_target);
+    free(new_offset);
+    free(_code->bytecode);
+    _code->bytecode = out;
+    _code->size = new_size;
+}
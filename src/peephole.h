@@ -0,0 +1,26 @@
+#include "api/core/global.h"
+#include "api/core/internal.h"
+#include "code.h"
+#include "opcode.h"
+
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+/*
+ * Rewrite common opcode sequences into superinstructions.
+ * Nested codes (functions, blocks, classes) are optimized as well.
+ *
+ * @param _code The code to optimize.
+ */
+void peephole_optimize(code_t* _code);
+
+/*
+ * Get the size of an instruction (opcode and operands).
+ *
+ * @param _bytecode The bytecode.
+ * @param _ip The offset of the instruction.
+ * @return The size in bytes.
+ */
+size_t peephole_instruction_size(uint8_t* _bytecode, size_t _ip);
+
+#endif
@@ -0,0 +1,591 @@
+#include "eval.h"
+#include "register.h"
+
+/*
+ * Register allocation follows the stack VM frame layout:
+ *   r0           receiver (this)
+ *   r1..rN       parameters, in declaration order
+ *   rN+1..       locals and temporaries, allocated like a stack and
+ *                released at the end of each expression or block
+ * Locals get a register for their whole lifetime so reads are free,
+ * temporaries only exist while an expression is being evaluated.
+ */
+
+typedef struct register_symbol_struct {
+    char* name;
+    int   reg;
+} register_symbol_t;
+
+typedef struct register_compiler_struct {
+    code_t*            code;
+    register_code_t*   output;
+    register_symbol_t* symbols;
+    size_t             symbol_count;
+    size_t             symbol_capacity;
+    int                top;
+    bool               failed;
+} register_compiler_t;
+
+INTERNAL void register_expression(register_compiler_t* _compiler, ast_node_t* _expression, int _dst);
+INTERNAL void register_statement(register_compiler_t* _compiler, ast_node_t* _statement);
+
+INTERNAL int register_emit(register_compiler_t* _compiler, register_opcode_t _opcode, int _a, int _b, int _c) {
+    register_code_t* output = _compiler->output;
+    if (output->count >= output->capacity) {
+        output->capacity = (output->capacity == 0) ? 16 : output->capacity * 2;
+        output->instructions = (register_instruction_t*) realloc(output->instructions, sizeof(register_instruction_t) * output->capacity);
+        ASSERTNULL(output->instructions, "failed to allocate memory for register code");
+    }
+    register_instruction_t* instruction = &output->instructions[output->count];
+    instruction->opcode = (uint8_t) _opcode;
+    instruction->a = _a;
+    instruction->b = _b;
+    instruction->c = _c;
+    return (int) output->count++;
+}
+
+INTERNAL int register_here(register_compiler_t* _compiler) {
+    return (int) _compiler->output->count;
+}
+
+/*
+ * Point a jump emitted earlier at the next instruction.
+ * The operand that holds the target depends on the kind of jump.
+ */
+INTERNAL void register_label(register_compiler_t* _compiler, int _jump) {
+    register_instruction_t* instruction = &_compiler->output->instructions[_jump];
+    int target = register_here(_compiler);
+    switch (instruction->opcode) {
+        case ROP_JUMP:
+            instruction->a = target;
+            break;
+        case ROP_JUMP_IF_FALSE:
+        case ROP_JUMP_IF_TRUE:
+            instruction->b = target;
+            break;
+        default:
+            instruction->c = target;
+            break;
+    }
+}
+
+INTERNAL int register_allocate(register_compiler_t* _compiler) {
+    int reg = _compiler->top++;
+    if ((size_t) _compiler->top > _compiler->output->register_count) {
+        _compiler->output->register_count = (size_t) _compiler->top;
+    }
+    return reg;
+}
+
+INTERNAL void register_declare(register_compiler_t* _compiler, char* _name, int _reg) {
+    if (_compiler->symbol_count >= _compiler->symbol_capacity) {
+        _compiler->symbol_capacity = (_compiler->symbol_capacity == 0) ? 8 : _compiler->symbol_capacity * 2;
+        _compiler->symbols = (register_symbol_t*) realloc(_compiler->symbols, sizeof(register_symbol_t) * _compiler->symbol_capacity);
+        ASSERTNULL(_compiler->symbols, "failed to allocate memory for register symbols");
+    }
+    _compiler->symbols[_compiler->symbol_count].name = _name;
+    _compiler->symbols[_compiler->symbol_count].reg  = _reg;
+    _compiler->symbol_count++;
+}
+
+/*
+ * Find the register of a local (innermost declaration wins).
+ *
+ * @return The register or -1 if the name is not a local.
+ */
+INTERNAL int register_lookup(register_compiler_t* _compiler, char* _name) {
+    for (size_t i = _compiler->symbol_count; i > 0; i--) {
+        if (strcmp(_compiler->symbols[i - 1].name, _name) == 0) {
+            return _compiler->symbols[i - 1].reg;
+        }
+    }
+    return -1;
+}
+
+INTERNAL void register_unsupported(register_compiler_t* _compiler) {
+    _compiler->failed = true;
+}
+
+// Same definition as the stack generator, so both tiers fold the same nodes
+INTERNAL bool register_is_constant_node(ast_node_t* _expression) {
+    switch (_expression->type) {
+        case AstInt:
+        case AstLong:
+        case AstFloat:
+        case AstDouble:
+        case AstString:
+        case AstBoolean:
+        case AstNull:
+            return true;
+        case AstBinaryMul:
+        case AstBinaryDiv:
+        case AstBinaryMod:
+        case AstBinaryAdd:
+        case AstBinarySub:
+        case AstBinaryShl:
+        case AstBinaryShr:
+        case AstLogicalAnd:
+        case AstLogicalOr:
+            return register_is_constant_node(_expression->ast0) && register_is_constant_node(_expression->ast1);
+        default:
+            return false;
+    }
+}
+
+// Whether a constant only has leaves the register tier can load
+INTERNAL bool register_is_foldable_node(ast_node_t* _expression) {
+    switch (_expression->type) {
+        case AstInt:
+        case AstBoolean:
+        case AstNull:
+            return true;
+        case AstBinaryMul:
+        case AstBinaryDiv:
+        case AstBinaryMod:
+        case AstBinaryAdd:
+        case AstBinarySub:
+        case AstBinaryShl:
+        case AstBinaryShr:
+        case AstLogicalAnd:
+        case AstLogicalOr:
+            return register_is_foldable_node(_expression->ast0) && register_is_foldable_node(_expression->ast1);
+        default:
+            return false;
+    }
+}
+
+INTERNAL bool register_has_assignment(ast_node_t* _expression) {
+    if (_expression == NULL) {
+        return false;
+    }
+    if (_expression->type == AstAssign) {
+        return true;
+    }
+    if (register_has_assignment(_expression->ast0) || register_has_assignment(_expression->ast1)) {
+        return true;
+    }
+    if (_expression->type == AstCall) {
+        for (size_t i = 0; _expression->array0[i] != NULL; i++) {
+            if (register_has_assignment(_expression->array0[i])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * Whether an expression only writes its destination with its last
+ * instruction, so a local can be used as the destination directly.
+ */
+INTERNAL bool register_writes_last(ast_node_t* _expression) {
+    switch (_expression->type) {
+        case AstInt:
+        case AstBoolean:
+        case AstNull:
+        case AstBinaryMul:
+        case AstBinaryDiv:
+        case AstBinaryMod:
+        case AstBinaryAdd:
+        case AstBinarySub:
+        case AstCmpLt:
+        case AstCmpLte:
+        case AstCmpGt:
+        case AstCmpGte:
+        case AstCmpEq:
+        case AstCmpNe:
+        case AstCall:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Get a register holding the value of an expression, locals are read in
+ * place and anything else is evaluated into a new temporary.
+ */
+INTERNAL int register_operand(register_compiler_t* _compiler, ast_node_t* _expression) {
+    if (_expression->type == AstName) {
+        int reg = register_lookup(_compiler, _expression->str0);
+        if (reg >= 0) {
+            return reg;
+        }
+    }
+    int reg = register_allocate(_compiler);
+    register_expression(_compiler, _expression, reg);
+    return reg;
+}
+
+INTERNAL void register_fold(register_compiler_t* _compiler, ast_node_t* _expression, int _dst) {
+    if (!register_is_foldable_node(_expression)) {
+        register_unsupported(_compiler);
+        return;
+    }
+    eval_result_t result = eval_eval(_expression);
+    switch (result.type) {
+        case EvalInt:
+            register_emit(_compiler, ROP_LOAD_INT, _dst, result.value.i32, 0);
+            break;
+        case EvalBoolean:
+            register_emit(_compiler, ROP_LOAD_BOOL, _dst, result.value.i32 == 1, 0);
+            break;
+        case EvalNull:
+            register_emit(_compiler, ROP_LOAD_NULL, _dst, 0, 0);
+            break;
+        default:
+            register_unsupported(_compiler);
+            break;
+    }
+}
+
+INTERNAL void register_binary(register_compiler_t* _compiler, ast_node_t* _expression, register_opcode_t _opcode, int _dst) {
+    int top = _compiler->top;
+    int lhs;
+    // The left value must be copied if the right side can overwrite it
+    if (register_has_assignment(_expression->ast1)) {
+        lhs = register_allocate(_compiler);
+        register_expression(_compiler, _expression->ast0, lhs);
+    } else {
+        lhs = register_operand(_compiler, _expression->ast0);
+    }
+    int rhs = register_operand(_compiler, _expression->ast1);
+    register_emit(_compiler, _opcode, _dst, lhs, rhs);
+    _compiler->top = top;
+}
+
+INTERNAL void register_call(register_compiler_t* _compiler, ast_node_t* _expression, int _dst) {
+    ast_node_t* function      = _expression->ast0;
+    ast_node_list_t arguments = _expression->array0;
+    if (function->type == AstMemberAccess) {
+        register_unsupported(_compiler);
+        return;
+    }
+    int argc;
+    for (argc = 0; arguments[argc] != NULL; argc++) {
+        if (arguments[argc]->type == AstUnarySpread) {
+            register_unsupported(_compiler);
+            return;
+        }
+    }
+    int top  = _compiler->top;
+    int base = register_allocate(_compiler);
+    for (int i = 0; i < argc; i++) {
+        register_allocate(_compiler);
+    }
+    // Same evaluation order as the stack generator (arguments right to left, then the function)
+    for (int i = argc - 1; i >= 0; i--) {
+        register_expression(_compiler, arguments[i], base + 1 + i);
+    }
+    register_expression(_compiler, function, base);
+    register_emit(_compiler, ROP_CALL, _dst, base, argc);
+    _compiler->top = top;
+}
+
+INTERNAL void register_assignment(register_compiler_t* _compiler, ast_node_t* _expression, int _dst) {
+    ast_node_t* lhs = _expression->ast0;
+    ast_node_t* rhs = _expression->ast1;
+    if (lhs->type != AstName) {
+        register_unsupported(_compiler);
+        return;
+    }
+    int reg = register_lookup(_compiler, lhs->str0);
+    if (reg < 0) {
+        register_expression(_compiler, rhs, _dst);
+        register_emit(_compiler, ROP_SET_NAME, _dst, code_add_constant(_compiler->code, lhs->str0), 0);
+        return;
+    }
+    if (register_writes_last(rhs)) {
+        register_expression(_compiler, rhs, reg);
+    } else {
+        int top = _compiler->top;
+        int value = register_allocate(_compiler);
+        register_expression(_compiler, rhs, value);
+        register_emit(_compiler, ROP_MOVE, reg, value, 0);
+        _compiler->top = top;
+    }
+    if (_dst != reg) {
+        register_emit(_compiler, ROP_MOVE, _dst, reg, 0);
+    }
+}
+
+INTERNAL void register_expression(register_compiler_t* _compiler, ast_node_t* _expression, int _dst) {
+    if (_compiler->failed) {
+        return;
+    }
+    switch (_expression->type) {
+        case AstName: {
+            int reg = register_lookup(_compiler, _expression->str0);
+            if (reg >= 0) {
+                if (reg != _dst) register_emit(_compiler, ROP_MOVE, _dst, reg, 0);
+                break;
+            }
+            register_emit(_compiler, ROP_LOAD_NAME, _dst, code_add_constant(_compiler->code, _expression->str0), 0);
+            break;
+        }
+        case AstInt:
+            register_emit(_compiler, ROP_LOAD_INT, _dst, _expression->value.i32, 0);
+            break;
+        case AstBoolean:
+            register_emit(_compiler, ROP_LOAD_BOOL, _dst, _expression->value.i32 == 1, 0);
+            break;
+        case AstNull:
+            register_emit(_compiler, ROP_LOAD_NULL, _dst, 0, 0);
+            break;
+        case AstCall:
+            register_call(_compiler, _expression, _dst);
+            break;
+        case AstBinaryMul:
+        case AstBinaryDiv:
+        case AstBinaryMod:
+        case AstBinaryAdd:
+        case AstBinarySub: {
+            if (register_is_constant_node(_expression)) {
+                register_fold(_compiler, _expression, _dst);
+                break;
+            }
+            register_opcode_t opcode = ROP_MUL + (_expression->type - AstBinaryMul);
+            register_binary(_compiler, _expression, opcode, _dst);
+            break;
+        }
+        case AstCmpLt:
+        case AstCmpLte:
+        case AstCmpGt:
+        case AstCmpGte:
+        case AstCmpEq:
+        case AstCmpNe: {
+            register_opcode_t opcode = ROP_CMP_LT + (_expression->type - AstCmpLt);
+            register_binary(_compiler, _expression, opcode, _dst);
+            break;
+        }
+        case AstLogicalAnd:
+        case AstLogicalOr: {
+            if (register_is_constant_node(_expression)) {
+                register_fold(_compiler, _expression, _dst);
+                break;
+            }
+            // The left value is the result when it short circuits
+            register_expression(_compiler, _expression->ast0, _dst);
+            int jump = register_emit(
+                _compiler,
+                (_expression->type == AstLogicalAnd) ? ROP_JUMP_IF_FALSE : ROP_JUMP_IF_TRUE,
+                _dst,
+                0,
+                0
+            );
+            register_expression(_compiler, _expression->ast1, _dst);
+            register_label(_compiler, jump);
+            break;
+        }
+        case AstAssign:
+            register_assignment(_compiler, _expression, _dst);
+            break;
+        default:
+            register_unsupported(_compiler);
+            break;
+    }
+}
+
+/*
+ * Compile a condition that jumps when it is false.
+ * Comparisons become a single compare-and-branch instruction.
+ *
+ * @param _jumps Receives the jumps to patch with the false target.
+ * @return The number of jumps written.
+ */
+INTERNAL size_t register_condition(register_compiler_t* _compiler, ast_node_t* _condition, int* _jumps, size_t _capacity) {
+    if (_compiler->failed || _capacity == 0) {
+        register_unsupported(_compiler);
+        return 0;
+    }
+    int top = _compiler->top;
+    switch (_condition->type) {
+        case AstCmpLt:
+        case AstCmpLte:
+        case AstCmpGt:
+        case AstCmpGte:
+        case AstCmpEq:
+        case AstCmpNe: {
+            int lhs;
+            if (register_has_assignment(_condition->ast1)) {
+                lhs = register_allocate(_compiler);
+                register_expression(_compiler, _condition->ast0, lhs);
+            } else {
+                lhs = register_operand(_compiler, _condition->ast0);
+            }
+            int rhs = register_operand(_compiler, _condition->ast1);
+            register_opcode_t opcode = ROP_LT_JUMP_IF_FALSE + (_condition->type - AstCmpLt);
+            _jumps[0] = register_emit(_compiler, opcode, lhs, rhs, 0);
+            _compiler->top = top;
+            return 1;
+        }
+        case AstLogicalAnd: {
+            if (register_is_constant_node(_condition)) {
+                break;
+            }
+            size_t count = register_condition(_compiler, _condition->ast0, _jumps, _capacity);
+            return count + register_condition(_compiler, _condition->ast1, _jumps + count, _capacity - count);
+        }
+        default:
+            break;
+    }
+    int value = register_operand(_compiler, _condition);
+    _jumps[0] = register_emit(_compiler, ROP_JUMP_IF_FALSE, value, 0, 0);
+    _compiler->top = top;
+    return 1;
+}
+
+#define REGISTER_MAX_CONDITION_JUMPS 16
+
+INTERNAL void register_block(register_compiler_t* _compiler, ast_node_t* _statement) {
+    // Locals declared inside go out of scope (and free their registers) at the end
+    size_t symbol_count = _compiler->symbol_count;
+    int top = _compiler->top;
+    register_statement(_compiler, _statement);
+    _compiler->symbol_count = symbol_count;
+    _compiler->top = top;
+}
+
+INTERNAL void register_statement(register_compiler_t* _compiler, ast_node_t* _statement) {
+    if (_compiler->failed) {
+        return;
+    }
+    switch (_statement->type) {
+        case AstConstStatement:
+        case AstLocalStatement: {
+            ast_node_list_t names  = _statement->array0;
+            ast_node_list_t values = _statement->array1;
+            for (size_t i = 0; names[i] != NULL; i++) {
+                int reg = register_allocate(_compiler);
+                if (values[i] != NULL) {
+                    register_expression(_compiler, values[i], reg);
+                } else {
+                    register_emit(_compiler, ROP_LOAD_NULL, reg, 0, 0);
+                }
+                register_declare(_compiler, names[i]->str0, reg);
+            }
+            break;
+        }
+        case AstIfStatement: {
+            int jumps[REGISTER_MAX_CONDITION_JUMPS];
+            size_t count = register_condition(_compiler, _statement->ast0, jumps, REGISTER_MAX_CONDITION_JUMPS);
+            register_block(_compiler, _statement->ast1);
+            int to_end = -1;
+            if (_statement->ast2 != NULL) {
+                to_end = register_emit(_compiler, ROP_JUMP, 0, 0, 0);
+            }
+            for (size_t i = 0; i < count; i++) {
+                register_label(_compiler, jumps[i]);
+            }
+            if (_statement->ast2 != NULL) {
+                register_block(_compiler, _statement->ast2);
+                register_label(_compiler, to_end);
+            }
+            break;
+        }
+        case AstWhileStatement: {
+            int jumps[REGISTER_MAX_CONDITION_JUMPS];
+            int loop_start = register_here(_compiler);
+            size_t count = register_condition(_compiler, _statement->ast0, jumps, REGISTER_MAX_CONDITION_JUMPS);
+            register_block(_compiler, _statement->ast1);
+            register_emit(_compiler, ROP_JUMP, loop_start, 0, 0);
+            for (size_t i = 0; i < count; i++) {
+                register_label(_compiler, jumps[i]);
+            }
+            break;
+        }
+        case AstReturnStatement: {
+            int top = _compiler->top;
+            int value;
+            if (_statement->ast0 != NULL) {
+                value = register_operand(_compiler, _statement->ast0);
+            } else {
+                value = register_allocate(_compiler);
+                register_emit(_compiler, ROP_LOAD_NULL, value, 0, 0);
+            }
+            register_emit(_compiler, ROP_RETURN, value, 0, 0);
+            _compiler->top = top;
+            break;
+        }
+        case AstExpressionStatement: {
+            ast_node_t* expression = _statement->ast0;
+            int top = _compiler->top;
+            int dst = -1;
+            // An assignment to a local needs no copy of its value
+            if (expression->type == AstAssign && expression->ast0->type == AstName) {
+                dst = register_lookup(_compiler, expression->ast0->str0);
+            }
+            if (dst < 0) {
+                dst = register_allocate(_compiler);
+            }
+            register_expression(_compiler, expression, dst);
+            _compiler->top = top;
+            break;
+        }
+        case AstBlockStatement: {
+            size_t symbol_count = _compiler->symbol_count;
+            int top = _compiler->top;
+            for (size_t i = 0; _statement->array0[i] != NULL; i++) {
+                register_statement(_compiler, _statement->array0[i]);
+            }
+            _compiler->symbol_count = symbol_count;
+            _compiler->top = top;
+            break;
+        }
+        default:
+            register_unsupported(_compiler);
+            break;
+    }
+}
+
+register_code_t* register_compile(code_t* _code, ast_node_list_t _params, ast_node_list_t _body) {
+    if (_code->is_async) {
+        return NULL;
+    }
+    register_code_t* output = (register_code_t*) malloc(sizeof(register_code_t));
+    ASSERTNULL(output, "failed to allocate memory for register code");
+    output->instructions   = NULL;
+    output->count          = 0;
+    output->capacity       = 0;
+    output->register_count = CODE_THIS_SLOT + 1;
+
+    register_compiler_t compiler = {
+        .code            = _code,
+        .output          = output,
+        .symbols         = NULL,
+        .symbol_count    = 0,
+        .symbol_capacity = 0,
+        .top             = CODE_THIS_SLOT + 1,
+        .failed          = false
+    };
+    for (size_t i = 0; _params[i] != NULL; i++) {
+        register_declare(&compiler, _params[i]->str0, register_allocate(&compiler));
+    }
+    // Same as the stack generator, stop at the second top level return
+    bool has_visible_return = false;
+    for (size_t i = 0; _body[i] != NULL && !compiler.failed; i++) {
+        if (_body[i]->type == AstReturnStatement && has_visible_return) {
+            break;
+        }
+        if (_body[i]->type == AstReturnStatement) has_visible_return = true;
+        register_statement(&compiler, _body[i]);
+    }
+    int value = register_allocate(&compiler);
+    register_emit(&compiler, ROP_LOAD_NULL, value, 0, 0);
+    register_emit(&compiler, ROP_RETURN, value, 0, 0);
+
+    free(compiler.symbols);
+    if (compiler.failed) {
+        register_code_free(output);
+        return NULL;
+    }
+    return output;
+}
+
+void register_code_free(register_code_t* _register_code) {
+    if (_register_code == NULL) {
+        return;
+    }
+    free(_register_code->instructions);
+    free(_register_code);
+}
@@ -0,0 +1,87 @@
+#include "api/ast/node.h"
+#include "api/core/global.h"
+#include "api/core/internal.h"
+#include "code.h"
+#include "node.h"
+
+#ifndef REGISTER_H
+#define REGISTER_H
+
+// The stack VM stays the default, build with -DVM_USE_REGISTER_TIER=1 to
+// compile and run supported functions on the register tier instead
+#ifndef VM_USE_REGISTER_TIER
+    #define VM_USE_REGISTER_TIER 0
+#endif
+
+/*
+ * Register tier instruction set.
+ * Operands are register indices unless noted, registers live in the frame
+ * slots of the function environment (register 0 is the receiver slot).
+ */
+typedef enum register_opcode_enum {
+    ROP_LOAD_INT,           // a = dst, b = value
+    ROP_LOAD_BOOL,          // a = dst, b = value
+    ROP_LOAD_NULL,          // a = dst
+    ROP_LOAD_NAME,          // a = dst, b = constant index of the name
+    ROP_SET_NAME,           // a = src, b = constant index of the name
+    ROP_MOVE,               // a = dst, b = src
+    ROP_MUL,                // a = dst, b = lhs, c = rhs
+    ROP_DIV,                // a = dst, b = lhs, c = rhs
+    ROP_MOD,                // a = dst, b = lhs, c = rhs
+    ROP_ADD,                // a = dst, b = lhs, c = rhs
+    ROP_SUB,                // a = dst, b = lhs, c = rhs
+    ROP_CMP_LT,             // a = dst, b = lhs, c = rhs
+    ROP_CMP_LTE,            // a = dst, b = lhs, c = rhs
+    ROP_CMP_GT,             // a = dst, b = lhs, c = rhs
+    ROP_CMP_GTE,            // a = dst, b = lhs, c = rhs
+    ROP_CMP_EQ,             // a = dst, b = lhs, c = rhs
+    ROP_CMP_NE,             // a = dst, b = lhs, c = rhs
+    ROP_JUMP,               // a = target
+    ROP_JUMP_IF_FALSE,      // a = condition, b = target
+    ROP_JUMP_IF_TRUE,       // a = condition, b = target
+    ROP_LT_JUMP_IF_FALSE,   // a = lhs, b = rhs, c = target
+    ROP_LTE_JUMP_IF_FALSE,  // a = lhs, b = rhs, c = target
+    ROP_GT_JUMP_IF_FALSE,   // a = lhs, b = rhs, c = target
+    ROP_GTE_JUMP_IF_FALSE,  // a = lhs, b = rhs, c = target
+    ROP_EQ_JUMP_IF_FALSE,   // a = lhs, b = rhs, c = target
+    ROP_NE_JUMP_IF_FALSE,   // a = lhs, b = rhs, c = target
+    ROP_CALL,               // a = dst, b = function (arguments follow in b+1..b+c), c = argument count
+    ROP_RETURN,             // a = src
+} register_opcode_t;
+
+typedef struct register_instruction_struct {
+    uint8_t opcode;
+    int     a;
+    int     b;
+    int     c;
+} register_instruction_t;
+
+// Declared as register_code_t in code.h
+struct register_code_struct {
+    register_instruction_t* instructions;
+    size_t                  count;
+    size_t                  capacity;
+    size_t                  register_count; // Frame slots needed (receiver, parameters, locals and temporaries)
+};
+
+/*
+ * Compile a function body into register code.
+ * Only a subset of the language is supported (integers, booleans, names,
+ * arithmetic, comparisons, calls, if/while/return), anything else makes
+ * the function stay on the stack tier.
+ *
+ * @param _code The stack code of the function (owns the name constants).
+ * @param _params The parameters of the function.
+ * @param _body The body of the function.
+ * @return The register code or NULL if the body is not supported.
+ */
+register_code_t* register_compile(code_t* _code, ast_node_list_t _params, ast_node_list_t _body);
+
+/*
+ * Free the register code.
+ *
+ * @param _register_code The register code to free.
+ */
+void register_code_free(register_code_t* _register_code);
+
+#endif
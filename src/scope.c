@@ -19,6 +19,8 @@ scope_t* scope_new(scope_t* _parent, scope_type_t _type) {
     ASSERTNULL(scope->captures, "failed to allocate memory for captures");
     scope->captures[0] = NULL;
     scope->is_block = false;
+    // Slot 0 is reserved for "this"
+    scope->local_count = 1;
     return scope;
 }
 
@@ -116,6 +118,37 @@ scope_value_t scope_get(scope_t* _scope, char* _name, bool _recurse) {
     PD("variable %s not found", _name);
 }
 
+INTERNAL bool scope_is_frame(scope_t* _scope) {
+    return _scope->type == ScopeTypeFunction
+        || _scope->type == ScopeTypeAsyncFunction
+        || _scope->type == ScopeTypeGlobal;
+}
+
+int scope_allocate_slot(scope_t* _scope) {
+    scope_t* current = _scope;
+    while (current != NULL && !scope_is_frame(current)) {
+        current = current->parent;
+    }
+    ASSERTNULL(current, "scope has no frame");
+    return (int) current->local_count++;
+}
+
+int scope_get_slot(scope_t* _scope, char* _name) {
+    size_t hash = hash64(_name);
+    for (scope_t* current = _scope; current != NULL; current = current->parent) {
+        scope_node_t* node = current->buckets[hash % current->bucket_count];
+        while (node) {
+            if (strcmp(node->name, _name) == 0) return node->value.slot;
+            node = node->next;
+        }
+        // Values beyond the frame belong to another activation
+        if (scope_is_frame(current) || current->type == ScopeTypeClass) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
 bool scope_is_global(scope_t* _scope) {
     return _scope->type == ScopeTypeGlobal;
 }
@@ -22,6 +22,7 @@ typedef struct scope_value_struct {
     char*       name;
     bool        is_const;
     bool        is_global;
+    int         slot; // -1 if the value is resolved by name
     position_t* position;
 } scope_value_t;
 
@@ -46,6 +47,8 @@ typedef struct scope_struct {
     bool           is_returned;
     // Block
     bool           is_block;
+    // Frame slots (function and global scopes)
+    size_t         local_count;
 } scope_t;
 
 /*
@@ -104,6 +107,26 @@ void scope_put(scope_t* _scope, char* _name, scope_value_t _value);
  */
 scope_value_t scope_get(scope_t* _scope, char* _name, bool _recurse);
 
+/*
+ * Allocate a local slot in the frame that owns the scope.
+ * The frame is the nearest function or global scope.
+ *
+ * @param _scope The scope where the value is declared.
+ * @return The slot index.
+ */
+int scope_allocate_slot(scope_t* _scope);
+
+/*
+ * Get the local slot of a value visible from the scope.
+ * The lookup stops at the frame boundary, so values owned
+ * by an enclosing function are not resolved to a slot.
+ *
+ * @param _scope The scope to check.
+ * @param _name The name of the value.
+ * @return The slot index, or -1 if the value must be resolved by name.
+ */
+int scope_get_slot(scope_t* _scope, char* _name);
+
 /*
  * Check if a scope is global.
  *
@@ -0,0 +1,71 @@
+#include "shape.h"
+#include "intern.h"
+#include "object.h"
+#include "type.h"
+
+INTERNAL shape_t* root_shape = NULL;
+
+/**
+ * Allocates a shape with room for the given number of properties.
+ *
+ * @param _parent The parent shape, NULL for the root.
+ * @param _count The number of properties.
+ * @return shape_t* The new shape.
+ */
+INTERNAL shape_t* shape_new(shape_t* _parent, size_t _count) {
+    shape_t* shape = (shape_t*) malloc(sizeof(shape_t));
+    ASSERTNULL(shape, "failed to allocate memory for shape");
+    shape->parent   = _parent;
+    shape->children = NULL;
+    shape->sibling  = NULL;
+    shape->count    = _count;
+    shape->keys     = NULL;
+    shape->hashes   = NULL;
+    if (_count > 0) {
+        shape->keys   = (object_t**) malloc(sizeof(object_t*) * _count);
+        shape->hashes = (size_t*) malloc(sizeof(size_t) * _count);
+        ASSERTNULL(shape->keys, "failed to allocate memory for shape keys");
+        ASSERTNULL(shape->hashes, "failed to allocate memory for shape hashes");
+    }
+    return shape;
+}
+
+shape_t* shape_root() {
+    if (root_shape == NULL) {
+        root_shape = shape_new(NULL, 0);
+    }
+    return root_shape;
+}
+
+shape_t* shape_transition(shape_t* _shape, object_t* _key) {
+    ASSERTNULL(_shape, "shape is null");
+
+    // Reuse an existing transition
+    for (shape_t* child = _shape->children; child != NULL; child = child->sibling) {
+        if (child->keys[child->count - 1] == _key) {
+            return child;
+        }
+    }
+
+    shape_t* child = shape_new(_shape, _shape->count + 1);
+    if (_shape->count > 0) {
+        memcpy(child->keys, _shape->keys, sizeof(object_t*) * _shape->count);
+        memcpy(child->hashes, _shape->hashes, sizeof(size_t) * _shape->count);
+    }
+    // Shapes live for the whole process, so do their keys
+    child->keys[_shape->count]   = intern_pin(_key);
+    child->hashes[_shape->count] = OBJECT_STRING(_key)->hash;
+
+    child->sibling   = _shape->children;
+    _shape->children = child;
+    return child;
+}
+
+long shape_lookup(shape_t* _shape, object_t* _key) {
+    for (size_t i = 0; i < _shape->count; i++) {
+        if (_shape->keys[i] == _key) {
+            return (long) i;
+        }
+    }
+    return -1;
+}
\ No newline at end of file
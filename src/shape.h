@@ -0,0 +1,60 @@
+#include "api/core/global.h"
+#include "api/core/object.h"
+#include "internal.h"
+
+#ifndef SHAPE_H
+#define SHAPE_H
+
+/*
+ * Maximum number of properties an object keeps in shape mode. Adding one
+ * more moves the object to dictionary mode (see hashmap.h).
+ */
+#ifndef SHAPE_MAX_PROPERTIES
+#define SHAPE_MAX_PROPERTIES 32
+#endif
+
+/*
+ * A shape (hidden class) describes the property layout of an object:
+ * which string keys it has and the slot each value lives in. Shapes form
+ * a transition tree rooted at the empty shape, so objects that get the
+ * same keys in the same order (same literal, same constructor) share one
+ * shape. Shapes and their keys (pinned atoms) live for the whole process.
+ */
+typedef struct shape_struct shape_t;
+typedef struct shape_struct {
+    shape_t*   parent;
+    shape_t*   children; // First transition out of this shape
+    shape_t*   sibling;  // Next transition out of the parent
+    size_t     count;    // Number of properties (aka slots)
+    object_t** keys;     // Keys by slot index
+    size_t*    hashes;   // Key hashes by slot index
+} shape_t;
+
+/*
+ * Get the empty root shape.
+ *
+ * @return The root shape.
+ */
+shape_t* shape_root();
+
+/*
+ * Get the shape reached by adding a key to a shape, creating it on the
+ * first transition.
+ *
+ * @param _shape The shape.
+ * @param _key The property name (an atom, see intern.h), pinned here.
+ * @return The child shape, its last slot holds the new key.
+ */
+shape_t* shape_transition(shape_t* _shape, object_t* _key);
+
+/*
+ * Find the slot of a key in a shape, keys are atoms so they are matched
+ * by pointer.
+ *
+ * @param _shape The shape.
+ * @param _key The property name (an atom).
+ * @return The slot index, or -1 if the shape has no such key.
+ */
+long shape_lookup(shape_t* _shape, object_t* _key);
+
+#endif
\ No newline at end of file
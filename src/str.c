@@ -0,0 +1,217 @@
+#include "str.h"
+#include "object.h"
+
+str_t* str_init(void* _memory, const char* _chars, size_t _length, uint32_t _flags) {
+    str_t* str = (str_t*) _memory;
+    str->length = _length;
+    str->hash   = 0;
+    str->flags  = _flags;
+    str->depth  = 0;
+    str->data   = (char*) (str + 1);
+    str->left   = NULL;
+    str->right  = NULL;
+    if (_chars != NULL) {
+        memcpy(str->data, _chars, _length);
+        str_seal(str);
+    }
+    str->data[_length] = '\0';
+    return str;
+}
+
+str_t* str_new(const char* _chars, size_t _length) {
+    void* memory = malloc(STR_SIZE(_length));
+    ASSERTNULL(memory, "failed to allocate memory for string");
+    return str_init(memory, _chars, _length, 0);
+}
+
+str_t* str_init_rope(void* _memory, object_t* _left, object_t* _right, uint32_t _flags) {
+    str_t* str = (str_t*) _memory;
+    str_t* left  = OBJECT_STRING(_left);
+    str_t* right = OBJECT_STRING(_right);
+    str->length = left->length + right->length;
+    str->hash   = 0;
+    // Ascii only if both halves are
+    str->flags  = _flags | (left->flags & right->flags & STR_FLAG_ASCII);
+    str->depth  = ((left->depth > right->depth) ? left->depth : right->depth) + 1;
+    str->data   = NULL;
+    str->left   = _left;
+    str->right  = _right;
+    return str;
+}
+
+str_t* str_init_slice(void* _memory, object_t* _parent, size_t _offset, size_t _length, uint32_t _flags) {
+    str_t* str = (str_t*) _memory;
+    str_t* parent = OBJECT_STRING(_parent);
+    str->length = _length;
+    str->hash   = 0;
+    str->flags  = _flags | STR_FLAG_SLICE | (parent->flags & STR_FLAG_ASCII);
+    str->depth  = 0;
+    // The bytes of a slice stay where its parent's point, even after the
+    // string that owns them took a copy of its own (see str_own)
+    str->data   = parent->data + _offset;
+    str->left   = ((parent->flags & STR_FLAG_SLICE) != 0) ? parent->left : _parent;
+    str->right  = NULL;
+    // A slice that ends where its parent does shares its terminator
+    if (_offset + _length < parent->length || (parent->flags & STR_FLAG_UNTERMINATED) != 0) {
+        str->flags |= STR_FLAG_UNTERMINATED;
+    }
+    return str;
+}
+
+str_t* str_init_external(void* _memory, const char* _chars, size_t _length, string_release_function _release, void* _context, uint32_t _flags) {
+    str_external_t* external = (str_external_t*) _memory;
+    str_t* str = &external->str;
+    str->length = _length;
+    str->hash   = 0;
+    // Not scanned for the ascii flag, that would touch every page
+    str->flags  = _flags | STR_FLAG_EXTERNAL | STR_FLAG_UNTERMINATED;
+    str->depth  = 0;
+    str->data   = (char*) _chars;
+    str->left   = NULL;
+    str->right  = NULL;
+    external->chars   = _chars;
+    external->release = _release;
+    external->context = _context;
+    return str;
+}
+
+/**
+ * Copy the borrowed bytes of a slice or an external string into a block
+ * of its own, followed by a null.
+ *
+ * @param _str The string.
+ * @return char* The bytes.
+ */
+INTERNAL char* str_own(str_t* _str) {
+    char* data = (char*) malloc(_str->length + 1);
+    ASSERTNULL(data, "failed to allocate memory for string");
+    memcpy(data, _str->data, _str->length);
+    data[_str->length] = '\0';
+    _str->flags &= ~(STR_FLAG_SLICE | STR_FLAG_UNTERMINATED);
+    _str->data = data;
+    _str->left = NULL;
+    return data;
+}
+
+char* str_flatten(str_t* _str) {
+    if (_str->data != NULL) {
+        return str_own(_str);
+    }
+    char* data = (char*) malloc(_str->length + 1);
+    ASSERTNULL(data, "failed to allocate memory for string");
+
+    // Walk the leaves in order, a stack as deep as the rope is enough
+    object_t** stack = (object_t**) malloc(sizeof(object_t*) * (_str->depth + 1));
+    ASSERTNULL(stack, "failed to allocate memory for rope");
+    size_t top = 0;
+    size_t used = 0;
+    stack[top++] = _str->right;
+    stack[top++] = _str->left;
+    while (top > 0) {
+        str_t* part = OBJECT_STRING(stack[--top]);
+        if (part->data != NULL) {
+            memcpy(data + used, part->data, part->length);
+            used += part->length;
+        } else {
+            stack[top++] = part->right;
+            stack[top++] = part->left;
+        }
+    }
+    free(stack);
+    data[used] = '\0';
+
+    _str->data  = data;
+    _str->depth = 0;
+    _str->left  = NULL;
+    _str->right = NULL;
+    return data;
+}
+
+object_t** str_leaves(str_t* _str, size_t* _count) {
+    size_t capacity = 16;
+    size_t count = 0;
+    object_t** leaves = (object_t**) malloc(sizeof(object_t*) * capacity);
+    object_t** stack = (object_t**) malloc(sizeof(object_t*) * (_str->depth + 1));
+    ASSERTNULL(leaves, "failed to allocate memory for rope");
+    ASSERTNULL(stack, "failed to allocate memory for rope");
+    size_t top = 0;
+    stack[top++] = _str->right;
+    stack[top++] = _str->left;
+    while (top > 0) {
+        object_t* part = stack[--top];
+        if (OBJECT_STRING(part)->data == NULL) {
+            stack[top++] = OBJECT_STRING(part)->right;
+            stack[top++] = OBJECT_STRING(part)->left;
+            continue;
+        }
+        if (count >= capacity) {
+            capacity *= 2;
+            leaves = (object_t**) realloc(leaves, sizeof(object_t*) * capacity);
+            ASSERTNULL(leaves, "failed to allocate memory for rope");
+        }
+        leaves[count++] = part;
+    }
+    free(stack);
+    *_count = count;
+    return leaves;
+}
+
+void str_seal(str_t* _str) {
+    unsigned char high = 0;
+    for (size_t i = 0; i < _str->length; i++) {
+        high |= (unsigned char) _str->data[i];
+    }
+    if (high < 0x80) {
+        _str->flags |= STR_FLAG_ASCII;
+    } else {
+        _str->flags &= ~STR_FLAG_ASCII;
+    }
+}
+
+size_t str_hash(str_t* _str) {
+    if ((_str->flags & STR_FLAG_HASHED) == 0) {
+        // Same as hash64, so a key hashes alike as a C string
+        char* data = STR_BYTES(_str);
+        size_t hash = 5381;
+        for (size_t i = 0; i < _str->length; i++) {
+            hash = ((hash << 5) + hash) + data[i];
+        }
+        _str->hash   = hash;
+        _str->flags |= STR_FLAG_HASHED;
+    }
+    return _str->hash;
+}
+
+bool str_equals(str_t* _a, str_t* _b) {
+    if (_a == _b) return true;
+    // Two atoms only hold the same bytes if they are the same atom
+    if ((_a->flags & _b->flags & STR_FLAG_ATOM) != 0) return false;
+    if (_a->length != _b->length) return false;
+    if ((_a->flags & _b->flags & STR_FLAG_HASHED) != 0 && _a->hash != _b->hash) return false;
+    return memcmp(STR_BYTES(_a), STR_BYTES(_b), _a->length) == 0;
+}
+
+bool str_equals_chars(str_t* _str, const char* _chars, size_t _hash) {
+    if ((_str->flags & STR_FLAG_HASHED) != 0 && _str->hash != _hash) return false;
+    return strncmp(STR_BYTES(_str), _chars, _str->length) == 0 && _chars[_str->length] == '\0';
+}
+
+void str_free(str_t* _str) {
+    if (_str == NULL) return;
+    if ((_str->flags & STR_FLAG_EXTERNAL) != 0) {
+        str_external_t* external = (str_external_t*) _str;
+        if (_str->data != external->chars) {
+            free(_str->data);
+        }
+        if (external->release != NULL) {
+            external->release(external->chars, _str->length, external->context);
+        }
+    } else if ((_str->flags & STR_FLAG_SLICE) == 0 && _str->data != NULL && _str->data != (char*) (_str + 1)) {
+        // A flattened rope or a copied slice has its bytes in a block of
+        // their own
+        free(_str->data);
+    }
+    if ((_str->flags & STR_FLAG_INLINE) == 0) {
+        free(_str);
+    }
+}
\ No newline at end of file
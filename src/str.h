@@ -0,0 +1,223 @@
+#include "api/core/global.h"
+#include "api/core/object.h"
+#include "api/core/text.h"
+
+#ifndef STR_H
+#define STR_H
+
+/*
+ * Strings up to this many bytes are stored in the same allocation as
+ * their object, longer ones get a block of their own.
+ */
+#ifndef STR_INLINE_MAX
+#define STR_INLINE_MAX 32
+#endif
+
+#define STR_FLAG_ASCII        0x1  // Every byte is below 0x80, otherwise UTF-8
+#define STR_FLAG_HASHED       0x2  // hash holds the cached hash
+#define STR_FLAG_INLINE       0x4  // Allocated together with its object
+#define STR_FLAG_ATOM         0x8  // The unique string with its bytes (see intern.h)
+#define STR_FLAG_SLICE        0x10 // The bytes belong to the string in left
+#define STR_FLAG_EXTERNAL     0x20 // The bytes belong to the embedder
+#define STR_FLAG_UNTERMINATED 0x40 // No null follows the bytes
+#define STR_FLAG_NOT_NUMBER   0x80 // Known not to parse as a number (see number_parse_string)
+
+/*
+ * Concatenations at least this long make a rope instead of copying.
+ */
+#ifndef STR_ROPE_MIN
+#define STR_ROPE_MIN 256
+#endif
+
+/*
+ * Ropes deeper than this are rebuilt balanced.
+ */
+#ifndef STR_ROPE_MAX_DEPTH
+#define STR_ROPE_MAX_DEPTH 64
+#endif
+
+/*
+ * A string header. The bytes are null terminated, the length excludes the
+ * terminator. Flat strings keep their bytes right past the header.
+ *
+ * A rope is the concatenation of two strings, made without copying. Its
+ * bytes are only built when they are needed (see STR_CHARS), after that
+ * it is flat and lets go of its halves.
+ *
+ * A slice points into the bytes of another flat string, kept alive
+ * through left. An external string points into memory of the embedder.
+ * Neither has to be followed by a null, STR_CHARS copies the bytes of
+ * those that are not.
+ */
+typedef struct str_struct {
+    size_t    length;
+    size_t    hash;  // Cached hash (hash64), see str_hash
+    uint32_t  flags;
+    uint32_t  depth; // Rope depth, 0 once flat
+    char*     data;  // NULL for a rope until it is flattened
+    object_t* left;  // Rope halves (string objects) or the parent of a slice
+    object_t* right;
+} str_t;
+
+/*
+ * The header of an external string.
+ */
+typedef struct str_external_struct {
+    str_t                   str;
+    const char*             chars;   // The embedder's bytes, data may hold a terminated copy
+    string_release_function release; // Called when the string is freed, may be NULL
+    void*                   context;
+} str_external_t;
+
+/*
+ * Get the bytes of a string, flattening a rope first. The bytes are not
+ * always null terminated, use with the length.
+ *
+ * @param _str The string.
+ * @return The bytes.
+ */
+#define STR_BYTES(_str) (((_str)->data != NULL) ? (_str)->data : str_flatten(_str))
+
+/*
+ * Get the null terminated bytes of a string, flattening a rope or copying
+ * unterminated bytes first.
+ *
+ * @param _str The string.
+ * @return The bytes.
+ */
+#define STR_CHARS(_str) (((_str)->data != NULL && ((_str)->flags & STR_FLAG_UNTERMINATED) == 0) ? (_str)->data : str_flatten(_str))
+
+/*
+ * Get the number of bytes a string with the given length needs, header
+ * included.
+ *
+ * @param _length The length of the string.
+ * @return The size in bytes.
+ */
+#define STR_SIZE(_length) (sizeof(str_t) + (_length) + 1)
+
+/*
+ * Initialize a string header in place, the memory must hold
+ * STR_SIZE(_length) bytes.
+ *
+ * @param _memory The memory.
+ * @param _chars The bytes to copy, NULL to leave them for the caller.
+ * @param _length The length of the string.
+ * @param _flags Extra flags (STR_FLAG_INLINE).
+ * @return The string.
+ */
+str_t* str_init(void* _memory, const char* _chars, size_t _length, uint32_t _flags);
+
+/*
+ * Create a new string in its own allocation.
+ *
+ * @param _chars The bytes to copy, NULL to leave them for the caller.
+ * @param _length The length of the string.
+ * @return The new string.
+ */
+str_t* str_new(const char* _chars, size_t _length);
+
+/*
+ * Initialize a rope header in place, the memory must hold sizeof(str_t)
+ * bytes.
+ *
+ * @param _memory The memory.
+ * @param _left The first half (a string object).
+ * @param _right The second half (a string object).
+ * @param _flags Extra flags (STR_FLAG_INLINE).
+ * @return The rope.
+ */
+str_t* str_init_rope(void* _memory, object_t* _left, object_t* _right, uint32_t _flags);
+
+/*
+ * Initialize a slice header in place, the memory must hold sizeof(str_t)
+ * bytes.
+ *
+ * @param _memory The memory.
+ * @param _parent The flat string to slice, a slice hands over the string
+ *                that owns its bytes.
+ * @param _offset The offset of the first byte in the parent.
+ * @param _length The length of the slice.
+ * @param _flags Extra flags (STR_FLAG_INLINE).
+ * @return The slice.
+ */
+str_t* str_init_slice(void* _memory, object_t* _parent, size_t _offset, size_t _length, uint32_t _flags);
+
+/*
+ * Initialize an external string header in place, the memory must hold
+ * sizeof(str_external_t) bytes.
+ *
+ * @param _memory The memory.
+ * @param _chars The bytes, owned by the embedder.
+ * @param _length The number of bytes.
+ * @param _release Called with the bytes when the string is freed, may be NULL.
+ * @param _context Passed to the release function.
+ * @param _flags Extra flags (STR_FLAG_INLINE).
+ * @return The string.
+ */
+str_t* str_init_external(void* _memory, const char* _chars, size_t _length, string_release_function _release, void* _context, uint32_t _flags);
+
+/*
+ * Give a string null terminated bytes of its own: build the bytes of a
+ * rope and drop its halves, or copy the bytes of a slice or an external
+ * string that has no terminator. The bytes of an external string stay
+ * with the embedder until it is freed, slices may still point into them.
+ *
+ * @param _str The string.
+ * @return The bytes.
+ */
+char* str_flatten(str_t* _str);
+
+/*
+ * Collect the flat strings a rope is made of, in order.
+ *
+ * @param _str The rope.
+ * @param _count Set to the number of leaves.
+ * @return The leaves (string objects), to be freed by the caller.
+ */
+object_t** str_leaves(str_t* _str, size_t* _count);
+
+/*
+ * Scan the bytes for the ascii flag, for strings whose bytes were
+ * written after str_init.
+ *
+ * @param _str The string.
+ */
+void str_seal(str_t* _str);
+
+/*
+ * Get the hash of a string, computed on first use.
+ *
+ * @param _str The string.
+ * @return The hash (same as hash64 of the bytes).
+ */
+size_t str_hash(str_t* _str);
+
+/*
+ * Compare two strings.
+ *
+ * @param _a The first string.
+ * @param _b The second string.
+ * @return True if both hold the same bytes.
+ */
+bool str_equals(str_t* _a, str_t* _b);
+
+/*
+ * Compare a string with a null terminated C string.
+ *
+ * @param _str The string.
+ * @param _chars The C string.
+ * @param _hash The hash of the C string (hash64).
+ * @return True if both hold the same bytes.
+ */
+bool str_equals_chars(str_t* _str, const char* _chars, size_t _hash);
+
+/*
+ * Free a string, inline strings are freed with their object. External
+ * bytes are handed back to the embedder.
+ *
+ * @param _str The string.
+ */
+void str_free(str_t* _str);
+
+#endif
\ No newline at end of file
@@ -1,3 +1,5 @@
+#include "api/core/global.h"
+
 #ifndef OBJECT_TYPE_H
 #define OBJECT_TYPE_H
 
@@ -19,23 +21,64 @@ typedef enum object_type_enum {
     OBJECT_TYPE_ITERATOR
 } object_type_t;
 
-#define OBJECT_TYPE_INT(object) (object->type == OBJECT_TYPE_INT)
-#define OBJECT_TYPE_DOUBLE(object) (object->type == OBJECT_TYPE_DOUBLE)
+/*
+ * Ints, booleans and null are immediate values: the handle itself carries
+ * the value in its low bits (heap objects are at least 8 byte aligned), so
+ * they are never allocated, linked into the heap or swept.
+ *   ...xxx1  int (value in the upper bits)
+ *   ...v010  bool (value in bit 3)
+ *   ...0100  null
+ */
+#define OBJECT_TAG_MASK ((uintptr_t) 0x7)
+#define OBJECT_TAG_INT  ((uintptr_t) 0x1)
+#define OBJECT_TAG_BOOL ((uintptr_t) 0x2)
+#define OBJECT_TAG_NULL ((uintptr_t) 0x4)
+
+#define OBJECT_IS_TAGGED(object) ((((uintptr_t)(object)) & OBJECT_TAG_MASK) != 0)
+#define OBJECT_HEAP_TYPE(object, _type) (!OBJECT_IS_TAGGED(object) && (object)->type == (_type))
+#define OBJECT_TYPE_OF(object) (!OBJECT_IS_TAGGED(object) \
+    ? (object)->type \
+    : ((((uintptr_t)(object)) & OBJECT_TAG_INT) != 0) \
+        ? OBJECT_TYPE_INT \
+        : ((((uintptr_t)(object)) & OBJECT_TAG_BOOL) != 0) ? OBJECT_TYPE_BOOL : OBJECT_TYPE_NULL)
+
+#define OBJECT_NULL ((object_t*) OBJECT_TAG_NULL)
+#define OBJECT_BOOL(value) ((object_t*) ((((uintptr_t) ((value) ? 1 : 0)) << 3) | OBJECT_TAG_BOOL))
+#define OBJECT_BOOL_VALUE(object) (((((uintptr_t)(object)) >> 3) & 1) != 0)
+#define OBJECT_INT(value) ((object_t*) ((((uintptr_t) (intptr_t) (value)) << 1) | OBJECT_TAG_INT))
+
+// Ints are 64-bit; the ones that do not fit in the handle are boxed
+#if UINTPTR_MAX > 0xFFFFFFFFu
+    #define OBJECT_SMALL_INT_MIN (-((int64_t) 1 << 62))
+    #define OBJECT_SMALL_INT_MAX (((int64_t) 1 << 62) - 1)
+#else
+    #define OBJECT_SMALL_INT_MIN (-((int64_t) 1 << 30))
+    #define OBJECT_SMALL_INT_MAX (((int64_t) 1 << 30) - 1)
+#endif
+#define OBJECT_INT_FITS(value) ((value) >= OBJECT_SMALL_INT_MIN && (value) <= OBJECT_SMALL_INT_MAX)
+#define OBJECT_TYPE_SMALL_INT(object) ((((uintptr_t)(object)) & OBJECT_TAG_INT) != 0)
+#define OBJECT_SMALL_INT_VALUE(object) ((int64_t) (((intptr_t)(object)) >> 1))
+#define OBJECT_INT_VALUE(object) (OBJECT_TYPE_SMALL_INT(object) \
+    ? OBJECT_SMALL_INT_VALUE(object) \
+    : (object)->value.i64)
+#define OBJECT_TYPE_INT(object) (OBJECT_TYPE_SMALL_INT(object) || OBJECT_HEAP_TYPE(object, OBJECT_TYPE_INT))
+
+#define OBJECT_TYPE_DOUBLE(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_DOUBLE)
 #define OBJECT_TYPE_NUMBER(object) (OBJECT_TYPE_INT(object) || OBJECT_TYPE_DOUBLE(object))
-#define OBJECT_TYPE_BOOL(object) (object->type == OBJECT_TYPE_BOOL)
-#define OBJECT_TYPE_STRING(object) (object->type == OBJECT_TYPE_STRING)
-#define OBJECT_TYPE_NULL(object) (object->type == OBJECT_TYPE_NULL)
-#define OBJECT_TYPE_ARRAY(object) (object->type == OBJECT_TYPE_ARRAY)
-#define OBJECT_TYPE_RANGE(object) (object->type == OBJECT_TYPE_RANGE)
-#define OBJECT_TYPE_USER_TYPE(object) (object->type == OBJECT_TYPE_USER_TYPE)
-#define OBJECT_TYPE_USER_TYPE_INSTANCE(object) (object->type == OBJECT_TYPE_USER_TYPE_INSTANCE)
-#define OBJECT_TYPE_FUNCTION(object) (object->type == OBJECT_TYPE_FUNCTION)
-#define OBJECT_TYPE_OBJECT(object) (object->type == OBJECT_TYPE_OBJECT)
-#define OBJECT_TYPE_PROMISE(object) (object->type == OBJECT_TYPE_PROMISE)
+#define OBJECT_TYPE_BOOL(object) ((((uintptr_t)(object)) & 0x3) == OBJECT_TAG_BOOL)
+#define OBJECT_TYPE_STRING(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_STRING)
+#define OBJECT_TYPE_NULL(object) ((((uintptr_t)(object)) & OBJECT_TAG_MASK) == OBJECT_TAG_NULL)
+#define OBJECT_TYPE_ARRAY(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_ARRAY)
+#define OBJECT_TYPE_RANGE(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_RANGE)
+#define OBJECT_TYPE_USER_TYPE(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_USER_TYPE)
+#define OBJECT_TYPE_USER_TYPE_INSTANCE(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_USER_TYPE_INSTANCE)
+#define OBJECT_TYPE_FUNCTION(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_FUNCTION)
+#define OBJECT_TYPE_OBJECT(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_OBJECT)
+#define OBJECT_TYPE_PROMISE(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_PROMISE)
 #define OBJECT_TYPE_COLLECTION(object) (OBJECT_TYPE_ARRAY(object) || OBJECT_TYPE_OBJECT(object) || OBJECT_TYPE_RANGE(object))
-#define OBJECT_TYPE_NATIVE_FUNCTION(object) (object->type == OBJECT_TYPE_NATIVE_FUNCTION)
+#define OBJECT_TYPE_NATIVE_FUNCTION(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_NATIVE_FUNCTION)
 #define OBJECT_TYPE_CALLABLE(object) (OBJECT_TYPE_FUNCTION(object) || OBJECT_TYPE_NATIVE_FUNCTION(object))
-#define OBJECT_TYPE_ERROR(object) (object->type == OBJECT_TYPE_ERROR)
-#define OBJECT_TYPE_ITERATOR(object) (object->type == OBJECT_TYPE_ITERATOR)
+#define OBJECT_TYPE_ERROR(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_ERROR)
+#define OBJECT_TYPE_ITERATOR(object) OBJECT_HEAP_TYPE(object, OBJECT_TYPE_ITERATOR)
 
 #endif
\ No newline at end of file
@@ -0,0 +1,555 @@
+#include "verifier.h"
+#include "peephole.h"
+
+#define REJECT(...) { \
+    *_message = string_format(__VA_ARGS__); \
+    goto REJECTED; \
+}
+
+INTERNAL int verifier_get_int(uint8_t* _bytecode, size_t _ip) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        value = value | ((uint32_t)_bytecode[_ip + i] << (i * 8));
+    }
+    return (int)value;
+}
+
+INTERNAL void* verifier_get_memory(uint8_t* _bytecode, size_t _ip) {
+    uintptr_t value = 0;
+    for (size_t i = 0; i < 8; i++) {
+        value |= ((uintptr_t)_bytecode[_ip + i] << (i * 8));
+    }
+    return (void*)value;
+}
+
+INTERNAL bool verifier_is_jump(uint8_t _opcode) {
+    switch (_opcode) {
+        case OPCODE_POP_JUMP_IF_FALSE:
+        case OPCODE_POP_JUMP_IF_TRUE:
+        case OPCODE_JUMP_IF_FALSE_OR_POP:
+        case OPCODE_JUMP_IF_TRUE_OR_POP:
+        case OPCODE_JUMP_IF_NOT_ERROR:
+        case OPCODE_JUMP_FORWARD:
+        case OPCODE_JUMP_IF_CONTINUE:
+        case OPCODE_JUMP_IF_BREAK:
+        case OPCODE_ABSOLUTE_JUMP:
+        case OPCODE_GET_ITERATOR_OR_JUMP:
+        case OPCODE_HAS_NEXT:
+        case OPCODE_CMP_LT_JUMP_IF_FALSE:
+        case OPCODE_CMP_LTE_JUMP_IF_FALSE:
+        case OPCODE_CMP_GT_JUMP_IF_FALSE:
+        case OPCODE_CMP_GTE_JUMP_IF_FALSE:
+        case OPCODE_CMP_EQ_JUMP_IF_FALSE:
+        case OPCODE_CMP_NE_JUMP_IF_FALSE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+INTERNAL bool verifier_is_terminator(uint8_t _opcode) {
+    switch (_opcode) {
+        case OPCODE_RETURN:
+        case OPCODE_RETURN_ASYNC:
+        case OPCODE_COMPLETE_BLOCK:
+        case OPCODE_CONTINUE:
+        case OPCODE_BREAK:
+        case OPCODE_JUMP_FORWARD:
+        case OPCODE_ABSOLUTE_JUMP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Computes the stack effect of a single instruction.
+ *
+ * @param _bytecode The bytecode.
+ * @param _ip The offset of the instruction.
+ * @param _pops The number of values the instruction reads from the stack.
+ * @param _peak The highest depth reached while the instruction runs (relative to its start).
+ * @param _taken The effect when the instruction jumps.
+ * @return int The effect when the instruction falls through.
+ */
+INTERNAL int verifier_stack_effect(uint8_t* _bytecode, size_t _ip, int* _pops, int* _peak, int* _taken) {
+    int pops = 0;
+    int pushes = 0;
+    int peak = -1;
+    int taken = 0;
+    switch (_bytecode[_ip]) {
+        case OPCODE_LOAD_NAME:
+        case OPCODE_LOAD_INT:
+        case OPCODE_LOAD_DOUBLE:
+        case OPCODE_LOAD_LONG:
+        case OPCODE_LOAD_BOOL:
+        case OPCODE_LOAD_STRING:
+        case OPCODE_LOAD_NULL:
+        case OPCODE_LOAD_THIS:
+        case OPCODE_LOAD_SUPER:
+        case OPCODE_LOAD_LOCAL:
+        case OPCODE_NEW_ARRAY:
+        case OPCODE_NEW_OBJECT:
+        case OPCODE_SETUP_FUNCTION:
+        case OPCODE_BEGIN_FUNCTION:
+            pushes = 1;
+            break;
+        case OPCODE_SETUP_CLASS:
+        case OPCODE_BEGIN_CLASS:
+            // The class body returns the prototype object
+            pushes = 1;
+            break;
+        case OPCODE_SETUP_BLOCK:
+        case OPCODE_BEGIN_BLOCK:
+        case OPCODE_NOP:
+        case OPCODE_JUMP_FORWARD:
+        case OPCODE_JUMP_IF_CONTINUE:
+        case OPCODE_JUMP_IF_BREAK:
+        case OPCODE_ABSOLUTE_JUMP:
+        case OPCODE_CONTINUE:
+        case OPCODE_BREAK:
+        case OPCODE_BEGIN_LOOP_THREAD:
+        case OPCODE_END_LOOP_THREAD:
+            break;
+        case OPCODE_LOAD_LOCAL_INT_BINARY:
+        case OPCODE_LOAD_NAME_INT_BINARY:
+            // Both operands are pushed before the binary runs
+            pushes = 1;
+            peak = 2;
+            break;
+        case OPCODE_INCREMENT_LOCAL:
+        case OPCODE_INCREMENT_NAME:
+            peak = 1;
+            break;
+        case OPCODE_DUPTOP:
+            pops = 1;
+            pushes = 2;
+            break;
+        case OPCODE_GET_NEXT_VALUE:
+            // The iterator stays below the value
+            pops = 1;
+            pushes = 2;
+            break;
+        case OPCODE_GET_NEXT_KEY_VALUE:
+            pops = 1;
+            pushes = 3;
+            break;
+        case OPCODE_ROT2:
+            pops = pushes = 2;
+            break;
+        case OPCODE_ROT3:
+            pops = pushes = 3;
+            break;
+        case OPCODE_ROT4:
+            pops = pushes = 4;
+            break;
+        case OPCODE_LOAD_ARRAY:
+        case OPCODE_CONCAT_N:
+            pops = verifier_get_int(_bytecode, _ip + 1);
+            pushes = 1;
+            break;
+        case OPCODE_LOAD_OBJECT:
+            pops = 2 * verifier_get_int(_bytecode, _ip + 1);
+            pushes = 1;
+            break;
+        case OPCODE_CALL_CONSTRUCTOR:
+        case OPCODE_CALL:
+            // The callee is popped with its arguments, the result is pushed
+            pops = verifier_get_int(_bytecode, _ip + 1) + 1;
+            pushes = 1;
+            break;
+        case OPCODE_CALL_METHOD:
+            pops = verifier_get_int(_bytecode, _ip + 1 + 4) + 1;
+            pushes = 1;
+            break;
+        case OPCODE_STORE_CLASS:
+        case OPCODE_SET_NAME:
+        case OPCODE_GET_PROPERTY:
+        case OPCODE_GET_FIELD:
+        case OPCODE_LAYOUT_CLASS:
+        case OPCODE_INCREMENT:
+        case OPCODE_DECREMENT:
+        case OPCODE_UNARY_PLUS:
+        case OPCODE_UNARY_MINUS:
+        case OPCODE_NOT:
+        case OPCODE_BITWISE_NOT:
+        case OPCODE_SET_LOCAL:
+        case OPCODE_SAVE_CAPTURES:
+        case OPCODE_JUMP_IF_NOT_ERROR:
+        case OPCODE_HAS_NEXT:
+            pops = pushes = 1;
+            break;
+        case OPCODE_SETUP_CATCH_BLOCK:
+            // The catch body consumes the error and leaves its result
+            pops = pushes = 1;
+            break;
+        case OPCODE_AWAIT:
+            // The pending promise is pushed before the frame suspends
+            pops = pushes = 1;
+            peak = 1;
+            break;
+        case OPCODE_STORE_NAME:
+        case OPCODE_POPTOP:
+        case OPCODE_STORE_LOCAL:
+        case OPCODE_SET_NAME_POP:
+        case OPCODE_RETURN:
+        case OPCODE_RETURN_ASYNC:
+        case OPCODE_COMPLETE_BLOCK:
+            pops = 1;
+            break;
+        case OPCODE_POP_JUMP_IF_FALSE:
+        case OPCODE_POP_JUMP_IF_TRUE:
+            pops = 1;
+            taken = -1;
+            break;
+        case OPCODE_JUMP_IF_FALSE_OR_POP:
+        case OPCODE_JUMP_IF_TRUE_OR_POP:
+            pops = 1;
+            break;
+        case OPCODE_GET_ITERATOR_OR_JUMP:
+            // The collection is replaced by its iterator, or dropped on the jump
+            pops = pushes = 1;
+            taken = -1;
+            break;
+        case OPCODE_EXTEND_ARRAY:
+        case OPCODE_APPEND_ARRAY:
+        case OPCODE_EXTEND_OBJECT:
+        case OPCODE_EXTEND_CLASS:
+        case OPCODE_SET_PROPERTY:
+        case OPCODE_SET_FIELD:
+        case OPCODE_RANGE:
+        case OPCODE_INDEX:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_MOD:
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_SHL:
+        case OPCODE_SHR:
+        case OPCODE_CMP_LT:
+        case OPCODE_CMP_LTE:
+        case OPCODE_CMP_GT:
+        case OPCODE_CMP_GTE:
+        case OPCODE_CMP_EQ:
+        case OPCODE_CMP_NE:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+            pops = 2;
+            pushes = 1;
+            break;
+        case OPCODE_PUT_OBJECT:
+        case OPCODE_SET_INDEX:
+            pops = 3;
+            pushes = 1;
+            break;
+        case OPCODE_CMP_LT_JUMP_IF_FALSE:
+        case OPCODE_CMP_LTE_JUMP_IF_FALSE:
+        case OPCODE_CMP_GT_JUMP_IF_FALSE:
+        case OPCODE_CMP_GTE_JUMP_IF_FALSE:
+        case OPCODE_CMP_EQ_JUMP_IF_FALSE:
+        case OPCODE_CMP_NE_JUMP_IF_FALSE:
+            pops = 2;
+            taken = -2;
+            break;
+        default:
+            PD("unknown opcode 0x%02X", _bytecode[_ip]);
+    }
+    int effect = pushes - pops;
+    *_pops = pops;
+    *_peak = (peak >= 0) ? peak : ((effect > 0) ? effect : 0);
+    *_taken = taken;
+    return effect;
+}
+
+/**
+ * Gets the size of an instruction, a SETUP opcode and the BEGIN opcode
+ * that follows it count as one instruction (the VM decodes them together).
+ *
+ * @param _bytecode The bytecode.
+ * @param _ip The offset of the instruction.
+ * @return size_t
+ */
+INTERNAL size_t verifier_instruction_size(uint8_t* _bytecode, size_t _ip) {
+    switch (_bytecode[_ip]) {
+        case OPCODE_SETUP_CLASS:
+        case OPCODE_SETUP_FUNCTION:
+        case OPCODE_SETUP_BLOCK:
+            return 1 + 1 + 8;
+        default:
+            return peephole_instruction_size(_bytecode, _ip);
+    }
+}
+
+/**
+ * Verifies a single code, then the codes nested in it.
+ *
+ * @param _code The code.
+ * @param _slot_count The number of frame slots the code may address.
+ * @param _entry_depth The number of values the code starts with (the error of a catch body).
+ * @param _message Set to the reason if the code is rejected.
+ * @return bool
+ */
+INTERNAL bool verifier_code(code_t* _code, int _slot_count, int _entry_depth, char** _message) {
+    uint8_t* bytecode = _code->bytecode;
+    size_t size = _code->size;
+    bool* boundary = (bool*) calloc(size + 1, sizeof(bool));
+    ASSERTNULL(boundary, "failed to allocate memory for verifier");
+    int* depth = (int*) malloc(sizeof(int) * (size + 1));
+    ASSERTNULL(depth, "failed to allocate memory for verifier");
+    size_t* worklist = (size_t*) malloc(sizeof(size_t) * (size + 1));
+    ASSERTNULL(worklist, "failed to allocate memory for verifier");
+    size_t pending = 0;
+    int max_depth = _entry_depth;
+
+    // Opcodes and operands
+    for (size_t ip = 0; ip < size; ip += verifier_instruction_size(bytecode, ip)) {
+        uint8_t opcode = bytecode[ip];
+        depth[ip] = -1;
+        boundary[ip] = true;
+        // Quickened opcodes only exist in decoded instructions
+        if (opcode < OPCODE_LOAD_NAME || opcode > OPCODE_CONCAT_N) {
+            REJECT("invalid opcode 0x%02X at %zu in %s", opcode, ip, _code->block_name);
+        }
+        if ((opcode == OPCODE_SAVE_CAPTURES || opcode == OPCODE_LAYOUT_CLASS) && ip + 1 + 4 > size) {
+            REJECT("truncated instruction at %zu in %s", ip, _code->block_name);
+        }
+        if (ip + verifier_instruction_size(bytecode, ip) > size) {
+            REJECT("truncated instruction at %zu in %s", ip, _code->block_name);
+        }
+        switch (opcode) {
+            case OPCODE_LOAD_NAME:
+            case OPCODE_LOAD_STRING:
+            case OPCODE_STORE_NAME:
+            case OPCODE_STORE_CLASS:
+            case OPCODE_SET_NAME:
+            case OPCODE_GET_PROPERTY:
+            case OPCODE_SET_PROPERTY:
+            case OPCODE_SET_NAME_POP:
+            case OPCODE_CALL_METHOD:
+            case OPCODE_GET_FIELD:
+            case OPCODE_SET_FIELD:
+            case OPCODE_LOAD_NAME_INT_BINARY:
+            case OPCODE_INCREMENT_NAME: {
+                int constant = verifier_get_int(bytecode, ip + 1);
+                if (constant < 0 || (size_t) constant >= _code->constant_count) {
+                    REJECT("constant %d out of range at %zu in %s", constant, ip, _code->block_name);
+                }
+                break;
+            }
+            case OPCODE_LOAD_LOCAL:
+            case OPCODE_STORE_LOCAL:
+            case OPCODE_SET_LOCAL:
+            case OPCODE_LOAD_LOCAL_INT_BINARY:
+            case OPCODE_INCREMENT_LOCAL: {
+                int slot = verifier_get_int(bytecode, ip + 1);
+                if (slot < 0 || slot >= _slot_count) {
+                    REJECT("frame slot %d out of range at %zu in %s", slot, ip, _code->block_name);
+                }
+                break;
+            }
+            case OPCODE_LOAD_ARRAY:
+            case OPCODE_LOAD_OBJECT:
+            case OPCODE_NEW_ARRAY:
+            case OPCODE_NEW_OBJECT:
+            case OPCODE_CALL_CONSTRUCTOR:
+            case OPCODE_CALL:
+                if (verifier_get_int(bytecode, ip + 1) < 0) {
+                    REJECT("negative count at %zu in %s", ip, _code->block_name);
+                }
+                break;
+            case OPCODE_CONCAT_N:
+                if (verifier_get_int(bytecode, ip + 1) < 2) {
+                    REJECT("concat of fewer than 2 operands at %zu in %s", ip, _code->block_name);
+                }
+                break;
+            case OPCODE_LOAD_BOOL:
+            case OPCODE_INCREMENT:
+            case OPCODE_DECREMENT:
+                if (bytecode[ip + 1] > 1) {
+                    REJECT("invalid flag at %zu in %s", ip, _code->block_name);
+                }
+                break;
+            case OPCODE_SETUP_CLASS:
+            case OPCODE_SETUP_FUNCTION:
+            case OPCODE_SETUP_BLOCK:
+                if (bytecode[ip + 1] != opcode + 1) {
+                    REJECT("unpaired setup opcode at %zu in %s", ip, _code->block_name);
+                }
+                if (verifier_get_memory(bytecode, ip + 2) == NULL) {
+                    REJECT("missing code at %zu in %s", ip, _code->block_name);
+                }
+                break;
+            case OPCODE_BEGIN_CLASS:
+            case OPCODE_BEGIN_FUNCTION:
+            case OPCODE_BEGIN_BLOCK:
+            case OPCODE_SETUP_CATCH_BLOCK:
+                if (verifier_get_memory(bytecode, ip + 1) == NULL) {
+                    REJECT("missing code at %zu in %s", ip, _code->block_name);
+                }
+                break;
+            case OPCODE_SAVE_CAPTURES: {
+                int capture_count = verifier_get_int(bytecode, ip + 1);
+                if (capture_count < 0) {
+                    REJECT("negative count at %zu in %s", ip, _code->block_name);
+                }
+                for (int i = 0; i < capture_count; i++) {
+                    size_t offset = ip + 1 + 4 + (8 * (size_t) i);
+                    int constant = verifier_get_int(bytecode, offset);
+                    int slot = verifier_get_int(bytecode, offset + 4);
+                    if (constant < 0 || (size_t) constant >= _code->constant_count) {
+                        REJECT("constant %d out of range at %zu in %s", constant, ip, _code->block_name);
+                    }
+                    if (slot < -1 || slot >= _slot_count) {
+                        REJECT("frame slot %d out of range at %zu in %s", slot, ip, _code->block_name);
+                    }
+                }
+                break;
+            }
+            case OPCODE_LAYOUT_CLASS: {
+                int field_count = verifier_get_int(bytecode, ip + 1);
+                if (field_count < 0) {
+                    REJECT("negative count at %zu in %s", ip, _code->block_name);
+                }
+                for (int i = 0; i < field_count; i++) {
+                    int constant = verifier_get_int(bytecode, ip + 1 + 4 + (4 * (size_t) i));
+                    if (constant < 0 || (size_t) constant >= _code->constant_count) {
+                        REJECT("constant %d out of range at %zu in %s", constant, ip, _code->block_name);
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        switch (opcode) {
+            case OPCODE_CALL_METHOD:
+                if (verifier_get_int(bytecode, ip + 1 + 4) < 0) {
+                    REJECT("negative count at %zu in %s", ip, _code->block_name);
+                }
+                break;
+            case OPCODE_GET_FIELD:
+            case OPCODE_SET_FIELD:
+                if (verifier_get_int(bytecode, ip + 1 + 4) < 0) {
+                    REJECT("negative field slot at %zu in %s", ip, _code->block_name);
+                }
+                break;
+            case OPCODE_LOAD_LOCAL_INT_BINARY:
+            case OPCODE_LOAD_NAME_INT_BINARY:
+                if (bytecode[ip + 1 + 4 + 4] < OPCODE_MUL || bytecode[ip + 1 + 4 + 4] > OPCODE_XOR) {
+                    REJECT("invalid binary opcode at %zu in %s", ip, _code->block_name);
+                }
+                break;
+            case OPCODE_INCREMENT_LOCAL:
+            case OPCODE_INCREMENT_NAME:
+                if (bytecode[ip + 1 + 4] != OPCODE_INCREMENT && bytecode[ip + 1 + 4] != OPCODE_DECREMENT) {
+                    REJECT("invalid increment opcode at %zu in %s", ip, _code->block_name);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Jump targets must start an instruction
+    for (size_t ip = 0; ip < size; ip += verifier_instruction_size(bytecode, ip)) {
+        if (!verifier_is_jump(bytecode[ip])) continue;
+        int target = verifier_get_int(bytecode, ip + 1);
+        if (target < 0 || (size_t) target > size || !boundary[target]) {
+            REJECT("invalid jump target %d at %zu in %s", target, ip, _code->block_name);
+        }
+    }
+
+    // Every path must see the same stack depth at a merge point, the end
+    // of the code is an implicit return
+    depth[size] = -1;
+    boundary[size] = true;
+    #define VERIFIER_MERGE(offset, value) { \
+        size_t at = (offset); \
+        int incoming = (value); \
+        if (depth[at] < 0) { \
+            depth[at] = incoming; \
+            worklist[pending++] = at; \
+        } else if (depth[at] != incoming) { \
+            REJECT("stack depth %d != %d at %zu in %s", depth[at], incoming, at, _code->block_name); \
+        } \
+    }
+    VERIFIER_MERGE(0, _entry_depth);
+    while (pending > 0) {
+        size_t ip = worklist[--pending];
+        if (ip == size) {
+            if (depth[ip] < 1) {
+                REJECT("stack underflow at the end of %s", _code->block_name);
+            }
+            continue;
+        }
+        uint8_t opcode = bytecode[ip];
+        int current = depth[ip];
+        int pops, peak, taken;
+        int effect = verifier_stack_effect(bytecode, ip, &pops, &peak, &taken);
+        if (current < pops) {
+            REJECT("stack underflow at %zu in %s", ip, _code->block_name);
+        }
+        if (current + peak > max_depth) {
+            max_depth = current + peak;
+        }
+        if (verifier_is_jump(opcode)) {
+            VERIFIER_MERGE((size_t) verifier_get_int(bytecode, ip + 1), current + taken);
+        }
+        if (!verifier_is_terminator(opcode)) {
+            VERIFIER_MERGE(ip + verifier_instruction_size(bytecode, ip), current + effect);
+        }
+    }
+    #undef VERIFIER_MERGE
+
+    free(boundary);
+    free(depth);
+    free(worklist);
+    _code->max_stack = (size_t) (max_depth - _entry_depth);
+    _code->verified = true;
+
+    // Nested codes (functions run on their own frame slots)
+    for (size_t ip = 0; ip < size; ip += verifier_instruction_size(bytecode, ip)) {
+        uint8_t opcode = bytecode[ip];
+        size_t operand = ip + 1;
+        switch (opcode) {
+            case OPCODE_SETUP_CLASS:
+            case OPCODE_SETUP_FUNCTION:
+            case OPCODE_SETUP_BLOCK:
+                opcode = bytecode[ip + 1];
+                operand = ip + 2;
+                break;
+            default:
+                break;
+        }
+        switch (opcode) {
+            case OPCODE_BEGIN_FUNCTION: {
+                // The arguments are on the stack when the function starts
+                code_t* nested = (code_t*) verifier_get_memory(bytecode, operand);
+                if (!verifier_code(nested, (int) nested->local_count, (int) nested->param_count, _message)) return false;
+                break;
+            }
+            case OPCODE_BEGIN_CLASS:
+            case OPCODE_BEGIN_BLOCK:
+                if (!verifier_code((code_t*) verifier_get_memory(bytecode, operand), _slot_count, 0, _message)) return false;
+                break;
+            case OPCODE_SETUP_CATCH_BLOCK:
+                if (!verifier_code((code_t*) verifier_get_memory(bytecode, operand), _slot_count, 1, _message)) return false;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+
+    REJECTED:
+    free(boundary);
+    free(depth);
+    free(worklist);
+    return false;
+}
+
+bool verifier_verify(code_t* _code, char** _message) {
+    *_message = NULL;
+    return verifier_code(_code, (int) _code->local_count, (int) _code->param_count, _message);
+}
@@ -0,0 +1,27 @@
+#include "api/core/global.h"
+#include "api/core/internal.h"
+#include "code.h"
+#include "opcode.h"
+
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+// Build with -DVM_UNCHECKED=1 to run verified code only, with the per
+// instruction checks of the dispatch loop compiled out
+#ifndef VM_UNCHECKED
+    #define VM_UNCHECKED 0
+#endif
+
+/*
+ * Verify a code and its nested codes (functions, blocks, classes).
+ * Checks opcodes, operand bounds, jump targets, SETUP/BEGIN pairs and the
+ * stack depth at every merge point, then marks the code as verified and
+ * records its deepest stack use.
+ *
+ * @param _code The code to verify.
+ * @param _message Set to the reason (caller frees) if the code is rejected.
+ * @return True if the code is valid.
+ */
+bool verifier_verify(code_t* _code, char** _message);
+
+#endif
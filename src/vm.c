@@ -3,24 +3,130 @@
 #include "code.h"
 #include "error.h"
 #include "gc.h"
+#include "intern.h"
 #include "internal.h"
 #include "object.h"
 #include "opcode.h"
+#include "register.h"
 #include "type.h"
+#include "verifier.h"
 #include "vm.h"
 
 #define GC_ALLOCATION_THRESHOLD 1000
+#define FRAME_STACK_SIZE 64 // Initial capacity, the frame stack grows on demand
+
+// The evaluation stack starts with one segment and grows by whole segments
+#ifndef EVALUATION_STACK_SEGMENT
+    #define EVALUATION_STACK_SEGMENT EVALUATION_STACK_SIZE
+#endif
+#define EVALUATION_STACK_LIMIT (EVALUATION_STACK_SIZE * 1024)
+
+// Threaded dispatch needs the labels-as-values extension (GCC and Clang)
+#ifndef VM_USE_COMPUTED_GOTO
+    #if defined(__GNUC__) || defined(__clang__)
+        #define VM_USE_COMPUTED_GOTO 1
+    #else
+        #define VM_USE_COMPUTED_GOTO 0
+    #endif
+#endif
+
+// Decoded code always ends with a RETURN (see vm_decode), unchecked builds rely
+// on it and skip the bound check
+#if VM_UNCHECKED
+    #define IN_CODE() true
+#else
+    #define IN_CODE() (ip < _code->instruction_count)
+#endif
+
+#if VM_USE_COMPUTED_GOTO
+    #define CASE(op) case op: TARGET_##op:
+    #define CASE_DEFAULT() default: TARGET_DEFAULT:
+    #define DISPATCH() { \
+        if (!IN_CODE()) break; \
+        instruction = &instructions[ip++]; \
+        opcode = instruction->opcode; \
+        goto *instruction->handler; \
+    }
+#else
+    #define CASE(op) case op:
+    #define CASE_DEFAULT() default:
+    #define DISPATCH() break
+#endif
+
+// Verified code has no unknown opcodes
+#if VM_UNCHECKED && (defined(__GNUC__) || defined(__clang__))
+    #define UNKNOWN_OPCODE() __builtin_unreachable()
+#else
+    #define UNKNOWN_OPCODE() { \
+        decompile(_code, false); \
+        PD("unknown opcode 0x%02X at instruction %02zu", opcode, ip-1); \
+    }
+#endif
+
+#if VM_USE_COMPUTED_GOTO
+    #define DECODE(code) vm_decode(code, dispatch_table)
+#else
+    #define DECODE(code) vm_decode(code, NULL)
+#endif
+
+// Make the frame on top of the frame stack the running one
+#define LOAD_FRAME() { \
+    vm_frame_t* frame = &instance->frames[instance->frame_count - 1]; \
+    _env  = frame->env; \
+    _code = frame->code; \
+    if (_code->instructions == NULL) { \
+        DECODE(_code); \
+    } \
+    instructions = _code->instructions; \
+    ip = frame->ip; \
+    brk = frame->brk; \
+    con = frame->con; \
+    loop_thead = frame->loop_thread; \
+}
+
+// Save the running frame and switch to the one a call or block just pushed
+#define ENTER_FRAME() { \
+    vm_frame_t* caller = &instance->frames[instance->frame_count - 2]; \
+    caller->ip = ip; \
+    caller->brk = brk; \
+    caller->con = con; \
+    caller->loop_thread = loop_thead; \
+    LOAD_FRAME(); \
+    GC_SAFEPOINT(); \
+    ENTER_REGISTER_TIER(); \
+}
+
+#if VM_USE_REGISTER_TIER
+    // Frames of functions with register code run in vm_execute_register
+    #define ENTER_REGISTER_TIER() { \
+        if (_code->register_code != NULL) goto REGISTER_TIER; \
+    }
+#else
+    #define ENTER_REGISTER_TIER()
+#endif
+
+// Collects only at function entry and loop back edges
+#define GC_SAFEPOINT() { \
+    if (instance->allocation_counter >= GC_ALLOCATION_THRESHOLD) { \
+        gc_collect(instance, _env); \
+    } \
+}
 
 #define PUSH(obj) vm_push(obj)
 
 #define PUSH_REF(obj) { \
-    ASSERTNULL(instance->evaluation_stack, "Evaluation stack is not initialized"); \
-    if (instance->sp >= EVALUATION_STACK_SIZE) { \
-        PD("Stackoverflow"); \
+    if (instance->sp >= instance->stack_capacity) { \
+        vm_reserve_stack(1); \
     } \
     instance->evaluation_stack[instance->sp++] = obj; \
 }
 
+// Frames reserve their maximum stack depth on entry (see vm_push_frame), so
+// pushes made by the dispatch loop itself skip the bound check
+#define PUSH_UNCHECKED(obj) { \
+    instance->evaluation_stack[instance->sp++] = obj; \
+}
+
 #define JUMP(offset) { \
     ip = offset; \
 }
@@ -29,11 +135,80 @@
     ip += size; \
 }
 
+// Rewrite the current instruction in place
+#if VM_USE_COMPUTED_GOTO
+    #define REWRITE(op) { \
+        instruction->opcode = op; \
+        instruction->handler = dispatch_table[op]; \
+    }
+#else
+    #define REWRITE(op) { \
+        instruction->opcode = op; \
+    }
+#endif
+
+// Specialize the current instruction for the operand types it sees first,
+// sites that already missed once (arg is set) stay generic
+#define QUICKEN(lhs, rhs) { \
+    if (instruction->arg == 0) { \
+        REWRITE(quicken_opcode(opcode, lhs, rhs)); \
+    } \
+}
+
+// Type miss in a quickened instruction, go back to the generic form
+#define DEQUICKEN(op) { \
+    REWRITE(op); \
+    instruction->arg = 1; \
+}
+
+// Guard of a quickened binary instruction (operands are obj1 and obj2)
+#define GUARD_OR_DEQUICKEN(condition, op, do_op) { \
+    if (!(condition)) { \
+        DEQUICKEN(op); \
+        do_op(obj1, obj2); \
+        DISPATCH(); \
+    } \
+}
+
+// Compare the two operands on top of the stack and jump if the result is falsy
+#define CMP_JUMP_IF_FALSE(do_cmp) { \
+    object_t* rhs = POPP(); \
+    object_t* lhs = POPP(); \
+    QUICKEN(lhs, rhs); \
+    do_cmp(lhs, rhs); \
+    if (!object_is_truthy(POPP())) { \
+        JUMP(instruction->operand.i32); \
+    } \
+}
+
+// Quickened CMP_JUMP_IF_FALSE for two ints
+#define CMP_INT_JUMP_IF_FALSE(operator, op, do_cmp) { \
+    object_t* rhs = POPP(); \
+    object_t* lhs = POPP(); \
+    bool result; \
+    if (OBJECT_TYPE_SMALL_INT(lhs) && OBJECT_TYPE_SMALL_INT(rhs)) { \
+        result = OBJECT_SMALL_INT_VALUE(lhs) operator OBJECT_SMALL_INT_VALUE(rhs); \
+    } else { \
+        DEQUICKEN(op); \
+        do_cmp(lhs, rhs); \
+        result = object_is_truthy(POPP()); \
+    } \
+    if (!result) { \
+        JUMP(instruction->operand.i32); \
+    } \
+}
+
+// Quickened compare for two ints
+#define CMP_INT(operator, op, do_cmp) { \
+    object_t *obj2 = POPP(); \
+    object_t *obj1 = POPP(); \
+    GUARD_OR_DEQUICKEN(OBJECT_TYPE_SMALL_INT(obj1) && OBJECT_TYPE_SMALL_INT(obj2), op, do_cmp); \
+    PUSH_UNCHECKED((OBJECT_SMALL_INT_VALUE(obj1) operator OBJECT_SMALL_INT_VALUE(obj2)) ? instance->tobj : instance->fobj); \
+}
+
 #define TOP (instance->sp - 1)
 #define BOT (instance->sp)
 
-#define OPCODE (bytecode[ip])
-
 #define PEEK() (instance->evaluation_stack[instance->sp - 1])
 #define POPP() (instance->evaluation_stack[--instance->sp])
 #define POPN(_times) { \
@@ -83,7 +258,34 @@ vm_t *instance = NULL;
 size_t save_top = 0;
 size_t save_bot = 0;
 
-INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code);
+INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code, async_t* _async);
+#if VM_USE_REGISTER_TIER
+INTERNAL bool vm_execute_register(size_t _base);
+#endif
+
+/**
+ * Makes room for more values on the evaluation stack.
+ * The stack grows by whole segments and never shrinks, values are
+ * addressed by index so moving the stack is safe.
+ *
+ * @param _count The number of values that must fit above the top.
+ */
+INTERNAL void vm_reserve_stack(size_t _count) {
+    size_t needed = instance->sp + _count;
+    if (needed <= instance->stack_capacity) {
+        return;
+    }
+    size_t capacity = instance->stack_capacity;
+    while (capacity < needed) {
+        capacity += EVALUATION_STACK_SEGMENT;
+    }
+    if (capacity > EVALUATION_STACK_LIMIT) {
+        PD("Stackoverflow");
+    }
+    instance->evaluation_stack = (object_t**)realloc(instance->evaluation_stack, sizeof(object_t*) * capacity);
+    ASSERTNULL(instance->evaluation_stack, "failed to allocate memory for evaluation stack");
+    instance->stack_capacity = capacity;
+}
 
 INTERNAL bool vm_object_is_in_root(object_t* _obj) {
     object_t* current = instance->root;
@@ -98,20 +300,20 @@ INTERNAL bool vm_object_is_in_root(object_t* _obj) {
 
 INTERNAL
 int get_int(uint8_t *bytecode, size_t ip) {
-    int value = 0;
+    uint32_t value = 0;
     for (size_t i = 0; i < 4; i++) {
-        value = value | (bytecode[ip + i] << (i * 8));
+        value = value | ((uint32_t)bytecode[ip + i] << (i * 8));
     }
-    return value;
+    return (int)value;
 }
 
 INTERNAL
-long get_long(uint8_t *bytecode, size_t ip) {
-    long value = 0;
+int64_t get_long(uint8_t *bytecode, size_t ip) {
+    uint64_t value = 0;
     for (size_t i = 0; i < 8; i++) {
-        value = value | (bytecode[ip + i] << (i * 8));
+        value = value | ((uint64_t) bytecode[ip + i] << (i * 8));
     }
-    return value;
+    return (int64_t) value;
 }
 
 INTERNAL
@@ -151,14 +353,280 @@ void* get_memory(uint8_t* _bytecode, size_t _ip) {
     return (void*)value;
 }
 
-INTERNAL
-char* get_string(uint8_t *_bytecode, size_t _ip) {
-    char* str = string_allocate("");
-    while (_bytecode[_ip] != 0) {
-        str = string_append_char(str, _bytecode[_ip]);
-        _ip++;
+/**
+ * Translates the raw bytecode into fixed-width instructions, so operands
+ * are decoded once instead of on every execution. Jump offsets are
+ * resolved to instruction indices.
+ *
+ * @param _code The code to decode.
+ * @param _handlers The dispatch table (NULL when dispatching with a switch).
+ */
+INTERNAL void vm_decode(code_t* _code, void** _handlers) {
+#if VM_UNCHECKED
+    // Unchecked builds trust verified code only, validate once here
+    if (!_code->verified) {
+        char* message = NULL;
+        if (!verifier_verify(_code, &message)) {
+            PD("invalid bytecode: %s", message);
+        }
+    }
+#endif
+    uint8_t* bytecode = _code->bytecode;
+    // Every instruction takes at least 1 byte
+    instruction_t* instructions = (instruction_t*)malloc(sizeof(instruction_t) * (_code->size + 1));
+    ASSERTNULL(instructions, "failed to allocate memory for instructions");
+    // Maps a byte offset to an instruction index
+    size_t* index_of = (size_t*)malloc(sizeof(size_t) * (_code->size + 1));
+    ASSERTNULL(index_of, "failed to allocate memory for instruction index");
+    for (size_t i = 0; i <= _code->size; i++) {
+        index_of[i] = SIZE_MAX;
+    }
+
+    size_t count = 0;
+    size_t cache_count = 0;
+    size_t ip = 0;
+
+    while (ip < _code->size) {
+        index_of[ip] = count;
+        opcode_t opcode = bytecode[ip++];
+        instruction_t* instruction = &instructions[count++];
+        instruction->handler = (_handlers != NULL) ? _handlers[opcode] : NULL;
+        instruction->operand.ptr = NULL;
+        instruction->arg = 0;
+        instruction->opcode = opcode;
+        instruction->op = 0;
+        instruction->cache = CODE_NO_CACHE;
+
+        // Property and method sites get their own inline cache
+        if ((opcode == OPCODE_GET_PROPERTY || opcode == OPCODE_SET_PROPERTY || opcode == OPCODE_CALL_METHOD ||
+             opcode == OPCODE_GET_FIELD || opcode == OPCODE_SET_FIELD)
+            && cache_count < CODE_NO_CACHE) {
+            instruction->cache = (uint16_t)cache_count++;
+        }
+
+        switch (opcode) {
+            case OPCODE_LOAD_LOCAL:
+            case OPCODE_STORE_LOCAL:
+            case OPCODE_SET_LOCAL:
+            case OPCODE_LOAD_ARRAY:
+            case OPCODE_LOAD_OBJECT:
+            case OPCODE_NEW_ARRAY:
+            case OPCODE_NEW_OBJECT:
+            case OPCODE_CONCAT_N:
+            case OPCODE_CALL_CONSTRUCTOR:
+            case OPCODE_CALL:
+            case OPCODE_POP_JUMP_IF_FALSE:
+            case OPCODE_POP_JUMP_IF_TRUE:
+            case OPCODE_JUMP_IF_FALSE_OR_POP:
+            case OPCODE_JUMP_IF_TRUE_OR_POP:
+            case OPCODE_JUMP_IF_NOT_ERROR:
+            case OPCODE_JUMP_FORWARD:
+            case OPCODE_JUMP_IF_CONTINUE:
+            case OPCODE_JUMP_IF_BREAK:
+            case OPCODE_ABSOLUTE_JUMP:
+            case OPCODE_GET_ITERATOR_OR_JUMP:
+            case OPCODE_HAS_NEXT:
+            case OPCODE_CMP_LT_JUMP_IF_FALSE:
+            case OPCODE_CMP_LTE_JUMP_IF_FALSE:
+            case OPCODE_CMP_GT_JUMP_IF_FALSE:
+            case OPCODE_CMP_GTE_JUMP_IF_FALSE:
+            case OPCODE_CMP_EQ_JUMP_IF_FALSE:
+            case OPCODE_CMP_NE_JUMP_IF_FALSE:
+                instruction->operand.i32 = get_int(bytecode, ip);
+                FORWARD(4);
+                break;
+            case OPCODE_LOAD_NAME:
+            case OPCODE_STORE_NAME:
+            case OPCODE_STORE_CLASS:
+            case OPCODE_SET_NAME:
+            case OPCODE_GET_PROPERTY:
+            case OPCODE_SET_PROPERTY:
+            case OPCODE_SET_NAME_POP:
+                // Names are atoms, looked up by pointer
+                instruction->operand.ptr = code_atom(_code, get_int(bytecode, ip));
+                FORWARD(4);
+                break;
+            case OPCODE_LOAD_LOCAL_INT_BINARY:
+                instruction->operand.i32 = get_int(bytecode, ip);
+                FORWARD(4);
+                instruction->arg = get_int(bytecode, ip);
+                FORWARD(4);
+                instruction->op = bytecode[ip];
+                FORWARD(1);
+                break;
+            case OPCODE_LOAD_NAME_INT_BINARY:
+                instruction->operand.ptr = code_atom(_code, get_int(bytecode, ip));
+                FORWARD(4);
+                instruction->arg = get_int(bytecode, ip);
+                FORWARD(4);
+                instruction->op = bytecode[ip];
+                FORWARD(1);
+                break;
+            case OPCODE_INCREMENT_LOCAL:
+                instruction->operand.i32 = get_int(bytecode, ip);
+                FORWARD(4);
+                instruction->op = bytecode[ip];
+                FORWARD(1);
+                break;
+            case OPCODE_INCREMENT_NAME:
+                instruction->operand.ptr = code_atom(_code, get_int(bytecode, ip));
+                FORWARD(4);
+                instruction->op = bytecode[ip];
+                FORWARD(1);
+                break;
+            case OPCODE_CALL_METHOD:
+                instruction->operand.ptr = code_atom(_code, get_int(bytecode, ip));
+                FORWARD(4);
+                instruction->arg = get_int(bytecode, ip);
+                FORWARD(4);
+                break;
+            case OPCODE_GET_FIELD:
+            case OPCODE_SET_FIELD: {
+                // The atom lets the field be matched by pointer
+                instruction->operand.ptr = code_atom(_code, get_int(bytecode, ip));
+                FORWARD(4);
+                instruction->arg = get_int(bytecode, ip);
+                FORWARD(4);
+                break;
+            }
+            case OPCODE_LAYOUT_CLASS: {
+                // The fields in declaration order, as a shape off the root
+                int field_count = get_int(bytecode, ip);
+                FORWARD(4);
+                shape_t* fields = shape_root();
+                for (int i = 0; i < field_count; i++) {
+                    object_t* name = code_atom(_code, get_int(bytecode, ip));
+                    if (fields->count < SHAPE_MAX_PROPERTIES && shape_lookup(fields, name) < 0) {
+                        fields = shape_transition(fields, name);
+                    }
+                    FORWARD(4);
+                }
+                instruction->operand.ptr = fields;
+                break;
+            }
+            // Literals are materialized once, loading one allocates nothing
+            case OPCODE_LOAD_INT:
+                instruction->operand.ptr = code_add_literal(_code, object_new_int(get_int(bytecode, ip)));
+                FORWARD(4);
+                break;
+            case OPCODE_LOAD_DOUBLE:
+                instruction->operand.ptr = code_add_literal(_code, object_new_double(get_double(bytecode, ip)));
+                FORWARD(8);
+                break;
+            case OPCODE_LOAD_LONG:
+                instruction->operand.ptr = code_add_literal(_code, object_new_long(get_long(bytecode, ip)));
+                FORWARD(8);
+                break;
+            case OPCODE_LOAD_STRING:
+                // String literals are atoms, equal ones are one object
+                instruction->operand.ptr = code_atom(_code, get_int(bytecode, ip));
+                FORWARD(4);
+                break;
+            case OPCODE_LOAD_BOOL:
+            case OPCODE_INCREMENT:
+            case OPCODE_DECREMENT:
+                instruction->operand.i32 = bytecode[ip];
+                FORWARD(1);
+                break;
+            case OPCODE_SETUP_CLASS:
+            case OPCODE_SETUP_FUNCTION:
+            case OPCODE_SETUP_BLOCK:
+                // Always paired with the matching BEGIN opcode
+#if !VM_UNCHECKED
+                if (ip >= _code->size || bytecode[ip] != opcode + 1) PD("incorrect bytecode format");
+#endif
+                FORWARD(1);
+                instruction->operand.ptr = get_memory(bytecode, ip);
+                FORWARD(8);
+                break;
+            case OPCODE_BEGIN_CLASS:
+            case OPCODE_BEGIN_FUNCTION:
+            case OPCODE_BEGIN_BLOCK:
+            case OPCODE_SETUP_CATCH_BLOCK:
+                instruction->operand.ptr = get_memory(bytecode, ip);
+                FORWARD(8);
+                break;
+            case OPCODE_SAVE_CAPTURES: {
+                // The (name, slot) pairs, the list is pointed to once
+                // every site is decoded (the array may still move)
+                int capture_count = get_int(bytecode, ip);
+                FORWARD(4);
+                if (capture_count > 0) {
+                    _code->captures = (code_capture_t*)realloc(_code->captures, sizeof(code_capture_t) * (_code->capture_count + capture_count));
+                    ASSERTNULL(_code->captures, "failed to allocate memory for captures");
+                }
+                instruction->operand.i32 = (int)_code->capture_count;
+                instruction->arg = capture_count;
+                for (int i = 0; i < capture_count; i++) {
+                    code_capture_t* capture = &_code->captures[_code->capture_count++];
+                    capture->name = code_atom(_code, get_int(bytecode, ip));
+                    capture->slot = get_int(bytecode, ip + 4);
+                    FORWARD(8);
+                }
+                break;
+            }
+            default:
+                break;
+        }
     }
-    return str;
+    index_of[_code->size] = count;
+
+    // Resolve jump targets
+    for (size_t i = 0; i < count; i++) {
+        instruction_t* instruction = &instructions[i];
+        switch (instruction->opcode) {
+            case OPCODE_POP_JUMP_IF_FALSE:
+            case OPCODE_POP_JUMP_IF_TRUE:
+            case OPCODE_JUMP_IF_FALSE_OR_POP:
+            case OPCODE_JUMP_IF_TRUE_OR_POP:
+            case OPCODE_JUMP_IF_NOT_ERROR:
+            case OPCODE_JUMP_FORWARD:
+            case OPCODE_JUMP_IF_CONTINUE:
+            case OPCODE_JUMP_IF_BREAK:
+            case OPCODE_ABSOLUTE_JUMP:
+            case OPCODE_GET_ITERATOR_OR_JUMP:
+            case OPCODE_HAS_NEXT:
+            case OPCODE_CMP_LT_JUMP_IF_FALSE:
+            case OPCODE_CMP_LTE_JUMP_IF_FALSE:
+            case OPCODE_CMP_GT_JUMP_IF_FALSE:
+            case OPCODE_CMP_GTE_JUMP_IF_FALSE:
+            case OPCODE_CMP_EQ_JUMP_IF_FALSE:
+            case OPCODE_CMP_NE_JUMP_IF_FALSE: {
+                int target = instruction->operand.i32;
+#if !VM_UNCHECKED
+                if (target < 0 || (size_t)target > _code->size || index_of[target] == SIZE_MAX) {
+                    PD("invalid jump target %d in %s", target, _code->block_name);
+                }
+#endif
+                instruction->operand.i32 = (int)index_of[target];
+                break;
+            }
+            case OPCODE_SAVE_CAPTURES:
+                instruction->operand.ptr = &_code->captures[instruction->operand.i32];
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Running off the end returns, a trailing RETURN does the same without a bound check
+    instruction_t* last = &instructions[count];
+    last->handler = (_handlers != NULL) ? _handlers[OPCODE_RETURN] : NULL;
+    last->operand.ptr = NULL;
+    last->arg = 0;
+    last->opcode = OPCODE_RETURN;
+    last->op = 0;
+    last->cache = CODE_NO_CACHE;
+
+    free(index_of);
+    if (cache_count > 0) {
+        _code->caches = (inline_cache_t*)calloc(cache_count, sizeof(inline_cache_t));
+        ASSERTNULL(_code->caches, "failed to allocate memory for inline caches");
+    }
+    _code->cache_count = cache_count;
+    _code->instructions = (instruction_t*)realloc(instructions, sizeof(instruction_t) * (count + 1));
+    ASSERTNULL(_code->instructions, "failed to allocate memory for instructions");
+    _code->instruction_count = count;
 }
 
 INTERNAL void vm_enqueue(async_t* _async) {
@@ -219,15 +687,31 @@ INTERNAL void rotate_left_3() {
     instance->evaluation_stack[instance->sp-3] = A;
 }
 
+/**
+ * Pushes the result of a double operation, kept as an int when it is
+ * integral and in the int64 range (same rule as the generic arithmetic).
+ *
+ * @param _value The result.
+ */
+INTERNAL void push_number(double _value) {
+    // The range is checked first, casting a double outside it is undefined
+    if (_value >= -9223372036854775808.0 && _value < 9223372036854775808.0 && _value == (double)(int64_t)_value) {
+        PUSH(object_new_long((int64_t)_value));
+        return;
+    }
+    PUSH(object_new_double(_value));
+}
+
 INTERNAL
 void do_increment(bool _is_postfix, object_t* _obj) {
     if (OBJECT_TYPE_INT(_obj)) {
-        long result = (long)_obj->value.i32 + 1;
-        if (result >= INT32_MIN && result <= INT32_MAX) {
-            PUSH(object_new_int((int)result));
+        int64_t value = OBJECT_INT_VALUE(_obj);
+        int64_t result;
+        if (!NUMBER_ADD_OVERFLOW(value, (int64_t) 1, &result)) {
+            PUSH(object_new_long(result));
             return;
         }
-        PUSH(object_new_double((double)result));
+        PUSH(object_new_double((double)value + 1));
         return;
     }
 
@@ -237,11 +721,7 @@ void do_increment(bool _is_postfix, object_t* _obj) {
 
     double result = number_coerce_to_double(_obj);
     result += 1;
-    if (result == (double)(int)result && result <= INT32_MAX && result >= INT32_MIN) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double(result));
+    push_number(result);
     return;
     ERROR:;
     if (_is_postfix) rotate2();
@@ -257,12 +737,13 @@ void do_increment(bool _is_postfix, object_t* _obj) {
 INTERNAL
 void do_decrement(bool _is_postfix, object_t* _obj) {
     if (OBJECT_TYPE_INT(_obj)) {
-        long result = (long)_obj->value.i32 - 1;
-        if (result >= INT32_MIN && result <= INT32_MAX) {
-            PUSH(object_new_int((int)result));
+        int64_t value = OBJECT_INT_VALUE(_obj);
+        int64_t result;
+        if (!NUMBER_SUB_OVERFLOW(value, (int64_t) 1, &result)) {
+            PUSH(object_new_long(result));
             return;
         }
-        PUSH(object_new_double((double)result));
+        PUSH(object_new_double((double)value - 1));
         return;
     }
 
@@ -272,11 +753,7 @@ void do_decrement(bool _is_postfix, object_t* _obj) {
 
     double result = number_coerce_to_double(_obj);
     result -= 1;
-    if (result == (double)(int)result && result <= INT32_MAX && result >= INT32_MIN) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double(result));
+    push_number(result);
     return;
     ERROR:;
     if (_is_postfix) rotate2();
@@ -292,8 +769,7 @@ void do_decrement(bool _is_postfix, object_t* _obj) {
 INTERNAL
 void do_unary_plus(object_t* _obj) {
     if (OBJECT_TYPE_INT(_obj)) {
-        int result = _obj->value.i32;
-        PUSH(object_new_int(_obj->value.i32));
+        PUSH(object_new_long(OBJECT_INT_VALUE(_obj)));
         return;
     }
 
@@ -303,11 +779,7 @@ void do_unary_plus(object_t* _obj) {
 
     double result = number_coerce_to_double(_obj);
     result = +result;
-    if (result == (double)(int)result && result <= INT32_MAX && result >= INT32_MIN) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double(result));
+    push_number(result);
     return;
     ERROR:;
     char* message = string_format("cannot unary plus type %s", object_type_to_string(_obj));
@@ -319,8 +791,13 @@ void do_unary_plus(object_t* _obj) {
 INTERNAL
 void do_unary_minus(object_t* _obj) {
     if (OBJECT_TYPE_INT(_obj)) {
-        int result = -_obj->value.i32;
-        PUSH(object_new_int(result));
+        int64_t value = OBJECT_INT_VALUE(_obj);
+        int64_t result;
+        if (!NUMBER_SUB_OVERFLOW((int64_t) 0, value, &result)) {
+            PUSH(object_new_long(result));
+            return;
+        }
+        PUSH(object_new_double(-(double)value));
         return;
     }
 
@@ -330,11 +807,7 @@ void do_unary_minus(object_t* _obj) {
 
     double result = number_coerce_to_double(_obj);
     result = -result;
-    if (result == (double)(int)result && result <= INT32_MAX && result >= INT32_MIN) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double(result));
+    push_number(result);
     return;
     ERROR:;
     char* message = string_format("cannot unary minus type %s", object_type_to_string(_obj));
@@ -346,7 +819,7 @@ void do_unary_minus(object_t* _obj) {
 INTERNAL
 void do_not(object_t* _obj) {
     if (OBJECT_TYPE_BOOL(_obj)) {
-        PUSH(object_new_bool(!_obj->value.i32));
+        PUSH(object_new_bool(!OBJECT_BOOL_VALUE(_obj)));
         return;
     }
 
@@ -358,8 +831,7 @@ void do_not(object_t* _obj) {
 INTERNAL
 void do_bitwise_not(object_t* _obj) {
     if (OBJECT_TYPE_INT(_obj)) {
-        int result = ~_obj->value.i32;
-        PUSH(object_new_int(result));
+        PUSH(object_new_long(~OBJECT_INT_VALUE(_obj)));
         return;
     }
 
@@ -369,11 +841,7 @@ void do_bitwise_not(object_t* _obj) {
 
     long result = number_coerce_to_long(_obj);
     result = ~result;
-    if (result >= INT32_MIN && result <= INT32_MAX) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double((double)result));
+    PUSH(object_new_long((int64_t)result));
     return;
     ERROR:;
     char* message = string_format("cannot bitwise not type %s", object_type_to_string(_obj));
@@ -386,12 +854,15 @@ INTERNAL
 void do_mul(object_t *_lhs, object_t *_rhs) {
     // Fast path for integers
     if (OBJECT_TYPE_INT(_lhs) && OBJECT_TYPE_INT(_rhs)) {
-        long result = (long)_lhs->value.i32 * _rhs->value.i32;
-        if (result >= INT32_MIN && result <= INT32_MAX) {
-            PUSH(object_new_int((int)result));
+        int64_t a = OBJECT_INT_VALUE(_lhs);
+        int64_t b = OBJECT_INT_VALUE(_rhs);
+        int64_t result;
+        if (!NUMBER_MUL_OVERFLOW(a, b, &result)) {
+            PUSH(object_new_long(result));
             return;
         }
-        PUSH(object_new_double((double)result));
+        // Overflow occurred, promote to double
+        PUSH(object_new_double((double)a * (double)b));
         return;
     }
 
@@ -405,11 +876,7 @@ void do_mul(object_t *_lhs, object_t *_rhs) {
     double result = lhs_value * rhs_value;
 
     // Try to preserve integer types if possible
-    if (result == (double)(int)result && result <= INT32_MAX && result >= INT32_MIN) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double(result));
+    push_number(result);
     return;
     ERROR:;
     char* message = string_format(
@@ -426,14 +893,18 @@ INTERNAL
 void do_div(object_t *_lhs, object_t *_rhs) {
     // Fast path for integers
     if (OBJECT_TYPE_INT(_lhs) && OBJECT_TYPE_INT(_rhs)) {
-        int a = _lhs->value.i32;
-        int b = _rhs->value.i32;
+        int64_t a = OBJECT_INT_VALUE(_lhs);
+        int64_t b = OBJECT_INT_VALUE(_rhs);
         if (b == 0) {
             PUSH(object_new_error("division by zero", true));
             return;
         }
-        int result = a / b;
-        PUSH(object_new_int(result));
+        // INT64_MIN / -1 is the one quotient that overflows
+        if (b == -1 && a == INT64_MIN) {
+            PUSH(object_new_double(-(double)a));
+            return;
+        }
+        PUSH(object_new_long(a / b));
         return;
     }
 
@@ -451,11 +922,7 @@ void do_div(object_t *_lhs, object_t *_rhs) {
     double result = lhs_value / rhs_value;
 
     // Try to preserve integer types if possible
-    if (result == (double)(int)result && result <= INT32_MAX && result >= INT32_MIN) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double(result));
+    push_number(result);
     return;
     ERROR:;
     char* message = string_format(
@@ -472,14 +939,13 @@ INTERNAL
 void do_mod(object_t *_lhs, object_t *_rhs) {
     // Fast path for integers
     if (OBJECT_TYPE_INT(_lhs) && OBJECT_TYPE_INT(_rhs)) {
-        int a = _lhs->value.i32;
-        int b = _rhs->value.i32;
+        int64_t a = OBJECT_INT_VALUE(_lhs);
+        int64_t b = OBJECT_INT_VALUE(_rhs);
         if (b == 0) {
             PUSH(object_new_error("division by zero", true));
             return;
         }
-        int result = a % b;
-        PUSH(object_new_int(result));
+        PUSH(object_new_long((b == -1) ? 0 : a % b));
         return;
     }
 
@@ -497,11 +963,7 @@ void do_mod(object_t *_lhs, object_t *_rhs) {
     double result = fmod(lhs_value, rhs_value);
 
     // Try to preserve integer types if possible
-    if (result == (double)(int)result && result <= INT32_MAX && result >= INT32_MIN) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double(result));
+    push_number(result);
     return;
     ERROR:;
     char* message = string_format(
@@ -518,25 +980,21 @@ INTERNAL
 void do_add(object_t *_lhs, object_t *_rhs) {
     // Fast path for integers
     if (OBJECT_TYPE_INT(_lhs) && OBJECT_TYPE_INT(_rhs)) {
-        // Use XOR trick to detect overflow
-        int a = _lhs->value.i32;
-        int b = _rhs->value.i32;
-        int sum = a + b;
-        if (((a ^ sum) & (b ^ sum)) < 0) {
+        int64_t a = OBJECT_INT_VALUE(_lhs);
+        int64_t b = OBJECT_INT_VALUE(_rhs);
+        int64_t sum;
+        if (NUMBER_ADD_OVERFLOW(a, b, &sum)) {
             // Overflow occurred, promote to double
             PUSH(object_new_double((double)a + (double)b));
             return;
         }
-        PUSH(object_new_int(sum));
+        PUSH(object_new_long(sum));
         return;
     }
 
     // Fast path for strings
     if (OBJECT_TYPE_STRING(_lhs) && OBJECT_TYPE_STRING(_rhs)) {
-        char* str = string_allocate("");
-        str = string_append(str, (char*)_lhs->value.opaque);
-        str = string_append(str, (char*)_rhs->value.opaque);
-        PUSH(object_new_string(str));
+        PUSH(object_new_string_concat(_lhs, _rhs));
         return;
     }
 
@@ -550,11 +1008,7 @@ void do_add(object_t *_lhs, object_t *_rhs) {
     double result = lhs_value + rhs_value;
 
     // Try to preserve integer types if possible
-    if (result == (double)(int)result && result <= INT32_MAX && result >= INT32_MIN) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double(result));
+    push_number(result);
     return;
     ERROR:;
     char* message = string_format(
@@ -567,18 +1021,45 @@ void do_add(object_t *_lhs, object_t *_rhs) {
     return;
 }
 
+/**
+ * Adds the operands on top of the stack from left to right, as the chain
+ * of adds it stands for. Strings are joined in one allocation.
+ *
+ * @param _count The number of operands.
+ */
+INTERNAL
+void do_concat_n(int _count) {
+    instance->sp -= _count;
+    object_t** operands = &instance->evaluation_stack[instance->sp];
+    int i;
+    for (i = 0; i < _count; i++) {
+        if (!OBJECT_TYPE_STRING(operands[i])) break;
+    }
+    if (i == _count) {
+        PUSH(object_new_string_join(operands, _count));
+        return;
+    }
+    // Each result only takes the place of the operand already read
+    object_t* result = operands[0];
+    for (i = 1; i < _count; i++) {
+        do_add(result, operands[i]);
+        result = POPP();
+    }
+    PUSH_REF(result);
+}
+
 INTERNAL
 void do_sub(object_t *_lhs, object_t *_rhs) {
     // Fast path for integers
     if (OBJECT_TYPE_INT(_lhs) && OBJECT_TYPE_INT(_rhs)) {
-        int a = _lhs->value.i32;
-        int b = _rhs->value.i32;
-        int diff = a - b;
-        if (((a ^ b) & (a ^ diff)) < 0) {
+        int64_t a = OBJECT_INT_VALUE(_lhs);
+        int64_t b = OBJECT_INT_VALUE(_rhs);
+        int64_t diff;
+        if (NUMBER_SUB_OVERFLOW(a, b, &diff)) {
             PUSH(object_new_double((double)a - (double)b));
             return;
         }
-        PUSH(object_new_int(diff));
+        PUSH(object_new_long(diff));
         return;
     }
 
@@ -592,11 +1073,7 @@ void do_sub(object_t *_lhs, object_t *_rhs) {
     double result = lhs_value - rhs_value;
 
     // Try to preserve integer types if possible
-    if (result == (double)(int)result && result <= INT32_MAX && result >= INT32_MIN) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double(result));
+    push_number(result);
     return;
     ERROR:;
     char* message = string_format(
@@ -611,10 +1088,9 @@ void do_sub(object_t *_lhs, object_t *_rhs) {
 
 INTERNAL void do_shl(object_t *_lhs, object_t *_rhs) {
     if (OBJECT_TYPE_INT(_lhs) && OBJECT_TYPE_INT(_rhs)) {
-        int a = _lhs->value.i32;
-        int b = _rhs->value.i32;
-        int result = a << b;
-        PUSH(object_new_int(result));
+        int64_t a = OBJECT_INT_VALUE(_lhs);
+        int64_t b = OBJECT_INT_VALUE(_rhs);
+        PUSH(object_new_long((int64_t)((uint64_t)a << (b & 63))));
         return;
     }
 
@@ -627,12 +1103,7 @@ INTERNAL void do_shl(object_t *_lhs, object_t *_rhs) {
     long rhs_value = number_coerce_to_long(_rhs);
     long result = lhs_value << rhs_value;
 
-    // Check if result can be represented as an int
-    if (result >= INT32_MIN && result <= INT32_MAX) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double((double)result));
+    PUSH(object_new_long((int64_t)result));
     return;
     ERROR:;
     char* message = string_format(
@@ -647,10 +1118,9 @@ INTERNAL void do_shl(object_t *_lhs, object_t *_rhs) {
 
 INTERNAL void do_shr(object_t *_lhs, object_t *_rhs) {
     if (OBJECT_TYPE_INT(_lhs) && OBJECT_TYPE_INT(_rhs)) {
-        int a = _lhs->value.i32;
-        int b = _rhs->value.i32;
-        int result = a >> b;
-        PUSH(object_new_int(result));
+        int64_t a = OBJECT_INT_VALUE(_lhs);
+        int64_t b = OBJECT_INT_VALUE(_rhs);
+        PUSH(object_new_long(a >> (b & 63)));
         return;
     }
 
@@ -662,13 +1132,7 @@ INTERNAL void do_shr(object_t *_lhs, object_t *_rhs) {
     long lhs_value = number_coerce_to_long(_lhs);
     long rhs_value = number_coerce_to_long(_rhs);
     long result = lhs_value >> rhs_value;
-
-    // Try to preserve integer types if possible
-    if (result >= INT32_MIN && result <= INT32_MAX) {
-        PUSH(object_new_int((int)result));
-        return;
-    }
-    PUSH(object_new_double((double)result));
+    PUSH(object_new_long((int64_t)result));
     return;
     ERROR:;
     char* message = string_format(
@@ -681,6 +1145,25 @@ INTERNAL void do_shr(object_t *_lhs, object_t *_rhs) {
     return;
 }
 
+/**
+ * Orders two numbers: ints compare exactly as 64-bit values, anything
+ * involving a double compares as doubles.
+ *
+ * @param _lhs The left number.
+ * @param _rhs The right number.
+ * @return int Negative, zero or positive.
+ */
+INTERNAL int compare_numbers(object_t* _lhs, object_t* _rhs) {
+    if (OBJECT_TYPE_INT(_lhs) && OBJECT_TYPE_INT(_rhs)) {
+        int64_t a = OBJECT_INT_VALUE(_lhs);
+        int64_t b = OBJECT_INT_VALUE(_rhs);
+        return (a > b) - (a < b);
+    }
+    double a = number_coerce_to_double(_lhs);
+    double b = number_coerce_to_double(_rhs);
+    return (a > b) - (a < b);
+}
+
 INTERNAL void do_cmp_lt(object_t *_lhs, object_t *_rhs) {
     if (!OBJECT_TYPE_NUMBER(_lhs) || !OBJECT_TYPE_NUMBER(_rhs)) {
         goto ERROR;
@@ -690,11 +1173,7 @@ INTERNAL void do_cmp_lt(object_t *_lhs, object_t *_rhs) {
         goto ERROR;
     }
 
-    // Coerce to long to avoid floating point comparisons
-    long lhs_value = number_coerce_to_long(_lhs);
-    long rhs_value = number_coerce_to_long(_rhs);
-    // Compare the long values
-    if (lhs_value < rhs_value) {
+    if (compare_numbers(_lhs, _rhs) < 0) {
         PUSH_REF(instance->tobj);
         return;
     }
@@ -720,11 +1199,7 @@ INTERNAL void do_cmp_lte(object_t *_lhs, object_t *_rhs) {
         goto ERROR;
     }
 
-    // Coerce to long to avoid floating point comparisons
-    long lhs_value = number_coerce_to_long(_lhs);
-    long rhs_value = number_coerce_to_long(_rhs);
-    // Compare the long values
-    if (lhs_value <= rhs_value) {
+    if (compare_numbers(_lhs, _rhs) <= 0) {
         PUSH_REF(instance->tobj);
         return;
     }
@@ -750,11 +1225,7 @@ INTERNAL void do_cmp_gt(object_t *_lhs, object_t *_rhs) {
         goto ERROR;
     }
 
-    // Coerce to long to avoid floating point comparisons
-    long lhs_value = number_coerce_to_long(_lhs);
-    long rhs_value = number_coerce_to_long(_rhs);
-    // Compare the long values
-    if (lhs_value > rhs_value) {
+    if (compare_numbers(_lhs, _rhs) > 0) {
         PUSH_REF(instance->tobj);
         return;
     }
@@ -780,11 +1251,7 @@ INTERNAL void do_cmp_gte(object_t *_lhs, object_t *_rhs) {
         goto ERROR;
     }
 
-    // Coerce to long to avoid floating point comparisons
-    long lhs_value = number_coerce_to_long(_lhs);
-    long rhs_value = number_coerce_to_long(_rhs);
-    // Compare the long values
-    if (lhs_value >= rhs_value) {
+    if (compare_numbers(_lhs, _rhs) >= 0) {
         PUSH_REF(instance->tobj);
         return;
     }
@@ -803,9 +1270,7 @@ INTERNAL void do_cmp_gte(object_t *_lhs, object_t *_rhs) {
 
 INTERNAL void do_cmp_eq(object_t *_lhs, object_t *_rhs) {
     if (OBJECT_TYPE_NUMBER(_lhs) && OBJECT_TYPE_NUMBER(_rhs)) {
-        long lhs_value = number_coerce_to_long(_lhs);
-        long rhs_value = number_coerce_to_long(_rhs);
-        if (lhs_value == rhs_value) {
+        if (compare_numbers(_lhs, _rhs) == 0) {
             PUSH_REF(instance->tobj);
             return;
         }
@@ -814,9 +1279,7 @@ INTERNAL void do_cmp_eq(object_t *_lhs, object_t *_rhs) {
     }
 
     if (OBJECT_TYPE_STRING(_lhs) && OBJECT_TYPE_STRING(_rhs)) {
-        char* lhs_str = (char*)_lhs->value.opaque;
-        char* rhs_str = (char*)_rhs->value.opaque;
-        if (strcmp(lhs_str, rhs_str) == 0) {
+        if (str_equals(OBJECT_STRING(_lhs), OBJECT_STRING(_rhs))) {
             PUSH_REF(instance->tobj);
             return;
         }
@@ -849,9 +1312,7 @@ INTERNAL void do_cmp_eq(object_t *_lhs, object_t *_rhs) {
 
 INTERNAL void do_cmp_ne(object_t *_lhs, object_t *_rhs) {
     if (OBJECT_TYPE_NUMBER(_lhs) && OBJECT_TYPE_NUMBER(_rhs)) {
-        long lhs_value = number_coerce_to_long(_lhs);
-        long rhs_value = number_coerce_to_long(_rhs);
-        if (lhs_value != rhs_value) {
+        if (compare_numbers(_lhs, _rhs) != 0) {
             PUSH_REF(instance->tobj);
             return;
         }
@@ -860,9 +1321,7 @@ INTERNAL void do_cmp_ne(object_t *_lhs, object_t *_rhs) {
     }
 
     if (OBJECT_TYPE_STRING(_lhs) && OBJECT_TYPE_STRING(_rhs)) {
-        char* lhs_str = (char*)_lhs->value.opaque;
-        char* rhs_str = (char*)_rhs->value.opaque;
-        if (strcmp(lhs_str, rhs_str) != 0) {
+        if (!str_equals(OBJECT_STRING(_lhs), OBJECT_STRING(_rhs))) {
             PUSH_REF(instance->tobj);
             return;
         }
@@ -890,10 +1349,7 @@ INTERNAL void do_cmp_ne(object_t *_lhs, object_t *_rhs) {
 
 INTERNAL void do_and(object_t *_lhs, object_t *_rhs) {
     if (OBJECT_TYPE_INT(_lhs) && OBJECT_TYPE_INT(_rhs)) {
-        int a = _lhs->value.i32;
-        int b = _rhs->value.i32;
-        int result = a & b;
-        PUSH(object_new_int(result));
+        PUSH(object_new_long(OBJECT_INT_VALUE(_lhs) & OBJECT_INT_VALUE(_rhs)));
         return;
     }
 
@@ -904,12 +1360,7 @@ INTERNAL void do_and(object_t *_lhs, object_t *_rhs) {
     long lhs_value = number_coerce_to_long(_lhs);
     long rhs_value = number_coerce_to_long(_rhs);
     long result = lhs_value & rhs_value;
-    // Check if result can be represented as an int
-    if (result >= INT32_MIN && result <= INT32_MAX) {
-        PUSH(object_new_int((int)result));
-    } else {
-        PUSH(object_new_double((double)result));
-    }
+    PUSH(object_new_long((int64_t)result));
     return;
     ERROR:;
     char* message = string_format(
@@ -924,10 +1375,7 @@ INTERNAL void do_and(object_t *_lhs, object_t *_rhs) {
 
 INTERNAL void do_or(object_t *_lhs, object_t *_rhs) {
     if (OBJECT_TYPE_INT(_lhs) && OBJECT_TYPE_INT(_rhs)) {
-        int a = _lhs->value.i32;
-        int b = _rhs->value.i32;
-        int result = a | b;
-        PUSH(object_new_int(result));
+        PUSH(object_new_long(OBJECT_INT_VALUE(_lhs) | OBJECT_INT_VALUE(_rhs)));
         return;
     }
 
@@ -938,12 +1386,7 @@ INTERNAL void do_or(object_t *_lhs, object_t *_rhs) {
     long lhs_value = number_coerce_to_long(_lhs);
     long rhs_value = number_coerce_to_long(_rhs);
     long result = lhs_value | rhs_value;
-    // Check if result can be represented as an int
-    if (result >= INT32_MIN && result <= INT32_MAX) {
-        PUSH(object_new_int((int)result));
-    } else {
-        PUSH(object_new_double((double)result));
-    }
+    PUSH(object_new_long((int64_t)result));
     return;
     ERROR:;
     char* message = string_format(
@@ -958,10 +1401,7 @@ INTERNAL void do_or(object_t *_lhs, object_t *_rhs) {
 
 INTERNAL void do_xor(object_t *_lhs, object_t *_rhs) {
     if (OBJECT_TYPE_INT(_lhs) && OBJECT_TYPE_INT(_rhs)) {
-        int a = _lhs->value.i32;
-        int b = _rhs->value.i32;
-        int result = a ^ b;
-        PUSH(object_new_int(result));
+        PUSH(object_new_long(OBJECT_INT_VALUE(_lhs) ^ OBJECT_INT_VALUE(_rhs)));
         return;
     }
 
@@ -972,12 +1412,7 @@ INTERNAL void do_xor(object_t *_lhs, object_t *_rhs) {
     long lhs_value = number_coerce_to_long(_lhs);
     long rhs_value = number_coerce_to_long(_rhs);
     long result = lhs_value ^ rhs_value;
-    // Check if result can be represented as an int
-    if (result >= INT32_MIN && result <= INT32_MAX) {
-        PUSH(object_new_int((int)result));
-    } else {
-        PUSH(object_new_double((double)result));
-    }
+    PUSH(object_new_long((int64_t)result));
     return;
     ERROR:;
     char* message = string_format(
@@ -991,93 +1426,343 @@ INTERNAL void do_xor(object_t *_lhs, object_t *_rhs) {
 }
 
 /**
- * We will convert block into function and execute it.
+ * Picks the specialized form of an arithmetic or compare instruction for
+ * the operand types it just saw.
  *
- * @param _env The environment.
- * @param _closure The closure.
+ * @param _opcode The generic opcode.
+ * @param _lhs The left operand.
+ * @param _rhs The right operand.
+ * @return opcode_t The quickened opcode, or _opcode if there is none.
  */
-INTERNAL void do_block(env_t* _parent_env, object_t* _closure, vm_block_signal_t* _signal) {
-    // _closure is a short lived object here, we will convert it into function and execute it.
-    code_t* code = (code_t*)_closure->value.opaque;
-    env_t* block_env = env_new(_parent_env);
-
-    block_env->closure = code->environment;
-    *_signal = vm_execute(block_env, 0, code);
-
-    if (*_signal == VmBlockSignalComplete) {
-        POPP();
+INTERNAL opcode_t quicken_opcode(opcode_t _opcode, object_t* _lhs, object_t* _rhs) {
+    bool is_int    = OBJECT_TYPE_SMALL_INT(_lhs) && OBJECT_TYPE_SMALL_INT(_rhs);
+    bool is_double = OBJECT_TYPE_DOUBLE(_lhs) && OBJECT_TYPE_DOUBLE(_rhs);
+    switch (_opcode) {
+        case OPCODE_ADD:
+            if (is_int) return OPCODE_ADD_INT_INT;
+            if (is_double) return OPCODE_ADD_DBL_DBL;
+            if (OBJECT_TYPE_STRING(_lhs) && OBJECT_TYPE_STRING(_rhs)) return OPCODE_CONCAT_STR_STR;
+            break;
+        case OPCODE_SUB:
+            if (is_int) return OPCODE_SUB_INT_INT;
+            if (is_double) return OPCODE_SUB_DBL_DBL;
+            break;
+        case OPCODE_MUL:
+            if (is_int) return OPCODE_MUL_INT_INT;
+            if (is_double) return OPCODE_MUL_DBL_DBL;
+            break;
+        case OPCODE_CMP_LT:
+        case OPCODE_CMP_LTE:
+        case OPCODE_CMP_GT:
+        case OPCODE_CMP_GTE:
+        case OPCODE_CMP_EQ:
+        case OPCODE_CMP_NE:
+            if (is_int) return OPCODE_CMP_LT_INT + (_opcode - OPCODE_CMP_LT);
+            break;
+        case OPCODE_CMP_LT_JUMP_IF_FALSE:
+        case OPCODE_CMP_LTE_JUMP_IF_FALSE:
+        case OPCODE_CMP_GT_JUMP_IF_FALSE:
+        case OPCODE_CMP_GTE_JUMP_IF_FALSE:
+        case OPCODE_CMP_EQ_JUMP_IF_FALSE:
+        case OPCODE_CMP_NE_JUMP_IF_FALSE:
+            if (is_int) return OPCODE_CMP_LT_INT_JUMP_IF_FALSE + (_opcode - OPCODE_CMP_LT_JUMP_IF_FALSE);
+            break;
+        default:
+            break;
     }
-
-    block_env->parent = NULL;
-    block_env->closure = NULL;
-    env_free(block_env);
+    return _opcode;
 }
 
-INTERNAL object_t* get_property(object_t* _obj, char* _property_name) {
-    // Fast path for regular objects
-    if (OBJECT_TYPE_OBJECT(_obj)) {
-        hashmap_t* map = (hashmap_t*)_obj->value.opaque;
-        return hashmap_has_string(map, _property_name)
-            ? hashmap_get_string(map, _property_name)
-            : NULL;
+/**
+ * Applies the binary operator folded into a superinstruction.
+ *
+ * @param _opcode The binary opcode.
+ * @param _lhs The left operand.
+ * @param _rhs The right operand.
+ */
+INTERNAL void do_binary(opcode_t _opcode, object_t* _lhs, object_t* _rhs) {
+    switch (_opcode) {
+        case OPCODE_MUL:    do_mul(_lhs, _rhs);     break;
+        case OPCODE_DIV:    do_div(_lhs, _rhs);     break;
+        case OPCODE_MOD:    do_mod(_lhs, _rhs);     break;
+        case OPCODE_ADD:    do_add(_lhs, _rhs);     break;
+        case OPCODE_SUB:    do_sub(_lhs, _rhs);     break;
+        case OPCODE_SHL:    do_shl(_lhs, _rhs);     break;
+        case OPCODE_SHR:    do_shr(_lhs, _rhs);     break;
+        case OPCODE_CMP_LT: do_cmp_lt(_lhs, _rhs);  break;
+        case OPCODE_CMP_LTE:do_cmp_lte(_lhs, _rhs); break;
+        case OPCODE_CMP_GT: do_cmp_gt(_lhs, _rhs);  break;
+        case OPCODE_CMP_GTE:do_cmp_gte(_lhs, _rhs); break;
+        case OPCODE_CMP_EQ: do_cmp_eq(_lhs, _rhs);  break;
+        case OPCODE_CMP_NE: do_cmp_ne(_lhs, _rhs);  break;
+        case OPCODE_AND:    do_and(_lhs, _rhs);     break;
+        case OPCODE_OR:     do_or(_lhs, _rhs);      break;
+        case OPCODE_XOR:    do_xor(_lhs, _rhs);     break;
+        default:
+            PD("invalid binary opcode 0x%02X", _opcode);
     }
+}
 
-    // Handle user types (classes)
-    if (OBJECT_TYPE_USER_TYPE(_obj)) {
-        user_type_t* user_type;
-
-        for (object_t* current = _obj; current != NULL; current = user_type->super) {
-            user_type = (user_type_t*)current->value.opaque;
-            hashmap_t* map = (hashmap_t*)user_type->prototype->value.opaque;
+/**
+ * Pushes the value of a variable. The default resolver looks the atom up
+ * directly, a custom one gets the name.
+ *
+ * @param _env The environment.
+ * @param _name The variable name (an atom).
+ */
+INTERNAL void do_load_name(env_t* _env, object_t* _name) {
+    if (instance->name_resolver != vm_name_resolver) {
+        instance->name_resolver(_env, OBJECT_STRING(_name)->data);
+        return;
+    }
+    object_t* value = env_get_atom(_env, _name);
+    if (value == NULL) {
+        char* message = string_format("variable \"%s\" not found", OBJECT_STRING(_name)->data);
+        PUSH(object_new_error(message, true));
+        free(message);
+        return;
+    }
+    PUSH_REF(value);
+}
 
-            if (hashmap_has_string(map, _property_name)) {
-                return hashmap_get_string(map, _property_name);
-            }
+/**
+ * Assigns the top of the stack to an existing variable, the value is
+ * left on the stack.
+ *
+ * @param _env The environment.
+ * @param _name The variable name (an atom).
+ * @return bool False if the variable does not exist (an error is pushed).
+ */
+INTERNAL bool do_set_name(env_t* _env, object_t* _name) {
+    if (!env_has_atom(_env, _name, true)) {
+        char* message = string_format(
+            "variable \"%s\" not found",
+            OBJECT_STRING(_name)->data
+        );
+        PUSH(object_new_error(message, true));
+        free(message);
+        return false;
+    }
+    env_t* env = _env;
+    while (env != NULL) {
+        if (env_has_atom(env, _name, false)) {
+            env_put_atom(env, _name, PEEK());
+            break;
         }
-        return NULL;
+        env = env_parent(env);
     }
+    return true;
+}
 
-    // Handle user type instances (objects)
-    if (OBJECT_TYPE_USER_TYPE_INSTANCE(_obj)) {
-        for (object_t* current = _obj; current != NULL;) {
-            if (OBJECT_TYPE_USER_TYPE_INSTANCE(current)) {
-                // Check instance properties first
-                user_type_instance_t* instance = (user_type_instance_t*)current->value.opaque;
-                hashmap_t* map = (hashmap_t*)instance->object->value.opaque;
-
-                if (hashmap_has_string(map, _property_name)) {
-                    return hashmap_get_string(map, _property_name);
-                }
-
-                // Move up to constructor/class
-                current = instance->constructor;
-            }
-            else if (OBJECT_TYPE_USER_TYPE(current)) {
-                // Check class prototype
-                user_type_t* user_type = (user_type_t*)current->value.opaque;
-                hashmap_t* map = (hashmap_t*)user_type->prototype->value.opaque;
+/**
+ * Pushes a frame onto the frame stack, the dispatch loop runs it next.
+ * The deepest stack use of the code is reserved here once per frame.
+ *
+ * @param _type The frame type.
+ * @param _code The code to run.
+ * @param _env The environment of the frame.
+ */
+INTERNAL void vm_push_frame(vm_frame_type_t _type, code_t* _code, env_t* _env) {
+    if (instance->frame_count >= instance->frame_capacity) {
+        instance->frame_capacity *= 2;
+        instance->frames = (vm_frame_t*)realloc(instance->frames, sizeof(vm_frame_t) * instance->frame_capacity);
+        ASSERTNULL(instance->frames, "failed to allocate memory for frame stack");
+    }
+    vm_frame_t* frame = &instance->frames[instance->frame_count++];
+    frame->type = _type;
+    frame->code = _code;
+    frame->env  = _env;
+    frame->sp   = instance->sp - ((_type == VmFrameFunction) ? _code->param_count : 0);
+    frame->ip   = 0;
+    frame->brk  = false;
+    frame->con  = false;
+    frame->loop_thread = false;
+    frame->promise = NULL;
+    vm_reserve_stack(_code->max_stack);
+}
 
-                if (hashmap_has_string(map, _property_name)) {
-                    return hashmap_get_string(map, _property_name);
-                }
+/**
+ * Pops the running frame after it finished with the given signal, and
+ * keeps unwinding while the signal has to reach an outer frame
+ * (return from inside a block, break/continue outside a loop thread).
+ *
+ * @param _signal The signal, updated when it is propagated.
+ * @param _base The index of the frame the current vm_execute started with.
+ * @return bool True if the frame on top should resume, false if the base
+ *         frame finished (its owner does the cleanup).
+ */
+INTERNAL bool vm_leave_frame(vm_block_signal_t* _signal, size_t _base) {
+    while (true) {
+        vm_frame_t frame = instance->frames[--instance->frame_count];
+        if (instance->frame_count == _base) {
+            return false;
+        }
+        vm_frame_t* parent = &instance->frames[instance->frame_count - 1];
 
-                // Move up to superclass
-                current = user_type->super;
-            }
-            else {
-                break;
+        if (frame.type == VmFrameFunction) {
+            // A pending async function keeps its environment for the resume
+            if (*_signal != VmBlockSignalPending) {
+                frame.env->closure = NULL;
+                env_free(frame.env);
             }
+            return true;
         }
-    }
 
+        // An await suspends the enclosing function with its blocks, the
+        // async keeps their frames for the resume (see OPCODE_AWAIT)
+        if (*_signal == VmBlockSignalPending) {
+            continue;
+        }
+
+        // Blocks, class and catch bodies
+        if (*_signal == VmBlockSignalComplete) {
+            POPP();
+        }
+        frame.env->parent = NULL;
+        frame.env->closure = NULL;
+        env_free(frame.env);
+
+        if (frame.type != VmFrameBlock) {
+            return true;
+        }
+        switch (*_signal) {
+            case VmBlockSignalComplete:
+                return true;
+            case VmBlockSignalReturned:
+                // The parent returns as well
+                break;
+            case VmBlockSignalCon:
+                parent->con = true;
+                if (parent->loop_thread) return true;
+                break;
+            case VmBlockSignalBrk:
+                parent->brk = true;
+                if (parent->loop_thread) return true;
+                break;
+            default:
+                PD("invalid signal state (%d)", *_signal);
+        }
+    }
+}
+
+/**
+ * Runs a block, class or catch body in a new frame.
+ * The block shares the frame slots of its parent.
+ *
+ * @param _parent_env The environment.
+ * @param _closure The closure.
+ * @param _type The frame type.
+ */
+INTERNAL void do_block(env_t* _parent_env, object_t* _closure, vm_frame_type_t _type) {
+    code_t* code = (code_t*)_closure->value.opaque;
+    env_t* block_env = env_new(_parent_env);
+    env_share_locals(block_env, _parent_env);
+    block_env->closure = code->environment;
+    vm_push_frame(_type, code, block_env);
+}
+
+/**
+ * Gets the flattened method table of a class, rebuilding it when the
+ * class version moved on since it was built. The table of the super
+ * class is copied first, so the class's own entries override inherited
+ * ones.
+ *
+ * @param _class The class.
+ * @return hashmap_t* Maps each property to the prototype that defines it.
+ */
+INTERNAL hashmap_t* user_type_methods(object_t* _class) {
+    user_type_t* user_type = (user_type_t*)_class->value.opaque;
+    if (user_type->methods != NULL && user_type->version == instance->class_version) {
+        return user_type->methods;
+    }
+
+    hashmap_t* methods = hashmap_new();
+    if (user_type->super != NULL && OBJECT_TYPE_USER_TYPE(user_type->super)) {
+        hashmap_extend(methods, user_type_methods(user_type->super));
+    }
+
+    hashmap_t* prototype_map = (hashmap_t*)user_type->prototype->value.opaque;
+    hashmap_cursor_t cursor;
+    object_t* key;
+    object_t* value;
+    hashmap_cursor_begin(prototype_map, &cursor);
+    while (hashmap_cursor_next(prototype_map, &cursor, &key, &value)) {
+        hashmap_put(methods, key, user_type->prototype);
+    }
+
+    hashmap_free(user_type->methods);
+    user_type->methods = methods;
+    user_type->version = instance->class_version;
+    return methods;
+}
+
+/**
+ * Finds a property on a class or the classes it extends.
+ *
+ * @param _class The class.
+ * @param _property_name The property name (an atom).
+ * @return object_t** The cell of the property in its prototype, or NULL if not found.
+ */
+INTERNAL object_t** user_type_lookup(object_t* _class, object_t* _property_name) {
+    object_t* prototype = hashmap_get_atom(user_type_methods(_class), _property_name);
+    return (prototype != NULL)
+        ? hashmap_cell_atom((hashmap_t*)prototype->value.opaque, _property_name)
+        : NULL;
+}
+
+/**
+ * Gets the field layout instances of a class start with, inherited from
+ * the classes it extends when it declares no fields of its own.
+ *
+ * @param _class The class.
+ * @return shape_t* The layout, or NULL if no class in the chain has one.
+ */
+INTERNAL shape_t* user_type_layout(object_t* _class) {
+    while (_class != NULL && OBJECT_TYPE_USER_TYPE(_class)) {
+        user_type_t* user_type = (user_type_t*)_class->value.opaque;
+        if (user_type->layout != NULL) {
+            return user_type->layout;
+        }
+        _class = user_type->super;
+    }
     return NULL;
 }
 
-INTERNAL void set_property(object_t* _obj, char* _property_name, object_t* _value) {
+INTERNAL object_t* get_property(object_t* _obj, object_t* _property_name) {
+    // Fast path for regular objects
+    if (OBJECT_TYPE_OBJECT(_obj)) {
+        return hashmap_get_atom((hashmap_t*)_obj->value.opaque, _property_name);
+    }
+
+    object_t* current = _obj;
+
+    // Handle user type instances (objects)
+    if (OBJECT_TYPE_USER_TYPE_INSTANCE(_obj)) {
+        // Check instance properties first
+        user_type_instance_t* instance = (user_type_instance_t*)_obj->value.opaque;
+        object_t* value = hashmap_get_atom((hashmap_t*)instance->object->value.opaque, _property_name);
+        if (value != NULL) {
+            return value;
+        }
+
+        // Move up to constructor/class
+        current = instance->constructor;
+    }
+
+    // Handle user types (classes)
+    if (OBJECT_TYPE_USER_TYPE(current)) {
+        object_t** cell = user_type_lookup(current, _property_name);
+        return (cell != NULL) ? *cell : NULL;
+    }
+
+    return NULL;
+}
+
+INTERNAL void set_property(object_t* _obj, object_t* _property_name, object_t* _value) {
     // Fast path: determine target hashmap directly based on object type
     hashmap_t* target_map = NULL;
 
-    switch (_obj->type) {
+    switch (OBJECT_TYPE_OF(_obj)) {
         case OBJECT_TYPE_USER_TYPE:
             target_map = (hashmap_t*)(((user_type_t*)_obj->value.opaque)->prototype->value.opaque);
             break;
@@ -1095,26 +1780,229 @@ INTERNAL void set_property(object_t* _obj, char* _property_name, object_t* _valu
     // If no valid target map found, exit early
     if (!target_map) return;
 
-    // Check if property already exists before creating key object
-    bool exists = hashmap_has_string(target_map, _property_name);
+    // Set the property, the name is already an atom
+    size_t size = hashmap_size(target_map);
+    hashmap_put_atom(target_map, _property_name, _value);
+
+    // A new key on a class changes what its method tables resolve to and
+    // may move the cells of its prototype
+    if (OBJECT_TYPE_USER_TYPE(_obj) && hashmap_size(target_map) != size) {
+        instance->class_version++;
+    }
+}
+
+/**
+ * Gets the inline cache key of a receiver: the shape of its own
+ * properties and the class it was made by.
+ *
+ * @param _obj The receiver.
+ * @param _map Set to the receiver's own properties (NULL for classes).
+ * @param _shape Set to the shape of the own properties (NULL for classes).
+ * @param _owner Set to the class of the receiver (NULL for plain objects).
+ * @return bool False if the receiver can not be cached (dictionary mode or not an object).
+ */
+INTERNAL bool cache_key(object_t* _obj, hashmap_t** _map, shape_t** _shape, object_t** _owner) {
+    switch (OBJECT_TYPE_OF(_obj)) {
+        case OBJECT_TYPE_OBJECT:
+            *_map = (hashmap_t*)_obj->value.opaque;
+            *_owner = NULL;
+            break;
+        case OBJECT_TYPE_USER_TYPE_INSTANCE: {
+            user_type_instance_t* instance = (user_type_instance_t*)_obj->value.opaque;
+            *_map = (hashmap_t*)instance->object->value.opaque;
+            *_owner = instance->constructor;
+            break;
+        }
+        case OBJECT_TYPE_USER_TYPE:
+            *_map = NULL;
+            *_shape = NULL;
+            *_owner = _obj;
+            return true;
+        default:
+            return false;
+    }
+    *_shape = (*_map)->shape;
+    return *_shape != NULL;
+}
+
+/**
+ * Finds the entry of an inline cache that matches a receiver.
+ *
+ * @param _cache The inline cache of the site.
+ * @param _shape The shape of the receiver's own properties.
+ * @param _owner The class of the receiver.
+ * @return inline_cache_entry_t* The entry, or NULL on a miss.
+ */
+INTERNAL inline_cache_entry_t* cache_probe(inline_cache_t* _cache, shape_t* _shape, object_t* _owner) {
+    for (size_t i = 0; i < INLINE_CACHE_WAYS; i++) {
+        inline_cache_entry_t* entry = &_cache->entries[i];
+        if (entry->shape == _shape && entry->owner == _owner &&
+            (entry->slot >= 0 || entry->version == instance->class_version)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Picks the entry of an inline cache a new receiver is recorded in,
+ * reusing a stale entry of the same receiver before evicting another.
+ *
+ * @param _cache The inline cache of the site.
+ * @param _shape The shape of the receiver's own properties.
+ * @param _owner The class of the receiver.
+ * @return inline_cache_entry_t* The entry to fill.
+ */
+INTERNAL inline_cache_entry_t* cache_victim(inline_cache_t* _cache, shape_t* _shape, object_t* _owner) {
+    inline_cache_entry_t* entry;
+    for (size_t i = 0; i < INLINE_CACHE_WAYS; i++) {
+        entry = &_cache->entries[i];
+        if ((entry->shape == _shape && entry->owner == _owner) || (entry->shape == NULL && entry->owner == NULL)) {
+            goto FILL;
+        }
+    }
+    entry = &_cache->entries[_cache->victim];
+    _cache->victim = (_cache->victim + 1) % INLINE_CACHE_WAYS;
+    FILL:;
+    entry->shape   = _shape;
+    entry->owner   = _owner;
+    entry->version = instance->class_version;
+    entry->slot    = -1;
+    entry->cell    = NULL;
+    entry->next    = NULL;
+    return entry;
+}
+
+/**
+ * Records where a property was found for a receiver in an inline cache:
+ * its own slot, or its cell in the prototype of the class.
+ *
+ * @param _cache The inline cache of the site.
+ * @param _shape The shape of the receiver's own properties.
+ * @param _owner The class of the receiver.
+ * @param _property_name The property name (an atom).
+ */
+INTERNAL void cache_record(inline_cache_t* _cache, shape_t* _shape, object_t* _owner, object_t* _property_name) {
+    long slot = (_shape != NULL) ? shape_lookup(_shape, _property_name) : -1;
+    object_t** cell = NULL;
+    if (slot < 0) {
+        if (_owner == NULL || !OBJECT_TYPE_USER_TYPE(_owner)) return;
+        cell = user_type_lookup(_owner, _property_name);
+        if (cell == NULL) return;
+    }
+    inline_cache_entry_t* entry = cache_victim(_cache, _shape, _owner);
+    entry->slot = slot;
+    entry->cell = cell;
+}
+
+/**
+ * get_property through the inline cache of a GET_PROPERTY site.
+ *
+ * @param _cache The inline cache of the site.
+ * @param _obj The receiver.
+ * @param _property_name The property name (an atom).
+ * @return object_t* The property, or NULL if not found.
+ */
+INTERNAL object_t* get_property_cached(inline_cache_t* _cache, object_t* _obj, object_t* _property_name) {
+    hashmap_t* map;
+    shape_t*   shape;
+    object_t*  owner;
+    if (!cache_key(_obj, &map, &shape, &owner)) {
+        return get_property(_obj, _property_name);
+    }
+
+    inline_cache_entry_t* entry = cache_probe(_cache, shape, owner);
+    if (entry != NULL) {
+        return (entry->slot >= 0) ? map->slots[entry->slot] : *entry->cell;
+    }
 
-    // Create string key object only once
-    object_t* key = object_new_string(_property_name);
+    object_t* property = get_property(_obj, _property_name);
+    if (property != NULL) {
+        cache_record(_cache, shape, owner, _property_name);
+    }
+    return property;
+}
 
-    // Set the property
-    hashmap_put(target_map, key, _value);
+/**
+ * set_property through the inline cache of a SET_PROPERTY site. Stores
+ * that add a property remember the shape transition as well.
+ *
+ * @param _cache The inline cache of the site.
+ * @param _obj The receiver.
+ * @param _property_name The property name (an atom).
+ * @param _value The value.
+ */
+INTERNAL void set_property_cached(inline_cache_t* _cache, object_t* _obj, object_t* _property_name, object_t* _value) {
+    hashmap_t* map;
+    shape_t*   shape;
+    object_t*  owner;
+    if (!cache_key(_obj, &map, &shape, &owner) || map == NULL) {
+        set_property(_obj, _property_name, _value);
+        return;
+    }
 
-    // Handle key object memory management
-    if (exists) {
-        // Property already exists, free our temporary key
-        free((char*)key->value.opaque);
-        free(key);
+    // Stores only depend on the own properties
+    inline_cache_entry_t* entry = cache_probe(_cache, shape, NULL);
+    if (entry == NULL) {
+        long slot = shape_lookup(shape, _property_name);
+        if (slot < 0 && shape->count >= SHAPE_MAX_PROPERTIES) {
+            // Goes to dictionary mode
+            set_property(_obj, _property_name, _value);
+            return;
+        }
+        entry = cache_victim(_cache, shape, NULL);
+        if (slot >= 0) {
+            entry->slot = slot;
+        } else {
+            entry->slot = (long)shape->count;
+            entry->next = shape_transition(shape, _property_name);
+        }
+    }
+
+    if (entry->next != NULL) {
+        hashmap_append(map, entry->next, _value);
     } else {
-        // New property, add key to heap management
-        vm_to_heap(key);
+        map->slots[entry->slot] = _value;
     }
 }
 
+/**
+ * Finds the own slot of a field of a GET_FIELD or SET_FIELD site, trying
+ * the slot of the layout (or the one it was last found in) first. The slot
+ * written back into the instruction is a monomorphic cache by design: a
+ * site that sees receivers with different layouts keeps the last slot and
+ * falls back to the scan on a miss, it never produces a wrong field.
+ *
+ * @param _instruction The field instruction, its slot is updated on a move.
+ * @param _obj The receiver.
+ * @return object_t** The slot, or NULL if the receiver has no such own field.
+ */
+INTERNAL object_t** field_cell(instruction_t* _instruction, object_t* _obj) {
+    if (!OBJECT_TYPE_USER_TYPE_INSTANCE(_obj)) {
+        return NULL;
+    }
+    user_type_instance_t* user_instance = (user_type_instance_t*)_obj->value.opaque;
+    hashmap_t* map = (hashmap_t*)user_instance->object->value.opaque;
+    shape_t* shape = map->shape;
+    if (shape == NULL) {
+        return NULL;
+    }
+
+    object_t* key = (object_t*)_instruction->operand.ptr;
+    size_t slot = (size_t)_instruction->arg;
+    if (slot < shape->count && shape->keys[slot] == key) {
+        return &map->slots[slot];
+    }
+    // Keys are shared, so a pointer compare is enough
+    for (size_t i = 0; i < shape->count; i++) {
+        if (shape->keys[i] == key) {
+            _instruction->arg = (int)i;
+            return &map->slots[i];
+        }
+    }
+    return NULL;
+}
+
 INTERNAL void do_index(object_t* _obj, object_t* _index) {
     // Check if object is a collection type
     if (!OBJECT_TYPE_COLLECTION(_obj)) {
@@ -1177,16 +2065,16 @@ INTERNAL void do_index(object_t* _obj, object_t* _index) {
 
     // Handle objects (maps)
     else if (OBJECT_TYPE_OBJECT(_obj)) {
-        hashmap_t* map = (hashmap_t*)_obj->value.opaque;
+        object_t* value = hashmap_get((hashmap_t*)_obj->value.opaque, _index);
 
         // Check if key exists
-        if (!hashmap_has(map, _index)) {
+        if (value == NULL) {
             PUSH(object_new_error("key not found", true));
             return;
         }
 
-        // Get and push object property
-        PUSH_REF(hashmap_get(map, _index));
+        // Push object property
+        PUSH_REF(value);
         return;
     }
 
@@ -1233,7 +2121,16 @@ INTERNAL void do_set_index(object_t* _obj, object_t* _index, object_t* _value) {
     free(message);
 }
 
-INTERNAL void do_call(env_t* _parent_env, bool _is_method, object_t *_function, int _argc) {
+/**
+ * Calls a function with the arguments on the stack.
+ *
+ * @param _is_method Whether the receiver is on the stack (below the arguments).
+ * @param _function The function.
+ * @param _argc The number of arguments.
+ * @param _push_frame Push a frame for the dispatch loop instead of running the call to completion.
+ * @return bool True if a frame was pushed.
+ */
+INTERNAL bool do_call(bool _is_method, object_t *_function, int _argc, bool _push_frame) {
     code_t* code = (code_t*)_function->value.opaque;
     object_t* this = _is_method ? POPP() : NULL;
 
@@ -1247,22 +2144,56 @@ INTERNAL void do_call(env_t* _parent_env, bool _is_method, object_t *_function,
         );
         PUSH(object_new_error(message, true));
         free(message);
-        return;
+        return false;
     }
 
-    env_t* func_env = env_new(_parent_env);
+    // Scoping is lexical: the callee sees its captures and the globals of
+    // the program, never the locals of its caller
+    env_t* func_env = env_new((instance->program_env != NULL) ? instance->program_env : instance->env);
     func_env->closure = code->environment;
 
+    size_t local_count = code->local_count;
+#if VM_USE_REGISTER_TIER
+    // The frame slots double as the register file of register code
+    if (code->register_code != NULL && code->register_code->register_count > local_count) {
+        local_count = code->register_code->register_count;
+    }
+#endif
+    env_reserve_locals(func_env, local_count);
+
     if (this != NULL) {
-        env_put(func_env, string_allocate("this"), this);
+        func_env->locals[CODE_THIS_SLOT] = this;
+    }
+
+    if (_push_frame) {
+        vm_push_frame(VmFrameFunction, code, func_env);
+        return true;
     }
 
-    vm_block_signal_t signal = vm_execute(func_env, 0, code);
-    func_env->closure = NULL;
+    vm_block_signal_t signal = vm_execute(func_env, 0, code, NULL);
 
     if (signal != VmBlockSignalPending) {
+        func_env->closure = NULL;
         env_free(func_env);
     }
+    return false;
+}
+
+/**
+ * Finds the receiver of the nearest method call.
+ *
+ * @param _env The environment.
+ * @return object_t*
+ */
+INTERNAL object_t* get_this(env_t* _env) {
+    env_t* current = _env;
+    while (current != NULL) {
+        if (current->local_count > 0 && current->locals[CODE_THIS_SLOT] != NULL) {
+            return current->locals[CODE_THIS_SLOT];
+        }
+        current = current->parent;
+    }
+    return NULL;
 }
 
 INTERNAL void do_native_call(object_t* _function, int _argc) {
@@ -1270,38 +2201,110 @@ INTERNAL void do_native_call(object_t* _function, int _argc) {
     function(_argc);
 }
 
-INTERNAL void vm_invoke_property(env_t* _parent_env, object_t* _obj, char* _method_name, int _argc) {
+/**
+ * Calls a function or native function with the arguments on the stack,
+ * the result (or an error) is left on the stack.
+ *
+ * @param _function The function.
+ * @param _argc The number of arguments.
+ * @param _push_frame Push a frame for the dispatch loop instead of running the call to completion.
+ * @return bool True if a frame was pushed.
+ */
+INTERNAL bool do_call_object(object_t* _function, int _argc, bool _push_frame) {
+    if (!OBJECT_TYPE_CALLABLE(_function)) {
+        POPN(_argc);
+        char* message = string_format(
+            "expected \"function\", got \"%s\"",
+            object_type_to_string(_function)
+        );
+        PUSH(object_new_error(message, true));
+        free(message);
+        return false;
+    }
+    if (OBJECT_TYPE_FUNCTION(_function)) {
+        return do_call(false, _function, _argc, _push_frame);
+    }
+    do_native_call(_function, _argc);
+    return false;
+}
+
+/**
+ * Finds the method a call on an object resolves to.
+ *
+ * @param _obj The receiver.
+ * @param _method_name The method name (an atom).
+ * @return object_t* The method, or NULL if not found.
+ */
+INTERNAL object_t* find_method(object_t* _obj, object_t* _method_name) {
     object_t* method = NULL;
-    bool is_method_call = !OBJECT_TYPE_USER_TYPE(_obj);
 
-    // Find the method in the object or its prototype chain
+    // Find the method in the class of the object, or the object itself
     if (OBJECT_TYPE_USER_TYPE(_obj) || OBJECT_TYPE_USER_TYPE_INSTANCE(_obj)) {
         // Start with the constructor for instances, or the type itself
         object_t* current = OBJECT_TYPE_USER_TYPE(_obj)
             ? _obj
             : ((user_type_instance_t*)_obj->value.opaque)->constructor;
 
-        // Walk up the prototype chain
-        while (current != NULL && OBJECT_TYPE_USER_TYPE(current)) {
-            user_type_t* user_type = (user_type_t*)current->value.opaque;
-            hashmap_t* prototype_map = (hashmap_t*)user_type->prototype->value.opaque;
-
-            if (hashmap_has_string(prototype_map, _method_name)) {
-                method = hashmap_get_string(prototype_map, _method_name);
-                break;
-            }
-            current = user_type->super;
+        if (OBJECT_TYPE_USER_TYPE(current)) {
+            object_t** cell = user_type_lookup(current, _method_name);
+            method = (cell != NULL) ? *cell : NULL;
         }
     } else if (OBJECT_TYPE_OBJECT(_obj)) {
         // Direct lookup for regular objects
-        hashmap_t* obj_map = (hashmap_t*)_obj->value.opaque;
-        if (hashmap_has_string(obj_map, _method_name)) {
-            method = hashmap_get_string(obj_map, _method_name);
-        }
+        method = hashmap_get_atom((hashmap_t*)_obj->value.opaque, _method_name);
     }
+    return method;
+}
 
-    // For method calls, push the object as 'this'
-    if (is_method_call) PUSH_REF(_obj);
+/**
+ * find_method through the inline cache of a CALL_METHOD site.
+ *
+ * @param _cache The inline cache of the site.
+ * @param _obj The receiver.
+ * @param _method_name The method name (an atom).
+ * @return object_t* The method, or NULL if not found.
+ */
+INTERNAL object_t* find_method_cached(inline_cache_t* _cache, object_t* _obj, object_t* _method_name) {
+    hashmap_t* map;
+    shape_t*   shape;
+    object_t*  owner;
+    if (OBJECT_TYPE_USER_TYPE_INSTANCE(_obj)) {
+        // Methods of instances only come from the class
+        map = NULL;
+        shape = NULL;
+        owner = ((user_type_instance_t*)_obj->value.opaque)->constructor;
+    } else if (!cache_key(_obj, &map, &shape, &owner)) {
+        return find_method(_obj, _method_name);
+    }
+
+    inline_cache_entry_t* entry = cache_probe(_cache, shape, owner);
+    if (entry != NULL) {
+        return (entry->slot >= 0) ? map->slots[entry->slot] : *entry->cell;
+    }
+
+    object_t* method = find_method(_obj, _method_name);
+    if (method != NULL) {
+        cache_record(_cache, shape, owner, _method_name);
+    }
+    return method;
+}
+
+INTERNAL bool vm_invoke_property(env_t* _env, object_t* _obj, object_t* _method_name, int _argc, bool _push_frame, inline_cache_t* _cache) {
+    bool is_method_call = !OBJECT_TYPE_USER_TYPE(_obj);
+    object_t* receiver = _obj;
+    object_t* method = (_cache != NULL)
+        ? find_method_cached(_cache, _obj, _method_name)
+        : find_method(_obj, _method_name);
+
+    // A method called through a class (super.init(), Base.method()) runs
+    // on the receiver of the caller, if the caller has one
+    if (!is_method_call) {
+        receiver = get_this(_env);
+        is_method_call = receiver != NULL;
+    }
+
+    // For method calls, push the receiver as 'this'
+    if (is_method_call) PUSH_REF(receiver);
 
     // Handle error cases
     if (method == NULL) {
@@ -1311,12 +2314,12 @@ INTERNAL void vm_invoke_property(env_t* _parent_env, object_t* _obj, char* _meth
 
         char* message = string_format(
             "method \"%s\" not found in \"%s\"",
-            _method_name,
+            OBJECT_STRING(_method_name)->data,
             object_to_string(_obj)
         );
         PUSH(object_new_error(message, true));
         free(message);
-        return;
+        return false;
     }
 
     if (!OBJECT_TYPE_CALLABLE(method)) {
@@ -1326,66 +2329,62 @@ INTERNAL void vm_invoke_property(env_t* _parent_env, object_t* _obj, char* _meth
 
         char* message = string_format(
             "method \"%s\" is not callable",
-            _method_name
+            OBJECT_STRING(_method_name)->data
         );
         PUSH(object_new_error(message, true));
         free(message);
-        return;
+        return false;
     }
 
     // Invoke the method
     if (OBJECT_TYPE_FUNCTION(method)) {
-        do_call(_parent_env, is_method_call, method, _argc);
-    } else {
-        do_native_call(method, _argc);
+        return do_call(is_method_call, method, _argc, _push_frame);
     }
+    do_native_call(method, _argc);
+    return false;
 }
 
-INTERNAL void do_new_constructor_call(env_t* _parent_env, object_t* _constructor, int _argc) {
-    char* constructor_name = "init";
-    user_type_t* user_type = (user_type_t*)_constructor->value.opaque;
-    hashmap_t* prototype_map;
+INTERNAL void do_new_constructor_call(object_t* _constructor, int _argc) {
+    object_t* constructor_name = instance->init_name;
 
     // Create a new instance with empty object
+    object_t* properties = vm_to_heap(object_new_object());
     object_t* new_instance = vm_to_heap(object_new_user_type_instance(
         _constructor,
-        vm_to_heap(object_new_object())
+        properties
     ));
 
-    // Find constructor in prototype chain
-    while (user_type != NULL) {
-        prototype_map = (hashmap_t*)user_type->prototype->value.opaque;
-
-        if (hashmap_has_string(prototype_map, constructor_name)) {
-            // Found constructor - check if it's callable
-            object_t* constructor_fn = hashmap_get_string(prototype_map, constructor_name);
+    // Room for the declared fields up front, so init does not regrow the slots
+    shape_t* layout = user_type_layout(_constructor);
+    if (layout != NULL) {
+        hashmap_reserve((hashmap_t*)properties->value.opaque, layout->count);
+    }
 
-            if (OBJECT_TYPE_CALLABLE(constructor_fn)) {
-                // Call the constructor with the new instance
-                vm_invoke_property(_parent_env, new_instance, constructor_name, _argc);
-                // Discard constructor's return value
-                POPP();
-                PUSH_REF(new_instance);
-                return;
-            } else {
-                // Constructor exists but isn't callable
-                POPN(_argc);
-                char* message = string_format(
-                    "constructor \"%s\" is not callable",
-                    constructor_name
-                );
-                PUSH(object_new_error(message, true));
-                free(message);
-                return;
-            }
-        }
+    // Find constructor in the method table (covers the inheritance chain)
+    object_t** cell = user_type_lookup(_constructor, constructor_name);
+    if (cell == NULL) {
+        // No constructor found - use default instance
+        POPN(_argc);
+        PUSH_REF(new_instance);
+        return;
+    }
 
-        // Move up the inheritance chain
-        user_type = user_type->super ? (user_type_t*)user_type->super->value.opaque : NULL;
+    if (!OBJECT_TYPE_CALLABLE(*cell)) {
+        // Constructor exists but isn't callable
+        POPN(_argc);
+        char* message = string_format(
+            "constructor \"%s\" is not callable",
+            OBJECT_STRING(constructor_name)->data
+        );
+        PUSH(object_new_error(message, true));
+        free(message);
+        return;
     }
 
-    // No constructor found - use default instance
-    POPN(_argc);
+    // Call the constructor with the new instance
+    vm_invoke_property(NULL, new_instance, constructor_name, _argc, false, NULL);
+    // Discard constructor's return value
+    POPP();
     PUSH_REF(new_instance);
 }
 
@@ -1410,22 +2409,7 @@ INTERNAL void do_panic(int _argc) {
     exit(EXIT_FAILURE);
 }
 
-INTERNAL void do_resolve(vm_block_signal_t _signal) {
-    object_t* return_value = POPP();
-    if (!OBJECT_TYPE_PROMISE(return_value)) {
-        PUSH_REF(return_value);
-        return;
-    }
-    async_promise_t* promise = (async_promise_t*) return_value->value.opaque;
-    if (_signal == VmBlockSignalReturned && promise->state == ASYNC_STATE_RESOLVED) {
-        PUSH_REF(promise->value);
-    } else {
-        // Push back
-        PUSH_REF(return_value);
-    }
-}
-
-INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code) {
+INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code, async_t* _async) {
     ASSERTNULL(instance, "VM is not initialized");
 
     char* file_path = _code->file_name;
@@ -1433,79 +2417,249 @@ INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code) {
 
     size_t ip = _ip;
 
-    // Shallow copy the bytecode
-    uint8_t* bytecode = _code->bytecode;
 
     bool brk = false; // Breakpoint flag
     bool con = false; // Continue flag
     bool loop_thead = false; // Loop thread flag
 
-    while (ip < _code->size) {
-        opcode_t opcode = bytecode[ip++];
-
-        if (instance->allocation_counter % GC_ALLOCATION_THRESHOLD == 0) {
-            gc_collect(instance, _env);
+#if VM_USE_COMPUTED_GOTO
+#if defined(__clang__)
+    #pragma clang diagnostic push
+    #pragma clang diagnostic ignored "-Winitializer-overrides"
+#else
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Woverride-init"
+#endif
+    static void* dispatch_table[256] = {
+        [0 ... 255]                        = &&TARGET_DEFAULT,
+        [OPCODE_LOAD_LOCAL]                = &&TARGET_OPCODE_LOAD_LOCAL,
+        [OPCODE_STORE_LOCAL]               = &&TARGET_OPCODE_STORE_LOCAL,
+        [OPCODE_SET_LOCAL]                 = &&TARGET_OPCODE_SET_LOCAL,
+        [OPCODE_LOAD_NAME]                 = &&TARGET_OPCODE_LOAD_NAME,
+        [OPCODE_LOAD_INT]                  = &&TARGET_OPCODE_LOAD_INT,
+        [OPCODE_LOAD_DOUBLE]               = &&TARGET_OPCODE_LOAD_DOUBLE,
+        [OPCODE_LOAD_LONG]                 = &&TARGET_OPCODE_LOAD_LONG,
+        [OPCODE_LOAD_BOOL]                 = &&TARGET_OPCODE_LOAD_BOOL,
+        [OPCODE_LOAD_STRING]               = &&TARGET_OPCODE_LOAD_STRING,
+        [OPCODE_LOAD_NULL]                 = &&TARGET_OPCODE_LOAD_NULL,
+        [OPCODE_LOAD_THIS]                 = &&TARGET_OPCODE_LOAD_THIS,
+        [OPCODE_LOAD_SUPER]                = &&TARGET_OPCODE_LOAD_SUPER,
+        [OPCODE_LOAD_ARRAY]                = &&TARGET_OPCODE_LOAD_ARRAY,
+        [OPCODE_NEW_ARRAY]                 = &&TARGET_OPCODE_NEW_ARRAY,
+        [OPCODE_EXTEND_ARRAY]              = &&TARGET_OPCODE_EXTEND_ARRAY,
+        [OPCODE_APPEND_ARRAY]              = &&TARGET_OPCODE_APPEND_ARRAY,
+        [OPCODE_LOAD_OBJECT]               = &&TARGET_OPCODE_LOAD_OBJECT,
+        [OPCODE_NEW_OBJECT]                = &&TARGET_OPCODE_NEW_OBJECT,
+        [OPCODE_EXTEND_OBJECT]             = &&TARGET_OPCODE_EXTEND_OBJECT,
+        [OPCODE_PUT_OBJECT]                = &&TARGET_OPCODE_PUT_OBJECT,
+        [OPCODE_STORE_NAME]                = &&TARGET_OPCODE_STORE_NAME,
+        [OPCODE_STORE_CLASS]               = &&TARGET_OPCODE_STORE_CLASS,
+        [OPCODE_SET_NAME]                  = &&TARGET_OPCODE_SET_NAME,
+        [OPCODE_SET_NAME_POP]              = &&TARGET_OPCODE_SET_NAME_POP,
+        [OPCODE_RANGE]                     = &&TARGET_OPCODE_RANGE,
+        [OPCODE_GET_PROPERTY]              = &&TARGET_OPCODE_GET_PROPERTY,
+        [OPCODE_INDEX]                     = &&TARGET_OPCODE_INDEX,
+        [OPCODE_SET_INDEX]                 = &&TARGET_OPCODE_SET_INDEX,
+        [OPCODE_CALL_CONSTRUCTOR]          = &&TARGET_OPCODE_CALL_CONSTRUCTOR,
+        [OPCODE_CALL]                      = &&TARGET_OPCODE_CALL,
+        [OPCODE_CALL_METHOD]               = &&TARGET_OPCODE_CALL_METHOD,
+        [OPCODE_INCREMENT]                 = &&TARGET_OPCODE_INCREMENT,
+        [OPCODE_DECREMENT]                 = &&TARGET_OPCODE_DECREMENT,
+        [OPCODE_UNARY_PLUS]                = &&TARGET_OPCODE_UNARY_PLUS,
+        [OPCODE_UNARY_MINUS]               = &&TARGET_OPCODE_UNARY_MINUS,
+        [OPCODE_NOT]                       = &&TARGET_OPCODE_NOT,
+        [OPCODE_BITWISE_NOT]               = &&TARGET_OPCODE_BITWISE_NOT,
+        [OPCODE_MUL]                       = &&TARGET_OPCODE_MUL,
+        [OPCODE_DIV]                       = &&TARGET_OPCODE_DIV,
+        [OPCODE_MOD]                       = &&TARGET_OPCODE_MOD,
+        [OPCODE_ADD]                       = &&TARGET_OPCODE_ADD,
+        [OPCODE_CONCAT_N]                  = &&TARGET_OPCODE_CONCAT_N,
+        [OPCODE_SUB]                       = &&TARGET_OPCODE_SUB,
+        [OPCODE_SHL]                       = &&TARGET_OPCODE_SHL,
+        [OPCODE_SHR]                       = &&TARGET_OPCODE_SHR,
+        [OPCODE_CMP_LT]                    = &&TARGET_OPCODE_CMP_LT,
+        [OPCODE_CMP_LTE]                   = &&TARGET_OPCODE_CMP_LTE,
+        [OPCODE_CMP_GT]                    = &&TARGET_OPCODE_CMP_GT,
+        [OPCODE_CMP_GTE]                   = &&TARGET_OPCODE_CMP_GTE,
+        [OPCODE_CMP_EQ]                    = &&TARGET_OPCODE_CMP_EQ,
+        [OPCODE_CMP_NE]                    = &&TARGET_OPCODE_CMP_NE,
+        [OPCODE_CMP_LT_JUMP_IF_FALSE]      = &&TARGET_OPCODE_CMP_LT_JUMP_IF_FALSE,
+        [OPCODE_CMP_LTE_JUMP_IF_FALSE]     = &&TARGET_OPCODE_CMP_LTE_JUMP_IF_FALSE,
+        [OPCODE_CMP_GT_JUMP_IF_FALSE]      = &&TARGET_OPCODE_CMP_GT_JUMP_IF_FALSE,
+        [OPCODE_CMP_GTE_JUMP_IF_FALSE]     = &&TARGET_OPCODE_CMP_GTE_JUMP_IF_FALSE,
+        [OPCODE_CMP_EQ_JUMP_IF_FALSE]      = &&TARGET_OPCODE_CMP_EQ_JUMP_IF_FALSE,
+        [OPCODE_CMP_NE_JUMP_IF_FALSE]      = &&TARGET_OPCODE_CMP_NE_JUMP_IF_FALSE,
+        [OPCODE_ADD_INT_INT]               = &&TARGET_OPCODE_ADD_INT_INT,
+        [OPCODE_ADD_DBL_DBL]               = &&TARGET_OPCODE_ADD_DBL_DBL,
+        [OPCODE_SUB_INT_INT]               = &&TARGET_OPCODE_SUB_INT_INT,
+        [OPCODE_SUB_DBL_DBL]               = &&TARGET_OPCODE_SUB_DBL_DBL,
+        [OPCODE_MUL_INT_INT]               = &&TARGET_OPCODE_MUL_INT_INT,
+        [OPCODE_MUL_DBL_DBL]               = &&TARGET_OPCODE_MUL_DBL_DBL,
+        [OPCODE_CONCAT_STR_STR]            = &&TARGET_OPCODE_CONCAT_STR_STR,
+        [OPCODE_CMP_LT_INT]                = &&TARGET_OPCODE_CMP_LT_INT,
+        [OPCODE_CMP_LTE_INT]               = &&TARGET_OPCODE_CMP_LTE_INT,
+        [OPCODE_CMP_GT_INT]                = &&TARGET_OPCODE_CMP_GT_INT,
+        [OPCODE_CMP_GTE_INT]               = &&TARGET_OPCODE_CMP_GTE_INT,
+        [OPCODE_CMP_EQ_INT]                = &&TARGET_OPCODE_CMP_EQ_INT,
+        [OPCODE_CMP_NE_INT]                = &&TARGET_OPCODE_CMP_NE_INT,
+        [OPCODE_CMP_LT_INT_JUMP_IF_FALSE]  = &&TARGET_OPCODE_CMP_LT_INT_JUMP_IF_FALSE,
+        [OPCODE_CMP_LTE_INT_JUMP_IF_FALSE] = &&TARGET_OPCODE_CMP_LTE_INT_JUMP_IF_FALSE,
+        [OPCODE_CMP_GT_INT_JUMP_IF_FALSE]  = &&TARGET_OPCODE_CMP_GT_INT_JUMP_IF_FALSE,
+        [OPCODE_CMP_GTE_INT_JUMP_IF_FALSE] = &&TARGET_OPCODE_CMP_GTE_INT_JUMP_IF_FALSE,
+        [OPCODE_CMP_EQ_INT_JUMP_IF_FALSE]  = &&TARGET_OPCODE_CMP_EQ_INT_JUMP_IF_FALSE,
+        [OPCODE_CMP_NE_INT_JUMP_IF_FALSE]  = &&TARGET_OPCODE_CMP_NE_INT_JUMP_IF_FALSE,
+        [OPCODE_AND]                       = &&TARGET_OPCODE_AND,
+        [OPCODE_OR]                        = &&TARGET_OPCODE_OR,
+        [OPCODE_XOR]                       = &&TARGET_OPCODE_XOR,
+        [OPCODE_POP_JUMP_IF_FALSE]         = &&TARGET_OPCODE_POP_JUMP_IF_FALSE,
+        [OPCODE_POP_JUMP_IF_TRUE]          = &&TARGET_OPCODE_POP_JUMP_IF_TRUE,
+        [OPCODE_JUMP_IF_FALSE_OR_POP]      = &&TARGET_OPCODE_JUMP_IF_FALSE_OR_POP,
+        [OPCODE_JUMP_IF_TRUE_OR_POP]       = &&TARGET_OPCODE_JUMP_IF_TRUE_OR_POP,
+        [OPCODE_JUMP_IF_NOT_ERROR]         = &&TARGET_OPCODE_JUMP_IF_NOT_ERROR,
+        [OPCODE_JUMP_FORWARD]              = &&TARGET_OPCODE_JUMP_FORWARD,
+        [OPCODE_JUMP_IF_CONTINUE]          = &&TARGET_OPCODE_JUMP_IF_CONTINUE,
+        [OPCODE_JUMP_IF_BREAK]             = &&TARGET_OPCODE_JUMP_IF_BREAK,
+        [OPCODE_ABSOLUTE_JUMP]             = &&TARGET_OPCODE_ABSOLUTE_JUMP,
+        [OPCODE_LOAD_LOCAL_INT_BINARY]     = &&TARGET_OPCODE_LOAD_LOCAL_INT_BINARY,
+        [OPCODE_LOAD_NAME_INT_BINARY]      = &&TARGET_OPCODE_LOAD_NAME_INT_BINARY,
+        [OPCODE_INCREMENT_LOCAL]           = &&TARGET_OPCODE_INCREMENT_LOCAL,
+        [OPCODE_INCREMENT_NAME]            = &&TARGET_OPCODE_INCREMENT_NAME,
+        [OPCODE_POPTOP]                    = &&TARGET_OPCODE_POPTOP,
+        [OPCODE_SETUP_CLASS]               = &&TARGET_OPCODE_SETUP_CLASS,
+        [OPCODE_BEGIN_CLASS]               = &&TARGET_OPCODE_BEGIN_CLASS,
+        [OPCODE_EXTEND_CLASS]              = &&TARGET_OPCODE_EXTEND_CLASS,
+        [OPCODE_SETUP_FUNCTION]            = &&TARGET_OPCODE_SETUP_FUNCTION,
+        [OPCODE_BEGIN_FUNCTION]            = &&TARGET_OPCODE_BEGIN_FUNCTION,
+        [OPCODE_SETUP_BLOCK]               = &&TARGET_OPCODE_SETUP_BLOCK,
+        [OPCODE_BEGIN_BLOCK]               = &&TARGET_OPCODE_BEGIN_BLOCK,
+        [OPCODE_SETUP_CATCH_BLOCK]         = &&TARGET_OPCODE_SETUP_CATCH_BLOCK,
+        [OPCODE_RETURN]                    = &&TARGET_OPCODE_RETURN,
+        [OPCODE_RETURN_ASYNC]              = &&TARGET_OPCODE_RETURN_ASYNC,
+        [OPCODE_COMPLETE_BLOCK]            = &&TARGET_OPCODE_COMPLETE_BLOCK,
+        [OPCODE_DUPTOP]                    = &&TARGET_OPCODE_DUPTOP,
+        [OPCODE_ROT2]                      = &&TARGET_OPCODE_ROT2,
+        [OPCODE_ROT3]                      = &&TARGET_OPCODE_ROT3,
+        [OPCODE_ROT4]                      = &&TARGET_OPCODE_ROT4,
+        [OPCODE_SAVE_CAPTURES]             = &&TARGET_OPCODE_SAVE_CAPTURES,
+        [OPCODE_GET_ITERATOR_OR_JUMP]      = &&TARGET_OPCODE_GET_ITERATOR_OR_JUMP,
+        [OPCODE_HAS_NEXT]                  = &&TARGET_OPCODE_HAS_NEXT,
+        [OPCODE_GET_NEXT_VALUE]            = &&TARGET_OPCODE_GET_NEXT_VALUE,
+        [OPCODE_GET_NEXT_KEY_VALUE]        = &&TARGET_OPCODE_GET_NEXT_KEY_VALUE,
+        [OPCODE_SET_PROPERTY]              = &&TARGET_OPCODE_SET_PROPERTY,
+        [OPCODE_GET_FIELD]                 = &&TARGET_OPCODE_GET_FIELD,
+        [OPCODE_SET_FIELD]                 = &&TARGET_OPCODE_SET_FIELD,
+        [OPCODE_LAYOUT_CLASS]              = &&TARGET_OPCODE_LAYOUT_CLASS,
+        [OPCODE_AWAIT]                     = &&TARGET_OPCODE_AWAIT,
+        [OPCODE_CONTINUE]                  = &&TARGET_OPCODE_CONTINUE,
+        [OPCODE_BREAK]                     = &&TARGET_OPCODE_BREAK,
+        [OPCODE_BEGIN_LOOP_THREAD]         = &&TARGET_OPCODE_BEGIN_LOOP_THREAD,
+        [OPCODE_END_LOOP_THREAD]           = &&TARGET_OPCODE_END_LOOP_THREAD,
+    };
+#if defined(__clang__)
+    #pragma clang diagnostic pop
+#else
+    #pragma GCC diagnostic pop
+#endif
+#endif
+
+    // Calls and blocks run in this loop as frames above the base frame
+    size_t base = instance->frame_count;
+    if (_async != NULL) {
+        // Resume an await on top of the current stack, with the stack and
+        // the frames the function had when it suspended
+        size_t stack_base = instance->sp;
+        if (_async->stack_count > 0) {
+            vm_reserve_stack(_async->stack_count);
+            memcpy(&instance->evaluation_stack[stack_base], _async->stack, sizeof(object_t*) * _async->stack_count);
+            instance->sp += _async->stack_count;
         }
+        for (size_t i = 0; i < _async->frame_count; i++) {
+            vm_frame_t* saved = &_async->frames[i];
+            vm_push_frame(saved->type, saved->code, saved->env);
+            instance->frames[base + i] = *saved;
+            instance->frames[base + i].sp = saved->sp - _async->frames[0].sp + stack_base;
+        }
+        instance->frames[base].promise = _async->promise;
+        async_promise_t* awaited = (async_promise_t*) _async->awaited->value.opaque;
+        PUSH_REF(awaited->value);
+    } else {
+        vm_push_frame(VmFrameFunction, _code, _env);
+        instance->frames[base].ip = _ip;
+    }
+
+    vm_block_signal_t signal;
+    instruction_t* instructions = NULL;
+    instruction_t* instruction = NULL;
+
+    LOAD_FRAME();
+    GC_SAFEPOINT();
+
+    RESUME:
+    ENTER_REGISTER_TIER();
+    while (IN_CODE()) {
+        instruction = &instructions[ip++];
+        opcode_t opcode = instruction->opcode;
 
         // Check if opcode is valid
         switch (opcode) {
-            case OPCODE_LOAD_NAME: {
-                char* name = get_string(bytecode, ip);
-                instance->name_resolver(
-                    _env, name
-                );
-                FORWARD(strlen(name) + 1);
-                break;
+            CASE(OPCODE_LOAD_LOCAL) {
+                object_t* value = _env->locals[instruction->operand.i32];
+                if (value == NULL) {
+                    PUSH_UNCHECKED(instance->null);
+                } else {
+                    PUSH_UNCHECKED(value);
+                }
+                DISPATCH();
             }
-            case OPCODE_LOAD_INT: {
-                PUSH(object_new_int(
-                    get_int(bytecode, ip)
-                ));
-                FORWARD(4);
-                break;
+            CASE(OPCODE_STORE_LOCAL) {
+                _env->locals[instruction->operand.i32] = POPP();
+                DISPATCH();
             }
-            case OPCODE_LOAD_DOUBLE: {
-                PUSH(object_new_double(
-                    get_double(bytecode, ip)
-                ));
-                FORWARD(8);
-                break;
+            CASE(OPCODE_SET_LOCAL) {
+                _env->locals[instruction->operand.i32] = PEEK();
+                DISPATCH();
             }
-            case OPCODE_LOAD_BOOL: {
-                if (bytecode[ip] == 1) {
-                    PUSH_REF(instance->tobj);
+            CASE(OPCODE_LOAD_NAME) {
+                do_load_name(_env, (object_t*)instruction->operand.ptr);
+                DISPATCH();
+            }
+            CASE(OPCODE_LOAD_INT)
+            CASE(OPCODE_LOAD_DOUBLE)
+            CASE(OPCODE_LOAD_LONG) {
+                PUSH_UNCHECKED((object_t*)instruction->operand.ptr);
+                DISPATCH();
+            }
+            CASE(OPCODE_LOAD_BOOL) {
+                if (instruction->operand.i32 == 1) {
+                    PUSH_UNCHECKED(instance->tobj);
                 } else {
-                    PUSH_REF(instance->fobj);
+                    PUSH_UNCHECKED(instance->fobj);
                 }
-                FORWARD(1);
-                break;
+                DISPATCH();
             }
-            case OPCODE_LOAD_STRING: {
-                char* str = get_string(bytecode, ip);
-                PUSH(object_new_string(
-                    string_allocate(str)
-                ));
-                FORWARD(strlen(str) + 1);
-                break;
+            CASE(OPCODE_LOAD_STRING) {
+                PUSH_UNCHECKED((object_t*)instruction->operand.ptr);
+                DISPATCH();
             }
-            case OPCODE_LOAD_NULL: {
-                PUSH_REF(instance->null);
-                break;
+            CASE(OPCODE_LOAD_NULL) {
+                PUSH_UNCHECKED(instance->null);
+                DISPATCH();
             }
-            case OPCODE_LOAD_THIS: {
-                if (!env_has(_env, "this", true)) {
+            CASE(OPCODE_LOAD_THIS) {
+                object_t* this = get_this(_env);
+                if (this == NULL) {
                     PUSH(object_new_error("this is not defined", true));
                     break;
                 }
-                PUSH_REF(env_get(_env, "this"));
-                break;
+                PUSH_UNCHECKED(this);
+                DISPATCH();
             }
-            case OPCODE_LOAD_SUPER: {
-                if (!env_has(_env, "this", true)) {
+            CASE(OPCODE_LOAD_SUPER) {
+                object_t* this = get_this(_env);
+                if (this == NULL) {
                     PUSH(object_new_error("super is not defined", true));
                     break;
                 }
-                object_t* this = env_get(_env, "this");
                 if (!OBJECT_TYPE_USER_TYPE_INSTANCE(this)) {
                     char* message = string_format(
                         "expected \"user type instance\", got \"%s\"",
@@ -1530,20 +2684,24 @@ INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code) {
                     free(message);
                     break;
                 }
-                PUSH_REF(super);
-                break;
+                PUSH_UNCHECKED(super);
+                DISPATCH();
             }
-            case OPCODE_LOAD_ARRAY: {
-                int length = get_int(bytecode, ip);
+            CASE(OPCODE_LOAD_ARRAY) {
+                int length = instruction->operand.i32;
                 object_t* array = object_new_array(length);
+                object_t** elements = ((array_t*) array->value.opaque)->elements;
                 for (int i = 0; i < length; i++) {
-                    array_set((array_t*) array->value.opaque, i, POPP());
+                    elements[i] = POPP();
                 }
                 PUSH(array);
-                FORWARD(4);
-                break;
+                DISPATCH();
             }
-            case OPCODE_EXTEND_ARRAY: {
+            CASE(OPCODE_NEW_ARRAY) {
+                PUSH(object_new_array_sized((size_t) instruction->operand.i32));
+                DISPATCH();
+            }
+            CASE(OPCODE_EXTEND_ARRAY) {
                 object_t* array_src = POPP();
                 object_t* array_dst = PEEK();
                 if (!OBJECT_TYPE_ARRAY(array_src) && !OBJECT_TYPE_RANGE(array_src)) {
@@ -1566,14 +2724,24 @@ INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code) {
                     free(message);
                     break;
                 }
-                array_t* src_array = (OBJECT_TYPE_ARRAY(array_src))
-                    ? (array_t*) array_src->value.opaque
-                    : (array_t*) (range_to_array((range_t*) array_src->value.opaque))->value.opaque;
+                array_t* dst_array = (array_t*) array_dst->value.opaque;
+                if (OBJECT_TYPE_RANGE(array_src)) {
+                    // Spread the range straight into the array, without a temporary array
+                    range_t* range = (range_t*) array_src->value.opaque;
+                    size_t length = range_length(range);
+                    array_reserve(dst_array, dst_array->length + length);
+                    double start = range->start;
+                    double step = range->step;
+                    for (size_t i = 0; i < length; i++) {
+                        dst_array->elements[dst_array->length++] = vm_to_heap(object_new_double(start + (double)i * step));
+                    }
+                    DISPATCH();
+                }
                 /************/
-                array_extend((array_t*) array_dst->value.opaque, src_array);
-                break;
+                array_extend(dst_array, (array_t*) array_src->value.opaque);
+                DISPATCH();
             }
-            case OPCODE_APPEND_ARRAY: {
+            CASE(OPCODE_APPEND_ARRAY) {
                 object_t* obj = POPP();
                 object_t* arr = PEEK();
                 if (!OBJECT_TYPE_ARRAY(arr)) {
@@ -1587,11 +2755,11 @@ INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code) {
                     break;
                 }
                 array_push((array_t*)arr->value.opaque, obj);
-                break;
+                DISPATCH();
             }
-            case OPCODE_LOAD_OBJECT: {
-                int length = get_int(bytecode, ip);
-                object_t* obj = object_new_object();
+            CASE(OPCODE_LOAD_OBJECT) {
+                int length = instruction->operand.i32;
+                object_t* obj = object_new_object_sized((size_t) length);
                 for (int i = 0; i < length; i++) {
                     object_t* key = POPP();
                     if (OBJECT_TYPE_COLLECTION(key)) {
@@ -1607,10 +2775,13 @@ INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code) {
                     hashmap_put((hashmap_t*)obj->value.opaque, key, val);
                 }
                 PUSH(obj);
-                FORWARD(4);
-                break;
+                DISPATCH();
             }
-            case OPCODE_EXTEND_OBJECT: {
+            CASE(OPCODE_NEW_OBJECT) {
+                PUSH(object_new_object_sized((size_t) instruction->operand.i32));
+                DISPATCH();
+            }
+            CASE(OPCODE_EXTEND_OBJECT) {
                 object_t* obj_src = POPP();
                 object_t* obj_dst = PEEK();
                 if (!OBJECT_TYPE_OBJECT(obj_src)) {
@@ -1634,9 +2805,9 @@ INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code) {
                     break;
                 }
                 hashmap_extend((hashmap_t*)obj_dst->value.opaque, (hashmap_t*)obj_src->value.opaque);
-                break;
+                DISPATCH();
             }
-            case OPCODE_PUT_OBJECT: {
+            CASE(OPCODE_PUT_OBJECT) {
                 object_t* key = POPP();
                 object_t* val = POPP();
                 object_t* obj_dst = PEEK();
@@ -1660,49 +2831,33 @@ INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code) {
                     break;
                 }
                 hashmap_put((hashmap_t*)obj_dst->value.opaque, key, val);
-                break;
+                DISPATCH();
             }
-            case OPCODE_STORE_NAME: {
-                char* name = get_string(bytecode, ip);
-                env_put(_env, name, POPP());
-                FORWARD(strlen(name) + 1);
-                free(name);
-                break;
+            CASE(OPCODE_STORE_NAME) {
+                object_t* name = (object_t*)instruction->operand.ptr;
+                env_put_atom(_env, name, POPP());
+                DISPATCH();
             }
-            case OPCODE_STORE_CLASS: {
-                char* name = get_string(bytecode, ip);
+            CASE(OPCODE_STORE_CLASS) {
+                object_t* name = (object_t*)instruction->operand.ptr;
                 object_t* obj = POPP();
-                object_t* user = object_new_user_type(name, NULL, obj);
-                env_put(_env, name, user);
-                PUSH_REF(user);
-                FORWARD(strlen(name) + 1);
-                break;
-            }
-            case OPCODE_SET_NAME: {
-                char* name = get_string(bytecode, ip);
-                if (!env_has(_env, name, true)) {
-                    char* message = string_format(
-                        "variable \"%s\" not found",
-                        name
-                    );
-                    PUSH(object_new_error(message, true));
-                    free(message);
-                    FORWARD(strlen(name) + 1);
-                    break;
-                }
-                env_t* env = _env;
-                while (env != NULL) {
-                    if (env_has(env, name, false)) {
-                        env_put(env, name, PEEK());
-                        break;
-                    }
-                    env = env_parent(env);
-                }
-                FORWARD(strlen(name) + 1);
-                free(name);
-                break;
+                object_t* user = vm_to_heap(object_new_user_type(OBJECT_STRING(name)->data, NULL, obj));
+                instance->class_version++;
+                env_put_atom(_env, name, user);
+                PUSH_UNCHECKED(user);
+                DISPATCH();
+            }
+            CASE(OPCODE_SET_NAME) {
+                do_set_name(_env, (object_t*)instruction->operand.ptr);
+                DISPATCH();
+            }
+            CASE(OPCODE_SET_NAME_POP) {
+                // The error (if any) is popped instead of the value
+                do_set_name(_env, (object_t*)instruction->operand.ptr);
+                POPP();
+                DISPATCH();
             }
-            case OPCODE_RANGE: {
+            CASE(OPCODE_RANGE) {
                 object_t* lhs = POPP();
                 if (!OBJECT_TYPE_NUMBER(lhs)) {
                     char* message = string_format(
@@ -1731,43 +2886,41 @@ INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code) {
                     ended,
                     step
                 ));
-                break;
+                DISPATCH();
             }
-            case OPCODE_GET_PROPERTY: {
-                char* name = get_string(bytecode, ip);
+            CASE(OPCODE_GET_PROPERTY) {
+                object_t* name = (object_t*)instruction->operand.ptr;
                 object_t* obj = POPP();
-                object_t* property = get_property(obj, name);
+                object_t* property = (instruction->cache != CODE_NO_CACHE)
+                    ? get_property_cached(&_code->caches[instruction->cache], obj, name)
+                    : get_property(obj, name);
                 if (property == NULL) {
                     char* message = string_format(
                         "property \"%s\" not found in \"%s\"",
-                        name,
+                        OBJECT_STRING(name)->data,
                         object_to_string(obj)
                     );
                     PUSH(object_new_error(message, true));
                     free(message);
-                    FORWARD(strlen(name) + 1);
-                    free(name);
                     break;
                 }
-                PUSH_REF(property);
-                FORWARD(strlen(name) + 1);
-                free(name);
-                break;
+                PUSH_UNCHECKED(property);
+                DISPATCH();
             }
-            case OPCODE_INDEX: {
+            CASE(OPCODE_INDEX) {
                 object_t* idx = POPP();
                 object_t* obj = POPP();
                 do_index(obj, idx);
-                break;
+                DISPATCH();
             }
-            case OPCODE_SET_INDEX: {
+            CASE(OPCODE_SET_INDEX) {
                 object_t* idx = POPP();
                 object_t* obj = POPP();
                 do_set_index(obj, idx, PEEK());
-                break;
+                DISPATCH();
             }
-            case OPCODE_CALL_CONSTRUCTOR: {
-                int argc = get_int(bytecode, ip);
+            CASE(OPCODE_CALL_CONSTRUCTOR) {
+                int argc = instruction->operand.i32;
                 object_t* constructor = POPP();
                 if (!OBJECT_TYPE_USER_TYPE(constructor)) {
                     for (int i = 0; i < argc; i++) POPP();
@@ -1777,276 +2930,426 @@ INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code) {
                     );
                     PUSH(object_new_error(message, true));
                     free(message);
-                    FORWARD(4);
                     break;
                 }
-                do_new_constructor_call(_env, constructor, argc);
-                FORWARD(4);
-                break;
+                do_new_constructor_call(constructor, argc);
+                DISPATCH();
             }
-            case OPCODE_CALL: {
-                int argc = get_int(bytecode, ip);
+            CASE(OPCODE_CALL) {
+                int argc = instruction->operand.i32;
                 object_t* function = POPP();
-                if (!OBJECT_TYPE_CALLABLE(function)) {
-                    for (int i = 0; i < argc; i++) POPP();
-                    char* message = string_format(
-                        "expected \"function\", got \"%s\"",
-                        object_type_to_string(function)
-                    );
-                    PUSH(object_new_error(message, true));
-                    free(message);
-                    FORWARD(4);
-                    break;
+                if (do_call_object(function, argc, true)) {
+                    ENTER_FRAME();
                 }
-                if (OBJECT_TYPE_FUNCTION(function)) {
-                    do_call(_env, false, function, argc);
-                } else {
-                    do_native_call(function, argc);
-                }
-                FORWARD(4);
-                break;
+                DISPATCH();
             }
-            case OPCODE_CALL_METHOD: {
-                char* method_name = get_string(bytecode, ip);
-                FORWARD(strlen(method_name) + 1);
-                int argc = get_int(bytecode, ip);
+            CASE(OPCODE_CALL_METHOD) {
+                object_t* method_name = (object_t*)instruction->operand.ptr;
+                int argc = instruction->arg;
                 object_t* obj = POPP();
-                vm_invoke_property(_env, obj, method_name, argc);
-                FORWARD(4);
-                free(method_name);
-                break;
+                inline_cache_t* cache = (instruction->cache != CODE_NO_CACHE) ? &_code->caches[instruction->cache] : NULL;
+                if (vm_invoke_property(_env, obj, method_name, argc, true, cache)) {
+                    ENTER_FRAME();
+                }
+                DISPATCH();
             }
-            case OPCODE_INCREMENT: {
-                bool is_postfix = bytecode[ip];
+            CASE(OPCODE_INCREMENT) {
+                bool is_postfix = instruction->operand.i32;
                 object_t* obj = POPP();
-                printf("Incrementing %s\n", object_to_string(obj));
                 do_increment(is_postfix, obj);
-                FORWARD(1);
-                break;
+                DISPATCH();
             }
-            case OPCODE_DECREMENT: {
-                bool is_postfix = bytecode[ip];
+            CASE(OPCODE_DECREMENT) {
+                bool is_postfix = instruction->operand.i32;
                 object_t *obj = POPP();
                 do_decrement(is_postfix, obj);
-                FORWARD(1);
-                break;
+                DISPATCH();
             }
-            case OPCODE_UNARY_PLUS: {
+            CASE(OPCODE_UNARY_PLUS) {
                 object_t *obj = POPP();
                 do_unary_plus(obj);
-                break;
+                DISPATCH();
             }
-            case OPCODE_UNARY_MINUS: {
+            CASE(OPCODE_UNARY_MINUS) {
                 object_t *obj = POPP();
                 do_unary_minus(obj);
-                break;
+                DISPATCH();
             }
-            case OPCODE_NOT: {
+            CASE(OPCODE_NOT) {
                 object_t *obj = POPP();
                 do_not(obj);
-                break;
+                DISPATCH();
             }
-            case OPCODE_BITWISE_NOT: {
+            CASE(OPCODE_BITWISE_NOT) {
                 object_t *obj = POPP();
                 do_bitwise_not(obj);
-                break;
+                DISPATCH();
             }
-            case OPCODE_MUL: {
+            CASE(OPCODE_MUL) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
+                QUICKEN(obj1, obj2);
                 do_mul(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_DIV: {
+            CASE(OPCODE_DIV) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
                 do_div(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_MOD: {
+            CASE(OPCODE_MOD) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
                 do_mod(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_ADD: {
+            CASE(OPCODE_ADD) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
+                QUICKEN(obj1, obj2);
                 do_add(obj1, obj2);
-                break;
+                DISPATCH();
+            }
+            CASE(OPCODE_CONCAT_N) {
+                do_concat_n(instruction->operand.i32);
+                DISPATCH();
             }
-            case OPCODE_SUB: {
+            CASE(OPCODE_SUB) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
+                QUICKEN(obj1, obj2);
                 do_sub(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_SHL: {
+            CASE(OPCODE_SHL) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
                 do_shl(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_SHR: {
+            CASE(OPCODE_SHR) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
                 do_shr(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_CMP_LT: {
+            CASE(OPCODE_CMP_LT) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
+                QUICKEN(obj1, obj2);
                 do_cmp_lt(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_CMP_LTE: {
+            CASE(OPCODE_CMP_LTE) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
+                QUICKEN(obj1, obj2);
                 do_cmp_lte(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_CMP_GT: {
+            CASE(OPCODE_CMP_GT) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
+                QUICKEN(obj1, obj2);
                 do_cmp_gt(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_CMP_GTE: {
+            CASE(OPCODE_CMP_GTE) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
+                QUICKEN(obj1, obj2);
                 do_cmp_gte(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_CMP_EQ: {
+            CASE(OPCODE_CMP_EQ) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
+                QUICKEN(obj1, obj2);
                 do_cmp_eq(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_CMP_NE: {
+            CASE(OPCODE_CMP_NE) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
+                QUICKEN(obj1, obj2);
                 do_cmp_ne(obj1, obj2);
-                break;
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_LT_JUMP_IF_FALSE) {
+                CMP_JUMP_IF_FALSE(do_cmp_lt);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_LTE_JUMP_IF_FALSE) {
+                CMP_JUMP_IF_FALSE(do_cmp_lte);
+                DISPATCH();
             }
-            case OPCODE_AND: {
+            CASE(OPCODE_CMP_GT_JUMP_IF_FALSE) {
+                CMP_JUMP_IF_FALSE(do_cmp_gt);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_GTE_JUMP_IF_FALSE) {
+                CMP_JUMP_IF_FALSE(do_cmp_gte);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_EQ_JUMP_IF_FALSE) {
+                CMP_JUMP_IF_FALSE(do_cmp_eq);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_NE_JUMP_IF_FALSE) {
+                CMP_JUMP_IF_FALSE(do_cmp_ne);
+                DISPATCH();
+            }
+            CASE(OPCODE_ADD_INT_INT) {
+                object_t *obj2 = POPP();
+                object_t *obj1 = POPP();
+                GUARD_OR_DEQUICKEN(OBJECT_TYPE_SMALL_INT(obj1) && OBJECT_TYPE_SMALL_INT(obj2), OPCODE_ADD, do_add);
+                // Two immediate ints cannot overflow 64 bits
+                PUSH(object_new_long(OBJECT_SMALL_INT_VALUE(obj1) + OBJECT_SMALL_INT_VALUE(obj2)));
+                DISPATCH();
+            }
+            CASE(OPCODE_ADD_DBL_DBL) {
+                object_t *obj2 = POPP();
+                object_t *obj1 = POPP();
+                GUARD_OR_DEQUICKEN(OBJECT_TYPE_DOUBLE(obj1) && OBJECT_TYPE_DOUBLE(obj2), OPCODE_ADD, do_add);
+                push_number(obj1->value.f64 + obj2->value.f64);
+                DISPATCH();
+            }
+            CASE(OPCODE_SUB_INT_INT) {
+                object_t *obj2 = POPP();
+                object_t *obj1 = POPP();
+                GUARD_OR_DEQUICKEN(OBJECT_TYPE_SMALL_INT(obj1) && OBJECT_TYPE_SMALL_INT(obj2), OPCODE_SUB, do_sub);
+                PUSH(object_new_long(OBJECT_SMALL_INT_VALUE(obj1) - OBJECT_SMALL_INT_VALUE(obj2)));
+                DISPATCH();
+            }
+            CASE(OPCODE_SUB_DBL_DBL) {
+                object_t *obj2 = POPP();
+                object_t *obj1 = POPP();
+                GUARD_OR_DEQUICKEN(OBJECT_TYPE_DOUBLE(obj1) && OBJECT_TYPE_DOUBLE(obj2), OPCODE_SUB, do_sub);
+                push_number(obj1->value.f64 - obj2->value.f64);
+                DISPATCH();
+            }
+            CASE(OPCODE_MUL_INT_INT) {
+                object_t *obj2 = POPP();
+                object_t *obj1 = POPP();
+                GUARD_OR_DEQUICKEN(OBJECT_TYPE_SMALL_INT(obj1) && OBJECT_TYPE_SMALL_INT(obj2), OPCODE_MUL, do_mul);
+                int64_t a = OBJECT_SMALL_INT_VALUE(obj1);
+                int64_t b = OBJECT_SMALL_INT_VALUE(obj2);
+                int64_t result;
+                if (NUMBER_MUL_OVERFLOW(a, b, &result)) {
+                    PUSH(object_new_double((double)a * (double)b));
+                } else {
+                    PUSH(object_new_long(result));
+                }
+                DISPATCH();
+            }
+            CASE(OPCODE_MUL_DBL_DBL) {
+                object_t *obj2 = POPP();
+                object_t *obj1 = POPP();
+                GUARD_OR_DEQUICKEN(OBJECT_TYPE_DOUBLE(obj1) && OBJECT_TYPE_DOUBLE(obj2), OPCODE_MUL, do_mul);
+                push_number(obj1->value.f64 * obj2->value.f64);
+                DISPATCH();
+            }
+            CASE(OPCODE_CONCAT_STR_STR) {
+                object_t *obj2 = POPP();
+                object_t *obj1 = POPP();
+                GUARD_OR_DEQUICKEN(OBJECT_TYPE_STRING(obj1) && OBJECT_TYPE_STRING(obj2), OPCODE_ADD, do_add);
+                PUSH(object_new_string_concat(obj1, obj2));
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_LT_INT) {
+                CMP_INT(< , OPCODE_CMP_LT, do_cmp_lt);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_LTE_INT) {
+                CMP_INT(<=, OPCODE_CMP_LTE, do_cmp_lte);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_GT_INT) {
+                CMP_INT(> , OPCODE_CMP_GT, do_cmp_gt);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_GTE_INT) {
+                CMP_INT(>=, OPCODE_CMP_GTE, do_cmp_gte);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_EQ_INT) {
+                CMP_INT(==, OPCODE_CMP_EQ, do_cmp_eq);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_NE_INT) {
+                CMP_INT(!=, OPCODE_CMP_NE, do_cmp_ne);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_LT_INT_JUMP_IF_FALSE) {
+                CMP_INT_JUMP_IF_FALSE(< , OPCODE_CMP_LT_JUMP_IF_FALSE, do_cmp_lt);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_LTE_INT_JUMP_IF_FALSE) {
+                CMP_INT_JUMP_IF_FALSE(<=, OPCODE_CMP_LTE_JUMP_IF_FALSE, do_cmp_lte);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_GT_INT_JUMP_IF_FALSE) {
+                CMP_INT_JUMP_IF_FALSE(> , OPCODE_CMP_GT_JUMP_IF_FALSE, do_cmp_gt);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_GTE_INT_JUMP_IF_FALSE) {
+                CMP_INT_JUMP_IF_FALSE(>=, OPCODE_CMP_GTE_JUMP_IF_FALSE, do_cmp_gte);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_EQ_INT_JUMP_IF_FALSE) {
+                CMP_INT_JUMP_IF_FALSE(==, OPCODE_CMP_EQ_JUMP_IF_FALSE, do_cmp_eq);
+                DISPATCH();
+            }
+            CASE(OPCODE_CMP_NE_INT_JUMP_IF_FALSE) {
+                CMP_INT_JUMP_IF_FALSE(!=, OPCODE_CMP_NE_JUMP_IF_FALSE, do_cmp_ne);
+                DISPATCH();
+            }
+            CASE(OPCODE_AND) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
                 do_and(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_OR: {
+            CASE(OPCODE_OR) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
                 do_or(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_XOR: {
+            CASE(OPCODE_XOR) {
                 object_t *obj2 = POPP();
                 object_t *obj1 = POPP();
                 do_xor(obj1, obj2);
-                break;
+                DISPATCH();
             }
-            case OPCODE_POP_JUMP_IF_FALSE: {
-                int jump_offset = get_int(bytecode, ip);
+            CASE(OPCODE_POP_JUMP_IF_FALSE) {
+                int jump_offset = instruction->operand.i32;
                 object_t *obj = POPP();
                 if (!object_is_truthy(obj)) {
                     JUMP(jump_offset);
-                } else {
-                    FORWARD(4);
                 }
-                break;
+                DISPATCH();
             }
-            case OPCODE_POP_JUMP_IF_TRUE: {
-                int jump_offset = get_int(bytecode, ip);
+            CASE(OPCODE_POP_JUMP_IF_TRUE) {
+                int jump_offset = instruction->operand.i32;
                 object_t *obj = POPP();
                 if (object_is_truthy(obj)) {
                     JUMP(jump_offset);
-                } else {
-                    FORWARD(4);
                 }
-                break;
+                DISPATCH();
             }
-            case OPCODE_JUMP_IF_FALSE_OR_POP: {
-                int jump_offset = get_int(bytecode, ip);
+            CASE(OPCODE_JUMP_IF_FALSE_OR_POP) {
+                int jump_offset = instruction->operand.i32;
                 object_t *obj = PEEK();
                 if (!object_is_truthy(obj)) {
                     JUMP(jump_offset);
                 } else {
                     POPP();
-                    FORWARD(4);
                 }
-                break;
+                DISPATCH();
             }
-            case OPCODE_JUMP_IF_TRUE_OR_POP: {
-                int jump_offset = get_int(bytecode, ip);
+            CASE(OPCODE_JUMP_IF_TRUE_OR_POP) {
+                int jump_offset = instruction->operand.i32;
                 object_t *obj = PEEK();
                 if (object_is_truthy(obj)) {
                     JUMP(jump_offset);
                 } else {
                     POPP();
-                    FORWARD(4);
                 }
-                break;
+                DISPATCH();
             }
-            case OPCODE_JUMP_IF_NOT_ERROR: {
-                int jump_offset = get_int(bytecode, ip);
+            CASE(OPCODE_JUMP_IF_NOT_ERROR) {
+                int jump_offset = instruction->operand.i32;
                 object_t* obj = PEEK();
                 if (!object_is_error(obj)) {
                     JUMP(jump_offset);
-                } else {
-                    FORWARD(4);
                 }
-                break;
+                DISPATCH();
             }
-            case OPCODE_JUMP_FORWARD: {
-                JUMP(get_int(bytecode, ip));
-                break;
+            CASE(OPCODE_JUMP_FORWARD) {
+                JUMP(instruction->operand.i32);
+                DISPATCH();
             }
-            case OPCODE_JUMP_IF_CONTINUE: {
+            CASE(OPCODE_JUMP_IF_CONTINUE) {
                 if (con) {
-                    JUMP(get_int(bytecode, ip));
+                    JUMP(instruction->operand.i32);
                     // reset
                     con = false;
-                } else {
-                    FORWARD(4);
+                    GC_SAFEPOINT();
                 }
-                break;
+                DISPATCH();
             }
-            case OPCODE_JUMP_IF_BREAK: {
+            CASE(OPCODE_JUMP_IF_BREAK) {
                 if (brk) {
-                    JUMP(get_int(bytecode, ip));
+                    JUMP(instruction->operand.i32);
                     // reset
                     brk = false;
+                }
+                DISPATCH();
+            }
+            CASE(OPCODE_ABSOLUTE_JUMP) {
+                JUMP(instruction->operand.i32);
+                GC_SAFEPOINT();
+                DISPATCH();
+            }
+            CASE(OPCODE_LOAD_LOCAL_INT_BINARY) {
+                object_t* lhs = _env->locals[instruction->operand.i32];
+                if (lhs == NULL) lhs = instance->null;
+                PUSH_UNCHECKED(lhs);
+                PUSH(object_new_int(instruction->arg));
+                object_t* obj2 = POPP();
+                object_t* obj1 = POPP();
+                do_binary(instruction->op, obj1, obj2);
+                DISPATCH();
+            }
+            CASE(OPCODE_LOAD_NAME_INT_BINARY) {
+                do_load_name(_env, (object_t*)instruction->operand.ptr);
+                PUSH(object_new_int(instruction->arg));
+                object_t* obj2 = POPP();
+                object_t* obj1 = POPP();
+                do_binary(instruction->op, obj1, obj2);
+                DISPATCH();
+            }
+            CASE(OPCODE_INCREMENT_LOCAL) {
+                object_t* obj = _env->locals[instruction->operand.i32];
+                if (obj == NULL) obj = instance->null;
+                if (instruction->op == OPCODE_INCREMENT) {
+                    do_increment(false, obj);
                 } else {
-                    FORWARD(4);
+                    do_decrement(false, obj);
                 }
-                break;
+                _env->locals[instruction->operand.i32] = POPP();
+                DISPATCH();
             }
-            case OPCODE_ABSOLUTE_JUMP: {
-                JUMP(get_int(bytecode, ip));
-                break;
+            CASE(OPCODE_INCREMENT_NAME) {
+                do_load_name(_env, (object_t*)instruction->operand.ptr);
+                object_t* obj = POPP();
+                if (instruction->op == OPCODE_INCREMENT) {
+                    do_increment(false, obj);
+                } else {
+                    do_decrement(false, obj);
+                }
+                do_set_name(_env, (object_t*)instruction->operand.ptr);
+                POPP();
+                DISPATCH();
             }
-            case OPCODE_POPTOP: {
+            CASE(OPCODE_POPTOP) {
                 POPP();
-                break;
+                DISPATCH();
             }
-            case OPCODE_SETUP_CLASS:
-            case OPCODE_BEGIN_CLASS: {
-                if (opcode == OPCODE_SETUP_CLASS)
-                if (OPCODE != OPCODE_BEGIN_CLASS) PD("incorrect bytecode format");
-                FORWARD(1);
+            CASE(OPCODE_SETUP_CLASS)
+            CASE(OPCODE_BEGIN_CLASS) {
                 code_t* class_bytecode =
-                    (code_t*)get_memory(bytecode, ip);
+                    (code_t*)instruction->operand.ptr;
                 /************/
                 SAVE_FUNCTION(class_bytecode); // Slow!, optimize later
                 object_t* closure = vm_to_heap(object_new_function(class_bytecode));
-                vm_block_signal_t signal = VmBlockSignalPending;
-                do_block(_env, closure, &signal);
-                FORWARD(8);
-                break;
+                do_block(_env, closure, VmFrameClass);
+                ENTER_FRAME();
+                DISPATCH();
             }
-            case OPCODE_EXTEND_CLASS: {
+            CASE(OPCODE_EXTEND_CLASS) {
                 object_t* super = POPP();
                 if (!OBJECT_TYPE_USER_TYPE(super)) {
                     break;
@@ -2056,198 +3359,435 @@ INTERNAL vm_block_signal_t vm_execute(env_t* _env, size_t _ip, code_t* _code) {
                     (user_type_t*)class->value.opaque;
                 /************/
                 user->super = super;
-                break;
+                instance->class_version++;
+                DISPATCH();
             }
-            case OPCODE_SETUP_FUNCTION:
-            case OPCODE_BEGIN_FUNCTION: {
-                if (opcode == OPCODE_SETUP_FUNCTION)
-                if (OPCODE != OPCODE_BEGIN_FUNCTION) PD("incorrect bytecode format");
-                FORWARD(1);
+            CASE(OPCODE_SETUP_FUNCTION)
+            CASE(OPCODE_BEGIN_FUNCTION) {
                 code_t* function_bytecode =
-                    (code_t*)get_memory(bytecode, ip);
+                    (code_t*)instruction->operand.ptr;
                 /************/
                 SAVE_FUNCTION(function_bytecode); // Slow!, optimize later
                 PUSH(object_new_function(function_bytecode));
-                FORWARD(8);
-                break;
+                DISPATCH();
             }
-            case OPCODE_SETUP_BLOCK:
-            case OPCODE_BEGIN_BLOCK: {
-                if (opcode == OPCODE_SETUP_BLOCK)
-                if (OPCODE != OPCODE_BEGIN_BLOCK) PD("incorrect bytecode format");
-                FORWARD(1);
-                code_t* block_bytecode = (code_t*)get_memory(bytecode, ip);
+            CASE(OPCODE_SETUP_BLOCK)
+            CASE(OPCODE_BEGIN_BLOCK) {
+                code_t* block_bytecode = (code_t*)instruction->operand.ptr;
                 SAVE_FUNCTION(block_bytecode); // Slow!, optimize later
                 object_t* closure = vm_to_heap(object_new_function(block_bytecode));
-                vm_block_signal_t signal = VmBlockSignalPending;
-                do_block(_env, closure, &signal);
-                FORWARD(8);
-                if (signal == VmBlockSignalComplete) break;
-                if (signal == VmBlockSignalReturned) return VmBlockSignalReturned;
-                if (signal == VmBlockSignalCon) {
-                    con = true;
-                    if (loop_thead) break;
-                    else return VmBlockSignalCon;
-                }
-                if (signal == VmBlockSignalBrk) {
-                    brk = true;
-                    if (loop_thead) break;
-                    else return VmBlockSignalBrk;
-                }
-                PD("invalid signal state (%d)", signal);
+                do_block(_env, closure, VmFrameBlock);
+                ENTER_FRAME();
+                DISPATCH();
             }
-            case OPCODE_SETUP_CATCH_BLOCK: {
-                code_t* block_bytecode = (code_t*)get_memory(bytecode, ip);
+            CASE(OPCODE_SETUP_CATCH_BLOCK) {
+                code_t* block_bytecode = (code_t*)instruction->operand.ptr;
                 SAVE_FUNCTION(block_bytecode); // Slow!, optimize later
                 object_t* closure = vm_to_heap(object_new_function(block_bytecode));
-                vm_block_signal_t signal = VmBlockSignalPending;
-                do_block(_env, closure, &signal);
-                FORWARD(8);
-                break;
+                do_block(_env, closure, VmFrameCatch);
+                ENTER_FRAME();
+                DISPATCH();
             }
-            case OPCODE_RETURN: {
-                return VmBlockSignalReturned;
+            CASE(OPCODE_RETURN) {
+                signal = VmBlockSignalReturned;
+                goto FINISH;
             }
-            case OPCODE_RETURN_ASYNC: {
+            CASE(OPCODE_RETURN_ASYNC) {
                 object_t* value = object_new_promise(ASYNC_STATE_RESOLVED, POPP());
                 PUSH(value);
-                return VmBlockSignalReturned;
+                signal = VmBlockSignalReturned;
+                goto FINISH;
             }
-            case OPCODE_COMPLETE_BLOCK: {
-                return VmBlockSignalComplete;
+            CASE(OPCODE_COMPLETE_BLOCK) {
+                signal = VmBlockSignalComplete;
+                goto FINISH;
             }
-            case OPCODE_DUPTOP: {
-                PUSH_REF(PEEK());
-                break;
+            CASE(OPCODE_DUPTOP) {
+                PUSH_UNCHECKED(PEEK());
+                DISPATCH();
             }
-            case OPCODE_ROT2: {
+            CASE(OPCODE_ROT2) {
                 // A B -> B A
                 rotate2();
-                break;
+                DISPATCH();
             }
-            case OPCODE_ROT3: {
+            CASE(OPCODE_ROT3) {
                 // A B C -> C A B
                 rotate3();
-                break;
+                DISPATCH();
             }
-            case OPCODE_ROT4: {
+            CASE(OPCODE_ROT4) {
                 // A B C D -> D A B C
                 rotate4();
-                break;
+                DISPATCH();
             }
-            case OPCODE_SAVE_CAPTURES: {
+            CASE(OPCODE_SAVE_CAPTURES) {
                 object_t* obj = PEEK();
                 code_t* code =
                     (code_t*)obj->value.opaque;
                 /************/
-                int capture_count = get_int(bytecode, ip);
-                int length = 4;
-                for (int i = 0; i < capture_count; i++) {
-                    char* name = get_string(bytecode, ip+length);
-                    // Store only if it's not in the environment
-                    if (!env_has(_env, name, true)) {
-                        // Handled dynamically by the name resolver
-                        length += strlen(name) + 1;
-                        free(name);
+                code_capture_t* captures = (code_capture_t*)instruction->operand.ptr;
+                for (int i = 0; i < instruction->arg; i++) {
+                    object_t* name = captures[i].name;
+                    int slot = captures[i].slot;
+                    if (slot >= 0) {
+                        // Store only if the slot is already assigned
+                        if (_env->locals[slot] != NULL) {
+                            env_put_atom(code->environment, name, _env->locals[slot]);
+                        }
                         continue;
                     }
-                    env_put(code->environment, name, env_get(_env, name));
-                    length += strlen(name) + 1;
-                    free(name);
+                    // Store only if it's in the environment, the rest is
+                    // handled dynamically by the name resolver
+                    object_t* value = env_get_atom(_env, name);
+                    if (value != NULL) {
+                        env_put_atom(code->environment, name, value);
+                    }
                 }
-                FORWARD(length);
-                break;
+                DISPATCH();
             }
-            case OPCODE_GET_ITERATOR_OR_JUMP: {
-                int jump_offset = get_int(bytecode, ip);
+            CASE(OPCODE_GET_ITERATOR_OR_JUMP) {
+                int jump_offset = instruction->operand.i32;
                 object_t* obj = POPP();
                 if (!OBJECT_TYPE_COLLECTION(obj)) {
                     JUMP(jump_offset);
                     break;
                 }
                 PUSH(object_new_iterator(obj));
-                FORWARD(4);
-                break;
+                DISPATCH();
             }
-            case OPCODE_HAS_NEXT: {
-                int jump_offset = get_int(bytecode, ip);
+            CASE(OPCODE_HAS_NEXT) {
+                int jump_offset = instruction->operand.i32;
                 object_t* obj = PEEK();
                 if (!iterator_has_next(obj)) {
                     JUMP(jump_offset);
                     break;
                 }
-                FORWARD(4);
-                break;
+                DISPATCH();
             }
-            case OPCODE_GET_NEXT_VALUE:
-            case OPCODE_GET_NEXT_KEY_VALUE: {
+            CASE(OPCODE_GET_NEXT_VALUE)
+            CASE(OPCODE_GET_NEXT_KEY_VALUE) {
                 object_t* obj = PEEK();
                 object_t** values = iterator_next(obj);
                 if (opcode == OPCODE_GET_NEXT_KEY_VALUE) {
-                    if (values[1] != NULL) PUSH_REF(values[1]) // value
-                    else PUSH_REF(instance->null);
+                    if (values[1] != NULL) PUSH_UNCHECKED(values[1]) // value
+                    else PUSH_UNCHECKED(instance->null);
                 }
-                PUSH_REF(values[0]); // key
-                break;
+                PUSH_UNCHECKED(values[0]); // key
+                DISPATCH();
             }
-            case OPCODE_SET_PROPERTY: {
-                char* name = get_string(bytecode, ip);
+            CASE(OPCODE_SET_PROPERTY) {
+                object_t* name = (object_t*)instruction->operand.ptr;
                 object_t* obj = POPP();
-                set_property(obj, name, PEEK());
-                FORWARD(strlen(name) + 1);
-                free(name);
-                break;
+                if (instruction->cache != CODE_NO_CACHE) {
+                    set_property_cached(&_code->caches[instruction->cache], obj, name, PEEK());
+                } else {
+                    set_property(obj, name, PEEK());
+                }
+                DISPATCH();
             }
-            case OPCODE_AWAIT: {
+            CASE(OPCODE_GET_FIELD) {
+                object_t* obj = POPP();
+                object_t** cell = field_cell(instruction, obj);
+                if (cell != NULL) {
+                    PUSH_UNCHECKED(*cell);
+                    DISPATCH();
+                }
+                // Not an own field (yet), resolve it like any property
+                object_t* name = (object_t*)instruction->operand.ptr;
+                object_t* property = (instruction->cache != CODE_NO_CACHE)
+                    ? get_property_cached(&_code->caches[instruction->cache], obj, name)
+                    : get_property(obj, name);
+                if (property == NULL) {
+                    char* message = string_format(
+                        "property \"%s\" not found in \"%s\"",
+                        OBJECT_STRING(name)->data,
+                        object_to_string(obj)
+                    );
+                    PUSH(object_new_error(message, true));
+                    free(message);
+                    break;
+                }
+                PUSH_UNCHECKED(property);
+                DISPATCH();
+            }
+            CASE(OPCODE_SET_FIELD) {
+                object_t* obj = POPP();
+                object_t** cell = field_cell(instruction, obj);
+                if (cell != NULL) {
+                    *cell = PEEK();
+                    DISPATCH();
+                }
+                object_t* name = (object_t*)instruction->operand.ptr;
+                if (instruction->cache != CODE_NO_CACHE) {
+                    set_property_cached(&_code->caches[instruction->cache], obj, name, PEEK());
+                } else {
+                    set_property(obj, name, PEEK());
+                }
+                DISPATCH();
+            }
+            CASE(OPCODE_LAYOUT_CLASS) {
+                object_t* class = PEEK();
+                if (!OBJECT_TYPE_USER_TYPE(class)) {
+                    DISPATCH();
+                }
+                user_type_t* user = (user_type_t*)class->value.opaque;
+                shape_t* fields = (shape_t*)instruction->operand.ptr;
+                // Inherited fields keep their slots, new ones go after them
+                shape_t* layout = user_type_layout(user->super);
+                if (layout == NULL) {
+                    layout = fields;
+                } else {
+                    for (size_t i = 0; i < fields->count && layout->count < SHAPE_MAX_PROPERTIES; i++) {
+                        if (shape_lookup(layout, fields->keys[i]) < 0) {
+                            layout = shape_transition(layout, fields->keys[i]);
+                        }
+                    }
+                }
+                user->layout = layout;
+                DISPATCH();
+            }
+            CASE(OPCODE_AWAIT) {
                 object_t* awaited = PEEK();
 
                 if (!OBJECT_TYPE_PROMISE(awaited)) {
                     continue;
                 }
+                POPP();
 
-                async_promise_t* promise = (async_promise_t*) awaited->value.opaque;
-
-                size_t awaited_index;
-
-                if (OBJECT_TYPE_PROMISE(awaited) && promise->state == ASYNC_STATE_RESOLVED) {
-                    POPP(); // Pop promise and push value
-                    PUSH_REF(promise->value);
-                    awaited_index = instance->sp;
-                } else {
-                    awaited_index = instance->sp - 1; // minus 1 to point to the actual return;
+                vm_frame_t* frame = &instance->frames[instance->frame_count - 1];
+                frame->ip = ip;
+                frame->brk = brk;
+                frame->con = con;
+                frame->loop_thread = loop_thead;
+
+                // The await suspends the enclosing function with its blocks
+                size_t first = instance->frame_count - 1;
+                while (instance->frames[first].type != VmFrameFunction) first--;
+
+                // The function returns its promise to the caller, a resumed
+                // function keeps the one it already returned
+                object_t* promise = instance->frames[first].promise;
+                if (promise == NULL) {
+                    promise = vm_to_heap(object_new_promise(ASYNC_STATE_PENDING, NULL));
                 }
 
-                object_t* obj = object_new_promise(ASYNC_STATE_PENDING, NULL);
-                PUSH(obj);
-
-                async_t* async = async_new(ip, awaited_index, _env, _code, obj);
-                vm_enqueue(async);
+                size_t stack_base = instance->frames[first].sp;
+                vm_enqueue(async_new(
+                    awaited,
+                    promise,
+                    &instance->frames[first],
+                    instance->frame_count - first,
+                    &instance->evaluation_stack[stack_base],
+                    instance->sp - stack_base
+                ));
 
-                return VmBlockSignalPending;
+                instance->sp = stack_base;
+                PUSH_REF(promise);
+                signal = VmBlockSignalPending;
+                goto FINISH;
             }
-            case OPCODE_CONTINUE: {
-                return VmBlockSignalCon;
+            CASE(OPCODE_CONTINUE) {
+                signal = VmBlockSignalCon;
+                goto FINISH;
             }
-            case OPCODE_BREAK: {
-                return VmBlockSignalBrk;
+            CASE(OPCODE_BREAK) {
+                signal = VmBlockSignalBrk;
+                goto FINISH;
             }
-            case OPCODE_BEGIN_LOOP_THREAD: {
+            CASE(OPCODE_BEGIN_LOOP_THREAD) {
                 loop_thead = true;
-                break;
+                DISPATCH();
             }
-            case OPCODE_END_LOOP_THREAD: {
+            CASE(OPCODE_END_LOOP_THREAD) {
                 loop_thead = false;
-                break;
+                DISPATCH();
             }
-            default: {
-                decompile(_code, false);
-                PD("unknown opcode 0x%02X at %02zu", opcode, ip-1);
+            CASE_DEFAULT() {
+                UNKNOWN_OPCODE();
             }
         }
     }
+    signal = VmBlockSignalReturned;
+
+    FINISH:
+    if (vm_leave_frame(&signal, base)) {
+        LOAD_FRAME();
+        goto RESUME;
+    }
+    return signal;
+
+#if VM_USE_REGISTER_TIER
+    REGISTER_TIER:
+    // Back here when the register code called or returned to a stack frame
+    if (vm_execute_register(base)) {
+        LOAD_FRAME();
+        goto RESUME;
+    }
     return VmBlockSignalReturned;
+#endif
 }
 
+#if VM_USE_REGISTER_TIER
+
+#define REGISTER_BINARY(do_op) { \
+    do_op(registers[instruction->b], registers[instruction->c]); \
+    registers[instruction->a] = POPP(); \
+}
+
+#define REGISTER_CMP_JUMP_IF_FALSE(operator, do_cmp) { \
+    object_t* lhs = registers[instruction->a]; \
+    object_t* rhs = registers[instruction->b]; \
+    bool result; \
+    if (OBJECT_TYPE_INT(lhs) && OBJECT_TYPE_INT(rhs)) { \
+        result = OBJECT_INT_VALUE(lhs) operator OBJECT_INT_VALUE(rhs); \
+    } else { \
+        do_cmp(lhs, rhs); \
+        result = object_is_truthy(POPP()); \
+    } \
+    if (!result) { \
+        pc = instruction->c; \
+    } \
+}
+
+/**
+ * Executes the register code of the frame on top of the frame stack.
+ * The frame slots are the register file, so the collector sees every
+ * live value without any extra bookkeeping. Calls between register
+ * functions push and pop frames here, calls into stack code go back to
+ * the dispatch loop of vm_execute, so neither nests on the C stack.
+ *
+ * @param _base The index of the frame the current vm_execute started with.
+ * @return bool True if a stack frame is on top and has to run, false if
+ *         the base frame returned (its owner does the cleanup).
+ */
+INTERNAL bool vm_execute_register(size_t _base) {
+    env_t* _env;
+    code_t* _code;
+    register_instruction_t* instructions;
+    object_t** registers;
+    size_t pc;
+
+    LOAD:;
+    vm_frame_t* frame = &instance->frames[instance->frame_count - 1];
+    _env = frame->env;
+    _code = frame->code;
+    instructions = _code->register_code->instructions;
+    registers = _env->locals;
+    pc = frame->ip;
+
+    if (pc == 0) {
+        // Parameters are passed in registers 1..n, the first argument is on top
+        for (size_t i = 0; i < _code->param_count; i++) {
+            registers[CODE_THIS_SLOT + 1 + i] = POPP();
+        }
+        GC_SAFEPOINT();
+    } else {
+        // Back from a call, its result is on top
+        registers[instructions[pc - 1].a] = POPP();
+    }
+
+    while (pc < _code->register_code->count) {
+        register_instruction_t* instruction = &instructions[pc++];
+        switch (instruction->opcode) {
+            case ROP_LOAD_INT:
+                registers[instruction->a] = vm_to_heap(object_new_int(instruction->b));
+                break;
+            case ROP_LOAD_BOOL:
+                registers[instruction->a] = instruction->b ? instance->tobj : instance->fobj;
+                break;
+            case ROP_LOAD_NULL:
+                registers[instruction->a] = instance->null;
+                break;
+            case ROP_LOAD_NAME:
+                do_load_name(_env, code_atom(_code, instruction->b));
+                registers[instruction->a] = POPP();
+                break;
+            case ROP_SET_NAME:
+                PUSH_REF(registers[instruction->a]);
+                if (!do_set_name(_env, code_atom(_code, instruction->b))) {
+                    // The error replaces the value
+                    registers[instruction->a] = POPP();
+                }
+                POPP();
+                break;
+            case ROP_MOVE:
+                registers[instruction->a] = registers[instruction->b];
+                break;
+            case ROP_MUL: REGISTER_BINARY(do_mul); break;
+            case ROP_DIV: REGISTER_BINARY(do_div); break;
+            case ROP_MOD: REGISTER_BINARY(do_mod); break;
+            case ROP_ADD: REGISTER_BINARY(do_add); break;
+            case ROP_SUB: REGISTER_BINARY(do_sub); break;
+            case ROP_CMP_LT:  REGISTER_BINARY(do_cmp_lt);  break;
+            case ROP_CMP_LTE: REGISTER_BINARY(do_cmp_lte); break;
+            case ROP_CMP_GT:  REGISTER_BINARY(do_cmp_gt);  break;
+            case ROP_CMP_GTE: REGISTER_BINARY(do_cmp_gte); break;
+            case ROP_CMP_EQ:  REGISTER_BINARY(do_cmp_eq);  break;
+            case ROP_CMP_NE:  REGISTER_BINARY(do_cmp_ne);  break;
+            case ROP_JUMP:
+                // Backward jumps are loop back edges
+                if ((size_t) instruction->a < pc) {
+                    GC_SAFEPOINT();
+                }
+                pc = instruction->a;
+                break;
+            case ROP_JUMP_IF_FALSE:
+                if (!object_is_truthy(registers[instruction->a])) {
+                    pc = instruction->b;
+                }
+                break;
+            case ROP_JUMP_IF_TRUE:
+                if (object_is_truthy(registers[instruction->a])) {
+                    pc = instruction->b;
+                }
+                break;
+            case ROP_LT_JUMP_IF_FALSE:  REGISTER_CMP_JUMP_IF_FALSE(< , do_cmp_lt);  break;
+            case ROP_LTE_JUMP_IF_FALSE: REGISTER_CMP_JUMP_IF_FALSE(<=, do_cmp_lte); break;
+            case ROP_GT_JUMP_IF_FALSE:  REGISTER_CMP_JUMP_IF_FALSE(> , do_cmp_gt);  break;
+            case ROP_GTE_JUMP_IF_FALSE: REGISTER_CMP_JUMP_IF_FALSE(>=, do_cmp_gte); break;
+            case ROP_EQ_JUMP_IF_FALSE:  REGISTER_CMP_JUMP_IF_FALSE(==, do_cmp_eq);  break;
+            case ROP_NE_JUMP_IF_FALSE:  REGISTER_CMP_JUMP_IF_FALSE(!=, do_cmp_ne);  break;
+            case ROP_CALL: {
+                // Push the arguments so that the first one ends on top
+                for (int i = instruction->c; i > 0; i--) {
+                    PUSH_REF(registers[instruction->b + i]);
+                }
+                if (!do_call_object(registers[instruction->b], instruction->c, true)) {
+                    // Native calls and errors leave their result right away
+                    registers[instruction->a] = POPP();
+                    break;
+                }
+                // The callee got its own frame, this one resumes after the call
+                frame = &instance->frames[instance->frame_count - 2];
+                frame->ip = pc;
+                if (instance->frames[instance->frame_count - 1].code->register_code != NULL) {
+                    goto LOAD;
+                }
+                return true;
+            }
+            case ROP_RETURN:
+                PUSH_REF(registers[instruction->a]);
+                goto RETURN;
+            default:
+                PD("unknown register opcode %d at instruction %02zu", instruction->opcode, pc - 1);
+        }
+    }
+    PUSH_REF(instance->null);
+
+    RETURN:;
+    vm_block_signal_t signal = VmBlockSignalReturned;
+    if (!vm_leave_frame(&signal, _base)) {
+        return false;
+    }
+    if (instance->frames[instance->frame_count - 1].code->register_code != NULL) {
+        goto LOAD;
+    }
+    return true;
+}
+
+#endif
+
 // -----------------------------
 
 DLLEXPORT void vm_init() {
@@ -2258,30 +3798,42 @@ DLLEXPORT void vm_init() {
     ASSERTNULL(instance, "failed to allocate memory for vm");
     // evaluation stack
     instance->evaluation_stack =
-        (object_t **)malloc(sizeof(object_t*) * EVALUATION_STACK_SIZE);
+        (object_t **)malloc(sizeof(object_t*) * EVALUATION_STACK_SEGMENT);
     ASSERTNULL(instance->evaluation_stack, "failed to allocate memory for evaluation stack");
+    instance->stack_capacity = EVALUATION_STACK_SEGMENT;
     instance->queque = (async_t**)malloc(sizeof(async_t*) * ASYNC_QUEUE_SIZE);
     ASSERTNULL(instance->queque, "failed to allocate memory for async queue");
     instance->sp = 0;
     instance->aq = 0;
+    // frame stack
+    instance->frames = (vm_frame_t*)malloc(sizeof(vm_frame_t) * FRAME_STACK_SIZE);
+    ASSERTNULL(instance->frames, "failed to allocate memory for frame stack");
+    instance->frame_count = 0;
+    instance->frame_capacity = FRAME_STACK_SIZE;
     // function table
     instance->function_table_size = 0;
     instance->function_table_item = (code_t**)malloc(sizeof(code_t*));
     instance->function_table_item[0] = NULL;
     // counter
     instance->allocation_counter = 0;
+    // inline caches
+    instance->class_version = 0;
     // name resolver
     instance->name_resolver = vm_name_resolver;
+    // intern table
+    intern_table_init(&instance->intern);
+    instance->init_name = intern_string("init");
     // root object
     instance->root = object_new_object();
     instance->tail = instance->root;
     // singleton null
-    instance->null = object_new(OBJECT_TYPE_NULL);
+    instance->null = object_new_null();
     // singleton boolean
     instance->tobj = object_new_bool(true);
     instance->fobj = object_new_bool(false);
     // env globals
     instance->env = env_new(NULL);
+    instance->program_env = NULL;
     // define panic function
     object_t* panic = object_new_native_function(1, do_panic);
     vm_define_global("panic", panic);
@@ -2302,6 +3854,10 @@ DLLEXPORT void vm_name_resolver(env_t* _env, char* _name) {
 }
 
 DLLEXPORT object_t* vm_to_heap(object_t* _obj) {
+    // Immediate values and immortal objects are not heap allocated
+    if (OBJECT_IS_TAGGED(_obj) || _obj->immortal) {
+        return _obj;
+    }
     if (_obj->next != NULL) {
         PD("Object is already in the root (%s)", object_to_string(_obj));
     }
@@ -2315,8 +3871,12 @@ DLLEXPORT object_t* vm_to_heap(object_t* _obj) {
 
 DLLEXPORT void vm_push(object_t* _obj) {
     ASSERTNULL(instance->evaluation_stack, "Evaluation stack is not initialized");
-    if (instance->sp >= EVALUATION_STACK_SIZE) {
-        PD("Stackoverflow: TOP(%s)", object_to_string(PEEK()));
+    if (instance->sp >= instance->stack_capacity) {
+        vm_reserve_stack(1);
+    }
+    if (OBJECT_IS_TAGGED(_obj) || _obj->immortal) {
+        instance->evaluation_stack[instance->sp++] = _obj;
+        return;
     }
     if (_obj->next != NULL) {
         PD("Object is already in the root (%s)", object_to_string(_obj));
@@ -2353,18 +3913,39 @@ DLLEXPORT void vm_run_main(code_t* _bytecode) {
     // Create a new environment for the main function
     env_t* env = env_new(instance->env);
     env->closure = _bytecode->environment;
-    vm_execute(env, 0, _bytecode);
+    env_reserve_locals(env, _bytecode->local_count);
+    instance->program_env = env;
+    vm_execute(env, 0, _bytecode, NULL);
     env->closure = NULL;
 
-    // Process async queue
+    // Process async queue, a function resumes once the promise it awaits
+    // is settled and resolves its own promise when it returns
+    size_t stalled = 0;
     while (instance->aq > 0) {
         async_t* async = vm_dequeue();
-        instance->sp = async->top;
-        vm_block_signal_t signal = vm_execute(async->env, async->ip, async->code);
-        do_resolve(signal);
-        if (signal == VmBlockSignalReturned) {
-            async_free(async);
+        async_promise_t* awaited = (async_promise_t*) async->awaited->value.opaque;
+        if (awaited->state == ASYNC_STATE_PENDING) {
+            if (++stalled > instance->aq) {
+                PD("async functions wait for each other");
+            }
+            vm_enqueue(async);
+            continue;
+        }
+        stalled = 0;
+
+        size_t stack_base = instance->sp;
+        vm_block_signal_t signal = vm_execute(NULL, 0, async->frames[0].code, async);
+        object_t* value = POPP();
+        if (signal != VmBlockSignalPending) {
+            if (OBJECT_TYPE_PROMISE(value)) {
+                value = ((async_promise_t*) value->value.opaque)->value;
+            }
+            async_resolve(async->promise, value);
+            async->frames[0].env->closure = NULL;
+            env_free(async->frames[0].env);
         }
+        instance->sp = stack_base;
+        async_free(async);
     }
 
     // Evaluation stack must contain exactly 1 object
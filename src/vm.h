@@ -4,6 +4,7 @@
 #include "code.h"
 #include "decompiler.h"
 #include "hashmap.h"
+#include "intern.h"
 #include "iterator.h"
 #include "object.h"
 #include "range.h"
@@ -20,19 +21,55 @@ typedef enum vm_block_signal_t {
     VmBlockSignalBrk,
 } vm_block_signal_t;
 
+typedef enum vm_frame_type_enum {
+    VmFrameFunction,
+    VmFrameBlock,
+    VmFrameClass,
+    VmFrameCatch,
+} vm_frame_type_t;
+
+// Activation record of a function or block running in the dispatch loop
+typedef struct vm_frame_struct {
+    vm_frame_type_t type;
+    code_t* code;
+    env_t*  env;
+    // Stack height on entry, below the arguments of a function
+    size_t  sp;
+    // Resume point, saved while a callee runs
+    size_t  ip;
+    bool    brk;
+    bool    con;
+    bool    loop_thread;
+    // Promise of a suspended async function, reused by its next await
+    object_t* promise;
+} vm_frame_t;
+
 typedef struct vm_struct {
     // evaluation stack
     object_t** evaluation_stack;
     async_t** queque;
     size_t sp;
     size_t aq;
+    size_t stack_capacity;
+    // frame stack
+    vm_frame_t* frames;
+    size_t frame_count;
+    size_t frame_capacity;
     // function table
     size_t function_table_size;
     code_t** function_table_item;
     // function table counter
     size_t allocation_counter;
+    // Bumped whenever a class is made, gets a super class or a new
+    // prototype key. Method tables and inline cache entries resolved
+    // under an older version are stale
+    size_t class_version;
     // name resolver
     vm_name_resolver_t name_resolver;
+    // One atom per distinct string (see intern.h)
+    intern_table_t intern;
+    // Atom of the constructor name
+    object_t* init_name;
     // root object
     object_t *root;
     object_t *tail;
@@ -43,6 +80,8 @@ typedef struct vm_struct {
     object_t *fobj;
     // env globals
     env_t* env;
+    // env of the running program, the parent of every function call
+    env_t* program_env;
     // Accumolator
     int acc;
 } vm_t;